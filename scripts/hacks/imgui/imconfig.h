@@ -0,0 +1,18 @@
+//-----------------------------------------------------------------------------
+// COMPILE-TIME OPTIONS FOR DEAR IMGUI
+// Replaces the default imconfig.h of the library (which only has commented out options)
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+//---- Per thread current context - NOT stock Dear ImGui behavior, opt-in with IMGUI_THREAD_LOCAL_CONTEXT
+// GImGui becomes thread_local so independent contexts can be built on separate threads at the same time
+// (editor viewports, tests). Each thread has to call ImGui::SetCurrentContext() for the context it works with,
+// a context made current on one thread is NOT current on any other thread.
+// The define changes the ABI: the library (IMGUI_THREAD_LOCAL_CONTEXT=ON in CMake) and every file that includes
+// imgui.h have to agree on it. The variable is defined in imgui_tls.cpp
+#ifdef IMGUI_THREAD_LOCAL_CONTEXT
+struct ImGuiContext;
+extern thread_local ImGuiContext* GImGuiThreadContext;
+#define GImGui GImGuiThreadContext
+#endif
@@ -0,0 +1,7 @@
+// Storage for the per thread current context, see imconfig.h
+
+#include "imgui.h"
+
+#ifdef IMGUI_THREAD_LOCAL_CONTEXT
+thread_local ImGuiContext* GImGuiThreadContext = NULL;
+#endif
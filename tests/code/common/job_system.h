@@ -0,0 +1,342 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+// Shared by the test applications, each of them is built from its own source root so this is header only
+// Include with a relative path: #include "../../common/job_system.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+//--
+
+// Number of submitted jobs that did not finish yet
+struct JobCounter
+{
+	std::atomic<uint32_t> count = 0;
+
+	inline bool done() const { return count.load() == 0; }
+};
+
+// Stand-in for the engine job system - work stealing over per worker queues
+// - jobs submitted from a worker go to its own queue, the worker takes them back LIFO (the data is still in the cache)
+// - jobs submitted from other threads are spread over the worker queues
+// - idle workers steal the oldest jobs from the other queues before going to sleep
+// - jobs run only on the workers: a worker waiting for a counter keeps running jobs, any other thread sleeps,
+//   so currentWorker() can be used to index per worker data (scratch memory, library contexts) without locking
+class JobSystem
+{
+public:
+	JobSystem(uint32_t numThreads = 0); // 0 - hardware concurrency
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	inline uint32_t numThreads() const { return (uint32_t)m_threads.size(); }
+	inline uint64_t numExecuted() const { return m_numExecuted; }
+	inline uint64_t numStolen() const { return m_numStolen; }
+
+	// Queue a job, the counter (optional) is incremented now and decremented once the job finished
+	void submit(std::function<void()> job, JobCounter* counter = nullptr);
+
+	// Wait until the counter drops to zero, workers run jobs in the meantime
+	void wait(JobCounter& counter);
+
+	// Run func for every index in [0, count), blocks until all are done
+	// Indices are handed out one by one so uneven items balance out, batchSize groups cheap ones
+	void parallelFor(uint32_t count, const std::function<void(uint32_t index)>& func, uint32_t batchSize = 1);
+
+	// Run func exactly once on every worker, blocks until all are done
+	void runOnAllWorkers(const std::function<void(uint32_t workerIndex)>& func);
+
+	// Index of the worker running the calling code, -1 if it's not one of our workers
+	int32_t currentWorker() const;
+
+private:
+	struct Job
+	{
+		std::function<void()> function;
+		JobCounter* counter = nullptr;
+	};
+
+	struct WorkerQueue
+	{
+		std::mutex lock;
+		std::deque<Job> jobs;
+		std::deque<Job> pinned; // only for this worker, never stolen
+		std::atomic<uint32_t> numPinned = 0;
+	};
+
+	std::vector<std::thread> m_threads;
+	std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+
+	std::atomic<uint32_t> m_numQueued = 0; // not counting the pinned jobs
+	std::atomic<uint32_t> m_numSleeping = 0;
+	std::atomic<uint32_t> m_nextQueue = 0;
+	std::atomic<uint64_t> m_numExecuted = 0;
+	std::atomic<uint64_t> m_numStolen = 0;
+
+	std::mutex m_sleepLock;
+	std::condition_variable m_workAvailable;
+	std::condition_variable m_counterDone;
+	bool m_exiting = false;
+
+	static inline thread_local const JobSystem* GCurrentJobSystem = nullptr;
+	static inline thread_local int32_t GCurrentWorker = -1;
+
+	void wakeWorkers(bool all);
+	bool findJob(uint32_t workerIndex, Job& outJob);
+	void execute(Job& job);
+	void threadLoop(uint32_t workerIndex);
+};
+
+//--
+
+inline JobSystem::JobSystem(uint32_t numThreads)
+{
+	if (numThreads == 0)
+		numThreads = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+
+	for (uint32_t i = 0; i < numThreads; ++i)
+		m_queues.push_back(std::make_unique<WorkerQueue>());
+
+	for (uint32_t i = 0; i < numThreads; ++i)
+		m_threads.emplace_back([this, i]() { threadLoop(i); });
+}
+
+inline JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepLock);
+		m_exiting = true;
+	}
+
+	m_workAvailable.notify_all();
+
+	for (auto& thread : m_threads)
+		thread.join();
+}
+
+inline int32_t JobSystem::currentWorker() const
+{
+	return (GCurrentJobSystem == this) ? GCurrentWorker : -1;
+}
+
+inline void JobSystem::wakeWorkers(bool all)
+{
+	// a worker going to sleep registers first and checks the queues after that, so one of us sees the other
+	if (m_numSleeping.load() > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepLock);
+		}
+
+		if (all)
+			m_workAvailable.notify_all();
+		else
+			m_workAvailable.notify_one();
+	}
+}
+
+inline void JobSystem::submit(std::function<void()> job, JobCounter* counter)
+{
+	if (counter)
+		counter->count += 1;
+
+	const auto worker = currentWorker();
+	const auto queueIndex = (worker >= 0) ? (uint32_t)worker : (m_nextQueue++ % numThreads());
+
+	// counted before it's visible so the count never drops below the real number of queued jobs
+	m_numQueued += 1;
+
+	{
+		auto& queue = *m_queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.lock);
+		queue.jobs.push_back(Job{ std::move(job), counter });
+	}
+
+	wakeWorkers(false);
+}
+
+inline void JobSystem::runOnAllWorkers(const std::function<void(uint32_t workerIndex)>& func)
+{
+	JobCounter counter;
+
+	for (uint32_t i = 0; i < numThreads(); ++i)
+	{
+		counter.count += 1;
+
+		auto& queue = *m_queues[i];
+		queue.numPinned += 1;
+
+		std::lock_guard<std::mutex> lock(queue.lock);
+		queue.pinned.push_back(Job{ [&func, i]() { func(i); }, &counter });
+	}
+
+	wakeWorkers(true);
+
+	// NOTE: called from a worker the other workers must not be waiting for this one
+	wait(counter);
+}
+
+inline void JobSystem::parallelFor(uint32_t count, const std::function<void(uint32_t index)>& func, uint32_t batchSize)
+{
+	if (!count)
+		return;
+
+	batchSize = std::max<uint32_t>(1, batchSize);
+
+	std::atomic<uint32_t> nextIndex = 0;
+
+	const auto numBatches = (count + batchSize - 1) / batchSize;
+	const auto numJobs = std::min(numBatches, numThreads());
+
+	JobCounter counter;
+	for (uint32_t i = 0; i < numJobs; ++i)
+	{
+		submit([&nextIndex, &func, count, batchSize]()
+			{
+				for (;;)
+				{
+					const auto first = nextIndex.fetch_add(batchSize);
+					if (first >= count)
+						break;
+
+					const auto last = std::min(first + batchSize, count);
+					for (auto index = first; index < last; ++index)
+						func(index);
+				}
+			}, &counter);
+	}
+
+	wait(counter);
+}
+
+inline bool JobSystem::findJob(uint32_t workerIndex, Job& outJob)
+{
+	// own queue first: pinned jobs, then the newest job
+	{
+		auto& queue = *m_queues[workerIndex];
+		if (queue.numPinned.load() > 0 || m_numQueued.load() > 0)
+		{
+			std::lock_guard<std::mutex> lock(queue.lock);
+			if (!queue.pinned.empty())
+			{
+				outJob = std::move(queue.pinned.front());
+				queue.pinned.pop_front();
+				queue.numPinned -= 1;
+				return true;
+			}
+
+			if (!queue.jobs.empty())
+			{
+				outJob = std::move(queue.jobs.back());
+				queue.jobs.pop_back();
+				m_numQueued -= 1;
+				return true;
+			}
+		}
+	}
+
+	if (m_numQueued.load() == 0)
+		return false;
+
+	// steal the oldest job from someone else
+	const auto numQueues = numThreads();
+	for (uint32_t i = 1; i < numQueues; ++i)
+	{
+		auto& queue = *m_queues[(workerIndex + i) % numQueues];
+		std::lock_guard<std::mutex> lock(queue.lock);
+		if (!queue.jobs.empty())
+		{
+			outJob = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			m_numQueued -= 1;
+			m_numStolen += 1;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+inline void JobSystem::execute(Job& job)
+{
+	job.function();
+	job.function = nullptr;
+
+	m_numExecuted += 1;
+
+	if (job.counter && job.counter->count.fetch_sub(1) == 1)
+	{
+		// threads outside of the job system sleep while waiting
+		{
+			std::lock_guard<std::mutex> lock(m_sleepLock);
+		}
+
+		m_counterDone.notify_all();
+	}
+}
+
+inline void JobSystem::wait(JobCounter& counter)
+{
+	const auto worker = currentWorker();
+
+	if (worker < 0)
+	{
+		std::unique_lock<std::mutex> lock(m_sleepLock);
+		m_counterDone.wait(lock, [&counter]() { return counter.done(); });
+		return;
+	}
+
+	while (!counter.done())
+	{
+		Job job;
+		if (findJob((uint32_t)worker, job))
+			execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+inline void JobSystem::threadLoop(uint32_t workerIndex)
+{
+	GCurrentJobSystem = this;
+	GCurrentWorker = (int32_t)workerIndex;
+
+	auto& queue = *m_queues[workerIndex];
+
+	for (;;)
+	{
+		Job job;
+		if (findJob(workerIndex, job))
+		{
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepLock);
+		m_numSleeping += 1;
+		m_workAvailable.wait(lock, [this, &queue]() { return m_exiting || m_numQueued.load() > 0 || queue.numPinned.load() > 0; });
+		m_numSleeping -= 1;
+
+		// everything submitted before the exit still runs
+		if (m_exiting && m_numQueued.load() == 0 && queue.numPinned.load() == 0)
+			break;
+	}
+}
+
+//--
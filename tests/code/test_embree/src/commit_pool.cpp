@@ -0,0 +1,29 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "commit_pool.h"
+
+//--
+
+std::string JoinCommitDeviceConfig(const JobSystem& jobs)
+{
+	return "threads=" + std::to_string(jobs.numThreads()) + ",user_threads=" + std::to_string(jobs.numThreads());
+}
+
+void JoinCommitOnWorkers(RTCScene scene, JobSystem& jobs)
+{
+	// the first worker to join starts the build, the others take tasks from it until it's done
+	jobs.runOnAllWorkers([scene](uint32_t) { rtcJoinCommitScene(scene); });
+}
+
+bool UsesTBBTasking(RTCDevice device)
+{
+	// 0 - internal, 1 - TBB, 2 - PPL
+	return rtcGetDeviceProperty(device, RTC_DEVICE_PROPERTY_TASKING_SYSTEM) == 1;
+}
+
+//--
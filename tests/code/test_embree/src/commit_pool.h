@@ -0,0 +1,32 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#pragma once
+
+#define EMBREE_STATIC_LIB
+#include <embree3/rtcore.h>
+
+#include "../../common/job_system.h"
+
+#include <stdint.h>
+#include <string>
+
+//--
+
+// BVH builds on the engine workers through rtcJoinCommitScene instead of letting Embree build on its own threads
+
+// Device config for devices whose commits are built only by the workers of the job system
+// NOTE: user_threads only has effect with the TBB tasking system, the internal one starts its own workers anyway
+extern std::string JoinCommitDeviceConfig(const JobSystem& jobs);
+
+// Build the scene on every worker of the job system, returns when the BVH is done
+// NOTE: not from inside a job, the other workers may be waiting for the calling one
+extern void JoinCommitOnWorkers(RTCScene scene, JobSystem& jobs);
+
+// Is the device using the TBB tasking system - the only one where user_threads keeps Embree from starting threads
+extern bool UsesTBBTasking(RTCDevice device);
+
+//--
@@ -0,0 +1,312 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "commit_pool.h"
+#include "ray_benchmark.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <TlHelp32.h>
+#else
+#include <sys/resource.h>
+#include <dirent.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+
+//--
+
+// Number of threads in this process, 0 if not known
+static uint32_t CountProcessThreads()
+{
+#ifdef _WIN32
+	auto snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+	if (snapshot == INVALID_HANDLE_VALUE)
+		return 0;
+
+	uint32_t count = 0;
+	THREADENTRY32 entry;
+	entry.dwSize = sizeof(entry);
+	if (Thread32First(snapshot, &entry))
+	{
+		do
+		{
+			if (entry.th32OwnerProcessID == GetCurrentProcessId())
+				count += 1;
+		} while (Thread32Next(snapshot, &entry));
+	}
+
+	CloseHandle(snapshot);
+	return count;
+#elif defined(__linux__)
+	auto* dir = opendir("/proc/self/task");
+	if (!dir)
+		return 0;
+
+	uint32_t count = 0;
+	while (const auto* entry = readdir(dir))
+		if (entry->d_name[0] != '.')
+			count += 1;
+
+	closedir(dir);
+	return count;
+#else
+	return 0;
+#endif
+}
+
+// User + kernel time of all threads of this process
+static double GetProcessCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime);
+
+	const auto toSeconds = [](const FILETIME& time) { return (((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime) / 10000000.0; };
+	return toSeconds(kernelTime) + toSeconds(userTime);
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+#endif
+}
+
+// Samples the thread count of the process while alive
+class ThreadCountSampler
+{
+public:
+	ThreadCountSampler()
+	{
+		m_thread = std::thread([this]()
+			{
+				while (!m_done)
+				{
+					m_peakThreads = std::max<uint32_t>(m_peakThreads, CountProcessThreads());
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			});
+	}
+
+	~ThreadCountSampler()
+	{
+		stop();
+	}
+
+	// Peak number of threads, without the sampler itself
+	uint32_t stop()
+	{
+		if (m_thread.joinable())
+		{
+			m_done = true;
+			m_thread.join();
+		}
+
+		return m_peakThreads ? m_peakThreads - 1 : 0;
+	}
+
+private:
+	std::thread m_thread;
+	std::atomic<bool> m_done = false;
+	std::atomic<uint32_t> m_peakThreads = 0;
+};
+
+//--
+
+TEST(CommitPool, DeviceConfigMatchesWorkers)
+{
+	JobSystem jobs(4);
+	EXPECT_EQ("threads=4,user_threads=4", JoinCommitDeviceConfig(jobs));
+}
+
+TEST(CommitPool, JoinCommitMatchesInternalBuild)
+{
+	RayMesh mesh;
+	GenerateTerrainMesh(256, 100.0f, 10.0f, mesh);
+
+	std::vector<RTCRayHit> referenceRays;
+	{
+		RTCDevice device = rtcNewDevice("");
+		ASSERT_NE(nullptr, device);
+
+		{
+			RayScene scene(device);
+			scene.addMesh(mesh);
+			scene.commit();
+
+			GeneratePrimaryRays(scene.bounds(), 128, 128, referenceRays);
+			TraceRays(scene, RayTraceSettings(), referenceRays);
+		}
+
+		rtcReleaseDevice(device);
+	}
+
+	JobSystem pool(4);
+
+	// Embree may start its threads when the device is created or on the first build, count them from before both
+	const auto threadsBefore = CountProcessThreads();
+
+	RTCDevice device = rtcNewDevice(JoinCommitDeviceConfig(pool).c_str());
+	ASSERT_NE(nullptr, device);
+
+	{
+		RayScene scene(device);
+		scene.addMesh(mesh);
+		scene.commit(pool);
+
+		// with TBB all of the work was done on our threads, the internal tasking system ignores user_threads
+		const auto embreeThreads = (int32_t)CountProcessThreads() - (int32_t)threadsBefore;
+		printf("Embree threads after the join commit: %d (%s tasking)\n", embreeThreads, UsesTBBTasking(device) ? "TBB" : "internal");
+
+		if (threadsBefore && UsesTBBTasking(device))
+		{
+			EXPECT_EQ(0, embreeThreads);
+		}
+
+		std::vector<RTCRayHit> rays;
+		GeneratePrimaryRays(scene.bounds(), 128, 128, rays);
+		TraceRays(scene, RayTraceSettings(), rays);
+
+		uint32_t mismatches = 0;
+		for (size_t i = 0; i < rays.size(); ++i)
+			if (rays[i].hit.geomID != referenceRays[i].hit.geomID || rays[i].hit.primID != referenceRays[i].hit.primID)
+				mismatches += 1;
+
+		EXPECT_LE(mismatches, rays.size() / 1000);
+	}
+
+	rtcReleaseDevice(device);
+}
+
+//--
+
+struct BuildBenchmarkResult
+{
+	double buildMs = 0.0;
+	double cpuParallelism = 0.0; // CPU time / wall time during the build
+	uint32_t embreeThreads = 0; // threads started by Embree
+	uint32_t runnableThreads = 0; // threads competing for the cores during the build
+	double backgroundShare = 0.0; // work done by the other bake stage during the build compared to when it runs alone
+	bool tbbTasking = false; // user_threads is only respected by TBB
+};
+
+static uint64_t SpinWork(const std::atomic<bool>& stop)
+{
+	uint64_t count = 0;
+	volatile uint32_t state = 1;
+	while (!stop)
+	{
+		for (uint32_t i = 0; i < 1000; ++i)
+			state = state * 1664525u + 1013904223u;
+		count += 1;
+	}
+	return count;
+}
+
+// Throughput of the other bake stage on the engine workers, in work units per millisecond
+static double MeasureBackgroundThroughput(JobSystem& pool, double durationMs)
+{
+	std::atomic<bool> stop = false;
+	std::atomic<uint64_t> work = 0;
+
+	std::thread timer([&]()
+		{
+			std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(durationMs));
+			stop = true;
+		});
+
+	pool.runOnAllWorkers([&](uint32_t) { work += SpinWork(stop); });
+	timer.join();
+
+	return work / durationMs;
+}
+
+TEST(CommitPool, DISABLED_BuildBenchmark)
+{
+	// ~10M triangles
+	RayMesh mesh;
+	GenerateTerrainMesh(2236, 1000.0f, 100.0f, mesh);
+
+	const auto hardwareThreads = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+
+	// engine workers, one per core
+	JobSystem pool(hardwareThreads);
+	const auto baselineThreads = CountProcessThreads();
+	const auto aloneThroughput = MeasureBackgroundThroughput(pool, 200.0);
+
+	const auto runBuild = [&](bool joinCommit) -> BuildBenchmarkResult
+	{
+		BuildBenchmarkResult ret;
+
+		RTCDevice device = rtcNewDevice(joinCommit ? JoinCommitDeviceConfig(pool).c_str() : "");
+		EXPECT_NE(nullptr, device);
+		ret.tbbTasking = UsesTBBTasking(device);
+
+		{
+			RayScene scene(device, RTC_BUILD_QUALITY_MEDIUM);
+			scene.addMesh(mesh);
+
+			ThreadCountSampler sampler;
+			const auto cpuStart = GetProcessCpuSeconds();
+
+			if (joinCommit)
+			{
+				// the workers stop what they were doing and build the BVH
+				scene.commit(pool);
+			}
+			else
+			{
+				// the other bake stage keeps the workers busy while Embree builds on its own threads
+				std::atomic<bool> stop = false;
+				std::atomic<uint64_t> work = 0;
+				std::thread background([&]() { pool.runOnAllWorkers([&](uint32_t) { work += SpinWork(stop); }); });
+
+				scene.commit();
+
+				stop = true;
+				background.join();
+
+				ret.backgroundShare = (work / scene.buildTimeMs()) / aloneThroughput;
+			}
+
+			const auto cpuSeconds = GetProcessCpuSeconds() - cpuStart;
+			const auto peakThreads = sampler.stop();
+
+			ret.buildMs = scene.buildTimeMs();
+			ret.cpuParallelism = cpuSeconds / (ret.buildMs / 1000.0);
+			const auto ownThreads = baselineThreads + (joinCommit ? 0 : 1); // the background stage is started from a separate thread
+			ret.embreeThreads = (peakThreads > ownThreads) ? peakThreads - ownThreads : 0;
+			ret.runnableThreads = (joinCommit ? pool.numThreads() : pool.numThreads() + 1) + ret.embreeThreads;
+		}
+
+		rtcReleaseDevice(device);
+		return ret;
+	};
+
+	printf("BVH build of %u triangles, %u hardware threads\n", mesh.numTriangles(), hardwareThreads);
+
+	for (const auto joinCommit : { false, true })
+	{
+		const auto result = runBuild(joinCommit);
+
+		printf("  %-28s build %8.1f ms, CPU parallelism %5.2f, Embree threads %3u, runnable threads %3u (%.2fx oversubscribed)",
+			joinCommit ? "rtcJoinCommitScene (pool)" : "internal tasking + bake load",
+			result.buildMs, result.cpuParallelism, result.embreeThreads, result.runnableThreads, result.runnableThreads / (double)hardwareThreads);
+
+		if (!joinCommit)
+			printf(", bake stage at %.0f%%", result.backgroundShare * 100.0);
+
+		printf("\n");
+
+		if (joinCommit && baselineThreads && result.tbbTasking)
+		{
+			EXPECT_EQ(0, result.embreeThreads);
+		}
+	}
+}
+
+//--
@@ -0,0 +1,75 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "device_isa.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+//--
+
+const char* DeviceISAName(DeviceISA isa)
+{
+	switch (isa)
+	{
+		case DeviceISA::SSE: return "SSE";
+		case DeviceISA::AVX: return "AVX/AVX2";
+		case DeviceISA::AVX512: return "AVX-512";
+		default: return "unknown";
+	}
+}
+
+DeviceISA GetDeviceISA(RTCDevice device)
+{
+	if (rtcGetDeviceProperty(device, RTC_DEVICE_PROPERTY_NATIVE_RAY16_SUPPORTED))
+		return DeviceISA::AVX512;
+
+	if (rtcGetDeviceProperty(device, RTC_DEVICE_PROPERTY_NATIVE_RAY8_SUPPORTED))
+		return DeviceISA::AVX;
+
+	return DeviceISA::SSE;
+}
+
+bool CpuSupportsAVX512()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int info[4];
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27))) // OSXSAVE
+		return false;
+
+	// opmask, upper ZMM and ZMM16-31 state must be enabled by the OS as well as XMM/YMM
+	const auto xcr0 = _xgetbv(0);
+	if ((xcr0 & 0xE6) != 0xE6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	const auto required = (1u << 16) | (1u << 17) | (1u << 28) | (1u << 30) | (1u << 31); // F, DQ, CD, BW, VL
+	return ((uint32_t)info[1] & required) == required;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	// checks the OS support as well
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd") && __builtin_cpu_supports("avx512dq")
+		&& __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl");
+#else
+	return false;
+#endif
+}
+
+const char* DeviceISAConfig(DeviceISA isa)
+{
+	switch (isa)
+	{
+		case DeviceISA::SSE: return "max_isa=sse4.2";
+		case DeviceISA::AVX: return "max_isa=avx2";
+		default: return "";
+	}
+}
+
+//--
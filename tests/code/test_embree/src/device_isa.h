@@ -0,0 +1,35 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#pragma once
+
+#define EMBREE_STATIC_LIB
+#include <embree3/rtcore.h>
+
+#include <stdint.h>
+
+//--
+
+// Widest SIMD the device traces with, Embree selects the kernels at runtime from the ISAs it was compiled with
+enum class DeviceISA : uint8_t
+{
+	SSE, // 4-wide
+	AVX, // 8-wide, AVX or AVX2
+	AVX512, // 16-wide
+};
+
+extern const char* DeviceISAName(DeviceISA isa);
+
+// Derived from the native packet widths reported by rtcGetDeviceProperty
+extern DeviceISA GetDeviceISA(RTCDevice device);
+
+// Does the CPU and the OS support the AVX-512 subset Embree needs (F, CD, DQ, BW, VL)
+extern bool CpuSupportsAVX512();
+
+// Device config string limiting the kernels to given ISA, "" for the widest available
+extern const char* DeviceISAConfig(DeviceISA isa);
+
+//--
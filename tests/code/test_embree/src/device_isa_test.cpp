@@ -0,0 +1,155 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "device_isa.h"
+#include "ray_benchmark.h"
+
+#include <thread>
+
+//--
+
+TEST(EmbreeISA, ReportsActiveISA)
+{
+	RTCDevice device = rtcNewDevice("");
+	ASSERT_NE(nullptr, device);
+
+	const auto isa = GetDeviceISA(device);
+	printf("Embree %u, active ISA: %s, CPU AVX-512: %s\n", (uint32_t)rtcGetDeviceProperty(device, RTC_DEVICE_PROPERTY_VERSION),
+		DeviceISAName(isa), CpuSupportsAVX512() ? "yes" : "no");
+
+	EXPECT_NE(0, rtcGetDeviceProperty(device, RTC_DEVICE_PROPERTY_NATIVE_RAY4_SUPPORTED));
+
+#ifndef __APPLE__
+	// the AVX-512 kernels are compiled in on windows and linux, the best one has to be picked at runtime
+	if (CpuSupportsAVX512())
+	{
+		EXPECT_EQ(DeviceISA::AVX512, isa);
+	}
+#endif
+
+	rtcReleaseDevice(device);
+}
+
+TEST(EmbreeISA, MaxISALimitsKernels)
+{
+	RTCDevice device = rtcNewDevice(DeviceISAConfig(DeviceISA::AVX));
+	ASSERT_NE(nullptr, device);
+
+	EXPECT_NE(DeviceISA::AVX512, GetDeviceISA(device));
+
+	rtcReleaseDevice(device);
+}
+
+TEST(EmbreeISA, SameHitsOnAllISAs)
+{
+	RayMesh mesh;
+	GenerateTerrainMesh(128, 100.0f, 10.0f, mesh);
+
+	std::vector<RTCRayHit> referenceRays;
+
+	for (const auto isa : { DeviceISA::SSE, DeviceISA::AVX, DeviceISA::AVX512 })
+	{
+		RTCDevice device = rtcNewDevice(DeviceISAConfig(isa));
+		ASSERT_NE(nullptr, device);
+
+		{
+			RayScene scene(device);
+			scene.addMesh(mesh);
+			scene.commit();
+
+			std::vector<RTCRayHit> rays;
+			GeneratePrimaryRays(scene.bounds(), 128, 128, rays);
+
+			RayTraceSettings settings;
+			settings.api = RayAPI::Packet16;
+			TraceRays(scene, settings, rays);
+
+			if (referenceRays.empty())
+			{
+				referenceRays = rays;
+			}
+			else
+			{
+				uint32_t mismatches = 0;
+				for (size_t i = 0; i < rays.size(); ++i)
+					if (rays[i].hit.geomID != referenceRays[i].hit.geomID || rays[i].hit.primID != referenceRays[i].hit.primID)
+						mismatches += 1;
+
+				EXPECT_LE(mismatches, rays.size() / 1000) << DeviceISAName(GetDeviceISA(device));
+			}
+		}
+
+		rtcReleaseDevice(device);
+	}
+}
+
+//--
+
+TEST(EmbreeISA, DISABLED_Packet16Benchmark)
+{
+	if (!CpuSupportsAVX512())
+		GTEST_SKIP() << "CPU does not support AVX-512";
+
+	RayMesh mesh;
+	GenerateTerrainMesh(1024, 1000.0f, 100.0f, mesh);
+
+	const auto numThreads = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+
+	for (const auto isa : { DeviceISA::AVX, DeviceISA::AVX512 })
+	{
+		RTCDevice device = rtcNewDevice(DeviceISAConfig(isa));
+		ASSERT_NE(nullptr, device);
+
+		{
+			RayScene scene(device);
+			scene.addMesh(mesh);
+			scene.commit();
+
+			std::vector<RTCRayHit> primaryRays;
+			GeneratePrimaryRays(scene.bounds(), 1024, 1024, primaryRays);
+
+			std::vector<RTCRayHit> diffuseRays;
+			{
+				RayTraceSettings settings;
+				settings.numThreads = numThreads;
+
+				auto tracedRays = primaryRays;
+				TraceRays(scene, settings, tracedRays);
+				GenerateDiffuseRays(scene.bounds(), tracedRays, 3, diffuseRays);
+			}
+
+			printf("%s: build %.1f ms\n", DeviceISAName(GetDeviceISA(device)), scene.buildTimeMs());
+
+			for (const auto api : { RayAPI::Packet8, RayAPI::Packet16, RayAPI::Stream16M })
+			{
+				for (const auto* sourceRays : { &primaryRays, &diffuseRays })
+				{
+					const auto coherent = (sourceRays == &primaryRays);
+					printf("  %-10s %-22s", coherent ? "primary" : "diffuse", RayAPIName(api));
+
+					for (const uint32_t threads : { 1u, numThreads })
+					{
+						RayTraceSettings settings;
+						settings.api = api;
+						settings.numThreads = threads;
+						settings.coherent = coherent;
+
+						auto rays = *sourceRays;
+						const auto result = TraceRays(scene, settings, rays);
+						printf(" %2u threads: %7.2f Mrays/s", threads, result.mraysPerSecond());
+					}
+
+					printf("\n");
+				}
+			}
+		}
+
+		rtcReleaseDevice(device);
+	}
+}
+
+//--
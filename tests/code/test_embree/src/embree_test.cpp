@@ -135,6 +135,10 @@ public:
 	void addGeometry(HelperGeometry& geometry)
 	{
 		rtcAttachGeometry(m_scene, geometry.geometery());
+	}
+
+	void commit()
+	{
 		rtcCommitScene(m_scene);
 	}
 
@@ -165,6 +169,7 @@ TEST(EmbreeBasic, GeometryAttachToScene)
 		HelperGeometryTriangle triangle(device);
 		HelperScene scene(device);
 		scene.addGeometry(triangle);
+		scene.commit();
 	}
 
 	rtcReleaseDevice(device);
@@ -179,6 +184,7 @@ TEST(EmbreeBasic, IntersectScene1)
 		HelperGeometryTriangle triangle(device);
 		HelperScene scene(device);
 		scene.addGeometry(triangle);
+		scene.commit();
 
 		RTCIntersectContext context;
 		rtcInitIntersectContext(&context);
@@ -207,6 +213,7 @@ TEST(EmbreeBasic, IntersectScene4)
 		HelperGeometryTriangle triangle(device);
 		HelperScene scene(device);
 		scene.addGeometry(triangle);
+		scene.commit();
 
 		RTCIntersectContext context;
 		rtcInitIntersectContext(&context);
@@ -243,6 +250,7 @@ TEST(EmbreeBasic, IntersectScene8)
 		HelperGeometryTriangle triangle(device);
 		HelperScene scene(device);
 		scene.addGeometry(triangle);
+		scene.commit();
 
 		RTCIntersectContext context;
 		rtcInitIntersectContext(&context);
@@ -279,6 +287,7 @@ TEST(EmbreeBasic, IntersectScene16)
 		HelperGeometryTriangle triangle(device);
 		HelperScene scene(device);
 		scene.addGeometry(triangle);
+		scene.commit();
 
 		RTCIntersectContext context;
 		rtcInitIntersectContext(&context);
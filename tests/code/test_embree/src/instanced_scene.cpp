@@ -0,0 +1,122 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "instanced_scene.h"
+
+#include <chrono>
+#include <cmath>
+
+//--
+
+InstanceTransform InstanceTransform::Make(float x, float y, float z, float yaw, float scale)
+{
+	const auto c = cosf(yaw) * scale;
+	const auto s = sinf(yaw) * scale;
+
+	InstanceTransform ret;
+	ret.m[0] = c; ret.m[1] = 0.0f; ret.m[2] = -s; // X axis
+	ret.m[3] = 0.0f; ret.m[4] = scale; ret.m[5] = 0.0f; // Y axis
+	ret.m[6] = s; ret.m[7] = 0.0f; ret.m[8] = c; // Z axis
+	ret.m[9] = x; ret.m[10] = y; ret.m[11] = z;
+	return ret;
+}
+
+void InstanceTransform::transformPoint(const float* pos, float* outPos) const
+{
+	outPos[0] = m[0] * pos[0] + m[3] * pos[1] + m[6] * pos[2] + m[9];
+	outPos[1] = m[1] * pos[0] + m[4] * pos[1] + m[7] * pos[2] + m[10];
+	outPos[2] = m[2] * pos[0] + m[5] * pos[1] + m[8] * pos[2] + m[11];
+}
+
+//--
+
+InstancedScene::InstancedScene(RTCDevice device, InstanceUpdateMode mode)
+	: m_device(device)
+	, m_mode(mode)
+{
+	m_scene = rtcNewScene(device);
+
+	if (mode == InstanceUpdateMode::Refit)
+	{
+		// fast top level builds, the BVH is allowed to degrade a bit as the instances move
+		rtcSetSceneFlags(m_scene, RTC_SCENE_FLAG_DYNAMIC);
+		rtcSetSceneBuildQuality(m_scene, RTC_BUILD_QUALITY_LOW);
+	}
+	else
+	{
+		rtcSetSceneFlags(m_scene, RTC_SCENE_FLAG_NONE);
+		rtcSetSceneBuildQuality(m_scene, RTC_BUILD_QUALITY_MEDIUM);
+	}
+}
+
+InstancedScene::~InstancedScene()
+{
+	for (auto geometry : m_instances)
+		rtcReleaseGeometry(geometry);
+
+	rtcReleaseScene(m_scene);
+}
+
+uint32_t InstancedScene::addInstance(RTCScene bottomLevel, const InstanceTransform& transform)
+{
+	const auto instanceID = (uint32_t)m_instances.size();
+
+	auto geometry = rtcNewGeometry(m_device, RTC_GEOMETRY_TYPE_INSTANCE);
+	rtcSetGeometryInstancedScene(geometry, bottomLevel);
+	rtcSetGeometryTimeStepCount(geometry, 1);
+	rtcSetGeometryTransform(geometry, 0, RTC_FORMAT_FLOAT3X4_COLUMN_MAJOR, transform.m);
+	rtcSetGeometryBuildQuality(geometry, m_mode == InstanceUpdateMode::Refit ? RTC_BUILD_QUALITY_REFIT : RTC_BUILD_QUALITY_MEDIUM);
+	rtcCommitGeometry(geometry);
+
+	// we keep our reference so the transform can be changed later
+	rtcAttachGeometryByID(m_scene, geometry, instanceID);
+
+	m_instances.push_back(geometry);
+	m_transforms.push_back(transform);
+	return instanceID;
+}
+
+void InstancedScene::setTransform(uint32_t instanceID, const InstanceTransform& transform)
+{
+	auto geometry = m_instances[instanceID];
+	rtcSetGeometryTransform(geometry, 0, RTC_FORMAT_FLOAT3X4_COLUMN_MAJOR, transform.m);
+	rtcCommitGeometry(geometry);
+
+	m_transforms[instanceID] = transform;
+}
+
+void InstancedScene::commit()
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	rtcCommitScene(m_scene);
+	m_commitTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//--
+
+void FlattenInstances(const RayMesh& mesh, const std::vector<InstanceTransform>& transforms, RayMesh& outMesh)
+{
+	outMesh.positions.reserve(outMesh.positions.size() + mesh.positions.size() * transforms.size());
+	outMesh.indices.reserve(outMesh.indices.size() + mesh.indices.size() * transforms.size());
+
+	for (const auto& transform : transforms)
+	{
+		const auto firstVertex = outMesh.numVertices();
+
+		for (size_t i = 0; i < mesh.positions.size(); i += 3)
+		{
+			float pos[3];
+			transform.transformPoint(&mesh.positions[i], pos);
+			outMesh.positions.insert(outMesh.positions.end(), pos, pos + 3);
+		}
+
+		for (const auto index : mesh.indices)
+			outMesh.indices.push_back(firstVertex + index);
+	}
+}
+
+//--
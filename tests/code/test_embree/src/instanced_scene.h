@@ -0,0 +1,74 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#pragma once
+
+#include "ray_benchmark.h"
+
+//--
+
+// Affine transform in the Embree RTC_FORMAT_FLOAT3X4_COLUMN_MAJOR layout (translation in m[9..11])
+struct InstanceTransform
+{
+	float m[12] = { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f };
+
+	// Uniform scale, rotation around Y and translation
+	static InstanceTransform Make(float x, float y, float z, float yaw = 0.0f, float scale = 1.0f);
+
+	void transformPoint(const float* pos, float* outPos) const;
+};
+
+enum class InstanceUpdateMode : uint8_t
+{
+	Refit, // RTC_SCENE_FLAG_DYNAMIC scene with RTC_BUILD_QUALITY_REFIT instances, commit after moving only updates the top level
+	Rebuild, // static scene, the top level BVH is built from scratch on every commit
+};
+
+// Two-level scene: instances (RTC_GEOMETRY_TYPE_INSTANCE) of shared bottom level scenes
+// Moving an instance only changes its transform, the bottom level BVHs are never touched
+class InstancedScene
+{
+public:
+	InstancedScene(RTCDevice device, InstanceUpdateMode mode = InstanceUpdateMode::Refit);
+	~InstancedScene();
+
+	InstancedScene(const InstancedScene&) = delete;
+	InstancedScene& operator=(const InstancedScene&) = delete;
+
+	inline RTCScene scene() const { return m_scene; }
+	inline operator RTCScene() const { return m_scene; }
+
+	inline InstanceUpdateMode mode() const { return m_mode; }
+	inline uint32_t numInstances() const { return (uint32_t)m_instances.size(); }
+	inline const InstanceTransform& transform(uint32_t instanceID) const { return m_transforms[instanceID]; }
+
+	// Time of the last commit
+	inline double commitTimeMs() const { return m_commitTimeMs; }
+
+	// Instance of the committed bottom level scene, returns the instance ID (reported in hit.instID[0])
+	uint32_t addInstance(RTCScene bottomLevel, const InstanceTransform& transform);
+
+	// Move the instance, visible to the queries after the next commit
+	void setTransform(uint32_t instanceID, const InstanceTransform& transform);
+
+	// Update the top level BVH
+	void commit();
+
+private:
+	RTCDevice m_device = nullptr;
+	RTCScene m_scene = nullptr;
+	InstanceUpdateMode m_mode = InstanceUpdateMode::Refit;
+
+	std::vector<RTCGeometry> m_instances;
+	std::vector<InstanceTransform> m_transforms;
+
+	double m_commitTimeMs = 0.0;
+};
+
+// Copies of the mesh with the transforms baked in, appended to the output - single level reference for the instanced scene
+extern void FlattenInstances(const RayMesh& mesh, const std::vector<InstanceTransform>& transforms, RayMesh& outMesh);
+
+//--
@@ -0,0 +1,347 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "instanced_scene.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+
+//--
+
+// Axis aligned box [-0.5, 0.5]^3
+static void BuildBox(RayMesh& outMesh)
+{
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		outMesh.positions.push_back((i & 1) ? 0.5f : -0.5f);
+		outMesh.positions.push_back((i & 2) ? 0.5f : -0.5f);
+		outMesh.positions.push_back((i & 4) ? 0.5f : -0.5f);
+	}
+
+	const uint32_t indices[36] = {
+		0, 2, 1, 1, 2, 3, // -z
+		4, 5, 6, 5, 7, 6, // +z
+		0, 1, 4, 1, 5, 4, // -y
+		2, 6, 3, 3, 6, 7, // +y
+		0, 4, 2, 2, 4, 6, // -x
+		1, 3, 5, 3, 7, 5, // +x
+	};
+
+	outMesh.indices.insert(outMesh.indices.end(), indices, indices + 36);
+}
+
+static RTCRayHit MakeDownRay(float x, float z)
+{
+	RTCRayHit ray;
+	memset(&ray, 0, sizeof(ray));
+	ray.ray.org_x = x;
+	ray.ray.org_y = 5.0f;
+	ray.ray.org_z = z;
+	ray.ray.dir_y = -1.0f;
+	ray.ray.tfar = 100.0f;
+	ray.ray.mask = 0xFFFFFFFF;
+	ray.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+	ray.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+	return ray;
+}
+
+static RTCRayHit TraceDownRay(RTCScene scene, float x, float z)
+{
+	RTCIntersectContext context;
+	rtcInitIntersectContext(&context);
+
+	auto ray = MakeDownRay(x, z);
+	rtcIntersect1(scene, &context, &ray);
+	return ray;
+}
+
+static std::vector<InstanceTransform> RandomTransforms(uint32_t count, float areaSize, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> position(-areaSize * 0.5f, areaSize * 0.5f);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+	std::vector<InstanceTransform> ret;
+	for (uint32_t i = 0; i < count; ++i)
+		ret.push_back(InstanceTransform::Make(position(rng), position(rng) * 0.05f, position(rng), angle(rng), scale(rng)));
+	return ret;
+}
+
+class InstancedSceneTest : public ::testing::TestWithParam<InstanceUpdateMode>
+{
+protected:
+	RTCDevice device = nullptr;
+
+	virtual void SetUp() override
+	{
+		device = rtcNewDevice("");
+		ASSERT_NE(nullptr, device);
+	}
+
+	virtual void TearDown() override
+	{
+		rtcReleaseDevice(device);
+	}
+};
+
+//--
+
+TEST_P(InstancedSceneTest, HitReportsInstance)
+{
+	RayMesh box;
+	BuildBox(box);
+
+	RayScene blas(device);
+	const auto boxID = blas.addMesh(box);
+	blas.commit();
+
+	InstancedScene scene(device, GetParam());
+	EXPECT_EQ(0, scene.addInstance(blas, InstanceTransform::Make(0.0f, 0.0f, 0.0f)));
+	EXPECT_EQ(1, scene.addInstance(blas, InstanceTransform::Make(10.0f, 0.0f, 0.0f, 0.0f, 2.0f)));
+	scene.commit();
+
+	const auto hit0 = TraceDownRay(scene, 0.1f, 0.2f);
+	EXPECT_EQ(0, hit0.hit.instID[0]);
+	EXPECT_EQ(boxID, hit0.hit.geomID);
+	EXPECT_NEAR(4.5f, hit0.ray.tfar, 1e-4f);
+
+	// scaled twice, top at y = 1
+	const auto hit1 = TraceDownRay(scene, 10.8f, -0.9f);
+	EXPECT_EQ(1, hit1.hit.instID[0]);
+	EXPECT_EQ(boxID, hit1.hit.geomID);
+	EXPECT_NEAR(4.0f, hit1.ray.tfar, 1e-4f);
+
+	const auto miss = TraceDownRay(scene, 5.0f, 0.0f);
+	EXPECT_EQ(RTC_INVALID_GEOMETRY_ID, miss.hit.geomID);
+}
+
+TEST_P(InstancedSceneTest, MovedInstanceAfterCommit)
+{
+	RayMesh box;
+	BuildBox(box);
+
+	RayScene blas(device);
+	blas.addMesh(box);
+	blas.commit();
+
+	InstancedScene scene(device, GetParam());
+	scene.addInstance(blas, InstanceTransform::Make(0.0f, 0.0f, 0.0f));
+	const auto moving = scene.addInstance(blas, InstanceTransform::Make(10.0f, 0.0f, 0.0f));
+	scene.commit();
+
+	for (uint32_t frame = 1; frame <= 10; ++frame)
+	{
+		const auto x = 10.0f + frame * 3.0f;
+		scene.setTransform(moving, InstanceTransform::Make(x, 0.0f, 0.0f, frame * 0.3f));
+		scene.commit();
+
+		EXPECT_EQ(moving, TraceDownRay(scene, x, 0.0f).hit.instID[0]);
+		EXPECT_EQ(RTC_INVALID_GEOMETRY_ID, TraceDownRay(scene, x - 3.0f, 0.0f).hit.geomID);
+		EXPECT_EQ(0, TraceDownRay(scene, 0.0f, 0.0f).hit.instID[0]);
+	}
+}
+
+TEST_P(InstancedSceneTest, MatchesFlattenedScene)
+{
+	RayMesh patch;
+	GenerateTerrainMesh(8, 4.0f, 1.0f, patch);
+
+	RayScene blas(device);
+	blas.addMesh(patch);
+	blas.commit();
+
+	auto transforms = RandomTransforms(500, 100.0f, 1);
+
+	InstancedScene scene(device, GetParam());
+	for (const auto& transform : transforms)
+		scene.addInstance(blas, transform);
+	scene.commit();
+
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+
+	for (uint32_t frame = 0; frame < 3; ++frame)
+	{
+		RayMesh flatMesh;
+		FlattenInstances(patch, transforms, flatMesh);
+
+		RayScene flatScene(device);
+		flatScene.addMesh(flatMesh);
+		flatScene.commit();
+
+		std::vector<RTCRayHit> rays;
+		GeneratePrimaryRays(flatScene.bounds(), 128, 128, rays);
+
+		auto flatRays = rays;
+		TraceRays(flatScene, RayTraceSettings(), flatRays);
+		TraceRays(scene, RayTraceSettings(), rays);
+
+		uint32_t mismatches = 0;
+		for (size_t i = 0; i < rays.size(); ++i)
+		{
+			const auto flatHit = flatRays[i].hit.geomID != RTC_INVALID_GEOMETRY_ID;
+			const auto hit = rays[i].hit.geomID != RTC_INVALID_GEOMETRY_ID;
+			if (flatHit != hit || (hit && fabsf(flatRays[i].ray.tfar - rays[i].ray.tfar) > 1e-3f * flatRays[i].ray.tfar))
+				mismatches += 1;
+		}
+
+		EXPECT_LE(mismatches, rays.size() / 1000) << "Frame " << frame;
+
+		// move everything a bit
+		for (uint32_t i = 0; i < transforms.size(); ++i)
+		{
+			transforms[i].m[9] += step(rng);
+			transforms[i].m[11] += step(rng);
+			scene.setTransform(i, transforms[i]);
+		}
+
+		scene.commit();
+	}
+}
+
+INSTANTIATE_TEST_SUITE_P(UpdateModes, InstancedSceneTest, ::testing::Values(InstanceUpdateMode::Refit, InstanceUpdateMode::Rebuild));
+
+//--
+
+struct FrameTiming
+{
+	double updateMs = 0.0; // setting the transforms (or vertices)
+	double commitMs = 0.0;
+	double maxCommitMs = 0.0;
+};
+
+TEST(InstancedSceneBenchmark, DISABLED_MovingInstances)
+{
+	const uint32_t NUM_INSTANCES = 10000;
+	const uint32_t NUM_FRAMES = 60;
+
+	RTCDevice device = rtcNewDevice("");
+	ASSERT_NE(nullptr, device);
+
+	{
+		// a few shared meshes of different complexity
+		RayMesh box;
+		BuildBox(box);
+
+		RayMesh patch;
+		GenerateTerrainMesh(16, 4.0f, 1.0f, patch);
+
+		RayScene boxBLAS(device);
+		boxBLAS.addMesh(box);
+		boxBLAS.commit();
+
+		RayScene patchBLAS(device);
+		patchBLAS.addMesh(patch);
+		patchBLAS.commit();
+
+		const auto initialTransforms = RandomTransforms(NUM_INSTANCES, 1000.0f, 3);
+
+		printf("%u instances, %u frames\n", NUM_INSTANCES, NUM_FRAMES);
+
+		for (const auto movingPercent : { 10u, 100u })
+		{
+			const auto numMoving = NUM_INSTANCES * movingPercent / 100;
+
+			// same motion for every variant
+			const auto animate = [&](uint32_t frame, uint32_t index) -> InstanceTransform
+			{
+				auto transform = initialTransforms[index];
+				transform.m[9] += 5.0f * sinf(frame * 0.1f + index);
+				transform.m[11] += 5.0f * cosf(frame * 0.1f + index);
+				return transform;
+			};
+
+			for (const auto mode : { InstanceUpdateMode::Refit, InstanceUpdateMode::Rebuild })
+			{
+				InstancedScene scene(device, mode);
+				for (uint32_t i = 0; i < NUM_INSTANCES; ++i)
+					scene.addInstance((i & 7) ? boxBLAS.scene() : patchBLAS.scene(), initialTransforms[i]);
+				scene.commit();
+
+				const auto initialCommitMs = scene.commitTimeMs();
+
+				FrameTiming timing;
+				for (uint32_t frame = 1; frame <= NUM_FRAMES; ++frame)
+				{
+					const auto start = std::chrono::high_resolution_clock::now();
+					for (uint32_t i = 0; i < numMoving; ++i)
+						scene.setTransform(i, animate(frame, i));
+					timing.updateMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+					scene.commit();
+					timing.commitMs += scene.commitTimeMs();
+					timing.maxCommitMs = std::max(timing.maxCommitMs, scene.commitTimeMs());
+				}
+
+				printf("  %3u%% moving, two-level %-8s: first commit %7.2f ms, per frame: update %6.3f ms, commit %6.3f ms (max %6.3f ms)\n",
+					movingPercent, mode == InstanceUpdateMode::Refit ? "refit" : "rebuild", initialCommitMs,
+					timing.updateMs / NUM_FRAMES, timing.commitMs / NUM_FRAMES, timing.maxCommitMs);
+			}
+
+			// single level reference: all instances baked into one mesh that is refitted after the vertices move
+			{
+				std::vector<uint32_t> firstVertex;
+				RayMesh flatMesh;
+				for (uint32_t i = 0; i < NUM_INSTANCES; ++i)
+				{
+					firstVertex.push_back(flatMesh.numVertices());
+					FlattenInstances((i & 7) ? box : patch, { initialTransforms[i] }, flatMesh);
+				}
+
+				auto flatScene = rtcNewScene(device);
+				rtcSetSceneFlags(flatScene, RTC_SCENE_FLAG_DYNAMIC);
+
+				auto geometry = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE);
+				rtcSetGeometryBuildQuality(geometry, RTC_BUILD_QUALITY_REFIT);
+				auto* vertices = (float*)rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, 3 * sizeof(float), flatMesh.numVertices());
+				memcpy(vertices, flatMesh.positions.data(), flatMesh.positions.size() * sizeof(float));
+				auto* indices = rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, 3 * sizeof(uint32_t), flatMesh.numTriangles());
+				memcpy(indices, flatMesh.indices.data(), flatMesh.indices.size() * sizeof(uint32_t));
+				rtcCommitGeometry(geometry);
+				rtcAttachGeometry(flatScene, geometry);
+
+				auto start = std::chrono::high_resolution_clock::now();
+				rtcCommitScene(flatScene);
+				const auto initialCommitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+				FrameTiming timing;
+				for (uint32_t frame = 1; frame <= NUM_FRAMES; ++frame)
+				{
+					start = std::chrono::high_resolution_clock::now();
+					for (uint32_t i = 0; i < numMoving; ++i)
+					{
+						const auto& mesh = (i & 7) ? box : patch;
+						const auto transform = animate(frame, i);
+						for (uint32_t v = 0; v < mesh.numVertices(); ++v)
+							transform.transformPoint(&mesh.positions[3 * v], &vertices[3 * (firstVertex[i] + v)]);
+					}
+					rtcUpdateGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0);
+					rtcCommitGeometry(geometry);
+					timing.updateMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+					start = std::chrono::high_resolution_clock::now();
+					rtcCommitScene(flatScene);
+					const auto commitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+					timing.commitMs += commitMs;
+					timing.maxCommitMs = std::max(timing.maxCommitMs, commitMs);
+				}
+
+				printf("  %3u%% moving, flat mesh refit    : first commit %7.2f ms, per frame: update %6.3f ms, commit %6.3f ms (max %6.3f ms)\n",
+					movingPercent, initialCommitMs, timing.updateMs / NUM_FRAMES, timing.commitMs / NUM_FRAMES, timing.maxCommitMs);
+
+				rtcReleaseGeometry(geometry);
+				rtcReleaseScene(flatScene);
+			}
+		}
+	}
+
+	rtcReleaseDevice(device);
+}
+
+//--
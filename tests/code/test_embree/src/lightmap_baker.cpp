@@ -0,0 +1,625 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "lightmap_baker.h"
+#include "commit_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+
+//--
+
+static const float PI = 3.14159265358979f;
+
+static uint32_t HashUint(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// Small stateless-seeded generator so every texel and pass gets the same samples regardless of the thread that bakes it
+class TexelSampler
+{
+public:
+	TexelSampler(uint32_t seed, uint32_t texelIndex, uint32_t passIndex)
+	{
+		m_state = HashUint(seed ^ HashUint(texelIndex ^ HashUint(passIndex + 0x9e3779b9u)));
+	}
+
+	inline float next()
+	{
+		m_state = m_state * 747796405u + 2891336453u;
+		return (HashUint(m_state) >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	uint32_t m_state = 0;
+};
+
+static void CosineSample(TexelSampler& sampler, const float* n, const float* t, const float* b, float* outDir)
+{
+	const auto r = sqrtf(sampler.next());
+	const auto phi = 2.0f * PI * sampler.next();
+	const auto lx = r * cosf(phi);
+	const auto ly = r * sinf(phi);
+	const auto lz = sqrtf(std::max(0.0f, 1.0f - lx * lx - ly * ly));
+
+	for (uint32_t k = 0; k < 3; ++k)
+		outDir[k] = t[k] * lx + b[k] * ly + n[k] * lz;
+}
+
+static void Normalize(float* v)
+{
+	const auto len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (len > 0.0f)
+	{
+		v[0] /= len;
+		v[1] /= len;
+		v[2] /= len;
+	}
+}
+
+static void Cross(const float* a, const float* b, float* out)
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float Luminance(const float* rgb)
+{
+	return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+}
+
+//--
+
+LightmapBaker::LightmapBaker(RTCScene scene, JobSystem& workers, const LightmapBakeSettings& settings)
+	: m_scene(scene)
+	, m_workers(workers)
+	, m_settings(settings)
+{
+	m_settings.samplesPerPass = std::max<uint32_t>(16, (m_settings.samplesPerPass + 15) & ~15u);
+	m_settings.tileSize = std::max<uint32_t>(1, m_settings.tileSize);
+	m_settings.minPasses = std::max<uint32_t>(2, m_settings.minPasses);
+}
+
+LightmapBaker::~LightmapBaker()
+{}
+
+void LightmapBaker::setMesh(const LightmapMesh& mesh, uint32_t geomID, uint32_t width, uint32_t height)
+{
+	m_width = width;
+	m_height = height;
+	m_geomID = geomID;
+	m_uvs = mesh.uvs;
+	m_indices = mesh.geometry.indices;
+
+	m_stats = LightmapBakeStats();
+	m_texels.clear();
+	m_texelMap.assign((size_t)width * height, -1);
+	m_bounceLookup.assign((size_t)width * height * 3, 0.0f);
+	m_bounceGeneration = 0;
+
+	const auto& positions = mesh.geometry.positions;
+	const auto hasNormals = mesh.normals.size() == positions.size();
+	const auto numTriangles = mesh.geometry.numTriangles();
+
+	m_faceNormals.resize((size_t)numTriangles * 3);
+
+	for (uint32_t i = 0; i < numTriangles; ++i)
+	{
+		const auto i0 = m_indices[3 * i + 0];
+		const auto i1 = m_indices[3 * i + 1];
+		const auto i2 = m_indices[3 * i + 2];
+
+		const auto* p0 = &positions[3 * i0];
+		const auto* p1 = &positions[3 * i1];
+		const auto* p2 = &positions[3 * i2];
+
+		const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		auto* faceNormal = &m_faceNormals[3 * i];
+		Cross(e1, e2, faceNormal);
+		Normalize(faceNormal);
+
+		// texel space
+		const float x[3] = { m_uvs[2 * i0 + 0] * width, m_uvs[2 * i1 + 0] * width, m_uvs[2 * i2 + 0] * width };
+		const float y[3] = { m_uvs[2 * i0 + 1] * height, m_uvs[2 * i1 + 1] * height, m_uvs[2 * i2 + 1] * height };
+
+		const auto area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+		if (fabsf(area) < 1e-12f)
+			continue;
+
+		const auto minX = std::max<int32_t>(0, (int32_t)floorf(std::min({ x[0], x[1], x[2] })));
+		const auto minY = std::max<int32_t>(0, (int32_t)floorf(std::min({ y[0], y[1], y[2] })));
+		const auto maxX = std::min<int32_t>(width - 1, (int32_t)ceilf(std::max({ x[0], x[1], x[2] })));
+		const auto maxY = std::min<int32_t>(height - 1, (int32_t)ceilf(std::max({ y[0], y[1], y[2] })));
+
+		for (int32_t py = minY; py <= maxY; ++py)
+		{
+			for (int32_t px = minX; px <= maxX; ++px)
+			{
+				// texel centers only, first triangle wins on shared edges
+				const auto cx = px + 0.5f;
+				const auto cy = py + 0.5f;
+
+				const auto b0 = ((x[2] - x[1]) * (cy - y[1]) - (y[2] - y[1]) * (cx - x[1])) / area;
+				const auto b1 = ((x[0] - x[2]) * (cy - y[2]) - (y[0] - y[2]) * (cx - x[2])) / area;
+				const auto b2 = 1.0f - b0 - b1;
+				if (b0 < -1e-5f || b1 < -1e-5f || b2 < -1e-5f)
+					continue;
+
+				auto& texelIndex = m_texelMap[py * width + px];
+				if (texelIndex >= 0)
+					continue;
+
+				texelIndex = (int32_t)m_texels.size();
+
+				Texel texel;
+				texel.x = px;
+				texel.y = py;
+
+				for (uint32_t k = 0; k < 3; ++k)
+				{
+					texel.position[k] = b0 * p0[k] + b1 * p1[k] + b2 * p2[k];
+					texel.normal[k] = hasNormals ? (b0 * mesh.normals[3 * i0 + k] + b1 * mesh.normals[3 * i1 + k] + b2 * mesh.normals[3 * i2 + k]) : faceNormal[k];
+				}
+
+				Normalize(texel.normal);
+				m_texels.push_back(texel);
+			}
+		}
+	}
+
+	// tiles, empty ones are not kept
+	const auto tileSize = m_settings.tileSize;
+	const auto tilesX = (width + tileSize - 1) / tileSize;
+	const auto tilesY = (height + tileSize - 1) / tileSize;
+
+	m_tiles.clear();
+	m_tiles.resize((size_t)tilesX * tilesY);
+
+	for (uint32_t i = 0; i < m_texels.size(); ++i)
+	{
+		const auto& texel = m_texels[i];
+		m_tiles[(texel.y / tileSize) * tilesX + (texel.x / tileSize)].push_back(i);
+	}
+
+	m_tiles.erase(std::remove_if(m_tiles.begin(), m_tiles.end(), [](const std::vector<uint32_t>& tile) { return tile.empty(); }), m_tiles.end());
+
+	m_stats.numTexels = (uint32_t)m_texels.size();
+}
+
+bool LightmapBaker::bakePass()
+{
+	if (m_texels.empty())
+		return true;
+
+	// bounce light comes from the earlier passes so the result does not depend on the order the tiles are baked in
+	// the lookup is rebuilt after 1, 2, 4, 8... passes, the last generation gets at least half of the passes to converge
+	const auto passIndex = m_stats.numPasses;
+	if (m_settings.indirect && passIndex && (passIndex & (passIndex - 1)) == 0)
+	{
+		m_bounceLookup = irradianceImage(2);
+		m_bounceGeneration += 1;
+	}
+
+	m_numRays = 0;
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	m_workers.parallelFor((uint32_t)m_tiles.size(), [this](uint32_t tileIndex) { bakeTile(tileIndex); });
+
+	m_stats.seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	m_stats.numRays += m_numRays;
+	m_stats.numPasses += 1;
+
+	m_stats.numConvergedTexels = 0;
+	m_stats.maxRelativeError = 0.0f;
+
+	double errorSum = 0.0;
+	for (const auto& texel : m_texels)
+	{
+		m_stats.numConvergedTexels += texel.converged ? 1 : 0;
+		m_stats.maxRelativeError = std::max(m_stats.maxRelativeError, texel.relativeError);
+		errorSum += texel.relativeError;
+	}
+
+	m_stats.meanRelativeError = (float)(errorSum / m_texels.size());
+
+	return m_stats.numConvergedTexels == m_stats.numTexels;
+}
+
+bool LightmapBaker::bake()
+{
+	while (m_stats.numPasses < m_settings.maxPasses)
+		if (bakePass())
+			return true;
+
+	return false;
+}
+
+void LightmapBaker::bakeTile(uint32_t tileIndex)
+{
+	uint64_t numRays = 0;
+
+	for (const auto texelIndex : m_tiles[tileIndex])
+	{
+		auto& texel = m_texels[texelIndex];
+		if (!texel.converged)
+			bakeTexel(texel, texelIndex, numRays);
+	}
+
+	m_numRays += numRays;
+}
+
+void LightmapBaker::bakeTexel(Texel& texel, uint32_t texelIndex, uint64_t& numRays) const
+{
+	const auto numSamples = m_settings.samplesPerPass;
+
+	TexelSampler sampler(m_settings.seed, texelIndex, texel.numPasses);
+
+	// averaging bounce light of the new lookup with the older (darker) ones would bias it low, the noise estimate as well
+	if (texel.bounceGeneration != m_bounceGeneration)
+	{
+		if (texel.hitBounce)
+		{
+			texel.bounceSum[0] = texel.bounceSum[1] = texel.bounceSum[2] = 0.0;
+			texel.luminanceSum = 0.0;
+			texel.luminanceSumSq = 0.0;
+			texel.numBouncePasses = 0;
+			texel.hitBounce = false;
+		}
+
+		texel.bounceGeneration = m_bounceGeneration;
+	}
+
+	const auto* n = texel.normal;
+	float t[3], b[3];
+	const float axis[3] = { fabsf(n[0]) > 0.9f ? 0.0f : 1.0f, fabsf(n[0]) > 0.9f ? 1.0f : 0.0f, 0.0f };
+	Cross(n, axis, t);
+	Normalize(t);
+	Cross(n, t, b);
+
+	float origin[3];
+	for (uint32_t k = 0; k < 3; ++k)
+		origin[k] = texel.position[k] + n[k] * m_settings.rayBias;
+
+	RTCIntersectContext context;
+	rtcInitIntersectContext(&context);
+	context.flags = RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT;
+
+	// AO, occluded rays get tfar = -inf
+	uint32_t numVisible = 0;
+	for (uint32_t batch = 0; batch < numSamples; batch += 8)
+	{
+		RTCRay8 rays;
+		int valid[8];
+
+		for (uint32_t i = 0; i < 8; ++i)
+		{
+			float dir[3];
+			CosineSample(sampler, n, t, b, dir);
+
+			rays.org_x[i] = origin[0];
+			rays.org_y[i] = origin[1];
+			rays.org_z[i] = origin[2];
+			rays.dir_x[i] = dir[0];
+			rays.dir_y[i] = dir[1];
+			rays.dir_z[i] = dir[2];
+			rays.tnear[i] = 0.0f;
+			rays.tfar[i] = m_settings.aoDistance;
+			rays.time[i] = 0.0f;
+			rays.mask[i] = 0xFFFFFFFF;
+			rays.id[i] = i;
+			rays.flags[i] = 0;
+			valid[i] = -1;
+		}
+
+		rtcOccluded8(valid, m_scene, &context, &rays);
+
+		for (uint32_t i = 0; i < 8; ++i)
+			numVisible += (rays.tfar[i] >= 0.0f) ? 1 : 0;
+	}
+
+	// sky and one bounce, with cosine sampling the irradiance is PI times the mean incoming radiance
+	float skyRadiance[3] = { 0.0f, 0.0f, 0.0f };
+	float bounceRadiance[3] = { 0.0f, 0.0f, 0.0f };
+	for (uint32_t batch = 0; batch < numSamples; batch += 16)
+	{
+		RTCRayHit16 rays;
+		int valid[16];
+
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			float dir[3];
+			CosineSample(sampler, n, t, b, dir);
+
+			rays.ray.org_x[i] = origin[0];
+			rays.ray.org_y[i] = origin[1];
+			rays.ray.org_z[i] = origin[2];
+			rays.ray.dir_x[i] = dir[0];
+			rays.ray.dir_y[i] = dir[1];
+			rays.ray.dir_z[i] = dir[2];
+			rays.ray.tnear[i] = 0.0f;
+			rays.ray.tfar[i] = INFINITY;
+			rays.ray.time[i] = 0.0f;
+			rays.ray.mask[i] = 0xFFFFFFFF;
+			rays.ray.id[i] = i;
+			rays.ray.flags[i] = 0;
+			rays.hit.geomID[i] = RTC_INVALID_GEOMETRY_ID;
+			rays.hit.primID[i] = RTC_INVALID_GEOMETRY_ID;
+			rays.hit.instID[0][i] = RTC_INVALID_GEOMETRY_ID;
+			valid[i] = -1;
+		}
+
+		rtcIntersect16(valid, m_scene, &context, &rays);
+
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			const auto geomID = rays.hit.geomID[i];
+			if (geomID == RTC_INVALID_GEOMETRY_ID)
+			{
+				for (uint32_t k = 0; k < 3; ++k)
+					skyRadiance[k] += m_settings.sky[k];
+			}
+			else if (m_settings.indirect && geomID == m_geomID)
+			{
+				// only the front side reflects
+				const auto primID = rays.hit.primID[i];
+				const auto* faceNormal = &m_faceNormals[3 * primID];
+				if (rays.ray.dir_x[i] * faceNormal[0] + rays.ray.dir_y[i] * faceNormal[1] + rays.ray.dir_z[i] * faceNormal[2] < 0.0f)
+				{
+					float bounce[3];
+					lookupBounce(primID, rays.hit.u[i], rays.hit.v[i], bounce);
+
+					for (uint32_t k = 0; k < 3; ++k)
+						bounceRadiance[k] += bounce[k] * m_settings.albedo[k] / PI;
+
+					texel.hitBounce = true;
+				}
+			}
+		}
+	}
+
+	numRays += 2 * numSamples;
+
+	float irradiance[3];
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		const auto direct = PI * skyRadiance[k] / numSamples;
+		const auto bounce = PI * bounceRadiance[k] / numSamples;
+		texel.directSum[k] += direct;
+		texel.bounceSum[k] += bounce;
+		irradiance[k] = direct + bounce;
+	}
+
+	const auto luminance = Luminance(irradiance);
+	texel.luminanceSum += luminance;
+	texel.luminanceSumSq += (double)luminance * luminance;
+	texel.aoSum += numVisible / (double)numSamples;
+	texel.numPasses += 1;
+	texel.numBouncePasses += 1;
+
+	// standard error of the mean of the per pass estimates, only the passes made with the current bounce lookup
+	const auto count = texel.numBouncePasses;
+	if (count >= m_settings.minPasses)
+	{
+		const auto mean = texel.luminanceSum / count;
+		const auto variance = std::max(0.0, (texel.luminanceSumSq - texel.luminanceSum * mean) / (count - 1));
+		const auto error = sqrt(variance / count);
+
+		texel.relativeError = (float)((mean > 1e-6) ? (error / mean) : (error > 1e-6 ? 1.0 : 0.0));
+		texel.converged = texel.relativeError < m_settings.targetError;
+	}
+}
+
+void LightmapBaker::lookupBounce(uint32_t primID, float u, float v, float* outRGB) const
+{
+	outRGB[0] = outRGB[1] = outRGB[2] = 0.0f;
+
+	if (3 * primID + 2 >= m_indices.size())
+		return;
+
+	const auto* uv0 = &m_uvs[2 * m_indices[3 * primID + 0]];
+	const auto* uv1 = &m_uvs[2 * m_indices[3 * primID + 1]];
+	const auto* uv2 = &m_uvs[2 * m_indices[3 * primID + 2]];
+
+	// Embree barycentrics: p = (1 - u - v) * p0 + u * p1 + v * p2
+	const auto w = 1.0f - u - v;
+	const auto tu = w * uv0[0] + u * uv1[0] + v * uv2[0];
+	const auto tv = w * uv0[1] + u * uv1[1] + v * uv2[1];
+
+	const auto px = std::clamp<int32_t>((int32_t)(tu * m_width), 0, m_width - 1);
+	const auto py = std::clamp<int32_t>((int32_t)(tv * m_height), 0, m_height - 1);
+
+	const auto* pixel = &m_bounceLookup[3 * ((size_t)py * m_width + px)];
+	outRGB[0] = pixel[0];
+	outRGB[1] = pixel[1];
+	outRGB[2] = pixel[2];
+}
+
+//--
+
+bool LightmapBaker::hasTexel(uint32_t x, uint32_t y) const
+{
+	return x < m_width && y < m_height && m_texelMap[y * m_width + x] >= 0;
+}
+
+void LightmapBaker::irradiance(uint32_t x, uint32_t y, float* outRGB) const
+{
+	outRGB[0] = outRGB[1] = outRGB[2] = 0.0f;
+
+	if (hasTexel(x, y))
+	{
+		const auto& texel = m_texels[m_texelMap[y * m_width + x]];
+		if (texel.numPasses)
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+				outRGB[k] = (float)(texel.directSum[k] / texel.numPasses);
+		}
+
+		if (texel.numBouncePasses)
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+				outRGB[k] += (float)(texel.bounceSum[k] / texel.numBouncePasses);
+		}
+	}
+}
+
+float LightmapBaker::ao(uint32_t x, uint32_t y) const
+{
+	if (hasTexel(x, y))
+	{
+		const auto& texel = m_texels[m_texelMap[y * m_width + x]];
+		if (texel.numPasses)
+			return (float)(texel.aoSum / texel.numPasses);
+	}
+
+	return 0.0f;
+}
+
+float LightmapBaker::relativeError(uint32_t x, uint32_t y) const
+{
+	return hasTexel(x, y) ? m_texels[m_texelMap[y * m_width + x]].relativeError : 0.0f;
+}
+
+void LightmapBaker::texelPosition(uint32_t x, uint32_t y, float* outXYZ) const
+{
+	outXYZ[0] = outXYZ[1] = outXYZ[2] = 0.0f;
+
+	if (hasTexel(x, y))
+	{
+		const auto& texel = m_texels[m_texelMap[y * m_width + x]];
+		outXYZ[0] = texel.position[0];
+		outXYZ[1] = texel.position[1];
+		outXYZ[2] = texel.position[2];
+	}
+}
+
+std::vector<float> LightmapBaker::irradianceImage(uint32_t dilateSteps) const
+{
+	std::vector<float> ret((size_t)m_width * m_height * 3, 0.0f);
+
+	for (const auto& texel : m_texels)
+		irradiance(texel.x, texel.y, &ret[3 * ((size_t)texel.y * m_width + texel.x)]);
+
+	dilate(ret, 3, dilateSteps);
+	return ret;
+}
+
+std::vector<float> LightmapBaker::aoImage(uint32_t dilateSteps) const
+{
+	std::vector<float> ret((size_t)m_width * m_height, 0.0f);
+
+	for (const auto& texel : m_texels)
+		ret[(size_t)texel.y * m_width + texel.x] = ao(texel.x, texel.y);
+
+	dilate(ret, 1, dilateSteps);
+	return ret;
+}
+
+void LightmapBaker::dilate(std::vector<float>& image, uint32_t numChannels, uint32_t steps) const
+{
+	std::vector<uint8_t> valid(m_texelMap.size());
+	for (size_t i = 0; i < valid.size(); ++i)
+		valid[i] = m_texelMap[i] >= 0;
+
+	for (uint32_t step = 0; step < steps; ++step)
+	{
+		auto source = image;
+		auto sourceValid = valid;
+
+		for (uint32_t y = 0; y < m_height; ++y)
+		{
+			for (uint32_t x = 0; x < m_width; ++x)
+			{
+				const auto index = (size_t)y * m_width + x;
+				if (sourceValid[index])
+					continue;
+
+				float sum[3] = { 0.0f, 0.0f, 0.0f };
+				uint32_t count = 0;
+
+				for (int32_t dy = -1; dy <= 1; ++dy)
+				{
+					for (int32_t dx = -1; dx <= 1; ++dx)
+					{
+						const auto nx = (int32_t)x + dx;
+						const auto ny = (int32_t)y + dy;
+						if (nx < 0 || ny < 0 || nx >= (int32_t)m_width || ny >= (int32_t)m_height)
+							continue;
+
+						const auto neighbor = (size_t)ny * m_width + nx;
+						if (!sourceValid[neighbor])
+							continue;
+
+						for (uint32_t k = 0; k < numChannels; ++k)
+							sum[k] += source[neighbor * numChannels + k];
+						count += 1;
+					}
+				}
+
+				if (count)
+				{
+					for (uint32_t k = 0; k < numChannels; ++k)
+						image[index * numChannels + k] = sum[k] / count;
+					valid[index] = 1;
+				}
+			}
+		}
+	}
+}
+
+bool LightmapBaker::saveHDR(const std::filesystem::path& path, uint32_t dilateSteps) const
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	const auto image = irradianceImage(dilateSteps);
+
+	file << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << m_height << " +X " << m_width << "\n";
+
+	// flat scanlines, no RLE
+	std::vector<uint8_t> row(m_width * 4);
+	for (uint32_t y = 0; y < m_height; ++y)
+	{
+		for (uint32_t x = 0; x < m_width; ++x)
+		{
+			const auto* rgb = &image[3 * ((size_t)y * m_width + x)];
+			auto* rgbe = &row[4 * x];
+
+			const auto maxValue = std::max({ rgb[0], rgb[1], rgb[2] });
+			if (maxValue < 1e-32f)
+			{
+				rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+			}
+			else
+			{
+				int exponent = 0;
+				const auto scale = frexpf(maxValue, &exponent) * 256.0f / maxValue;
+				rgbe[0] = (uint8_t)(rgb[0] * scale);
+				rgbe[1] = (uint8_t)(rgb[1] * scale);
+				rgbe[2] = (uint8_t)(rgb[2] * scale);
+				rgbe[3] = (uint8_t)(exponent + 128);
+			}
+		}
+
+		file.write((const char*)row.data(), row.size());
+	}
+
+	return (bool)file;
+}
+
+//--
@@ -0,0 +1,152 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#pragma once
+
+#include "ray_benchmark.h"
+
+#include <atomic>
+
+class JobSystem;
+
+//--
+
+// Mesh to bake, UVs are the lightmap UVs (charts already packed into [0,1])
+struct LightmapMesh
+{
+	RayMesh geometry;
+	std::vector<float> uvs; // uv, one per vertex, v = 0 is the first row of the lightmap
+	std::vector<float> normals; // xyz, one per vertex, optional - face normals are used if empty
+};
+
+struct LightmapBakeSettings
+{
+	uint32_t tileSize = 16; // texels are grouped into tiles of tileSize x tileSize, each tile is one job
+	uint32_t samplesPerPass = 32; // AO and indirect rays per texel in each pass, rounded up to 16
+	uint32_t minPasses = 4; // noise estimate is not trusted before that
+	uint32_t maxPasses = 64;
+	float targetError = 0.01f; // texel stops when the standard error of its irradiance is below this fraction of the value
+	float aoDistance = 1e30f; // occlusion rays are only traced this far
+	float rayBias = 1e-3f; // ray origin offset along the normal
+	float sky[3] = { 1.0f, 1.0f, 1.0f }; // uniform sky radiance
+	float albedo[3] = { 0.5f, 0.5f, 0.5f }; // of the baked mesh, other geometry is black
+	bool indirect = true; // bounce light from the baked mesh (using the lightmap of the earlier passes, updated after 1, 2, 4, 8... passes)
+	uint32_t seed = 1;
+};
+
+struct LightmapBakeStats
+{
+	uint32_t numTexels = 0;
+	uint32_t numConvergedTexels = 0;
+	uint32_t numPasses = 0;
+	uint64_t numRays = 0;
+	double seconds = 0.0; // tracing passes only
+	float maxRelativeError = 0.0f; // over all texels
+	float meanRelativeError = 0.0f;
+
+	inline double mraysPerSecond() const { return seconds > 0.0 ? (numRays / seconds) / 1000000.0 : 0.0; }
+};
+
+// Progressive CPU lightmap baker
+// - texel centers are rasterized in UV space, each texel gets a world position and normal
+// - AO uses cosine weighted rtcOccluded8 packets, sky and bounce light use rtcIntersect16 packets
+// - texels are grouped into tiles and tiles are distributed over the job system workers
+// - every pass adds samples to the texels that have not converged yet, the noise is estimated from the variance between passes
+// - sky and bounce light are accumulated separately, the bounce estimate of a texel restarts whenever the bounce lookup it used changes
+// Output is HDR irradiance (the incoming light, multiply by albedo / PI for the outgoing radiance) and AO
+class LightmapBaker
+{
+public:
+	LightmapBaker(RTCScene scene, JobSystem& workers, const LightmapBakeSettings& settings = LightmapBakeSettings());
+	~LightmapBaker();
+
+	LightmapBaker(const LightmapBaker&) = delete;
+	LightmapBaker& operator=(const LightmapBaker&) = delete;
+
+	inline uint32_t width() const { return m_width; }
+	inline uint32_t height() const { return m_height; }
+	inline const LightmapBakeSettings& settings() const { return m_settings; }
+	inline const LightmapBakeStats& stats() const { return m_stats; }
+
+	// Rasterize the mesh into a width x height lightmap, geomID is the ID of the mesh in the scene (used for the bounce lookups)
+	void setMesh(const LightmapMesh& mesh, uint32_t geomID, uint32_t width, uint32_t height);
+
+	// Trace one pass, returns true when all texels converged
+	bool bakePass();
+
+	// Trace passes until everything converges or maxPasses is reached, returns true if converged
+	bool bake();
+
+	//--
+
+	// Is the pixel covered by a texel
+	bool hasTexel(uint32_t x, uint32_t y) const;
+
+	// Current estimates for a texel, zero if not covered
+	void irradiance(uint32_t x, uint32_t y, float* outRGB) const;
+	float ao(uint32_t x, uint32_t y) const;
+	float relativeError(uint32_t x, uint32_t y) const;
+
+	// World space position of the texel center
+	void texelPosition(uint32_t x, uint32_t y, float* outXYZ) const;
+
+	// RGB float image, pixels without texels are filled from the neighbors (dilateSteps times) so bilinear filtering does not bleed black into the charts
+	std::vector<float> irradianceImage(uint32_t dilateSteps = 2) const;
+	std::vector<float> aoImage(uint32_t dilateSteps = 2) const;
+
+	// Radiance HDR (RGBE), readable by most image tools
+	bool saveHDR(const std::filesystem::path& path, uint32_t dilateSteps = 2) const;
+
+private:
+	struct Texel
+	{
+		float position[3];
+		float normal[3];
+		uint32_t x = 0, y = 0;
+
+		double directSum[3] = { 0.0, 0.0, 0.0 }; // sum of per pass sky light estimates, all passes
+		double bounceSum[3] = { 0.0, 0.0, 0.0 }; // sum of per pass bounce light estimates since the restart
+		double luminanceSum = 0.0; // per pass sky + bounce since the restart
+		double luminanceSumSq = 0.0;
+		double aoSum = 0.0;
+		uint32_t numPasses = 0;
+		uint32_t numBouncePasses = 0; // since the restart
+		uint32_t bounceGeneration = 0; // of the lookup used by the bounce estimate
+		bool hitBounce = false; // the bounce estimate depends on the lookup
+		float relativeError = 1.0f;
+		bool converged = false;
+	};
+
+	RTCScene m_scene = nullptr;
+	JobSystem& m_workers;
+	LightmapBakeSettings m_settings;
+	LightmapBakeStats m_stats;
+
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	uint32_t m_geomID = RTC_INVALID_GEOMETRY_ID;
+
+	std::vector<float> m_uvs; // per vertex, for the bounce lookups
+	std::vector<uint32_t> m_indices;
+	std::vector<float> m_faceNormals;
+
+	std::vector<Texel> m_texels;
+	std::vector<int32_t> m_texelMap; // pixel -> texel index, -1 if not covered
+	std::vector<std::vector<uint32_t>> m_tiles; // texel indices
+
+	std::vector<float> m_bounceLookup; // irradiance of the earlier passes, dilated
+	uint32_t m_bounceGeneration = 0; // incremented every time the lookup is rebuilt
+
+	std::atomic<uint64_t> m_numRays = 0;
+
+	void bakeTile(uint32_t tileIndex);
+	void bakeTexel(Texel& texel, uint32_t texelIndex, uint64_t& numRays) const;
+
+	void lookupBounce(uint32_t primID, float u, float v, float* outRGB) const;
+	void dilate(std::vector<float>& image, uint32_t numChannels, uint32_t steps) const;
+};
+
+//--
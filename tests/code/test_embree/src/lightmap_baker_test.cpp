@@ -0,0 +1,456 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "lightmap_baker.h"
+#include "commit_pool.h"
+#include "test_data.h"
+
+#include <cmath>
+#include <fstream>
+
+//--
+
+static const float PI = 3.14159265358979f;
+
+// Quad p0-p1-p2-p3, front side is cross(p1 - p0, p2 - p0), UVs map p0 to (u0, v0) and p2 to (u1, v1)
+static void AddQuad(LightmapMesh& mesh, const float* p0, const float* p1, const float* p2, const float* p3, float u0, float v0, float u1, float v1)
+{
+	const auto base = mesh.geometry.numVertices();
+
+	for (const auto* p : { p0, p1, p2, p3 })
+		mesh.geometry.positions.insert(mesh.geometry.positions.end(), p, p + 3);
+
+	const float uvs[8] = { u0, v0, u0, v1, u1, v1, u1, v0 };
+	mesh.uvs.insert(mesh.uvs.end(), uvs, uvs + 8);
+
+	const uint32_t indices[6] = { base + 0, base + 1, base + 2, base + 0, base + 2, base + 3 };
+	mesh.geometry.indices.insert(mesh.geometry.indices.end(), indices, indices + 6);
+}
+
+// Floor of size x size at y = 0 facing up, centered at the origin
+static void BuildFloor(float size, LightmapMesh& outMesh)
+{
+	const auto h = size * 0.5f;
+	const float p0[3] = { -h, 0.0f, -h };
+	const float p1[3] = { -h, 0.0f, h };
+	const float p2[3] = { h, 0.0f, h };
+	const float p3[3] = { h, 0.0f, -h };
+	AddQuad(outMesh, p0, p1, p2, p3, 0.0f, 0.0f, 1.0f, 1.0f);
+}
+
+// Walls (and the ceiling) of a room around the floor
+static void BuildRoomWalls(float size, float height, bool ceiling, RayMesh& outMesh)
+{
+	const auto h = size * 0.5f;
+	const float corners[4][2] = { { -h, -h }, { h, -h }, { h, h }, { -h, h } };
+
+	// with a ceiling everything overlaps a bit so no ray can sneak out through the edges
+	const auto top = ceiling ? height * 1.05f : height;
+	const auto ch = ceiling ? h * 1.05f : h;
+
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		const auto* a = corners[i];
+		const auto* b = corners[(i + 1) % 4];
+
+		const auto base = outMesh.numVertices();
+		const float positions[12] = { a[0], 0.0f, a[1], b[0], 0.0f, b[1], b[0], top, b[1], a[0], top, a[1] };
+		outMesh.positions.insert(outMesh.positions.end(), positions, positions + 12);
+
+		const uint32_t indices[6] = { base + 0, base + 1, base + 2, base + 0, base + 2, base + 3 };
+		outMesh.indices.insert(outMesh.indices.end(), indices, indices + 6);
+	}
+
+	if (ceiling)
+	{
+		const auto base = outMesh.numVertices();
+		const float positions[12] = { -ch, height, -ch, ch, height, -ch, ch, height, ch, -ch, height, ch };
+		outMesh.positions.insert(outMesh.positions.end(), positions, positions + 12);
+
+		const uint32_t indices[6] = { base + 0, base + 1, base + 2, base + 0, base + 2, base + 3 };
+		outMesh.indices.insert(outMesh.indices.end(), indices, indices + 6);
+	}
+}
+
+// Cosine weighted fraction of the hemisphere of a point on the floor seen through a centered size x size opening at given height
+static float AnalyticOpeningAO(float size, float height)
+{
+	// form factor from a differential area to a parallel rectangle above its corner, 4 quadrants
+	const auto x = (size * 0.5f) / height;
+	const auto sx = sqrtf(1.0f + x * x);
+	const auto quadrant = (1.0f / (2.0f * PI)) * 2.0f * (x / sx) * atanf(x / sx);
+	return 4.0f * quadrant;
+}
+
+class LightmapBakerTest : public ::testing::Test
+{
+protected:
+	RTCDevice device = nullptr;
+	JobSystem workers;
+
+	virtual void SetUp() override
+	{
+		device = rtcNewDevice("");
+		ASSERT_NE(nullptr, device);
+	}
+
+	virtual void TearDown() override
+	{
+		rtcReleaseDevice(device);
+	}
+};
+
+//--
+
+TEST_F(LightmapBakerTest, RasterizesEveryTexelOnce)
+{
+	LightmapMesh floor;
+	BuildFloor(4.0f, floor);
+
+	RayScene scene(device);
+	const auto geomID = scene.addMesh(floor.geometry);
+	scene.commit();
+
+	LightmapBaker baker(scene, workers);
+	baker.setMesh(floor, geomID, 32, 32);
+
+	EXPECT_EQ(32 * 32, baker.stats().numTexels);
+
+	for (uint32_t y = 0; y < 32; ++y)
+	{
+		for (uint32_t x = 0; x < 32; ++x)
+		{
+			ASSERT_TRUE(baker.hasTexel(x, y));
+
+			float pos[3];
+			baker.texelPosition(x, y, pos);
+			EXPECT_NEAR(-2.0f + (x + 0.5f) * 4.0f / 32.0f, pos[0], 1e-4f);
+			EXPECT_NEAR(0.0f, pos[1], 1e-4f);
+			EXPECT_NEAR(-2.0f + (y + 0.5f) * 4.0f / 32.0f, pos[2], 1e-4f);
+		}
+	}
+}
+
+TEST_F(LightmapBakerTest, OpenRoomAOMatchesAnalytic)
+{
+	const auto size = 4.0f;
+	const auto height = 2.0f;
+
+	LightmapMesh floor;
+	BuildFloor(size, floor);
+
+	RayMesh walls;
+	BuildRoomWalls(size, height, false, walls);
+
+	RayScene scene(device);
+	const auto geomID = scene.addMesh(floor.geometry);
+	scene.addMesh(walls);
+	scene.commit();
+
+	LightmapBakeSettings settings;
+	settings.indirect = false;
+	settings.samplesPerPass = 256;
+	settings.maxPasses = 32;
+	settings.targetError = 0.0f; // run all passes
+
+	// odd size so there is a texel exactly in the middle of the floor
+	LightmapBaker baker(scene, workers, settings);
+	baker.setMesh(floor, geomID, 17, 17);
+	EXPECT_FALSE(baker.bake());
+	EXPECT_EQ(32, baker.stats().numPasses);
+
+	float pos[3];
+	baker.texelPosition(8, 8, pos);
+	EXPECT_NEAR(0.0f, pos[0], 1e-4f);
+	EXPECT_NEAR(0.0f, pos[2], 1e-4f);
+
+	// 8192 samples, one sigma of the binomial estimate is ~0.0055
+	const auto expected = AnalyticOpeningAO(size, height);
+	EXPECT_NEAR(expected, baker.ao(8, 8), 0.025f);
+
+	// sky visibility without bounces is the same thing
+	float irradiance[3];
+	baker.irradiance(8, 8, irradiance);
+	EXPECT_NEAR(PI * expected, irradiance[0], PI * 0.025f);
+	EXPECT_LT(baker.relativeError(8, 8), 0.02f);
+
+	// corners see less of the sky than the middle
+	EXPECT_LT(baker.ao(0, 0), baker.ao(8, 8));
+	EXPECT_LT(baker.ao(16, 16), baker.ao(8, 8));
+}
+
+TEST_F(LightmapBakerTest, LimitedAODistance)
+{
+	LightmapMesh floor;
+	BuildFloor(4.0f, floor);
+
+	RayMesh walls;
+	BuildRoomWalls(4.0f, 2.0f, true, walls);
+
+	RayScene scene(device);
+	const auto geomID = scene.addMesh(floor.geometry);
+	scene.addMesh(walls);
+	scene.commit();
+
+	// the ceiling is further away than the AO distance - nothing is occluded in the middle
+	LightmapBakeSettings settings;
+	settings.aoDistance = 1.5f;
+	settings.maxPasses = 4;
+
+	LightmapBaker baker(scene, workers, settings);
+	baker.setMesh(floor, geomID, 17, 17);
+	baker.bake();
+
+	EXPECT_FLOAT_EQ(1.0f, baker.ao(8, 8));
+	EXPECT_LT(baker.ao(0, 0), 1.0f);
+}
+
+TEST_F(LightmapBakerTest, ClosedRoomIsDark)
+{
+	LightmapMesh floor;
+	BuildFloor(4.0f, floor);
+
+	RayMesh walls;
+	BuildRoomWalls(4.0f, 2.0f, true, walls);
+
+	RayScene scene(device);
+	const auto geomID = scene.addMesh(floor.geometry);
+	scene.addMesh(walls);
+	scene.commit();
+
+	LightmapBakeSettings settings;
+	settings.minPasses = 4;
+
+	LightmapBaker baker(scene, workers, settings);
+	baker.setMesh(floor, geomID, 16, 16);
+
+	// exact zero converges as soon as the noise estimate is trusted
+	EXPECT_TRUE(baker.bake());
+	EXPECT_EQ(4, baker.stats().numPasses);
+
+	for (uint32_t y = 0; y < 16; ++y)
+	{
+		for (uint32_t x = 0; x < 16; ++x)
+		{
+			float irradiance[3];
+			baker.irradiance(x, y, irradiance);
+			EXPECT_EQ(0.0f, baker.ao(x, y));
+			EXPECT_EQ(0.0f, irradiance[0]);
+		}
+	}
+}
+
+TEST_F(LightmapBakerTest, BounceLightFromWall)
+{
+	// floor and a wall on its x = 0 edge, both baked into the same lightmap
+	const auto size = 2.0f;
+
+	LightmapMesh mesh;
+	{
+		const float f0[3] = { 0.0f, 0.0f, 0.0f };
+		const float f1[3] = { 0.0f, 0.0f, size };
+		const float f2[3] = { size, 0.0f, size };
+		const float f3[3] = { size, 0.0f, 0.0f };
+		AddQuad(mesh, f0, f1, f2, f3, 0.0f, 0.0f, 0.5f, 1.0f);
+
+		const float w0[3] = { 0.0f, 0.0f, 0.0f };
+		const float w1[3] = { 0.0f, size, 0.0f };
+		const float w2[3] = { 0.0f, size, size };
+		const float w3[3] = { 0.0f, 0.0f, size };
+		AddQuad(mesh, w0, w1, w2, w3, 0.5f, 0.0f, 1.0f, 1.0f);
+	}
+
+	RayScene scene(device);
+	const auto geomID = scene.addMesh(mesh.geometry);
+	scene.commit();
+
+	LightmapBakeSettings settings;
+	settings.samplesPerPass = 128;
+	settings.maxPasses = 16;
+	settings.targetError = 0.0f;
+
+	const auto bakeTexel = [&](float albedo, float* outIrradiance)
+	{
+		settings.albedo[0] = settings.albedo[1] = settings.albedo[2] = albedo;
+
+		LightmapBaker baker(scene, workers, settings);
+		baker.setMesh(mesh, geomID, 32, 16);
+		baker.bake();
+
+		// floor texel next to the wall
+		baker.irradiance(0, 8, outIrradiance);
+	};
+
+	float black[3], white[3];
+	bakeTexel(0.0f, black);
+	bakeTexel(0.8f, white);
+
+	// half of the hemisphere is blocked by the wall near the corner
+	EXPECT_LT(black[0], PI * 0.7f);
+
+	// reference from a radiosity solution of the same floor and wall (32x32 patches each, converged bounces):
+	// 1.641 of sky light and 1.049 of bounce light with albedo 0.8, the bounce of the last 8 passes (1024 samples) has ~3% noise
+	EXPECT_NEAR(1.641f, black[0], 0.15f);
+	EXPECT_NEAR(1.049f, white[0] - black[0], 0.1f);
+
+	// energy conservation
+	EXPECT_LT(white[0], PI);
+}
+
+TEST_F(LightmapBakerTest, SameResultOnAnyThreadCount)
+{
+	LightmapMesh floor;
+	BuildFloor(4.0f, floor);
+
+	RayMesh walls;
+	BuildRoomWalls(4.0f, 2.0f, false, walls);
+
+	RayScene scene(device);
+	const auto geomID = scene.addMesh(floor.geometry);
+	scene.addMesh(walls);
+	scene.commit();
+
+	LightmapBakeSettings settings;
+	settings.maxPasses = 8;
+
+	std::vector<float> reference;
+	for (const auto numThreads : { 1, 3, 8 })
+	{
+		JobSystem pool(numThreads);
+		LightmapBaker baker(scene, pool, settings);
+		baker.setMesh(floor, geomID, 16, 16);
+		baker.bake();
+
+		const auto image = baker.irradianceImage();
+		if (reference.empty())
+			reference = image;
+		else
+			EXPECT_EQ(reference, image) << numThreads << " threads";
+	}
+}
+
+TEST_F(LightmapBakerTest, NoiseEstimateDecreases)
+{
+	LightmapMesh floor;
+	BuildFloor(4.0f, floor);
+
+	RayMesh walls;
+	BuildRoomWalls(4.0f, 2.0f, false, walls);
+
+	RayScene scene(device);
+	const auto geomID = scene.addMesh(floor.geometry);
+	scene.addMesh(walls);
+	scene.commit();
+
+	LightmapBakeSettings settings;
+	settings.targetError = 0.0f;
+	settings.minPasses = 4;
+
+	LightmapBaker baker(scene, workers, settings);
+	baker.setMesh(floor, geomID, 16, 16);
+
+	for (uint32_t i = 0; i < 4; ++i)
+		baker.bakePass();
+	const auto errorAfter4 = baker.stats().meanRelativeError;
+
+	for (uint32_t i = 0; i < 12; ++i)
+		baker.bakePass();
+	const auto errorAfter16 = baker.stats().meanRelativeError;
+
+	// 1/sqrt(n), with some slack for the noise of the estimate itself
+	EXPECT_LT(errorAfter16, errorAfter4 * 0.75f);
+	EXPECT_EQ(16 * 16 * 16 * 2 * settings.samplesPerPass, baker.stats().numRays);
+}
+
+TEST_F(LightmapBakerTest, SavesHDR)
+{
+	LightmapMesh floor;
+	BuildFloor(4.0f, floor);
+
+	RayScene scene(device);
+	const auto geomID = scene.addMesh(floor.geometry);
+	scene.commit();
+
+	LightmapBakeSettings settings;
+	settings.maxPasses = 4;
+
+	LightmapBaker baker(scene, workers, settings);
+	baker.setMesh(floor, geomID, 8, 4);
+	baker.bake();
+
+	const auto path = std::filesystem::temp_directory_path() / "embree_lightmap_test.hdr";
+	ASSERT_TRUE(baker.saveHDR(path));
+
+	std::ifstream file(path, std::ios::binary);
+	std::string magic;
+	std::getline(file, magic);
+	EXPECT_EQ("#?RADIANCE", magic);
+
+	const std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y 4 +X 8\n";
+	EXPECT_EQ(header.size() + 8 * 4 * 4, std::filesystem::file_size(path));
+
+	file.close();
+	std::filesystem::remove(path);
+}
+
+//--
+
+TEST_F(LightmapBakerTest, DISABLED_LargeLevelBenchmark)
+{
+	// 500k triangle terrain with planar lightmap UVs, scattered props as occluders
+	LightmapMesh level;
+	GenerateTerrainMesh(512, 1000.0f, 100.0f, level.geometry);
+
+	for (size_t i = 0; i < level.geometry.positions.size(); i += 3)
+	{
+		level.uvs.push_back(level.geometry.positions[i + 0] / 1000.0f + 0.5f);
+		level.uvs.push_back(level.geometry.positions[i + 2] / 1000.0f + 0.5f);
+	}
+
+	RayMesh props;
+	RayMesh cube;
+	if (LoadFBXMesh(MakeTestDataPath("cube.fbx"), cube))
+		ScatterMesh(cube, 40, 40, 20.0f, 1.0f, 5, props);
+
+	RayScene scene(device);
+	const auto geomID = scene.addMesh(level.geometry);
+	if (props.numTriangles())
+		scene.addMesh(props);
+	scene.commit(workers);
+
+	LightmapBakeSettings settings;
+	settings.aoDistance = 50.0f;
+	settings.rayBias = 0.01f;
+	settings.maxPasses = 8;
+
+	LightmapBaker baker(scene, workers, settings);
+	baker.setMesh(level, geomID, 512, 512);
+
+	printf("Level: %llu triangles, %u texels, %u threads\n", (unsigned long long)scene.numTriangles(), baker.stats().numTexels, workers.numThreads());
+
+	while (baker.stats().numPasses < settings.maxPasses)
+	{
+		const auto raysBefore = baker.stats().numRays;
+		const auto secondsBefore = baker.stats().seconds;
+		const auto converged = baker.bakePass();
+
+		const auto& stats = baker.stats();
+		const auto passRays = stats.numRays - raysBefore;
+		const auto passSeconds = stats.seconds - secondsBefore;
+
+		printf("  pass %2u: %7.1f ms, %7.2f Mrays/s, converged %6u/%u, mean error %.4f, max error %.4f\n", stats.numPasses,
+			passSeconds * 1000.0, passSeconds > 0.0 ? passRays / passSeconds / 1000000.0 : 0.0,
+			stats.numConvergedTexels, stats.numTexels, stats.meanRelativeError, stats.maxRelativeError);
+
+		if (converged)
+			break;
+	}
+
+	printf("  total: %.1f ms, %.2f Mrays/s\n", baker.stats().seconds * 1000.0, baker.stats().mraysPerSecond());
+}
+
+//--
@@ -0,0 +1,134 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "memory_monitor.h"
+
+//--
+
+EmbreeMemoryMonitor::EmbreeMemoryMonitor(RTCDevice device, uint64_t budget)
+	: m_device(device)
+	, m_budget(budget)
+{
+	createAccount("unassigned");
+	rtcSetDeviceMemoryMonitorFunction(device, &MonitorCallback, this);
+}
+
+EmbreeMemoryMonitor::~EmbreeMemoryMonitor()
+{
+	rtcSetDeviceMemoryMonitorFunction(m_device, nullptr, nullptr);
+}
+
+void EmbreeMemoryMonitor::resetPeak()
+{
+	m_peakBytes = m_totalBytes.load();
+}
+
+uint32_t EmbreeMemoryMonitor::createAccount(const char* name)
+{
+	// NOTE: accounts are created up front, not while Embree is allocating
+	auto account = std::make_unique<Account>();
+	account->name = name;
+	m_accounts.push_back(std::move(account));
+	return (uint32_t)m_accounts.size() - 1;
+}
+
+int64_t EmbreeMemoryMonitor::accountBytes(uint32_t account) const
+{
+	return (account < m_accounts.size()) ? m_accounts[account]->bytes.load() : 0;
+}
+
+int64_t EmbreeMemoryMonitor::accountPeakBytes(uint32_t account) const
+{
+	return (account < m_accounts.size()) ? m_accounts[account]->peakBytes.load() : 0;
+}
+
+const char* EmbreeMemoryMonitor::accountName(uint32_t account) const
+{
+	return (account < m_accounts.size()) ? m_accounts[account]->name.c_str() : "";
+}
+
+void EmbreeMemoryMonitor::resetAccountPeak(uint32_t account)
+{
+	if (account < m_accounts.size())
+		m_accounts[account]->peakBytes = m_accounts[account]->bytes.load();
+}
+
+void EmbreeMemoryMonitor::printReport() const
+{
+	printf("Embree memory: %.2f MB (peak %.2f MB", m_totalBytes / (1024.0 * 1024.0), m_peakBytes / (1024.0 * 1024.0));
+	if (m_budget)
+		printf(", budget %.2f MB", m_budget / (1024.0 * 1024.0));
+	printf(", %llu allocations refused)\n", (unsigned long long)m_numRejected.load());
+
+	for (const auto& account : m_accounts)
+		printf("  %-24s %10.2f MB (peak %10.2f MB)\n", account->name.c_str(), account->bytes / (1024.0 * 1024.0), account->peakBytes / (1024.0 * 1024.0));
+}
+
+//--
+
+EmbreeMemoryMonitor::Scope::Scope(EmbreeMemoryMonitor& monitor, uint32_t account)
+	: m_monitor(monitor)
+{
+	m_previousAccount = monitor.m_activeAccount.exchange(account);
+}
+
+EmbreeMemoryMonitor::Scope::~Scope()
+{
+	m_monitor.m_activeAccount = m_previousAccount;
+}
+
+//--
+
+void EmbreeMemoryMonitor::UpdatePeak(std::atomic<int64_t>& peak, int64_t value)
+{
+	auto current = peak.load();
+	while (value > current && !peak.compare_exchange_weak(current, value))
+	{}
+}
+
+bool EmbreeMemoryMonitor::onMemory(int64_t bytes)
+{
+	// frees are always accepted, Embree never fails them
+	if (bytes > 0)
+	{
+		const auto budget = m_budget.load();
+
+		auto current = m_totalBytes.load();
+		for (;;)
+		{
+			if (budget && (uint64_t)(current + bytes) > budget)
+			{
+				// Embree cancels the operation and does not call us to undo it
+				m_numRejected += 1;
+				return false;
+			}
+
+			if (m_totalBytes.compare_exchange_weak(current, current + bytes))
+				break;
+		}
+
+		UpdatePeak(m_peakBytes, current + bytes);
+	}
+	else
+	{
+		m_totalBytes += bytes;
+	}
+
+	// frees go to the active account as well, the callback does not tell where the memory came from
+	auto& account = *m_accounts[m_activeAccount.load()];
+	const auto accountBytes = (account.bytes += bytes);
+	UpdatePeak(account.peakBytes, accountBytes);
+	return true;
+}
+
+bool EmbreeMemoryMonitor::MonitorCallback(void* userPtr, ssize_t bytes, bool post)
+{
+	// called before the allocation (post = false) and after the free (post = true)
+	return ((EmbreeMemoryMonitor*)userPtr)->onMemory((int64_t)bytes);
+}
+
+//--
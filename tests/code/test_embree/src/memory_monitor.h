@@ -0,0 +1,94 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#pragma once
+
+#define EMBREE_STATIC_LIB
+#include <embree3/rtcore.h>
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+//--
+
+// Tracks the memory Embree allocates on a device through rtcSetDeviceMemoryMonitorFunction and enforces a budget -
+// an allocation over the budget is refused so the commit (or buffer allocation) fails with RTC_ERROR_OUT_OF_MEMORY
+// right away instead of the build agent running out of memory
+// Embree does not say which scene an allocation belongs to, so allocations are charged to the account of the active scope
+// Frees don't say what is freed either and are charged to the active account as well - release scenes (and geometries)
+// inside a scope of the account they were built in, otherwise that account keeps the bytes and the active one goes negative
+// NOTE: scopes are not per thread (the BVH build allocates on the Embree worker threads), only one scope can be active at a time
+class EmbreeMemoryMonitor
+{
+public:
+	EmbreeMemoryMonitor(RTCDevice device, uint64_t budget = 0); // 0 - no budget
+	~EmbreeMemoryMonitor();
+
+	EmbreeMemoryMonitor(const EmbreeMemoryMonitor&) = delete;
+	EmbreeMemoryMonitor& operator=(const EmbreeMemoryMonitor&) = delete;
+
+	inline uint64_t budget() const { return m_budget; }
+	inline void setBudget(uint64_t budget) { m_budget = budget; }
+
+	inline int64_t totalBytes() const { return m_totalBytes; }
+	inline int64_t peakBytes() const { return m_peakBytes; }
+	inline uint64_t numRejected() const { return m_numRejected; }
+
+	void resetPeak();
+
+	//--
+
+	// Account 0 collects everything allocated outside of the scopes
+	uint32_t createAccount(const char* name);
+
+	int64_t accountBytes(uint32_t account) const;
+	int64_t accountPeakBytes(uint32_t account) const;
+	const char* accountName(uint32_t account) const;
+
+	void resetAccountPeak(uint32_t account);
+
+	// Charges everything allocated and freed while alive to the account, see the note about frees above
+	class Scope
+	{
+	public:
+		Scope(EmbreeMemoryMonitor& monitor, uint32_t account);
+		~Scope();
+
+	private:
+		EmbreeMemoryMonitor& m_monitor;
+		uint32_t m_previousAccount = 0;
+	};
+
+	void printReport() const;
+
+private:
+	struct Account
+	{
+		std::string name;
+		std::atomic<int64_t> bytes = 0;
+		std::atomic<int64_t> peakBytes = 0;
+	};
+
+	RTCDevice m_device = nullptr;
+
+	std::atomic<uint64_t> m_budget = 0;
+	std::atomic<int64_t> m_totalBytes = 0;
+	std::atomic<int64_t> m_peakBytes = 0;
+	std::atomic<uint64_t> m_numRejected = 0;
+
+	std::vector<std::unique_ptr<Account>> m_accounts;
+	std::atomic<uint32_t> m_activeAccount = 0;
+
+	bool onMemory(int64_t bytes);
+
+	static bool MonitorCallback(void* userPtr, ssize_t bytes, bool post);
+	static void UpdatePeak(std::atomic<int64_t>& peak, int64_t value);
+};
+
+//--
@@ -0,0 +1,278 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "memory_monitor.h"
+#include "ray_benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+//--
+
+class EmbreeMemoryTest : public ::testing::Test
+{
+protected:
+	RTCDevice device = nullptr;
+
+	virtual void SetUp() override
+	{
+		device = rtcNewDevice("");
+		ASSERT_NE(nullptr, device);
+	}
+
+	virtual void TearDown() override
+	{
+		rtcReleaseDevice(device);
+	}
+};
+
+//--
+
+TEST_F(EmbreeMemoryTest, BuffersAreReported)
+{
+	EmbreeMemoryMonitor monitor(device);
+	const auto baseline = monitor.totalBytes();
+
+	const uint32_t numVertices = 100000;
+	auto geometry = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE);
+	auto* vertices = rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, 3 * sizeof(float), numVertices);
+	ASSERT_NE(nullptr, vertices);
+
+	// buffer is padded a bit (SSE loads of the last vertex) and the geometry itself is allocated through the monitor as well
+	const auto allocated = monitor.totalBytes() - baseline;
+	EXPECT_GE(allocated, (int64_t)numVertices * 12);
+	EXPECT_LE(allocated, (int64_t)numVertices * 12 + 64 * 1024);
+
+	rtcReleaseGeometry(geometry);
+	EXPECT_EQ(baseline, monitor.totalBytes());
+	EXPECT_GE(monitor.peakBytes(), baseline + (int64_t)numVertices * 12);
+}
+
+TEST_F(EmbreeMemoryTest, SceneAccountingBalances)
+{
+	EmbreeMemoryMonitor monitor(device);
+	const auto small = monitor.createAccount("small");
+	const auto large = monitor.createAccount("large");
+
+	RayMesh smallMesh, largeMesh;
+	GenerateTerrainMesh(32, 100.0f, 10.0f, smallMesh);
+	GenerateTerrainMesh(256, 100.0f, 10.0f, largeMesh);
+
+	{
+		EmbreeMemoryMonitor::Scope scope(monitor, small);
+		RayScene scene(device);
+		scene.addMesh(smallMesh);
+		ASSERT_TRUE(scene.commit());
+
+		EXPECT_GT(monitor.accountBytes(small), 0);
+	}
+
+	{
+		EmbreeMemoryMonitor::Scope scope(monitor, large);
+		RayScene scene(device);
+		scene.addMesh(largeMesh);
+		ASSERT_TRUE(scene.commit());
+
+		EXPECT_GT(monitor.accountBytes(large), 0);
+	}
+
+	// everything allocated for the scene is freed when it's released (the scene was destroyed inside the scope)
+	EXPECT_EQ(0, monitor.accountBytes(small));
+	EXPECT_EQ(0, monitor.accountBytes(large));
+
+	// 64x more triangles
+	EXPECT_GT(monitor.accountPeakBytes(large), 16 * monitor.accountPeakBytes(small));
+	EXPECT_GE(monitor.peakBytes(), monitor.accountPeakBytes(large));
+}
+
+TEST_F(EmbreeMemoryTest, ReleaseOutsideOfScopeChargesActiveAccount)
+{
+	EmbreeMemoryMonitor monitor(device);
+	const auto account = monitor.createAccount("scene");
+
+	RayMesh mesh;
+	GenerateTerrainMesh(64, 100.0f, 10.0f, mesh);
+
+	auto scene = std::make_unique<RayScene>(device);
+	{
+		EmbreeMemoryMonitor::Scope scope(monitor, account);
+		scene->addMesh(mesh);
+		ASSERT_TRUE(scene->commit());
+	}
+
+	const auto sceneBytes = monitor.accountBytes(account);
+	const auto unassignedBytes = monitor.accountBytes(0);
+	EXPECT_GT(sceneBytes, 0);
+
+	// released without the scope - the scene account keeps its bytes, the frees come off the unassigned account
+	scene.reset();
+	EXPECT_EQ(sceneBytes, monitor.accountBytes(account));
+	EXPECT_LE(monitor.accountBytes(0), unassignedBytes - sceneBytes);
+
+	// the totals are right regardless
+	EXPECT_EQ(monitor.totalBytes(), monitor.accountBytes(0) + monitor.accountBytes(account));
+}
+
+TEST_F(EmbreeMemoryTest, BudgetFailsFast)
+{
+	EmbreeMemoryMonitor monitor(device);
+
+	RayMesh mesh;
+	GenerateTerrainMesh(512, 100.0f, 10.0f, mesh);
+
+	RayScene scene(device);
+	ASSERT_NE(RTC_INVALID_GEOMETRY_ID, scene.addMesh(mesh));
+
+	// ~500k triangles need way more than a MB over the geometry buffers for the BVH
+	monitor.setBudget(monitor.totalBytes() + 1024 * 1024);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	EXPECT_FALSE(scene.commit());
+	const auto commitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	EXPECT_GT(monitor.numRejected(), 0);
+	EXPECT_LE((uint64_t)monitor.peakBytes(), monitor.budget());
+	printf("Failed commit took %.2f ms\n", commitMs);
+
+	// with the budget lifted the same scene builds fine
+	monitor.setBudget(0);
+	EXPECT_TRUE(scene.commit());
+}
+
+TEST_F(EmbreeMemoryTest, BudgetRejectsBuffers)
+{
+	EmbreeMemoryMonitor monitor(device, 1024 * 1024);
+
+	RayMesh mesh;
+	GenerateTerrainMesh(1024, 100.0f, 10.0f, mesh);
+
+	RayScene scene(device);
+	EXPECT_EQ(RTC_INVALID_GEOMETRY_ID, scene.addMesh(mesh));
+	EXPECT_EQ(RTC_ERROR_OUT_OF_MEMORY, rtcGetDeviceError(device));
+	EXPECT_EQ(0, scene.numTriangles());
+}
+
+#ifndef _WIN32
+
+static int64_t ResidentBytes()
+{
+	std::ifstream file("/proc/self/statm");
+
+	uint64_t size = 0, resident = 0;
+	if (!(file >> size >> resident))
+		return -1;
+
+	return (int64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+TEST_F(EmbreeMemoryTest, MatchesResidentMemory)
+{
+	if (ResidentBytes() < 0)
+		GTEST_SKIP() << "No /proc/self/statm";
+
+	EmbreeMemoryMonitor monitor(device);
+
+	RayMesh mesh;
+	GenerateTerrainMesh(1024, 100.0f, 10.0f, mesh);
+
+	const auto residentBefore = ResidentBytes();
+	const auto monitorBefore = monitor.totalBytes();
+
+	RayScene scene(device);
+	scene.addMesh(mesh);
+	ASSERT_TRUE(scene.commit());
+
+	// build scratch memory is freed already, what's left is the geometry and the BVH, both are written so they are resident
+	const auto resident = ResidentBytes() - residentBefore;
+	const auto reported = monitor.totalBytes() - monitorBefore;
+	printf("Reported %.2f MB, resident %.2f MB\n", reported / (1024.0 * 1024.0), resident / (1024.0 * 1024.0));
+
+	// loose, the allocator keeps some of the freed build memory around and Embree reserves blocks it did not touch yet
+	EXPECT_GT(reported, 0);
+	EXPECT_GT(resident, reported / 2);
+	EXPECT_LT(resident, reported * 2 + 16 * 1024 * 1024);
+}
+
+#endif
+
+//--
+
+TEST_F(EmbreeMemoryTest, DISABLED_BuildQualityBenchmark)
+{
+	RayMesh mesh;
+	GenerateTerrainMesh(1024, 1000.0f, 100.0f, mesh);
+
+	std::vector<RTCRayHit> rays;
+	{
+		RayScene boundsScene(device);
+		boundsScene.addMesh(mesh);
+		boundsScene.commit();
+		GeneratePrimaryRays(boundsScene.bounds(), 1024, 1024, rays);
+	}
+
+	EmbreeMemoryMonitor monitor(device);
+	const auto geometryAccount = monitor.createAccount("geometry");
+	const auto bvhAccount = monitor.createAccount("bvh");
+
+	RayTraceSettings traceSettings;
+	traceSettings.api = RayAPI::Packet16;
+	traceSettings.numThreads = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+
+	printf("Build quality on %u triangles:\n", mesh.numTriangles());
+
+	const RTCBuildQuality qualities[] = { RTC_BUILD_QUALITY_LOW, RTC_BUILD_QUALITY_MEDIUM, RTC_BUILD_QUALITY_HIGH };
+	const char* qualityNames[] = { "LOW", "MEDIUM", "HIGH" };
+
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		for (const auto compact : { false, true })
+		{
+			// geometry and BVH are freed together when the scene is released so neither account gets them back,
+			// everything is measured as the difference over the scope
+			RayScene scene(device, qualities[i]);
+			scene.setFlags(compact ? RTC_SCENE_FLAG_COMPACT : RTC_SCENE_FLAG_NONE);
+
+			const auto geometryBefore = monitor.accountBytes(geometryAccount);
+			{
+				EmbreeMemoryMonitor::Scope scope(monitor, geometryAccount);
+				scene.addMesh(mesh);
+			}
+			const auto geometryBytes = monitor.accountBytes(geometryAccount) - geometryBefore;
+
+			const auto bvhBefore = monitor.accountBytes(bvhAccount);
+			bool committed = false;
+			{
+				EmbreeMemoryMonitor::Scope scope(monitor, bvhAccount);
+				monitor.resetAccountPeak(bvhAccount);
+				committed = scene.commit();
+			}
+			ASSERT_TRUE(committed);
+
+			const auto bvhBytes = monitor.accountBytes(bvhAccount) - bvhBefore;
+			const auto bvhPeakBytes = monitor.accountPeakBytes(bvhAccount) - bvhBefore;
+
+			auto tracedRays = rays;
+			const auto result = TraceRays(scene, traceSettings, tracedRays);
+
+			printf("  %-6s %-8s: BVH %6.1f B/tri (peak %7.2f MB, geometry %6.2f MB), build %7.2f ms, trace %7.2f Mrays/s\n",
+				qualityNames[i], compact ? "compact" : "", (double)bvhBytes / mesh.numTriangles(),
+				bvhPeakBytes / (1024.0 * 1024.0), geometryBytes / (1024.0 * 1024.0),
+				scene.buildTimeMs(), result.mraysPerSecond());
+		}
+	}
+
+	// per account numbers are cumulative here, the scenes were released outside of the scopes
+	monitor.printReport();
+}
+
+//--
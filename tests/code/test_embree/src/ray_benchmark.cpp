@@ -0,0 +1,697 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "ray_benchmark.h"
+#include "commit_pool.h"
+
+#include <ofbx.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <thread>
+
+//--
+
+static const float PI = 3.14159265358979f;
+
+static float HashNoise(uint32_t x, uint32_t z)
+{
+	auto h = x * 374761393u + z * 668265263u;
+	h = (h ^ (h >> 13)) * 1274126177u;
+	h ^= h >> 16;
+	return (h & 0xFFFF) / 65535.0f;
+}
+
+void GenerateTerrainMesh(uint32_t cells, float size, float height, RayMesh& outMesh)
+{
+	const auto numVerts = cells + 1;
+
+	outMesh.positions.resize((size_t)numVerts * numVerts * 3);
+	outMesh.indices.resize((size_t)cells * cells * 6);
+
+	for (uint32_t z = 0; z < numVerts; ++z)
+	{
+		for (uint32_t x = 0; x < numVerts; ++x)
+		{
+			const auto u = x / (float)cells;
+			const auto v = z / (float)cells;
+
+			// few octaves of hills plus per vertex roughness so the BVH has some real work to do
+			auto h = 0.5f * sinf(u * 7.0f) * cosf(v * 5.0f);
+			h += 0.25f * sinf(u * 23.0f + v * 17.0f);
+			h += 0.1f * sinf(u * 61.0f) * sinf(v * 53.0f);
+			h += 0.02f * HashNoise(x, z);
+
+			auto* pos = &outMesh.positions[3 * ((size_t)z * numVerts + x)];
+			pos[0] = (u - 0.5f) * size;
+			pos[1] = h * height;
+			pos[2] = (v - 0.5f) * size;
+		}
+	}
+
+	auto* index = outMesh.indices.data();
+	for (uint32_t z = 0; z < cells; ++z)
+	{
+		for (uint32_t x = 0; x < cells; ++x)
+		{
+			const auto i00 = z * numVerts + x;
+			const auto i10 = i00 + 1;
+			const auto i01 = i00 + numVerts;
+			const auto i11 = i01 + 1;
+
+			*index++ = i00;
+			*index++ = i01;
+			*index++ = i11;
+
+			*index++ = i00;
+			*index++ = i11;
+			*index++ = i10;
+		}
+	}
+}
+
+//--
+
+static bool LoadFileToBuffer(const std::filesystem::path& path, std::vector<uint8_t>& outBuffer)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return false;
+
+	const auto size = (size_t)file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	outBuffer.resize(size);
+	return (bool)file.read((char*)outBuffer.data(), size);
+}
+
+static ofbx::Matrix MultiplyMatrix(const ofbx::Matrix& a, const ofbx::Matrix& b)
+{
+	ofbx::Matrix ret;
+	for (uint32_t col = 0; col < 4; ++col)
+	{
+		for (uint32_t row = 0; row < 4; ++row)
+		{
+			double sum = 0.0;
+			for (uint32_t k = 0; k < 4; ++k)
+				sum += a.m[k * 4 + row] * b.m[col * 4 + k];
+			ret.m[col * 4 + row] = sum;
+		}
+	}
+	return ret;
+}
+
+bool LoadFBXMesh(const std::filesystem::path& path, RayMesh& outMesh)
+{
+	std::vector<uint8_t> data;
+	if (!LoadFileToBuffer(path, data))
+		return false;
+
+	auto* scene = ofbx::load(data.data(), (int)data.size(), 0);
+	if (!scene)
+		return false;
+
+	outMesh = RayMesh();
+
+	for (int meshIndex = 0; meshIndex < scene->getMeshCount(); ++meshIndex)
+	{
+		const auto* mesh = scene->getMesh(meshIndex);
+		const auto* geometry = mesh ? mesh->getGeometry() : nullptr;
+		if (!geometry)
+			continue;
+
+		const auto* vertices = geometry->getVertices();
+		const auto vertexCount = geometry->getVertexCount();
+		const auto* faceIndices = geometry->getFaceIndices();
+		const auto indexCount = geometry->getIndexCount();
+		if (!vertices || !faceIndices || indexCount < 3)
+			continue;
+
+		// column major, translation in m[12..14]
+		const auto transform = MultiplyMatrix(mesh->getGlobalTransform(), mesh->getGeometricMatrix());
+		const auto& m = transform.m;
+
+		const auto firstVertex = outMesh.numVertices();
+		for (int i = 0; i < vertexCount; ++i)
+		{
+			const auto& v = vertices[i];
+			outMesh.positions.push_back((float)(m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12]));
+			outMesh.positions.push_back((float)(m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13]));
+			outMesh.positions.push_back((float)(m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14]));
+		}
+
+		// polygons as fans, last index of the polygon is encoded as negative
+		int polygonStart = 0;
+		for (int i = 0; i < indexCount; ++i)
+		{
+			if (faceIndices[i] >= 0)
+				continue;
+
+			const auto decode = [&](int corner) { const auto index = faceIndices[corner]; return (uint32_t)(index < 0 ? -index - 1 : index); };
+			for (int j = polygonStart + 1; j < i; ++j)
+			{
+				outMesh.indices.push_back(firstVertex + decode(polygonStart));
+				outMesh.indices.push_back(firstVertex + decode(j));
+				outMesh.indices.push_back(firstVertex + decode(j + 1));
+			}
+
+			polygonStart = i + 1;
+		}
+	}
+
+	scene->destroy();
+	return outMesh.numTriangles() > 0;
+}
+
+void ScatterMesh(const RayMesh& mesh, uint32_t countX, uint32_t countZ, float spacing, float scale, uint32_t seed, RayMesh& outMesh)
+{
+	if (mesh.positions.empty())
+		return;
+
+	// copies are centered on the grid point and stand on the ground
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t i = 0; i < mesh.positions.size(); i += 3)
+	{
+		for (uint32_t j = 0; j < 3; ++j)
+		{
+			boundsMin[j] = std::min(boundsMin[j], mesh.positions[i + j]);
+			boundsMax[j] = std::max(boundsMax[j], mesh.positions[i + j]);
+		}
+	}
+
+	const float center[3] = { (boundsMin[0] + boundsMax[0]) * 0.5f, boundsMin[1], (boundsMin[2] + boundsMax[2]) * 0.5f };
+
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> heightScale(0.5f, 4.0f);
+	std::uniform_int_distribution<int> rotation(0, 3);
+
+	outMesh.positions.reserve(outMesh.positions.size() + mesh.positions.size() * countX * countZ);
+	outMesh.indices.reserve(outMesh.indices.size() + mesh.indices.size() * countX * countZ);
+
+	for (uint32_t z = 0; z < countZ; ++z)
+	{
+		for (uint32_t x = 0; x < countX; ++x)
+		{
+			const auto offsetX = (x - (countX - 1) * 0.5f) * spacing;
+			const auto offsetZ = (z - (countZ - 1) * 0.5f) * spacing;
+			const auto scaleY = scale * heightScale(rng);
+			const auto angle = rotation(rng) * PI * 0.5f;
+			const auto cosA = cosf(angle);
+			const auto sinA = sinf(angle);
+
+			const auto firstVertex = outMesh.numVertices();
+			for (size_t i = 0; i < mesh.positions.size(); i += 3)
+			{
+				const auto px = (mesh.positions[i + 0] - center[0]) * scale;
+				const auto py = (mesh.positions[i + 1] - center[1]) * scaleY;
+				const auto pz = (mesh.positions[i + 2] - center[2]) * scale;
+
+				outMesh.positions.push_back(px * cosA - pz * sinA + offsetX);
+				outMesh.positions.push_back(py);
+				outMesh.positions.push_back(px * sinA + pz * cosA + offsetZ);
+			}
+
+			for (const auto index : mesh.indices)
+				outMesh.indices.push_back(firstVertex + index);
+		}
+	}
+}
+
+//--
+
+RayScene::RayScene(RTCDevice device, RTCBuildQuality quality)
+	: m_device(device)
+	, m_quality(quality)
+{
+	m_scene = rtcNewScene(device);
+	rtcSetSceneBuildQuality(m_scene, quality);
+}
+
+RayScene::~RayScene()
+{
+	rtcReleaseScene(m_scene);
+}
+
+uint32_t RayScene::addMesh(const RayMesh& mesh)
+{
+	auto geometry = rtcNewGeometry(m_device, RTC_GEOMETRY_TYPE_TRIANGLE);
+	rtcSetGeometryBuildQuality(geometry, m_quality);
+
+	auto* vertices = rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, 3 * sizeof(float), mesh.numVertices());
+	auto* indices = rtcSetNewGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, 3 * sizeof(uint32_t), mesh.numTriangles());
+
+	// out of memory (or over the memory monitor budget)
+	if (!vertices || !indices)
+	{
+		rtcReleaseGeometry(geometry);
+		return RTC_INVALID_GEOMETRY_ID;
+	}
+
+	memcpy(vertices, mesh.positions.data(), mesh.positions.size() * sizeof(float));
+	memcpy(indices, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+
+	rtcCommitGeometry(geometry);
+
+	// scene keeps the reference
+	const auto id = rtcAttachGeometry(m_scene, geometry);
+	rtcReleaseGeometry(geometry);
+
+	m_numTriangles += mesh.numTriangles();
+	return id;
+}
+
+void RayScene::setFlags(RTCSceneFlags flags)
+{
+	rtcSetSceneFlags(m_scene, flags);
+}
+
+bool RayScene::commit()
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	rtcCommitScene(m_scene);
+	m_buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	return rtcGetDeviceError(m_device) == RTC_ERROR_NONE;
+}
+
+bool RayScene::commit(JobSystem& workers)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	JoinCommitOnWorkers(m_scene, workers);
+	m_buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	return rtcGetDeviceError(m_device) == RTC_ERROR_NONE;
+}
+
+RTCBounds RayScene::bounds() const
+{
+	RTCBounds ret;
+	rtcGetSceneBounds(m_scene, &ret);
+	return ret;
+}
+
+//--
+
+static void InitRay(RTCRayHit& ray, const float* org, const float* dir, float tnear, float tfar)
+{
+	memset(&ray, 0, sizeof(ray));
+	ray.ray.org_x = org[0];
+	ray.ray.org_y = org[1];
+	ray.ray.org_z = org[2];
+	ray.ray.dir_x = dir[0];
+	ray.ray.dir_y = dir[1];
+	ray.ray.dir_z = dir[2];
+	ray.ray.tnear = tnear;
+	ray.ray.tfar = tfar;
+	ray.ray.mask = 0xFFFFFFFF;
+	ray.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+	ray.hit.primID = RTC_INVALID_GEOMETRY_ID;
+	ray.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+}
+
+static void Normalize(float* v)
+{
+	const auto len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (len > 0.0f)
+	{
+		v[0] /= len;
+		v[1] /= len;
+		v[2] /= len;
+	}
+}
+
+static void Cross(const float* a, const float* b, float* out)
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float SceneExtent(const RTCBounds& bounds)
+{
+	return std::max(bounds.upper_x - bounds.lower_x, std::max(bounds.upper_y - bounds.lower_y, bounds.upper_z - bounds.lower_z));
+}
+
+void GeneratePrimaryRays(const RTCBounds& bounds, uint32_t width, uint32_t height, std::vector<RTCRayHit>& outRays)
+{
+	width &= ~3u;
+	height &= ~3u;
+
+	const auto extent = SceneExtent(bounds);
+	const float target[3] = { (bounds.lower_x + bounds.upper_x) * 0.5f, bounds.lower_y, (bounds.lower_z + bounds.upper_z) * 0.5f };
+	const float eye[3] = { target[0], bounds.upper_y + extent * 0.5f, target[2] - extent * 0.6f };
+
+	float forward[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+	Normalize(forward);
+
+	const float up[3] = { 0.0f, 1.0f, 0.0f };
+	float right[3], cameraUp[3];
+	Cross(up, forward, right);
+	Normalize(right);
+	Cross(forward, right, cameraUp);
+
+	const auto tanHalfFov = tanf(60.0f * 0.5f * PI / 180.0f);
+	const auto aspect = width / (float)height;
+
+	outRays.resize((size_t)width * height);
+	auto* ray = outRays.data();
+
+	for (uint32_t by = 0; by < height; by += 4)
+	{
+		for (uint32_t bx = 0; bx < width; bx += 4)
+		{
+			for (uint32_t j = 0; j < 4; ++j)
+			{
+				for (uint32_t i = 0; i < 4; ++i)
+				{
+					const auto sx = ((bx + i + 0.5f) / width * 2.0f - 1.0f) * tanHalfFov * aspect;
+					const auto sy = (1.0f - (by + j + 0.5f) / height * 2.0f) * tanHalfFov;
+
+					float dir[3];
+					for (uint32_t k = 0; k < 3; ++k)
+						dir[k] = forward[k] + right[k] * sx + cameraUp[k] * sy;
+					Normalize(dir);
+
+					InitRay(*ray++, eye, dir, 0.0f, INFINITY);
+				}
+			}
+		}
+	}
+}
+
+void GenerateDiffuseRays(const RTCBounds& bounds, const std::vector<RTCRayHit>& primaryRays, uint32_t seed, std::vector<RTCRayHit>& outRays)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	const auto epsilon = SceneExtent(bounds) * 1e-4f;
+
+	outRays.resize(primaryRays.size());
+	for (size_t i = 0; i < primaryRays.size(); ++i)
+	{
+		const auto& primary = primaryRays[i];
+
+		if (primary.hit.geomID == RTC_INVALID_GEOMETRY_ID)
+		{
+			const float org[3] = {
+				bounds.lower_x + (bounds.upper_x - bounds.lower_x) * unit(rng),
+				bounds.lower_y + (bounds.upper_y - bounds.lower_y) * unit(rng),
+				bounds.lower_z + (bounds.upper_z - bounds.lower_z) * unit(rng) };
+
+			const auto z = 1.0f - 2.0f * unit(rng);
+			const auto r = sqrtf(std::max(0.0f, 1.0f - z * z));
+			const auto phi = 2.0f * PI * unit(rng);
+			const float dir[3] = { r * cosf(phi), z, r * sinf(phi) };
+
+			InitRay(outRays[i], org, dir, 0.0f, INFINITY);
+			continue;
+		}
+
+		// geometric normal facing the incoming ray
+		float n[3] = { primary.hit.Ng_x, primary.hit.Ng_y, primary.hit.Ng_z };
+		Normalize(n);
+		if (n[0] * primary.ray.dir_x + n[1] * primary.ray.dir_y + n[2] * primary.ray.dir_z > 0.0f)
+		{
+			n[0] = -n[0];
+			n[1] = -n[1];
+			n[2] = -n[2];
+		}
+
+		float t[3], b[3];
+		const float axis[3] = { fabsf(n[0]) > 0.9f ? 0.0f : 1.0f, fabsf(n[0]) > 0.9f ? 1.0f : 0.0f, 0.0f };
+		Cross(n, axis, t);
+		Normalize(t);
+		Cross(n, t, b);
+
+		// cosine weighted hemisphere
+		const auto r = sqrtf(unit(rng));
+		const auto phi = 2.0f * PI * unit(rng);
+		const auto lx = r * cosf(phi);
+		const auto ly = r * sinf(phi);
+		const auto lz = sqrtf(std::max(0.0f, 1.0f - lx * lx - ly * ly));
+
+		float dir[3];
+		for (uint32_t k = 0; k < 3; ++k)
+			dir[k] = t[k] * lx + b[k] * ly + n[k] * lz;
+
+		const auto tHit = primary.ray.tfar;
+		const float org[3] = {
+			primary.ray.org_x + primary.ray.dir_x * tHit + n[0] * epsilon,
+			primary.ray.org_y + primary.ray.dir_y * tHit + n[1] * epsilon,
+			primary.ray.org_z + primary.ray.dir_z * tHit + n[2] * epsilon };
+
+		InitRay(outRays[i], org, dir, 0.0f, INFINITY);
+	}
+}
+
+//--
+
+const char* RayAPIName(RayAPI api)
+{
+	switch (api)
+	{
+		case RayAPI::Single: return "rtcIntersect1";
+		case RayAPI::Packet4: return "rtcIntersect4";
+		case RayAPI::Packet8: return "rtcIntersect8";
+		case RayAPI::Packet16: return "rtcIntersect16";
+		case RayAPI::Stream1M: return "rtcIntersect1M";
+		case RayAPI::Stream8M: return "rtcIntersectNM (N=8)";
+		case RayAPI::Stream16M: return "rtcIntersectNM (N=16)";
+		default: return "unknown";
+	}
+}
+
+template< typename T >
+struct RayPacketTraits;
+
+template<>
+struct RayPacketTraits<RTCRayHit4>
+{
+	static const uint32_t N = 4;
+	static void Intersect(const int* valid, RTCScene scene, RTCIntersectContext* context, RTCRayHit4* packet) { rtcIntersect4(valid, scene, context, packet); }
+};
+
+template<>
+struct RayPacketTraits<RTCRayHit8>
+{
+	static const uint32_t N = 8;
+	static void Intersect(const int* valid, RTCScene scene, RTCIntersectContext* context, RTCRayHit8* packet) { rtcIntersect8(valid, scene, context, packet); }
+};
+
+template<>
+struct RayPacketTraits<RTCRayHit16>
+{
+	static const uint32_t N = 16;
+	static void Intersect(const int* valid, RTCScene scene, RTCIntersectContext* context, RTCRayHit16* packet) { rtcIntersect16(valid, scene, context, packet); }
+};
+
+template< typename T >
+static void PackRays(const RTCRayHit* rays, uint32_t count, T& packet, int* valid)
+{
+	for (uint32_t i = 0; i < RayPacketTraits<T>::N; ++i)
+	{
+		if (i < count)
+		{
+			const auto& ray = rays[i].ray;
+			packet.ray.org_x[i] = ray.org_x;
+			packet.ray.org_y[i] = ray.org_y;
+			packet.ray.org_z[i] = ray.org_z;
+			packet.ray.tnear[i] = ray.tnear;
+			packet.ray.dir_x[i] = ray.dir_x;
+			packet.ray.dir_y[i] = ray.dir_y;
+			packet.ray.dir_z[i] = ray.dir_z;
+			packet.ray.time[i] = ray.time;
+			packet.ray.tfar[i] = ray.tfar;
+			packet.ray.mask[i] = ray.mask;
+			packet.ray.id[i] = ray.id;
+			packet.ray.flags[i] = ray.flags;
+			valid[i] = -1;
+		}
+		else
+		{
+			// padding, tnear > tfar disables the ray in the stream API that has no valid mask
+			packet.ray.org_x[i] = packet.ray.org_y[i] = packet.ray.org_z[i] = 0.0f;
+			packet.ray.dir_x[i] = packet.ray.dir_z[i] = 0.0f;
+			packet.ray.dir_y[i] = 1.0f;
+			packet.ray.time[i] = 0.0f;
+			packet.ray.tnear[i] = 0.0f;
+			packet.ray.tfar[i] = -1.0f;
+			packet.ray.mask[i] = 0;
+			packet.ray.id[i] = 0;
+			packet.ray.flags[i] = 0;
+			valid[i] = 0;
+		}
+
+		packet.hit.geomID[i] = RTC_INVALID_GEOMETRY_ID;
+		packet.hit.primID[i] = RTC_INVALID_GEOMETRY_ID;
+		packet.hit.instID[0][i] = RTC_INVALID_GEOMETRY_ID;
+	}
+}
+
+template< typename T >
+static void UnpackRays(const T& packet, uint32_t count, RTCRayHit* rays)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		auto& ray = rays[i];
+		ray.ray.tfar = packet.ray.tfar[i];
+		ray.hit.Ng_x = packet.hit.Ng_x[i];
+		ray.hit.Ng_y = packet.hit.Ng_y[i];
+		ray.hit.Ng_z = packet.hit.Ng_z[i];
+		ray.hit.u = packet.hit.u[i];
+		ray.hit.v = packet.hit.v[i];
+		ray.hit.primID = packet.hit.primID[i];
+		ray.hit.geomID = packet.hit.geomID[i];
+		ray.hit.instID[0] = packet.hit.instID[0][i];
+	}
+}
+
+// Run func(begin, end) for chunks of items on numThreads threads (calling thread included), returns wall time
+template< typename Func >
+static double RunParallel(uint32_t numItems, uint32_t chunkSize, uint32_t numThreads, const Func& func)
+{
+	std::atomic<uint32_t> next = 0;
+
+	const auto worker = [&]()
+	{
+		for (;;)
+		{
+			const auto begin = next.fetch_add(chunkSize);
+			if (begin >= numItems)
+				break;
+
+			func(begin, std::min(numItems, begin + chunkSize));
+		}
+	};
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < numThreads; ++i)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (auto& thread : threads)
+		thread.join();
+
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static void InitContext(RTCIntersectContext& context, bool coherent)
+{
+	rtcInitIntersectContext(&context);
+	context.flags = coherent ? RTC_INTERSECT_CONTEXT_FLAG_COHERENT : RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT;
+}
+
+template< typename T >
+static double TracePackets(RTCScene scene, const RayTraceSettings& settings, std::vector<RTCRayHit>& rays, bool stream)
+{
+	const auto N = RayPacketTraits<T>::N;
+	const auto numRays = (uint32_t)rays.size();
+	const auto numPackets = (numRays + N - 1) / N;
+
+	// the conversion is not part of the measurement, a real user would generate the rays in this layout directly
+	std::vector<T> packets(numPackets);
+	std::vector<int> valid(numPackets * N);
+	for (uint32_t i = 0; i < numPackets; ++i)
+		PackRays(rays.data() + i * N, std::min<uint32_t>(N, numRays - i * N), packets[i], valid.data() + i * N);
+
+	const auto chunkSize = std::max<uint32_t>(1, settings.chunkSize / N);
+	const auto seconds = RunParallel(numPackets, chunkSize, settings.numThreads, [&](uint32_t begin, uint32_t end)
+		{
+			RTCIntersectContext context;
+			InitContext(context, settings.coherent);
+
+			if (stream)
+			{
+				rtcIntersectNM(scene, &context, (RTCRayHitN*)(packets.data() + begin), N, end - begin, sizeof(T));
+			}
+			else
+			{
+				for (uint32_t i = begin; i < end; ++i)
+					RayPacketTraits<T>::Intersect(valid.data() + i * N, scene, &context, &packets[i]);
+			}
+		});
+
+	for (uint32_t i = 0; i < numPackets; ++i)
+		UnpackRays(packets[i], std::min<uint32_t>(N, numRays - i * N), rays.data() + i * N);
+
+	return seconds;
+}
+
+RayTraceResult TraceRays(RTCScene scene, const RayTraceSettings& settings, std::vector<RTCRayHit>& rays)
+{
+	RayTraceResult ret;
+	ret.numRays = rays.size();
+
+	const auto numRays = (uint32_t)rays.size();
+	const auto numThreads = std::max<uint32_t>(1, settings.numThreads);
+	const auto chunkSize = std::max<uint32_t>(16, settings.chunkSize);
+
+	switch (settings.api)
+	{
+		case RayAPI::Single:
+			ret.seconds = RunParallel(numRays, chunkSize, numThreads, [&](uint32_t begin, uint32_t end)
+				{
+					RTCIntersectContext context;
+					InitContext(context, settings.coherent);
+
+					for (uint32_t i = begin; i < end; ++i)
+						rtcIntersect1(scene, &context, &rays[i]);
+				});
+			break;
+
+		case RayAPI::Stream1M:
+			ret.seconds = RunParallel(numRays, chunkSize, numThreads, [&](uint32_t begin, uint32_t end)
+				{
+					RTCIntersectContext context;
+					InitContext(context, settings.coherent);
+
+					rtcIntersect1M(scene, &context, rays.data() + begin, end - begin, sizeof(RTCRayHit));
+				});
+			break;
+
+		case RayAPI::Packet4:
+			ret.seconds = TracePackets<RTCRayHit4>(scene, settings, rays, false);
+			break;
+
+		case RayAPI::Packet8:
+			ret.seconds = TracePackets<RTCRayHit8>(scene, settings, rays, false);
+			break;
+
+		case RayAPI::Packet16:
+			ret.seconds = TracePackets<RTCRayHit16>(scene, settings, rays, false);
+			break;
+
+		case RayAPI::Stream8M:
+			ret.seconds = TracePackets<RTCRayHit8>(scene, settings, rays, true);
+			break;
+
+		case RayAPI::Stream16M:
+			ret.seconds = TracePackets<RTCRayHit16>(scene, settings, rays, true);
+			break;
+
+		default:
+			break;
+	}
+
+	for (const auto& ray : rays)
+		if (ray.hit.geomID != RTC_INVALID_GEOMETRY_ID)
+			ret.numHits += 1;
+
+	return ret;
+}
+
+//--
@@ -0,0 +1,127 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#pragma once
+
+#define EMBREE_STATIC_LIB
+#include <embree3/rtcore.h>
+
+#include <stdint.h>
+#include <vector>
+#include <filesystem>
+
+//--
+
+// Indexed triangle mesh ready to be copied into Embree buffers
+struct RayMesh
+{
+	std::vector<float> positions; // xyz
+	std::vector<uint32_t> indices; // 3 per triangle
+
+	inline uint32_t numVertices() const { return (uint32_t)(positions.size() / 3); }
+	inline uint32_t numTriangles() const { return (uint32_t)(indices.size() / 3); }
+};
+
+// Height field of cells x cells quads (2 triangles each) spanning [-size/2, size/2] on XZ
+extern void GenerateTerrainMesh(uint32_t cells, float size, float height, RayMesh& outMesh);
+
+// All meshes of the FBX file merged into one, in world space
+extern bool LoadFBXMesh(const std::filesystem::path& path, RayMesh& outMesh);
+
+// Copies of the mesh placed on a countX x countZ grid on XZ with random height scale, appended to the output
+extern void ScatterMesh(const RayMesh& mesh, uint32_t countX, uint32_t countZ, float spacing, float scale, uint32_t seed, RayMesh& outMesh);
+
+class JobSystem;
+
+//--
+
+// Static triangle scene, all meshes are attached first and the BVH is built once in commit()
+class RayScene
+{
+public:
+	RayScene(RTCDevice device, RTCBuildQuality quality = RTC_BUILD_QUALITY_HIGH);
+	~RayScene();
+
+	RayScene(const RayScene&) = delete;
+	RayScene& operator=(const RayScene&) = delete;
+
+	inline RTCScene scene() const { return m_scene; }
+	inline operator RTCScene() const { return m_scene; }
+
+	inline uint64_t numTriangles() const { return m_numTriangles; }
+	inline double buildTimeMs() const { return m_buildTimeMs; }
+
+	// Attach the mesh as a new geometry, returns its geometry ID (RTC_INVALID_GEOMETRY_ID if the buffers could not be allocated)
+	uint32_t addMesh(const RayMesh& mesh);
+
+	// RTC_SCENE_FLAG_*, before the first commit
+	void setFlags(RTCSceneFlags flags);
+
+	// Build the BVH, false if it failed (out of memory, memory budget)
+	bool commit();
+
+	// Build the BVH on the workers of the job system (rtcJoinCommitScene), the device should be created with JoinCommitDeviceConfig()
+	bool commit(JobSystem& workers);
+
+	RTCBounds bounds() const;
+
+private:
+	RTCDevice m_device = nullptr;
+	RTCScene m_scene = nullptr;
+	RTCBuildQuality m_quality = RTC_BUILD_QUALITY_HIGH;
+
+	uint64_t m_numTriangles = 0;
+	double m_buildTimeMs = 0.0;
+};
+
+//--
+
+// Pinhole camera looking at the scene from above at an angle, rays are ordered in 4x4 pixel blocks so
+// every 4, 8 or 16 consecutive rays are a compact screen space packet
+extern void GeneratePrimaryRays(const RTCBounds& bounds, uint32_t width, uint32_t height, std::vector<RTCRayHit>& outRays);
+
+// One cosine distributed bounce ray for every primary ray, starting at the hit point (random ray inside the scene bounds for misses)
+// NOTE: the primary rays must be traced already
+extern void GenerateDiffuseRays(const RTCBounds& bounds, const std::vector<RTCRayHit>& primaryRays, uint32_t seed, std::vector<RTCRayHit>& outRays);
+
+//--
+
+enum class RayAPI : uint8_t
+{
+	Single, // rtcIntersect1
+	Packet4, // rtcIntersect4
+	Packet8, // rtcIntersect8
+	Packet16, // rtcIntersect16
+	Stream1M, // rtcIntersect1M
+	Stream8M, // rtcIntersectNM with N=8
+	Stream16M, // rtcIntersectNM with N=16
+
+	MAX,
+};
+
+extern const char* RayAPIName(RayAPI api);
+
+struct RayTraceSettings
+{
+	RayAPI api = RayAPI::Single;
+	uint32_t numThreads = 1; // rays are traced on our threads, Embree does not spawn any for queries
+	uint32_t chunkSize = 4096; // rays per job
+	bool coherent = false; // RTC_INTERSECT_CONTEXT_FLAG_COHERENT hint
+};
+
+struct RayTraceResult
+{
+	uint64_t numRays = 0;
+	uint64_t numHits = 0;
+	double seconds = 0.0; // tracing only, converting to packets is not included
+
+	inline double mraysPerSecond() const { return seconds > 0.0 ? (numRays / seconds) / 1000000.0 : 0.0; }
+};
+
+// Trace the rays with given API, results are written back to the rays (tfar and hit)
+extern RayTraceResult TraceRays(RTCScene scene, const RayTraceSettings& settings, std::vector<RTCRayHit>& rays);
+
+//--
@@ -0,0 +1,266 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "ray_benchmark.h"
+#include "test_data.h"
+
+#include <cmath>
+#include <thread>
+
+//--
+
+class RayBenchmarkTest : public ::testing::Test
+{
+protected:
+	RTCDevice device = nullptr;
+
+	virtual void SetUp() override
+	{
+		device = rtcNewDevice("");
+		ASSERT_NE(nullptr, device);
+	}
+
+	virtual void TearDown() override
+	{
+		rtcReleaseDevice(device);
+	}
+};
+
+static uint32_t CountMismatches(const std::vector<RTCRayHit>& reference, const std::vector<RTCRayHit>& rays)
+{
+	uint32_t count = 0;
+	for (size_t i = 0; i < reference.size(); ++i)
+	{
+		const auto& a = reference[i];
+		const auto& b = rays[i];
+
+		if (a.hit.geomID != b.hit.geomID || a.hit.primID != b.hit.primID)
+			count += 1;
+		else if (a.hit.geomID != RTC_INVALID_GEOMETRY_ID && fabsf(a.ray.tfar - b.ray.tfar) > 1e-3f * std::max(1.0f, a.ray.tfar))
+			count += 1;
+	}
+
+	return count;
+}
+
+TEST_F(RayBenchmarkTest, TerrainTriangleCount)
+{
+	RayMesh mesh;
+	GenerateTerrainMesh(64, 100.0f, 10.0f, mesh);
+
+	EXPECT_EQ(65 * 65, mesh.numVertices());
+	EXPECT_EQ(64 * 64 * 2, mesh.numTriangles());
+
+	for (const auto index : mesh.indices)
+		ASSERT_LT(index, mesh.numVertices());
+
+	RayScene scene(device);
+	scene.addMesh(mesh);
+	scene.commit();
+	EXPECT_EQ(64 * 64 * 2, scene.numTriangles());
+
+	const auto bounds = scene.bounds();
+	EXPECT_NEAR(-50.0f, bounds.lower_x, 0.01f);
+	EXPECT_NEAR(50.0f, bounds.upper_x, 0.01f);
+	EXPECT_NEAR(-50.0f, bounds.lower_z, 0.01f);
+	EXPECT_NEAR(50.0f, bounds.upper_z, 0.01f);
+}
+
+TEST_F(RayBenchmarkTest, FBXMeshLoads)
+{
+	RayMesh mesh;
+	ASSERT_TRUE(LoadFBXMesh(MakeTestDataPath("cube.fbx"), mesh));
+
+	EXPECT_EQ(12, mesh.numTriangles());
+	EXPECT_LE(8, mesh.numVertices());
+
+	RayMesh scattered;
+	ScatterMesh(mesh, 4, 3, 10.0f, 1.0f, 1, scattered);
+	EXPECT_EQ(12 * 12, scattered.numTriangles());
+	EXPECT_EQ(12 * mesh.numVertices(), scattered.numVertices());
+}
+
+TEST_F(RayBenchmarkTest, PrimaryRaysHitTerrain)
+{
+	RayMesh mesh;
+	GenerateTerrainMesh(128, 100.0f, 10.0f, mesh);
+
+	RayScene scene(device);
+	scene.addMesh(mesh);
+	scene.commit();
+
+	std::vector<RTCRayHit> rays;
+	GeneratePrimaryRays(scene.bounds(), 128, 128, rays);
+	ASSERT_EQ(128 * 128, rays.size());
+
+	RayTraceSettings settings;
+	settings.coherent = true;
+	const auto result = TraceRays(scene, settings, rays);
+	EXPECT_EQ(rays.size(), result.numRays);
+	EXPECT_GT(result.numHits, result.numRays / 2);
+
+	// bounces start above the surface so they can't hit the triangle they start on from below
+	std::vector<RTCRayHit> diffuseRays;
+	GenerateDiffuseRays(scene.bounds(), rays, 1, diffuseRays);
+	ASSERT_EQ(rays.size(), diffuseRays.size());
+
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		if (rays[i].hit.geomID == RTC_INVALID_GEOMETRY_ID)
+			continue;
+
+		const auto& hit = rays[i].hit;
+		const auto& ray = diffuseRays[i].ray;
+		const auto incoming = rays[i].ray.dir_x * hit.Ng_x + rays[i].ray.dir_y * hit.Ng_y + rays[i].ray.dir_z * hit.Ng_z;
+		const auto outgoing = ray.dir_x * hit.Ng_x + ray.dir_y * hit.Ng_y + ray.dir_z * hit.Ng_z;
+		ASSERT_LE(incoming * outgoing, 1e-6f) << "Bounce ray " << i << " goes through the surface";
+	}
+}
+
+TEST_F(RayBenchmarkTest, AllAPIsMatchSingleRays)
+{
+	RayMesh mesh;
+	GenerateTerrainMesh(128, 100.0f, 10.0f, mesh);
+
+	RayMesh cube;
+	if (LoadFBXMesh(MakeTestDataPath("cube.fbx"), cube))
+		ScatterMesh(cube, 8, 8, 10.0f, 1.0f, 1, mesh);
+
+	RayScene scene(device);
+	scene.addMesh(mesh);
+	scene.commit();
+
+	// odd size so the last packet is partially filled
+	std::vector<RTCRayHit> primaryRays;
+	GeneratePrimaryRays(scene.bounds(), 124, 100, primaryRays);
+	primaryRays.resize(primaryRays.size() - 3);
+
+	std::vector<RTCRayHit> diffuseRays;
+	{
+		auto tracedRays = primaryRays;
+		TraceRays(scene, RayTraceSettings(), tracedRays);
+		GenerateDiffuseRays(scene.bounds(), tracedRays, 2, diffuseRays);
+	}
+
+	for (const auto* sourceRays : { &primaryRays, &diffuseRays })
+	{
+		auto referenceRays = *sourceRays;
+		const auto reference = TraceRays(scene, RayTraceSettings(), referenceRays);
+
+		for (uint8_t api = 0; api < (uint8_t)RayAPI::MAX; ++api)
+		{
+			for (const uint32_t numThreads : { 1, 4 })
+			{
+				RayTraceSettings settings;
+				settings.api = (RayAPI)api;
+				settings.numThreads = numThreads;
+				settings.chunkSize = 256;
+				settings.coherent = (sourceRays == &primaryRays);
+
+				auto rays = *sourceRays;
+				const auto result = TraceRays(scene, settings, rays);
+
+				// watertightness is not guaranteed to be identical between the single ray and packet kernels
+				const auto mismatches = CountMismatches(referenceRays, rays);
+				EXPECT_LE(mismatches, rays.size() / 1000) << RayAPIName(settings.api) << " on " << numThreads << " threads";
+				EXPECT_NEAR((double)reference.numHits, (double)result.numHits, rays.size() / 1000.0) << RayAPIName(settings.api);
+			}
+		}
+	}
+}
+
+//--
+
+static void RunThroughputBenchmark(const char* sceneName, const RayScene& scene)
+{
+	const auto bounds = scene.bounds();
+
+	std::vector<RTCRayHit> primaryRays;
+	GeneratePrimaryRays(bounds, 1024, 1024, primaryRays);
+
+	std::vector<RTCRayHit> diffuseRays;
+	{
+		RayTraceSettings settings;
+		settings.numThreads = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+
+		auto tracedRays = primaryRays;
+		TraceRays(scene, settings, tracedRays);
+		GenerateDiffuseRays(bounds, tracedRays, 3, diffuseRays);
+	}
+
+	std::vector<uint32_t> threadCounts = { 1, 4 };
+	if (std::thread::hardware_concurrency() > 4)
+		threadCounts.push_back(std::thread::hardware_concurrency());
+
+	printf("%s: %llu triangles, build %.1f ms, %u rays\n", sceneName, (unsigned long long)scene.numTriangles(), scene.buildTimeMs(), (uint32_t)primaryRays.size());
+
+	for (const auto* sourceRays : { &primaryRays, &diffuseRays })
+	{
+		const auto coherent = (sourceRays == &primaryRays);
+
+		for (uint8_t api = 0; api < (uint8_t)RayAPI::MAX; ++api)
+		{
+			printf("  %-10s %-22s", coherent ? "primary" : "diffuse", RayAPIName((RayAPI)api));
+
+			for (const auto numThreads : threadCounts)
+			{
+				RayTraceSettings settings;
+				settings.api = (RayAPI)api;
+				settings.numThreads = numThreads;
+				settings.coherent = coherent;
+
+				auto rays = *sourceRays;
+				const auto result = TraceRays(scene, settings, rays);
+				printf(" %2u threads: %7.2f Mrays/s", numThreads, result.mraysPerSecond());
+			}
+
+			printf("\n");
+		}
+	}
+}
+
+TEST_F(RayBenchmarkTest, DISABLED_ThroughputBenchmark)
+{
+	{
+		RayMesh mesh;
+		GenerateTerrainMesh(1024, 1000.0f, 100.0f, mesh);
+
+		RayScene scene(device);
+		scene.addMesh(mesh);
+		scene.commit();
+
+		RunThroughputBenchmark("Terrain", scene);
+	}
+
+	{
+		RayMesh mesh;
+		GenerateTerrainMesh(512, 1000.0f, 100.0f, mesh);
+
+		// BM_EMBREE_BENCHMARK_FBX can point to a bigger asset, otherwise the test cube is scattered around the terrain
+		RayMesh fbxMesh;
+		if (const auto* path = getenv("BM_EMBREE_BENCHMARK_FBX"))
+		{
+			ASSERT_TRUE(LoadFBXMesh(path, fbxMesh)) << "Failed to load " << path;
+			for (const auto index : fbxMesh.indices)
+				mesh.indices.push_back(mesh.numVertices() + index);
+			mesh.positions.insert(mesh.positions.end(), fbxMesh.positions.begin(), fbxMesh.positions.end());
+		}
+		else
+		{
+			ASSERT_TRUE(LoadFBXMesh(MakeTestDataPath("cube.fbx"), fbxMesh));
+			ScatterMesh(fbxMesh, 200, 200, 4.5f, 1.0f, 4, mesh);
+		}
+
+		RayScene scene(device);
+		scene.addMesh(mesh);
+		scene.commit();
+
+		RunThroughputBenchmark("FBX", scene);
+	}
+}
+
+//--
@@ -0,0 +1,325 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "ray_queue.h"
+#include "commit_pool.h"
+
+#include <algorithm>
+#include <chrono>
+
+//--
+
+// 3 octant bits and 4 bits per axis of the origin cell, interleaved so nearby cells end up in nearby bins
+static const uint32_t NUM_BINS = 1 << 15;
+
+static uint32_t SpreadBits4(uint32_t x)
+{
+	x &= 0xF;
+	x = (x | (x << 4)) & 0x0C3;
+	x = (x | (x << 2)) & 0x249;
+	return x;
+}
+
+//--
+
+void RayQueue::SOABuffer::resize(uint32_t size)
+{
+	for (auto* stream : { &orgX, &orgY, &orgZ, &tnear, &dirX, &dirY, &dirZ, &time, &tfar, &ngX, &ngY, &ngZ, &u, &v })
+		stream->resize(size);
+
+	for (auto* stream : { &mask, &id, &flags, &primID, &geomID, &instID })
+		stream->resize(size);
+}
+
+RTCRayHitNp RayQueue::SOABuffer::view(uint32_t offset)
+{
+	RTCRayHitNp ret;
+	ret.ray.org_x = orgX.data() + offset;
+	ret.ray.org_y = orgY.data() + offset;
+	ret.ray.org_z = orgZ.data() + offset;
+	ret.ray.tnear = tnear.data() + offset;
+	ret.ray.dir_x = dirX.data() + offset;
+	ret.ray.dir_y = dirY.data() + offset;
+	ret.ray.dir_z = dirZ.data() + offset;
+	ret.ray.time = time.data() + offset;
+	ret.ray.tfar = tfar.data() + offset;
+	ret.ray.mask = mask.data() + offset;
+	ret.ray.id = id.data() + offset;
+	ret.ray.flags = flags.data() + offset;
+	ret.hit.Ng_x = ngX.data() + offset;
+	ret.hit.Ng_y = ngY.data() + offset;
+	ret.hit.Ng_z = ngZ.data() + offset;
+	ret.hit.u = u.data() + offset;
+	ret.hit.v = v.data() + offset;
+	ret.hit.primID = primID.data() + offset;
+	ret.hit.geomID = geomID.data() + offset;
+	ret.hit.instID[0] = instID.data() + offset;
+	return ret;
+}
+
+//--
+
+RayQueue::RayQueue(RTCScene scene, const RTCBounds& bounds, const RayQueueSettings& settings)
+	: m_scene(scene)
+	, m_settings(settings)
+{
+	m_settings.cellsPerAxis = std::clamp<uint32_t>(m_settings.cellsPerAxis, 1, 16);
+	m_settings.batchSize = std::max<uint32_t>(16, (m_settings.batchSize + 15) & ~15u);
+
+	const float lower[3] = { bounds.lower_x, bounds.lower_y, bounds.lower_z };
+	const float upper[3] = { bounds.upper_x, bounds.upper_y, bounds.upper_z };
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		m_gridOrigin[i] = lower[i];
+		m_gridScale[i] = (upper[i] > lower[i]) ? m_settings.cellsPerAxis / (upper[i] - lower[i]) : 0.0f;
+	}
+}
+
+RayQueue::~RayQueue()
+{}
+
+void RayQueue::reserve(uint32_t numRays)
+{
+	m_rays.reserve(numRays);
+	m_owners.reserve(numRays);
+	m_keys.reserve(numRays);
+}
+
+uint16_t RayQueue::computeKey(const RTCRay& ray) const
+{
+	const auto octant = (ray.dir_x < 0.0f ? 1u : 0u) | (ray.dir_y < 0.0f ? 2u : 0u) | (ray.dir_z < 0.0f ? 4u : 0u);
+
+	const float org[3] = { ray.org_x, ray.org_y, ray.org_z };
+	uint32_t cell[3];
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		const auto pos = (org[i] - m_gridOrigin[i]) * m_gridScale[i];
+		cell[i] = (uint32_t)std::clamp<float>(pos, 0.0f, (float)(m_settings.cellsPerAxis - 1));
+	}
+
+	const auto morton = SpreadBits4(cell[0]) | (SpreadBits4(cell[1]) << 1) | (SpreadBits4(cell[2]) << 2);
+	return (uint16_t)((octant << 12) | morton);
+}
+
+void RayQueue::push(const RTCRay& ray, uint32_t owner)
+{
+	m_rays.push_back(ray);
+	m_owners.push_back(owner);
+	m_keys.push_back(computeKey(ray));
+}
+
+void RayQueue::flush(RTCRayHit* results, JobSystem* workers)
+{
+	const auto numRays = (uint32_t)m_rays.size();
+	if (!numRays)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	sortRays();
+	gatherRays();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_stats.binningMs += std::chrono::duration<double, std::milli>(end - start).count();
+	start = end;
+
+	const auto numBatches = (numRays + m_settings.batchSize - 1) / m_settings.batchSize;
+
+	if (workers)
+	{
+		workers->parallelFor(numBatches, [this](uint32_t batchIndex) { traceBatch(batchIndex); });
+	}
+	else
+	{
+		for (uint32_t i = 0; i < numBatches; ++i)
+			traceBatch(i);
+	}
+
+	end = std::chrono::high_resolution_clock::now();
+	m_stats.traceMs += std::chrono::duration<double, std::milli>(end - start).count();
+	start = end;
+
+	scatterHits(results);
+
+	end = std::chrono::high_resolution_clock::now();
+	m_stats.scatterMs += std::chrono::duration<double, std::milli>(end - start).count();
+	m_stats.numRays += numRays;
+
+	m_rays.clear();
+	m_owners.clear();
+	m_keys.clear();
+}
+
+void RayQueue::sortRays()
+{
+	const auto numRays = (uint32_t)m_rays.size();
+	m_order.resize(numRays);
+
+	if (!m_settings.binning)
+	{
+		for (uint32_t i = 0; i < numRays; ++i)
+			m_order[i] = i;
+		return;
+	}
+
+	// counting sort, stable so rays of one sample stay together inside a bin
+	m_binOffsets.assign(NUM_BINS + 1, 0);
+	for (const auto key : m_keys)
+		m_binOffsets[key + 1] += 1;
+
+	for (uint32_t i = 1; i <= NUM_BINS; ++i)
+		m_binOffsets[i] += m_binOffsets[i - 1];
+
+	for (uint32_t i = 0; i < numRays; ++i)
+		m_order[m_binOffsets[m_keys[i]]++] = i;
+}
+
+void RayQueue::gatherRays()
+{
+	const auto numRays = (uint32_t)m_rays.size();
+
+	if (m_settings.dispatch == RayQueueDispatch::Packet16)
+	{
+		const auto numPackets = (numRays + 15) / 16;
+		m_packets.resize(numPackets);
+
+		for (uint32_t p = 0; p < numPackets; ++p)
+		{
+			auto& packet = m_packets[p];
+
+			for (uint32_t lane = 0; lane < 16; ++lane)
+			{
+				const auto index = p * 16 + lane;
+				if (index < numRays)
+				{
+					const auto& ray = m_rays[m_order[index]];
+					packet.ray.org_x[lane] = ray.org_x;
+					packet.ray.org_y[lane] = ray.org_y;
+					packet.ray.org_z[lane] = ray.org_z;
+					packet.ray.tnear[lane] = ray.tnear;
+					packet.ray.dir_x[lane] = ray.dir_x;
+					packet.ray.dir_y[lane] = ray.dir_y;
+					packet.ray.dir_z[lane] = ray.dir_z;
+					packet.ray.time[lane] = ray.time;
+					packet.ray.tfar[lane] = ray.tfar;
+					packet.ray.mask[lane] = ray.mask;
+					packet.ray.id[lane] = ray.id;
+					packet.ray.flags[lane] = ray.flags;
+				}
+				else
+				{
+					// disabled by the valid mask
+					packet.ray.tnear[lane] = 0.0f;
+					packet.ray.tfar[lane] = -1.0f;
+				}
+
+				packet.hit.geomID[lane] = RTC_INVALID_GEOMETRY_ID;
+				packet.hit.primID[lane] = RTC_INVALID_GEOMETRY_ID;
+				packet.hit.instID[0][lane] = RTC_INVALID_GEOMETRY_ID;
+			}
+		}
+	}
+	else
+	{
+		m_stream.resize(numRays);
+
+		for (uint32_t i = 0; i < numRays; ++i)
+		{
+			const auto& ray = m_rays[m_order[i]];
+			m_stream.orgX[i] = ray.org_x;
+			m_stream.orgY[i] = ray.org_y;
+			m_stream.orgZ[i] = ray.org_z;
+			m_stream.tnear[i] = ray.tnear;
+			m_stream.dirX[i] = ray.dir_x;
+			m_stream.dirY[i] = ray.dir_y;
+			m_stream.dirZ[i] = ray.dir_z;
+			m_stream.time[i] = ray.time;
+			m_stream.tfar[i] = ray.tfar;
+			m_stream.mask[i] = ray.mask;
+			m_stream.id[i] = ray.id;
+			m_stream.flags[i] = ray.flags;
+			m_stream.geomID[i] = RTC_INVALID_GEOMETRY_ID;
+			m_stream.primID[i] = RTC_INVALID_GEOMETRY_ID;
+			m_stream.instID[i] = RTC_INVALID_GEOMETRY_ID;
+		}
+	}
+}
+
+void RayQueue::traceBatch(uint32_t batchIndex)
+{
+	const auto numRays = (uint32_t)m_rays.size();
+	const auto first = batchIndex * m_settings.batchSize;
+	const auto count = std::min(m_settings.batchSize, numRays - first);
+
+	// after binning the rays of a batch are coherent
+	RTCIntersectContext context;
+	rtcInitIntersectContext(&context);
+	context.flags = m_settings.binning ? RTC_INTERSECT_CONTEXT_FLAG_COHERENT : RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT;
+
+	if (m_settings.dispatch == RayQueueDispatch::Packet16)
+	{
+		const auto firstPacket = first / 16;
+		const auto numPackets = (count + 15) / 16;
+
+		for (uint32_t p = 0; p < numPackets; ++p)
+		{
+			int valid[16];
+			const auto packetStart = (firstPacket + p) * 16;
+			for (uint32_t lane = 0; lane < 16; ++lane)
+				valid[lane] = (packetStart + lane < numRays) ? -1 : 0;
+
+			rtcIntersect16(valid, m_scene, &context, &m_packets[firstPacket + p]);
+		}
+	}
+	else
+	{
+		const auto view = m_stream.view(first);
+		rtcIntersectNp(m_scene, &context, &view, count);
+	}
+}
+
+void RayQueue::scatterHits(RTCRayHit* results) const
+{
+	const auto numRays = (uint32_t)m_rays.size();
+
+	for (uint32_t i = 0; i < numRays; ++i)
+	{
+		const auto queueIndex = m_order[i];
+		auto& result = results[m_owners[queueIndex]];
+
+		result.ray = m_rays[queueIndex];
+
+		if (m_settings.dispatch == RayQueueDispatch::Packet16)
+		{
+			const auto& packet = m_packets[i / 16];
+			const auto lane = i % 16;
+			result.ray.tfar = packet.ray.tfar[lane];
+			result.hit.Ng_x = packet.hit.Ng_x[lane];
+			result.hit.Ng_y = packet.hit.Ng_y[lane];
+			result.hit.Ng_z = packet.hit.Ng_z[lane];
+			result.hit.u = packet.hit.u[lane];
+			result.hit.v = packet.hit.v[lane];
+			result.hit.primID = packet.hit.primID[lane];
+			result.hit.geomID = packet.hit.geomID[lane];
+			result.hit.instID[0] = packet.hit.instID[0][lane];
+		}
+		else
+		{
+			result.ray.tfar = m_stream.tfar[i];
+			result.hit.Ng_x = m_stream.ngX[i];
+			result.hit.Ng_y = m_stream.ngY[i];
+			result.hit.Ng_z = m_stream.ngZ[i];
+			result.hit.u = m_stream.u[i];
+			result.hit.v = m_stream.v[i];
+			result.hit.primID = m_stream.primID[i];
+			result.hit.geomID = m_stream.geomID[i];
+			result.hit.instID[0] = m_stream.instID[i];
+		}
+	}
+}
+
+//--
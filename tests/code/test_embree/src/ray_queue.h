@@ -0,0 +1,103 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#pragma once
+
+#include "ray_benchmark.h"
+
+#include <atomic>
+
+class JobSystem;
+
+//--
+
+enum class RayQueueDispatch : uint8_t
+{
+	Packet16, // rtcIntersect16 on consecutive rays of the sorted queue
+	StreamNp, // rtcIntersectNp on SOA batches of the sorted queue
+};
+
+struct RayQueueSettings
+{
+	uint32_t cellsPerAxis = 16; // origin grid over the scene bounds, up to 16
+	uint32_t batchSize = 1024; // rays per job and per rtcIntersectNp call, multiple of 16
+	RayQueueDispatch dispatch = RayQueueDispatch::StreamNp;
+	bool binning = true; // false - rays are traced in the order they were pushed
+};
+
+struct RayQueueStats
+{
+	uint64_t numRays = 0;
+	double binningMs = 0.0; // sorting and gathering into the dispatch layout
+	double traceMs = 0.0;
+	double scatterMs = 0.0; // writing the hits back to the owners
+
+	inline double totalMs() const { return binningMs + traceMs + scatterMs; }
+	inline double mraysPerSecond() const { return totalMs() > 0.0 ? (numRays / totalMs()) / 1000.0 : 0.0; }
+};
+
+// Deferred tracing of incoherent (secondary) rays - rays are buffered, binned by direction octant and origin cell so that
+// rays in the same packet or stream batch travel through the same part of the BVH, traced and their hits scattered back
+// to the samples that own them
+class RayQueue
+{
+public:
+	RayQueue(RTCScene scene, const RTCBounds& bounds, const RayQueueSettings& settings = RayQueueSettings());
+	~RayQueue();
+
+	RayQueue(const RayQueue&) = delete;
+	RayQueue& operator=(const RayQueue&) = delete;
+
+	inline uint32_t size() const { return (uint32_t)m_rays.size(); }
+	inline const RayQueueSettings& settings() const { return m_settings; }
+	inline const RayQueueStats& stats() const { return m_stats; }
+
+	void reserve(uint32_t numRays);
+
+	// Queue the ray, owner is the index of its entry in the results passed to flush()
+	void push(const RTCRay& ray, uint32_t owner);
+
+	// Trace all queued rays, the traced ray and its hit are written to results[owner], the queue is empty afterwards
+	// Without workers everything runs on the calling thread
+	void flush(RTCRayHit* results, JobSystem* workers = nullptr);
+
+private:
+	struct SOABuffer
+	{
+		std::vector<float> orgX, orgY, orgZ, tnear, dirX, dirY, dirZ, time, tfar;
+		std::vector<uint32_t> mask, id, flags;
+		std::vector<float> ngX, ngY, ngZ, u, v;
+		std::vector<uint32_t> primID, geomID, instID;
+
+		void resize(uint32_t size);
+		RTCRayHitNp view(uint32_t offset);
+	};
+
+	RTCScene m_scene = nullptr;
+	RayQueueSettings m_settings;
+	RayQueueStats m_stats;
+
+	float m_gridOrigin[3];
+	float m_gridScale[3];
+
+	std::vector<RTCRay> m_rays;
+	std::vector<uint32_t> m_owners;
+	std::vector<uint16_t> m_keys;
+
+	std::vector<uint32_t> m_order; // queue index of each sorted ray
+	std::vector<uint32_t> m_binOffsets;
+	std::vector<RTCRayHit16> m_packets;
+	SOABuffer m_stream;
+
+	uint16_t computeKey(const RTCRay& ray) const;
+
+	void sortRays();
+	void gatherRays();
+	void traceBatch(uint32_t batchIndex);
+	void scatterHits(RTCRayHit* results) const;
+};
+
+//--
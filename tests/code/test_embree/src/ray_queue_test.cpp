@@ -0,0 +1,250 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "ray_queue.h"
+#include "commit_pool.h"
+#include "test_data.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+//--
+
+class RayQueueTest : public ::testing::Test
+{
+protected:
+	RTCDevice device = nullptr;
+
+	virtual void SetUp() override
+	{
+		device = rtcNewDevice("");
+		ASSERT_NE(nullptr, device);
+	}
+
+	virtual void TearDown() override
+	{
+		rtcReleaseDevice(device);
+	}
+};
+
+// Secondary rays of a bake: raysPerSample cosine distributed bounce rays for every primary hit, sample after sample
+static void GenerateBakeRays(const RayScene& scene, uint32_t resolution, uint32_t raysPerSample, std::vector<RTCRayHit>& outRays)
+{
+	const auto bounds = scene.bounds();
+
+	std::vector<RTCRayHit> primaryRays;
+	GeneratePrimaryRays(bounds, resolution, resolution, primaryRays);
+
+	RayTraceSettings settings;
+	settings.numThreads = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+	TraceRays(scene, settings, primaryRays);
+
+	outRays.resize(primaryRays.size() * raysPerSample);
+
+	std::vector<RTCRayHit> bounceRays;
+	for (uint32_t k = 0; k < raysPerSample; ++k)
+	{
+		GenerateDiffuseRays(bounds, primaryRays, 100 + k, bounceRays);
+
+		for (size_t i = 0; i < bounceRays.size(); ++i)
+			outRays[i * raysPerSample + k] = bounceRays[i];
+	}
+}
+
+static void BuildLevel(RayScene& scene, uint32_t terrainCells)
+{
+	RayMesh mesh;
+	GenerateTerrainMesh(terrainCells, 1000.0f, 100.0f, mesh);
+	scene.addMesh(mesh);
+
+	RayMesh cube;
+	if (LoadFBXMesh(MakeTestDataPath("cube.fbx"), cube))
+	{
+		RayMesh props;
+		ScatterMesh(cube, 60, 60, 15.0f, 1.0f, 7, props);
+		scene.addMesh(props);
+	}
+
+	scene.commit();
+}
+
+//--
+
+TEST_F(RayQueueTest, EmptyFlush)
+{
+	RayScene scene(device);
+	BuildLevel(scene, 16);
+
+	RayQueue queue(scene, scene.bounds());
+	queue.flush(nullptr);
+
+	EXPECT_EQ(0, queue.size());
+	EXPECT_EQ(0, queue.stats().numRays);
+}
+
+TEST_F(RayQueueTest, HitsReturnToOwners)
+{
+	RayScene scene(device);
+	BuildLevel(scene, 64);
+
+	std::vector<RTCRayHit> rays;
+	GenerateBakeRays(scene, 64, 8, rays);
+
+	// odd count so the last packet and batch are partial
+	rays.resize(rays.size() - 5);
+
+	// reference, one ray at a time
+	auto referenceRays = rays;
+	{
+		RTCIntersectContext context;
+		rtcInitIntersectContext(&context);
+		for (auto& ray : referenceRays)
+			rtcIntersect1(scene, &context, &ray);
+	}
+
+	// owners are shuffled so the scatter is really tested
+	std::vector<uint32_t> owners(rays.size());
+	for (uint32_t i = 0; i < owners.size(); ++i)
+		owners[i] = i;
+	std::shuffle(owners.begin(), owners.end(), std::mt19937(5));
+
+	JobSystem workers(4);
+
+	for (const auto dispatch : { RayQueueDispatch::Packet16, RayQueueDispatch::StreamNp })
+	{
+		for (const auto binning : { false, true })
+		{
+			for (auto* pool : { (JobSystem*)nullptr, &workers })
+			{
+				RayQueueSettings settings;
+				settings.dispatch = dispatch;
+				settings.binning = binning;
+				settings.batchSize = 1000;
+
+				RayQueue queue(scene, scene.bounds(), settings);
+				for (uint32_t i = 0; i < rays.size(); ++i)
+					queue.push(rays[i].ray, owners[i]);
+				EXPECT_EQ(rays.size(), queue.size());
+
+				std::vector<RTCRayHit> results(rays.size());
+				queue.flush(results.data(), pool);
+				EXPECT_EQ(0, queue.size());
+				EXPECT_EQ(rays.size(), queue.stats().numRays);
+
+				uint32_t mismatches = 0;
+				for (uint32_t i = 0; i < rays.size(); ++i)
+				{
+					const auto& expected = referenceRays[i];
+					const auto& result = results[owners[i]];
+
+					if (expected.hit.geomID != result.hit.geomID || expected.hit.primID != result.hit.primID)
+						mismatches += 1;
+					else if (expected.hit.geomID != RTC_INVALID_GEOMETRY_ID && fabsf(expected.ray.tfar - result.ray.tfar) > 1e-3f * expected.ray.tfar)
+						mismatches += 1;
+
+					ASSERT_EQ(expected.ray.org_x, result.ray.org_x);
+					ASSERT_EQ(expected.ray.dir_z, result.ray.dir_z);
+				}
+
+				EXPECT_LE(mismatches, rays.size() / 1000) << (dispatch == RayQueueDispatch::Packet16 ? "Packet16" : "StreamNp")
+					<< (binning ? " binned" : " unbinned") << (pool ? " workers" : " single thread");
+			}
+		}
+	}
+}
+
+TEST_F(RayQueueTest, QueueCanBeReused)
+{
+	RayScene scene(device);
+	BuildLevel(scene, 32);
+
+	std::vector<RTCRayHit> rays;
+	GenerateBakeRays(scene, 32, 4, rays);
+
+	RayQueue queue(scene, scene.bounds());
+	std::vector<RTCRayHit> first(rays.size()), second(rays.size());
+
+	for (uint32_t pass = 0; pass < 2; ++pass)
+	{
+		for (uint32_t i = 0; i < rays.size(); ++i)
+			queue.push(rays[i].ray, i);
+
+		queue.flush(pass ? second.data() : first.data());
+	}
+
+	for (uint32_t i = 0; i < rays.size(); ++i)
+	{
+		EXPECT_EQ(first[i].hit.geomID, second[i].hit.geomID);
+		EXPECT_EQ(first[i].hit.primID, second[i].hit.primID);
+	}
+
+	EXPECT_EQ(2 * rays.size(), queue.stats().numRays);
+}
+
+//--
+
+TEST_F(RayQueueTest, DISABLED_BakeBenchmark)
+{
+	RayScene scene(device);
+	BuildLevel(scene, 1024);
+
+	// 256k samples with 16 bounce rays each
+	std::vector<RTCRayHit> rays;
+	GenerateBakeRays(scene, 512, 16, rays);
+
+	const auto hardwareThreads = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+	printf("Bake rays: %u on %llu triangles\n", (uint32_t)rays.size(), (unsigned long long)scene.numTriangles());
+
+	for (const auto numThreads : { 1u, hardwareThreads })
+	{
+		// naive: every sample traces its own rays, one packet (or single rays) per sample
+		for (const auto api : { RayAPI::Single, RayAPI::Packet16 })
+		{
+			RayTraceSettings settings;
+			settings.api = api;
+			settings.numThreads = numThreads;
+			settings.chunkSize = 1024;
+
+			auto tracedRays = rays;
+			const auto result = TraceRays(scene, settings, tracedRays);
+			printf("  %2u threads, per sample %-24s: %7.2f Mrays/s\n", numThreads, RayAPIName(api), result.mraysPerSecond());
+		}
+
+		JobSystem workers(numThreads);
+
+		for (const auto dispatch : { RayQueueDispatch::Packet16, RayQueueDispatch::StreamNp })
+		{
+			for (const auto binning : { false, true })
+			{
+				RayQueueSettings settings;
+				settings.dispatch = dispatch;
+				settings.binning = binning;
+
+				RayQueue queue(scene, scene.bounds(), settings);
+				queue.reserve((uint32_t)rays.size());
+
+				std::vector<RTCRayHit> results(rays.size());
+
+				// pushing is part of the cost
+				const auto start = std::chrono::high_resolution_clock::now();
+				for (uint32_t i = 0; i < rays.size(); ++i)
+					queue.push(rays[i].ray, i);
+				queue.flush(results.data(), &workers);
+				const auto totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+				const auto& stats = queue.stats();
+				printf("  %2u threads, queue %-8s %-9s     : %7.2f Mrays/s (binning %6.1f ms, trace %6.1f ms, scatter %6.1f ms)\n",
+					numThreads, dispatch == RayQueueDispatch::Packet16 ? "Packet16" : "StreamNp", binning ? "binned" : "unbinned",
+					rays.size() / totalMs / 1000.0, stats.binningMs, stats.traceMs, stats.scatterMs);
+			}
+		}
+	}
+}
+
+//--
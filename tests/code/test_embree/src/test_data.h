@@ -0,0 +1,17 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+//--
+
+// Path to a file in the shared test data directory (tests/data)
+extern std::filesystem::path MakeTestDataPath(std::string_view name);
+
+//--
@@ -0,0 +1,498 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "font_atlas_cache.h"
+
+#include <imgui_internal.h> // ImFontAtlasBuildSetupFont
+
+#include <string.h>
+#include <fstream>
+
+//--
+
+static uint64_t HashData(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+	const auto* ptr = (const uint8_t*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= ptr[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+template< typename T >
+static uint64_t HashValue(const T& value, uint64_t hash)
+{
+	return HashData(&value, sizeof(value), hash);
+}
+
+static int FontIndex(const ImFontAtlas* atlas, const ImFont* font)
+{
+	for (int i = 0; i < atlas->Fonts.Size; ++i)
+		if (atlas->Fonts[i] == font)
+			return i;
+	return -1;
+}
+
+static const ImWchar* ConfigGlyphRanges(const ImFontAtlas* atlas, const ImFontConfig& cfg)
+{
+	// same fallback as the builder uses
+	return cfg.GlyphRanges ? cfg.GlyphRanges : const_cast<ImFontAtlas*>(atlas)->GetGlyphRangesDefault();
+}
+
+uint64_t FontAtlasCacheKey(ImFontAtlas* atlas)
+{
+	if (atlas->ConfigData.empty())
+		atlas->AddFontDefault();
+
+	auto hash = HashValue((uint32_t)IMGUI_VERSION_NUM, 0xcbf29ce484222325ULL);
+	hash = HashValue(atlas->Flags, hash);
+	hash = HashValue(atlas->TexDesiredWidth, hash);
+	hash = HashValue(atlas->TexGlyphPadding, hash);
+	hash = HashValue(atlas->FontBuilderFlags, hash);
+	hash = HashValue(atlas->Fonts.Size, hash);
+
+	for (const auto& cfg : atlas->ConfigData)
+	{
+		hash = HashData(cfg.FontData, cfg.FontDataSize, hash);
+		hash = HashValue(cfg.FontDataSize, hash);
+		hash = HashValue(cfg.FontNo, hash);
+		hash = HashValue(cfg.SizePixels, hash);
+		hash = HashValue(cfg.OversampleH, hash);
+		hash = HashValue(cfg.OversampleV, hash);
+		hash = HashValue(cfg.PixelSnapH, hash);
+		hash = HashValue(cfg.GlyphExtraSpacing, hash);
+		hash = HashValue(cfg.GlyphOffset, hash);
+		hash = HashValue(cfg.GlyphMinAdvanceX, hash);
+		hash = HashValue(cfg.GlyphMaxAdvanceX, hash);
+		hash = HashValue(cfg.MergeMode, hash);
+		hash = HashValue(cfg.FontBuilderFlags, hash);
+		hash = HashValue(cfg.RasterizerMultiply, hash);
+		hash = HashValue(cfg.EllipsisChar, hash);
+		hash = HashValue(FontIndex(atlas, cfg.DstFont), hash);
+
+		const auto* ranges = ConfigGlyphRanges(atlas, cfg);
+		while (ranges[0])
+		{
+			hash = HashData(ranges, 2 * sizeof(ImWchar), hash);
+			ranges += 2;
+		}
+	}
+
+	// only the user rects exist before the build, their placement is part of the cached data
+	for (const auto& rect : atlas->CustomRects)
+	{
+		hash = HashValue(rect.Width, hash);
+		hash = HashValue(rect.Height, hash);
+		hash = HashValue(rect.GlyphID, hash);
+		hash = HashValue(rect.GlyphAdvanceX, hash);
+		hash = HashValue(rect.GlyphOffset, hash);
+		hash = HashValue(FontIndex(atlas, rect.Font), hash);
+	}
+
+	return hash;
+}
+
+//--
+
+class CacheWriter
+{
+public:
+	CacheWriter(std::vector<uint8_t>& data)
+		: m_data(data)
+	{}
+
+	void write(const void* data, size_t size)
+	{
+		const auto offset = m_data.size();
+		m_data.resize(offset + size);
+		if (size)
+			memcpy(m_data.data() + offset, data, size);
+	}
+
+	template< typename T >
+	void write(const T& value)
+	{
+		write(&value, sizeof(value));
+	}
+
+private:
+	std::vector<uint8_t>& m_data;
+};
+
+class CacheReader
+{
+public:
+	CacheReader(const uint8_t* data, size_t size)
+		: m_pos(data)
+		, m_end(data + size)
+	{}
+
+	inline bool valid() const { return m_valid; }
+	inline bool finished() const { return m_valid && m_pos == m_end; }
+	inline size_t remaining() const { return (size_t)(m_end - m_pos); }
+
+	bool read(void* data, size_t size)
+	{
+		if (!m_valid || size > (size_t)(m_end - m_pos))
+		{
+			m_valid = false;
+			return false;
+		}
+
+		if (size)
+			memcpy(data, m_pos, size);
+		m_pos += size;
+		return true;
+	}
+
+	template< typename T >
+	bool read(T& value)
+	{
+		return read(&value, sizeof(value));
+	}
+
+	// element count of an array that follows, validated against the remaining data so garbage can't make us allocate gigabytes
+	bool readCount(uint32_t& count, size_t elementSize)
+	{
+		if (!read(count))
+			return false;
+
+		if ((uint64_t)count * elementSize > (uint64_t)(m_end - m_pos))
+			m_valid = false;
+
+		return m_valid;
+	}
+
+private:
+	const uint8_t* m_pos = nullptr;
+	const uint8_t* m_end = nullptr;
+	bool m_valid = true;
+};
+
+//--
+
+struct CachedCustomRect
+{
+	uint16_t width = 0, height = 0;
+	uint16_t x = 0, y = 0;
+	uint32_t glyphId = 0;
+	float glyphAdvanceX = 0.0f;
+	ImVec2 glyphOffset;
+	int32_t font = -1; // index in atlas->Fonts
+};
+
+struct CachedFont
+{
+	float fontSize = 0.0f;
+	float ascent = 0.0f;
+	float descent = 0.0f;
+	int32_t metricsTotalSurface = 0;
+	ImWchar ellipsisChar = 0;
+	std::vector<ImFontGlyph> glyphs;
+};
+
+struct CachedAtlas
+{
+	int32_t texWidth = 0;
+	int32_t texHeight = 0;
+	uint8_t texPixelsUseColors = 0;
+	ImVec2 texUvScale;
+	ImVec2 texUvWhitePixel;
+	ImVec4 texUvLines[IM_DRAWLIST_TEX_LINES_WIDTH_MAX + 1];
+	int32_t packIdMouseCursors = -1;
+	int32_t packIdLines = -1;
+
+	std::vector<uint8_t> pixelsAlpha8;
+	std::vector<uint32_t> pixelsRGBA32; // only for atlases with colored glyphs that have no alpha8 data
+
+	std::vector<CachedCustomRect> customRects;
+	std::vector<CachedFont> fonts;
+};
+
+static bool ReadCachedAtlas(CacheReader& reader, const ImFontAtlas* atlas, CachedAtlas& ret)
+{
+	reader.read(ret.texWidth);
+	reader.read(ret.texHeight);
+	reader.read(ret.texPixelsUseColors);
+	reader.read(ret.texUvScale);
+	reader.read(ret.texUvWhitePixel);
+	reader.read(ret.texUvLines, sizeof(ret.texUvLines));
+	reader.read(ret.packIdMouseCursors);
+	reader.read(ret.packIdLines);
+	if (!reader.valid() || ret.texWidth <= 0 || ret.texHeight <= 0)
+		return false;
+
+	const auto numPixels = (size_t)ret.texWidth * (size_t)ret.texHeight;
+
+	uint8_t pixelFormat = 0;
+	if (!reader.read(pixelFormat) || numPixels * (pixelFormat ? sizeof(uint32_t) : 1) > reader.remaining())
+		return false;
+
+	if (pixelFormat == 0)
+	{
+		ret.pixelsAlpha8.resize(numPixels);
+		if (!reader.read(ret.pixelsAlpha8.data(), numPixels))
+			return false;
+	}
+	else
+	{
+		ret.pixelsRGBA32.resize(numPixels);
+		if (!reader.read(ret.pixelsRGBA32.data(), numPixels * sizeof(uint32_t)))
+			return false;
+	}
+
+	uint32_t numRects = 0;
+	if (!reader.readCount(numRects, sizeof(CachedCustomRect)))
+		return false;
+
+	ret.customRects.resize(numRects);
+	for (auto& rect : ret.customRects)
+	{
+		reader.read(rect);
+		if (rect.font < -1 || rect.font >= atlas->Fonts.Size)
+			return false;
+	}
+
+	uint32_t numFonts = 0;
+	if (!reader.read(numFonts) || numFonts != (uint32_t)atlas->Fonts.Size)
+		return false;
+
+	ret.fonts.resize(numFonts);
+	for (auto& font : ret.fonts)
+	{
+		reader.read(font.fontSize);
+		reader.read(font.ascent);
+		reader.read(font.descent);
+		reader.read(font.metricsTotalSurface);
+		reader.read(font.ellipsisChar);
+
+		uint32_t numGlyphs = 0;
+		if (!reader.readCount(numGlyphs, sizeof(ImFontGlyph)))
+			return false;
+
+		font.glyphs.resize(numGlyphs);
+		if (!reader.read(font.glyphs.data(), numGlyphs * sizeof(ImFontGlyph)))
+			return false;
+	}
+
+	return reader.finished();
+}
+
+//--
+
+bool SaveFontAtlasCache(ImFontAtlas* atlas, std::vector<uint8_t>& outData)
+{
+	if (!atlas->IsBuilt() || (!atlas->TexPixelsAlpha8 && !atlas->TexPixelsRGBA32))
+		return false;
+
+	std::vector<uint8_t> payload;
+	CacheWriter writer(payload);
+
+	writer.write((int32_t)atlas->TexWidth);
+	writer.write((int32_t)atlas->TexHeight);
+	writer.write((uint8_t)(atlas->TexPixelsUseColors ? 1 : 0));
+	writer.write(atlas->TexUvScale);
+	writer.write(atlas->TexUvWhitePixel);
+	writer.write(atlas->TexUvLines, sizeof(atlas->TexUvLines));
+	writer.write((int32_t)atlas->PackIdMouseCursors);
+	writer.write((int32_t)atlas->PackIdLines);
+
+	// alpha8 is 4x smaller and GetTexDataAsRGBA32 expands it in no time, colored glyphs exist only in RGBA32
+	const auto numPixels = (size_t)atlas->TexWidth * (size_t)atlas->TexHeight;
+	if (atlas->TexPixelsAlpha8)
+	{
+		writer.write((uint8_t)0);
+		writer.write(atlas->TexPixelsAlpha8, numPixels);
+	}
+	else
+	{
+		writer.write((uint8_t)1);
+		writer.write(atlas->TexPixelsRGBA32, numPixels * sizeof(uint32_t));
+	}
+
+	writer.write((uint32_t)atlas->CustomRects.Size);
+	for (const auto& rect : atlas->CustomRects)
+	{
+		CachedCustomRect cached;
+		cached.width = rect.Width;
+		cached.height = rect.Height;
+		cached.x = rect.X;
+		cached.y = rect.Y;
+		cached.glyphId = rect.GlyphID;
+		cached.glyphAdvanceX = rect.GlyphAdvanceX;
+		cached.glyphOffset = rect.GlyphOffset;
+		cached.font = FontIndex(atlas, rect.Font);
+		writer.write(cached);
+	}
+
+	writer.write((uint32_t)atlas->Fonts.Size);
+	for (const auto* font : atlas->Fonts)
+	{
+		writer.write(font->FontSize);
+		writer.write(font->Ascent);
+		writer.write(font->Descent);
+		writer.write((int32_t)font->MetricsTotalSurface);
+		writer.write(font->EllipsisChar);
+		writer.write((uint32_t)font->Glyphs.Size);
+		writer.write(font->Glyphs.Data, font->Glyphs.Size * sizeof(ImFontGlyph));
+	}
+
+	FontAtlasCacheHeader header;
+	header.imguiVersion = IMGUI_VERSION_NUM;
+	header.sizeOfGlyph = sizeof(ImFontGlyph);
+	header.key = FontAtlasCacheKey(atlas);
+	header.payloadHash = HashData(payload.data(), payload.size());
+	header.payloadSize = payload.size();
+
+	outData.resize(sizeof(header) + payload.size());
+	memcpy(outData.data(), &header, sizeof(header));
+	memcpy(outData.data() + sizeof(header), payload.data(), payload.size());
+	return true;
+}
+
+bool LoadFontAtlasCache(ImFontAtlas* atlas, const std::vector<uint8_t>& data)
+{
+	IM_ASSERT(!atlas->Locked && "Cannot modify a locked ImFontAtlas between NewFrame() and EndFrame/Render()!");
+
+	FontAtlasCacheHeader header;
+	if (data.size() < sizeof(header))
+		return false;
+
+	memcpy(&header, data.data(), sizeof(header));
+	if (header.magic != FONT_ATLAS_CACHE_MAGIC || header.version != FONT_ATLAS_CACHE_VERSION)
+		return false;
+	if (header.imguiVersion != IMGUI_VERSION_NUM || header.sizeOfGlyph != sizeof(ImFontGlyph))
+		return false;
+	if (header.payloadSize != data.size() - sizeof(header))
+		return false;
+
+	const auto* payload = data.data() + sizeof(header);
+	if (header.payloadHash != HashData(payload, (size_t)header.payloadSize))
+		return false;
+	if (header.key != FontAtlasCacheKey(atlas))
+		return false;
+
+	// parse everything first so a bad entry leaves the atlas untouched
+	CachedAtlas cached;
+	CacheReader reader(payload, (size_t)header.payloadSize);
+	if (!ReadCachedAtlas(reader, atlas, cached))
+		return false;
+
+	atlas->ClearTexData();
+	atlas->TexWidth = cached.texWidth;
+	atlas->TexHeight = cached.texHeight;
+	atlas->TexPixelsUseColors = cached.texPixelsUseColors != 0;
+	atlas->TexUvScale = cached.texUvScale;
+	atlas->TexUvWhitePixel = cached.texUvWhitePixel;
+	memcpy(atlas->TexUvLines, cached.texUvLines, sizeof(atlas->TexUvLines));
+	atlas->PackIdMouseCursors = cached.packIdMouseCursors;
+	atlas->PackIdLines = cached.packIdLines;
+
+	// ClearTexData releases these with IM_FREE
+	if (!cached.pixelsAlpha8.empty())
+	{
+		atlas->TexPixelsAlpha8 = (unsigned char*)IM_ALLOC(cached.pixelsAlpha8.size());
+		memcpy(atlas->TexPixelsAlpha8, cached.pixelsAlpha8.data(), cached.pixelsAlpha8.size());
+	}
+	else
+	{
+		atlas->TexPixelsRGBA32 = (unsigned int*)IM_ALLOC(cached.pixelsRGBA32.size() * sizeof(uint32_t));
+		memcpy(atlas->TexPixelsRGBA32, cached.pixelsRGBA32.data(), cached.pixelsRGBA32.size() * sizeof(uint32_t));
+	}
+
+	atlas->CustomRects.resize((int)cached.customRects.size());
+	for (int i = 0; i < atlas->CustomRects.Size; ++i)
+	{
+		const auto& src = cached.customRects[i];
+		auto& rect = atlas->CustomRects[i];
+		rect.Width = src.width;
+		rect.Height = src.height;
+		rect.X = src.x;
+		rect.Y = src.y;
+		rect.GlyphID = src.glyphId;
+		rect.GlyphAdvanceX = src.glyphAdvanceX;
+		rect.GlyphOffset = src.glyphOffset;
+		rect.Font = (src.font >= 0) ? atlas->Fonts[src.font] : nullptr;
+	}
+
+	// same font setup as the builder does (clears the font, links configs), metrics come from the cache instead of the font file
+	for (auto& cfg : atlas->ConfigData)
+		ImFontAtlasBuildSetupFont(atlas, cfg.DstFont, &cfg, 0.0f, 0.0f);
+
+	for (int i = 0; i < atlas->Fonts.Size; ++i)
+	{
+		const auto& src = cached.fonts[i];
+		auto* font = atlas->Fonts[i];
+
+		font->FontSize = src.fontSize;
+		font->Ascent = src.ascent;
+		font->Descent = src.descent;
+		font->MetricsTotalSurface = src.metricsTotalSurface;
+
+		// glyphs are stored after the builder applied the config offsets and rounding, don't go through AddGlyph again
+		font->Glyphs.resize((int)src.glyphs.size());
+		if (!src.glyphs.empty())
+			memcpy(font->Glyphs.Data, src.glyphs.data(), src.glyphs.size() * sizeof(ImFontGlyph));
+
+		font->BuildLookupTable();
+		font->EllipsisChar = src.ellipsisChar;
+	}
+
+	atlas->TexReady = true;
+	return true;
+}
+
+//--
+
+static bool LoadFileToVector(const std::filesystem::path& path, std::vector<uint8_t>& outBuffer)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return false;
+
+	const auto size = (size_t)file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	outBuffer.resize(size);
+	return (bool)file.read((char*)outBuffer.data(), size);
+}
+
+static bool SaveVectorToFile(const std::filesystem::path& path, const std::vector<uint8_t>& buffer)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	return (bool)file.write((const char*)buffer.data(), buffer.size());
+}
+
+bool BuildFontAtlasCached(ImFontAtlas* atlas, const std::filesystem::path& path, bool* outCacheHit)
+{
+	if (outCacheHit)
+		*outCacheHit = false;
+
+	std::vector<uint8_t> data;
+	if (LoadFileToVector(path, data) && LoadFontAtlasCache(atlas, data))
+	{
+		if (outCacheHit)
+			*outCacheHit = true;
+		return true;
+	}
+
+	if (!atlas->Build())
+		return false;
+
+	// failing to write the cache is not an error, we just pay for the build again next time
+	if (SaveFontAtlasCache(atlas, data))
+		SaveVectorToFile(path, data);
+
+	return true;
+}
+
+//--
@@ -0,0 +1,50 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include <imgui.h>
+
+#include <stdint.h>
+#include <vector>
+#include <filesystem>
+
+//--
+
+static const uint32_t FONT_ATLAS_CACHE_MAGIC = 0x41464D42; // "BMFA"
+static const uint32_t FONT_ATLAS_CACHE_VERSION = 1;
+
+// Header in front of the cached atlas, anything that does not match exactly makes the cache stale
+#pragma pack(push, 1)
+struct FontAtlasCacheHeader
+{
+	uint32_t magic = FONT_ATLAS_CACHE_MAGIC;
+	uint32_t version = FONT_ATLAS_CACHE_VERSION;
+	uint32_t imguiVersion = 0; // IMGUI_VERSION_NUM, glyphs and custom rects are stored as raw structures
+	uint32_t sizeOfGlyph = 0; // sizeof(ImFontGlyph)
+	uint64_t key = 0; // FontAtlasCacheKey() of the atlas that was built
+	uint64_t payloadHash = 0;
+	uint64_t payloadSize = 0;
+};
+#pragma pack(pop)
+
+// Hash of everything that affects the atlas build - font data, configs, glyph ranges, atlas flags and custom rects
+// NOTE: an empty atlas gets the default font when it's built so it's added here as well
+extern uint64_t FontAtlasCacheKey(ImFontAtlas* atlas);
+
+// Serialize a built atlas (pixels, UVs, custom rects and glyph tables of all fonts)
+// Returns false if the atlas was not built yet
+extern bool SaveFontAtlasCache(ImFontAtlas* atlas, std::vector<uint8_t>& outData);
+
+// Restore the atlas from serialized data without rasterizing or packing anything, fonts must be added (but not built) exactly as when the data was saved
+// Returns false if the data is stale or corrupted, the atlas is not modified in that case
+extern bool LoadFontAtlasCache(ImFontAtlas* atlas, const std::vector<uint8_t>& data);
+
+// Build the atlas using the cache file at given path, the file is (re)written if it was not usable
+// Returns false only if the atlas failed to build
+extern bool BuildFontAtlasCached(ImFontAtlas* atlas, const std::filesystem::path& path, bool* outCacheHit = nullptr);
+
+//--
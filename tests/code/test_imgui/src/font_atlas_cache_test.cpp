@@ -0,0 +1,367 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "font_atlas_cache.h"
+#include "test_data.h"
+
+#include <chrono>
+#include <memory>
+#include <float.h>
+#include <string.h>
+
+//--
+
+// Fonts of a typical tool - default font plus the UI font at a few sizes, one of them with a big glyph range
+static void AddToolFonts(ImFontAtlas* atlas, float scale = 1.0f, bool largeRanges = false)
+{
+	atlas->AddFontDefault();
+
+	const auto path = MakeTestDataPath("test.ttf").u8string();
+	for (const auto size : { 13.0f, 16.0f, 24.0f })
+	{
+		ImFontConfig cfg;
+		cfg.OversampleH = 3;
+		ASSERT_NE(nullptr, atlas->AddFontFromFileTTF((const char*)path.c_str(), size * scale, &cfg, atlas->GetGlyphRangesDefault()));
+	}
+
+	ImFontConfig cfg;
+	cfg.OversampleH = 2;
+	cfg.OversampleV = 2;
+	const auto* ranges = largeRanges ? atlas->GetGlyphRangesChineseFull() : atlas->GetGlyphRangesCyrillic();
+	ASSERT_NE(nullptr, atlas->AddFontFromFileTTF((const char*)path.c_str(), 32.0f * scale, &cfg, ranges));
+}
+
+static std::unique_ptr<ImFontAtlas> CreateToolAtlas(float scale = 1.0f, bool largeRanges = false)
+{
+	auto atlas = std::make_unique<ImFontAtlas>();
+	AddToolFonts(atlas.get(), scale, largeRanges);
+	return atlas;
+}
+
+static std::filesystem::path MakeTempCachePath(const char* name)
+{
+	const auto path = std::filesystem::temp_directory_path() / name;
+
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+	return path;
+}
+
+static void ExpectSameAtlas(ImFontAtlas* a, ImFontAtlas* b)
+{
+	ASSERT_EQ(a->TexWidth, b->TexWidth);
+	ASSERT_EQ(a->TexHeight, b->TexHeight);
+	EXPECT_TRUE(b->IsBuilt());
+	EXPECT_EQ(a->TexUvWhitePixel.x, b->TexUvWhitePixel.x);
+	EXPECT_EQ(a->TexUvWhitePixel.y, b->TexUvWhitePixel.y);
+	EXPECT_EQ(0, memcmp(a->TexUvLines, b->TexUvLines, sizeof(a->TexUvLines)));
+
+	unsigned char* pixelsA = nullptr;
+	unsigned char* pixelsB = nullptr;
+	int width = 0, height = 0;
+	a->GetTexDataAsRGBA32(&pixelsA, &width, &height);
+	b->GetTexDataAsRGBA32(&pixelsB, &width, &height);
+	ASSERT_NE(nullptr, pixelsA);
+	ASSERT_NE(nullptr, pixelsB);
+	EXPECT_EQ(0, memcmp(pixelsA, pixelsB, (size_t)width * height * 4));
+
+	ASSERT_EQ(a->Fonts.Size, b->Fonts.Size);
+	for (int i = 0; i < a->Fonts.Size; ++i)
+	{
+		const auto* fontA = a->Fonts[i];
+		const auto* fontB = b->Fonts[i];
+
+		EXPECT_EQ(fontA->FontSize, fontB->FontSize) << i;
+		EXPECT_EQ(fontA->Ascent, fontB->Ascent) << i;
+		EXPECT_EQ(fontA->Descent, fontB->Descent) << i;
+		EXPECT_EQ(fontA->FallbackChar, fontB->FallbackChar) << i;
+		EXPECT_EQ(fontA->EllipsisChar, fontB->EllipsisChar) << i;
+		EXPECT_EQ(fontA->IndexAdvanceX.Size, fontB->IndexAdvanceX.Size) << i;
+		EXPECT_EQ(b, fontB->ContainerAtlas) << i;
+
+		ASSERT_EQ(fontA->Glyphs.Size, fontB->Glyphs.Size) << i;
+		EXPECT_EQ(0, memcmp(fontA->Glyphs.Data, fontB->Glyphs.Data, fontA->Glyphs.Size * sizeof(ImFontGlyph))) << i;
+
+		// text layout goes through the lookup tables, not the glyph list
+		const char* text = "The quick brown fox jumps over the lazy dog\n0123456789 {}[]()";
+		const auto sizeA = fontA->CalcTextSizeA(fontA->FontSize, FLT_MAX, 0.0f, text);
+		const auto sizeB = fontB->CalcTextSizeA(fontB->FontSize, FLT_MAX, 0.0f, text);
+		EXPECT_EQ(sizeA.x, sizeB.x) << i;
+		EXPECT_EQ(sizeA.y, sizeB.y) << i;
+	}
+}
+
+//--
+
+TEST(FontAtlasCache, RoundtripMatchesBuild)
+{
+	auto built = CreateToolAtlas();
+	ASSERT_TRUE(built->Build());
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(SaveFontAtlasCache(built.get(), data));
+
+	auto restored = CreateToolAtlas();
+	ASSERT_TRUE(LoadFontAtlasCache(restored.get(), data));
+
+	ExpectSameAtlas(built.get(), restored.get());
+}
+
+TEST(FontAtlasCache, DefaultFontRoundtrip)
+{
+	ImFontAtlas built;
+	unsigned char* pixels = nullptr;
+	int width = 0, height = 0;
+	built.GetTexDataAsRGBA32(&pixels, &width, &height);
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(SaveFontAtlasCache(&built, data));
+
+	// default font gets added the same way the build does it
+	ImFontAtlas restored;
+	ASSERT_TRUE(LoadFontAtlasCache(&restored, data));
+	ExpectSameAtlas(&built, &restored);
+}
+
+TEST(FontAtlasCache, CustomRectsRestored)
+{
+	const auto addRects = [](ImFontAtlas* atlas)
+	{
+		atlas->AddFontDefault();
+		atlas->AddCustomRectRegular(32, 32);
+		atlas->AddCustomRectFontGlyph(atlas->Fonts[0], 0xE000, 13, 13, 15.0f);
+	};
+
+	ImFontAtlas built;
+	addRects(&built);
+	ASSERT_TRUE(built.Build());
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(SaveFontAtlasCache(&built, data));
+
+	ImFontAtlas restored;
+	addRects(&restored);
+	ASSERT_TRUE(LoadFontAtlasCache(&restored, data));
+
+	ASSERT_EQ(built.CustomRects.Size, restored.CustomRects.Size);
+	for (int i = 0; i < built.CustomRects.Size; ++i)
+	{
+		EXPECT_EQ(built.CustomRects[i].X, restored.CustomRects[i].X);
+		EXPECT_EQ(built.CustomRects[i].Y, restored.CustomRects[i].Y);
+		EXPECT_EQ(built.CustomRects[i].IsPacked(), restored.CustomRects[i].IsPacked());
+	}
+
+	EXPECT_EQ(built.PackIdMouseCursors, restored.PackIdMouseCursors);
+	EXPECT_NE(nullptr, restored.Fonts[0]->FindGlyphNoFallback(0xE000));
+	ExpectSameAtlas(&built, &restored);
+}
+
+TEST(FontAtlasCache, NotBuiltAtlasNotSaved)
+{
+	auto atlas = CreateToolAtlas();
+
+	std::vector<uint8_t> data;
+	EXPECT_FALSE(SaveFontAtlasCache(atlas.get(), data));
+}
+
+TEST(FontAtlasCache, ChangedConfigRejected)
+{
+	auto built = CreateToolAtlas();
+	ASSERT_TRUE(built->Build());
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(SaveFontAtlasCache(built.get(), data));
+
+	// different size
+	{
+		auto other = CreateToolAtlas(1.5f);
+		EXPECT_FALSE(LoadFontAtlasCache(other.get(), data));
+		EXPECT_FALSE(other->IsBuilt());
+		EXPECT_EQ(nullptr, other->TexPixelsAlpha8);
+	}
+
+	// different glyph ranges
+	{
+		auto other = CreateToolAtlas(1.0f, true);
+		EXPECT_FALSE(LoadFontAtlasCache(other.get(), data));
+	}
+
+	// different atlas settings
+	{
+		auto other = CreateToolAtlas();
+		other->TexGlyphPadding = 2;
+		EXPECT_FALSE(LoadFontAtlasCache(other.get(), data));
+	}
+
+	// one font less
+	{
+		ImFontAtlas other;
+		other.AddFontDefault();
+		EXPECT_FALSE(LoadFontAtlasCache(&other, data));
+	}
+}
+
+TEST(FontAtlasCache, CorruptedDataRejected)
+{
+	auto built = CreateToolAtlas();
+	ASSERT_TRUE(built->Build());
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(SaveFontAtlasCache(built.get(), data));
+
+	{
+		auto corrupted = data;
+		corrupted[corrupted.size() / 2] ^= 0x5A;
+
+		auto atlas = CreateToolAtlas();
+		EXPECT_FALSE(LoadFontAtlasCache(atlas.get(), corrupted));
+		EXPECT_FALSE(atlas->IsBuilt());
+	}
+
+	{
+		auto truncated = data;
+		truncated.resize(truncated.size() - 100);
+
+		auto atlas = CreateToolAtlas();
+		EXPECT_FALSE(LoadFontAtlasCache(atlas.get(), truncated));
+	}
+
+	{
+		std::vector<uint8_t> header(data.begin(), data.begin() + sizeof(FontAtlasCacheHeader) - 1);
+
+		auto atlas = CreateToolAtlas();
+		EXPECT_FALSE(LoadFontAtlasCache(atlas.get(), header));
+	}
+}
+
+TEST(FontAtlasCache, CacheFileUsedOnSecondBuild)
+{
+	const auto path = MakeTempCachePath("bm_font_atlas_cache_test.bin");
+
+	auto first = CreateToolAtlas();
+	bool hit = true;
+	ASSERT_TRUE(BuildFontAtlasCached(first.get(), path, &hit));
+	EXPECT_FALSE(hit);
+	EXPECT_TRUE(std::filesystem::exists(path));
+
+	auto second = CreateToolAtlas();
+	ASSERT_TRUE(BuildFontAtlasCached(second.get(), path, &hit));
+	EXPECT_TRUE(hit);
+	ExpectSameAtlas(first.get(), second.get());
+
+	// stale file gets rebuilt and replaced
+	auto scaled = CreateToolAtlas(2.0f);
+	ASSERT_TRUE(BuildFontAtlasCached(scaled.get(), path, &hit));
+	EXPECT_FALSE(hit);
+
+	auto scaledAgain = CreateToolAtlas(2.0f);
+	ASSERT_TRUE(BuildFontAtlasCached(scaledAgain.get(), path, &hit));
+	EXPECT_TRUE(hit);
+
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+}
+
+TEST(FontAtlasCache, RestoredAtlasRendersText)
+{
+	const auto path = MakeTempCachePath("bm_font_atlas_cache_render_test.bin");
+
+	uint32_t numVertices[2] = { 0, 0 };
+	for (uint32_t pass = 0; pass < 2; ++pass)
+	{
+		auto* atlas = IM_NEW(ImFontAtlas)();
+		AddToolFonts(atlas);
+
+		bool hit = false;
+		ASSERT_TRUE(BuildFontAtlasCached(atlas, path, &hit));
+		EXPECT_EQ(pass == 1, hit);
+
+		auto* ctx = ImGui::CreateContext(atlas);
+		auto& io = ImGui::GetIO();
+		io.DisplaySize = ImVec2(1280, 720);
+		io.IniFilename = nullptr;
+
+		ImGui::NewFrame();
+		ImGui::SetNextWindowPos(ImVec2(0, 0));
+		ImGui::SetNextWindowSize(ImVec2(1280, 720));
+		ImGui::Begin("Text");
+		for (auto* font : atlas->Fonts)
+		{
+			ImGui::PushFont(font);
+			ImGui::TextUnformatted("The quick brown fox jumps over the lazy dog 0123456789");
+			ImGui::PopFont();
+		}
+		ImGui::End();
+		ImGui::Render();
+
+		numVertices[pass] = (uint32_t)ImGui::GetDrawData()->TotalVtxCount;
+
+		ImGui::DestroyContext(ctx);
+		IM_DELETE(atlas);
+	}
+
+	EXPECT_LT(0, numVertices[0]);
+	EXPECT_EQ(numVertices[0], numVertices[1]);
+
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+}
+
+//--
+
+TEST(FontAtlasCache, DISABLED_StartupBenchmark)
+{
+	const auto path = MakeTempCachePath("bm_font_atlas_cache_benchmark.bin");
+	const uint32_t numRuns = 5;
+
+	for (const auto largeRanges : { false, true })
+	{
+		// fonts are loaded from disk in both cases, only the atlas build differs
+		const auto measure = [&](bool cached) -> double
+		{
+			auto best = 1e10;
+			for (uint32_t i = 0; i < numRuns; ++i)
+			{
+				const auto start = std::chrono::high_resolution_clock::now();
+
+				auto atlas = CreateToolAtlas(1.0f, largeRanges);
+				if (cached)
+				{
+					bool hit = false;
+					EXPECT_TRUE(BuildFontAtlasCached(atlas.get(), path, &hit));
+					EXPECT_TRUE(hit);
+				}
+
+				unsigned char* pixels = nullptr;
+				int width = 0, height = 0;
+				atlas->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+				best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+			}
+			return best;
+		};
+
+		// prime the cache
+		{
+			auto atlas = CreateToolAtlas(1.0f, largeRanges);
+			ASSERT_TRUE(BuildFontAtlasCached(atlas.get(), path));
+		}
+
+		const auto coldTime = measure(false);
+		const auto warmTime = measure(true);
+
+		std::error_code ec;
+		const auto cacheSize = std::filesystem::file_size(path, ec);
+
+		printf("%-14s ranges: cold %7.2f ms, warm %7.2f ms (%.1fx), cache %.1f KB\n",
+			largeRanges ? "CJK" : "Cyrillic", coldTime, warmTime, coldTime / warmTime, cacheSize / 1024.0);
+
+		std::filesystem::remove(path, ec);
+	}
+}
+
+//--
@@ -0,0 +1,601 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "soft_renderer.h"
+#include "../../common/job_system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <math.h>
+
+#if SOFT_RENDERER_SSE2
+#include <emmintrin.h>
+#endif
+
+//--
+
+void SoftFramebuffer::resize(uint32_t w, uint32_t h)
+{
+	width = w;
+	height = h;
+	pixels.resize((size_t)w * h);
+}
+
+void SoftFramebuffer::clear(uint32_t color)
+{
+	std::fill(pixels.begin(), pixels.end(), color);
+}
+
+bool SoftFramebuffer::saveTGA(const std::filesystem::path& path) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	uint8_t header[18];
+	memset(header, 0, sizeof(header));
+	header[2] = 2; // uncompressed true color
+	header[12] = (uint8_t)(width & 0xFF);
+	header[13] = (uint8_t)(width >> 8);
+	header[14] = (uint8_t)(height & 0xFF);
+	header[15] = (uint8_t)(height >> 8);
+	header[16] = 32;
+	header[17] = 0x28; // 8 bits of alpha, top-left origin
+	file.write((const char*)header, sizeof(header));
+
+	std::vector<uint8_t> data(pixels.size() * 4);
+	for (size_t i = 0; i < pixels.size(); ++i)
+	{
+		const auto pixel = pixels[i];
+		data[i * 4 + 0] = (uint8_t)(pixel >> 16); // B
+		data[i * 4 + 1] = (uint8_t)(pixel >> 8); // G
+		data[i * 4 + 2] = (uint8_t)(pixel >> 0); // R
+		data[i * 4 + 3] = (uint8_t)(pixel >> 24); // A
+	}
+
+	return (bool)file.write((const char*)data.data(), data.size());
+}
+
+bool SoftFramebuffer::loadTGA(const std::filesystem::path& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	uint8_t header[18];
+	if (!file.read((char*)header, sizeof(header)))
+		return false;
+
+	const auto bpp = header[16];
+	if (header[1] != 0 || header[2] != 2 || (bpp != 32 && bpp != 24))
+		return false;
+
+	file.seekg(header[0], std::ios::cur); // image ID
+
+	const uint32_t w = header[12] | (header[13] << 8);
+	const uint32_t h = header[14] | (header[15] << 8);
+	const auto topLeft = 0 != (header[17] & 0x20);
+	const auto pixelSize = bpp / 8;
+
+	std::vector<uint8_t> data((size_t)w * h * pixelSize);
+	if (!file.read((char*)data.data(), data.size()))
+		return false;
+
+	resize(w, h);
+	for (uint32_t y = 0; y < h; ++y)
+	{
+		const auto* src = data.data() + (size_t)(topLeft ? y : (h - 1 - y)) * w * pixelSize;
+		auto* dst = pixels.data() + (size_t)y * w;
+
+		for (uint32_t x = 0; x < w; ++x, src += pixelSize)
+		{
+			const uint32_t a = (pixelSize == 4) ? src[3] : 255;
+			dst[x] = src[2] | (src[1] << 8) | (src[0] << 16) | (a << 24);
+		}
+	}
+
+	return true;
+}
+
+//--
+
+typedef std::chrono::high_resolution_clock RenderClock;
+
+static double ElapsedMs(RenderClock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(RenderClock::now() - start).count();
+}
+
+static const float INV_255 = 1.0f / 255.0f;
+
+static inline bool Covers(float w, bool topLeft)
+{
+	return w > 0.0f || (w == 0.0f && topLeft);
+}
+
+static inline uint32_t PackChannel(float value, uint32_t shift)
+{
+	return (uint32_t)(std::min(std::max(value, 0.0f), 255.0f) + 0.5f) << shift;
+}
+
+//--
+
+SoftRenderer::SoftRenderer(const SoftRendererSettings& settings)
+	: m_settings(settings)
+{
+	m_settings.tileSize = std::max<uint32_t>(8, m_settings.tileSize);
+}
+
+SoftRenderer::~SoftRenderer()
+{}
+
+uint32_t SoftRenderer::numThreads() const
+{
+	return m_settings.jobs ? m_settings.jobs->numThreads() : 1;
+}
+
+bool SoftRenderer::HasSIMD()
+{
+	return SOFT_RENDERER_SSE2 != 0;
+}
+
+void SoftRenderer::setFontAtlas(ImFontAtlas* atlas)
+{
+	unsigned char* pixels = nullptr;
+	int width = 0, height = 0;
+	atlas->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+	m_fontTexture.pixels = (const uint32_t*)pixels;
+	m_fontTexture.width = (uint32_t)width;
+	m_fontTexture.height = (uint32_t)height;
+
+	atlas->SetTexID((ImTextureID)&m_fontTexture);
+}
+
+void SoftRenderer::render(const ImDrawData* drawData, SoftFramebuffer& target)
+{
+	m_stats = SoftRenderStats();
+
+	if (!drawData || !drawData->Valid || !target.width || !target.height)
+		return;
+
+	m_target = &target;
+
+	const auto tileSize = m_settings.tileSize;
+	m_tilesX = (target.width + tileSize - 1) / tileSize;
+	m_tilesY = (target.height + tileSize - 1) / tileSize;
+	m_tileBins.resize(m_tilesX * m_tilesY);
+	for (auto& bin : m_tileBins)
+		bin.clear();
+
+	m_stats.numTiles = m_tilesX * m_tilesY;
+
+	const auto setupStart = RenderClock::now();
+	setupTriangles(drawData);
+	m_stats.setupTimeMs = ElapsedMs(setupStart);
+
+	const auto rasterStart = RenderClock::now();
+	renderTiles();
+	m_stats.rasterTimeMs = ElapsedMs(rasterStart);
+
+	m_target = nullptr;
+}
+
+//--
+
+void SoftRenderer::setupTriangles(const ImDrawData* drawData)
+{
+	m_triangles.clear();
+
+	const auto offset = drawData->DisplayPos;
+	const auto scale = ImVec2(drawData->FramebufferScale.x > 0.0f ? drawData->FramebufferScale.x : 1.0f, drawData->FramebufferScale.y > 0.0f ? drawData->FramebufferScale.y : 1.0f);
+
+	for (int listIndex = 0; listIndex < drawData->CmdListsCount; ++listIndex)
+	{
+		const auto* list = drawData->CmdLists[listIndex];
+
+		for (const auto& cmd : list->CmdBuffer)
+		{
+			// there is no render state to reset and callbacks can't draw into our target
+			if (cmd.UserCallback)
+				continue;
+
+			// same scissor rect as the GL/DX backends compute
+			int32_t clip[4];
+			clip[0] = (int32_t)std::max<float>(0.0f, (cmd.ClipRect.x - offset.x) * scale.x);
+			clip[1] = (int32_t)std::max<float>(0.0f, (cmd.ClipRect.y - offset.y) * scale.y);
+			clip[2] = (int32_t)std::min<float>((float)m_target->width, (cmd.ClipRect.z - offset.x) * scale.x);
+			clip[3] = (int32_t)std::min<float>((float)m_target->height, (cmd.ClipRect.w - offset.y) * scale.y);
+
+			const auto numTriangles = cmd.ElemCount / 3;
+			m_stats.numTriangles += numTriangles;
+
+			if (clip[0] >= clip[2] || clip[1] >= clip[3])
+			{
+				m_stats.numCulledTriangles += numTriangles;
+				continue;
+			}
+
+			// no texture set - the atlas was not registered with setFontAtlas, assume it's the font
+			auto* texture = cmd.TextureId ? (const SoftTexture*)cmd.TextureId : &m_fontTexture;
+			if (!texture->pixels || !texture->width || !texture->height)
+				texture = nullptr;
+
+			const auto* indices = list->IdxBuffer.Data + cmd.IdxOffset;
+			const auto* vertices = list->VtxBuffer.Data + cmd.VtxOffset;
+
+			for (uint32_t i = 0; i < numTriangles; ++i)
+			{
+				const auto& v0 = vertices[indices[3 * i + 0]];
+				const auto& v1 = vertices[indices[3 * i + 1]];
+				const auto& v2 = vertices[indices[3 * i + 2]];
+
+				if (!setupTriangle(v0, v1, v2, offset, scale, clip, texture))
+					m_stats.numCulledTriangles += 1;
+			}
+		}
+	}
+}
+
+bool SoftRenderer::setupTriangle(const ImDrawVert& v0, const ImDrawVert& v1, const ImDrawVert& v2, const ImVec2& offset, const ImVec2& scale, const int32_t* clip, const SoftTexture* texture)
+{
+	const ImDrawVert* verts[3] = { &v0, &v1, &v2 };
+
+	float px[3], py[3];
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		px[i] = (verts[i]->pos.x - offset.x) * scale.x;
+		py[i] = (verts[i]->pos.y - offset.y) * scale.y;
+	}
+
+	// clamped as floats first, ImGui uses huge coordinates for "no limit"
+	const auto minX = (int32_t)std::max<float>((float)clip[0], floorf(std::min(px[0], std::min(px[1], px[2]))));
+	const auto minY = (int32_t)std::max<float>((float)clip[1], floorf(std::min(py[0], std::min(py[1], py[2]))));
+	const auto maxX = (int32_t)std::min<float>((float)clip[2], ceilf(std::max(px[0], std::max(px[1], px[2]))));
+	const auto maxY = (int32_t)std::min<float>((float)clip[3], ceilf(std::max(py[0], std::max(py[1], py[2]))));
+	if (minX >= maxX || minY >= maxY)
+		return false;
+
+	const auto area = ((double)px[1] - px[0]) * ((double)py[2] - py[0]) - ((double)py[1] - py[0]) * ((double)px[2] - px[0]);
+	if (area == 0.0)
+		return false;
+
+	Triangle tri;
+	tri.minX = minX;
+	tri.minY = minY;
+	tri.maxX = maxX;
+	tri.maxY = maxY;
+	tri.invArea = (float)(1.0 / fabs(area));
+	tri.texture = texture;
+
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		const auto a = (i + 1) % 3;
+		const auto b = (i + 2) % 3;
+
+		auto& edge = tri.edges[i];
+		edge.a = py[a] - py[b];
+		edge.b = px[b] - px[a];
+
+		// edge shared by two triangles is evaluated from the same vertex in both so the results are exact negatives
+		// of each other, with the top-left rule every pixel along the edge is drawn exactly once
+		const auto fromA = (px[a] < px[b]) || (px[a] == px[b] && py[a] < py[b]);
+		edge.ox = fromA ? px[a] : px[b];
+		edge.oy = fromA ? py[a] : py[b];
+
+		if (area < 0.0)
+		{
+			edge.a = -edge.a;
+			edge.b = -edge.b;
+		}
+
+		edge.topLeft = edge.a > 0.0f || (edge.a == 0.0f && edge.b > 0.0f);
+	}
+
+	tri.u0 = v0.uv.x;
+	tri.du1 = v1.uv.x - v0.uv.x;
+	tri.du2 = v2.uv.x - v0.uv.x;
+	tri.v0 = v0.uv.y;
+	tri.dv1 = v1.uv.y - v0.uv.y;
+	tri.dv2 = v2.uv.y - v0.uv.y;
+
+	static const uint32_t ColorShifts[4] = { IM_COL32_R_SHIFT, IM_COL32_G_SHIFT, IM_COL32_B_SHIFT, IM_COL32_A_SHIFT };
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		const auto c0 = (float)((v0.col >> ColorShifts[c]) & 0xFF);
+		const auto c1 = (float)((v1.col >> ColorShifts[c]) & 0xFF);
+		const auto c2 = (float)((v2.col >> ColorShifts[c]) & 0xFF);
+		tri.c0[c] = c0;
+		tri.dc1[c] = c1 - c0;
+		tri.dc2[c] = c2 - c0;
+	}
+
+	tri.uniformColor = (v0.col == v1.col) && (v0.col == v2.col);
+
+	const auto index = (uint32_t)m_triangles.size();
+	m_triangles.push_back(tri);
+
+	const auto tileSize = (int32_t)m_settings.tileSize;
+	for (int32_t ty = minY / tileSize; ty <= (maxY - 1) / tileSize; ++ty)
+	{
+		for (int32_t tx = minX / tileSize; tx <= (maxX - 1) / tileSize; ++tx)
+		{
+			m_tileBins[ty * m_tilesX + tx].push_back(index);
+			m_stats.numBinnedTriangles += 1;
+		}
+	}
+
+	return true;
+}
+
+//--
+
+void SoftRenderer::renderTiles()
+{
+	const auto numTiles = m_tilesX * m_tilesY;
+
+	if (!m_settings.jobs || numTiles <= 1)
+	{
+		for (uint32_t i = 0; i < numTiles; ++i)
+			renderTile(i);
+		return;
+	}
+
+	// tiles don't overlap so they can be rendered in any order
+	m_settings.jobs->parallelFor(numTiles, [this](uint32_t tileIndex) { renderTile(tileIndex); });
+}
+
+void SoftRenderer::renderTile(uint32_t tileIndex)
+{
+	const auto& bin = m_tileBins[tileIndex];
+	if (bin.empty())
+		return;
+
+	const auto tileSize = (int32_t)m_settings.tileSize;
+	const auto tileMinX = (int32_t)(tileIndex % m_tilesX) * tileSize;
+	const auto tileMinY = (int32_t)(tileIndex / m_tilesX) * tileSize;
+	const auto tileMaxX = std::min<int32_t>(tileMinX + tileSize, (int32_t)m_target->width);
+	const auto tileMaxY = std::min<int32_t>(tileMinY + tileSize, (int32_t)m_target->height);
+
+	const auto simd = m_settings.simd && HasSIMD();
+
+	for (const auto index : bin)
+	{
+		const auto& tri = m_triangles[index];
+
+		const auto minX = std::max(tri.minX, tileMinX);
+		const auto minY = std::max(tri.minY, tileMinY);
+		const auto maxX = std::min(tri.maxX, tileMaxX);
+		const auto maxY = std::min(tri.maxY, tileMaxY);
+
+		if (simd)
+			rasterizeSSE2(tri, minX, minY, maxX, maxY);
+		else
+			rasterizeScalar(tri, minX, minY, maxX, maxY);
+	}
+}
+
+//--
+
+void SoftRenderer::rasterizeScalar(const Triangle& tri, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY)
+{
+	const auto& e0 = tri.edges[0];
+	const auto& e1 = tri.edges[1];
+	const auto& e2 = tri.edges[2];
+
+	const auto* texture = tri.texture;
+	const auto texWidth = texture ? (float)texture->width : 0.0f;
+	const auto texHeight = texture ? (float)texture->height : 0.0f;
+	const auto texMaxX = texture ? (float)(texture->width - 1) : 0.0f;
+	const auto texMaxY = texture ? (float)(texture->height - 1) : 0.0f;
+
+	for (int32_t y = minY; y < maxY; ++y)
+	{
+		const auto py = (float)y + 0.5f;
+		const auto row0 = e0.b * (py - e0.oy);
+		const auto row1 = e1.b * (py - e1.oy);
+		const auto row2 = e2.b * (py - e2.oy);
+
+		auto* dst = m_target->pixels.data() + (size_t)y * m_target->width;
+
+		for (int32_t x = minX; x < maxX; ++x)
+		{
+			const auto px = (float)x + 0.5f;
+			const auto w0 = e0.a * (px - e0.ox) + row0;
+			const auto w1 = e1.a * (px - e1.ox) + row1;
+			const auto w2 = e2.a * (px - e2.ox) + row2;
+
+			if (!Covers(w0, e0.topLeft) || !Covers(w1, e1.topLeft) || !Covers(w2, e2.topLeft))
+				continue;
+
+			const auto l1 = w1 * tri.invArea;
+			const auto l2 = w2 * tri.invArea;
+
+			float col[4];
+			for (uint32_t c = 0; c < 4; ++c)
+				col[c] = tri.uniformColor ? tri.c0[c] : (tri.c0[c] + l1 * tri.dc1[c] + l2 * tri.dc2[c]);
+
+			if (texture)
+			{
+				const auto u = tri.u0 + l1 * tri.du1 + l2 * tri.du2;
+				const auto v = tri.v0 + l1 * tri.dv1 + l2 * tri.dv2;
+				const auto tx = (uint32_t)std::min(std::max(u * texWidth, 0.0f), texMaxX);
+				const auto ty = (uint32_t)std::min(std::max(v * texHeight, 0.0f), texMaxY);
+				const auto texel = texture->pixels[tx + ty * texture->width];
+
+				for (uint32_t c = 0; c < 4; ++c)
+					col[c] = (col[c] * (float)((texel >> (8 * c)) & 0xFF)) * INV_255;
+			}
+
+			// SRC_ALPHA, ONE_MINUS_SRC_ALPHA for color and ONE, ONE_MINUS_SRC_ALPHA for alpha, same as the standard backends
+			const auto old = dst[x];
+			const auto srcAlpha = col[3] * INV_255;
+			const auto invAlpha = 1.0f - srcAlpha;
+
+			uint32_t pixel = 0;
+			for (uint32_t c = 0; c < 3; ++c)
+				pixel |= PackChannel(col[c] * srcAlpha + (float)((old >> (8 * c)) & 0xFF) * invAlpha, 8 * c);
+			pixel |= PackChannel(col[3] + (float)(old >> 24) * invAlpha, 24);
+
+			dst[x] = pixel;
+		}
+	}
+}
+
+#if SOFT_RENDERER_SSE2
+
+static inline __m128 CoversSSE2(__m128 w, __m128 topLeft)
+{
+	const auto zero = _mm_setzero_ps();
+	return _mm_or_ps(_mm_cmpgt_ps(w, zero), _mm_and_ps(_mm_cmpeq_ps(w, zero), topLeft));
+}
+
+static inline __m128 UnpackChannelSSE2(__m128i pixels, int shift)
+{
+	return _mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(pixels, _mm_cvtsi32_si128(shift)), _mm_set1_epi32(0xFF)));
+}
+
+static inline __m128i PackChannelSSE2(__m128 value, int shift)
+{
+	const auto clamped = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+	return _mm_sll_epi32(_mm_cvttps_epi32(_mm_add_ps(clamped, _mm_set1_ps(0.5f))), _mm_cvtsi32_si128(shift));
+}
+
+// Same math as the scalar version, 4 pixels of a row at a time with the color channels in separate registers
+void SoftRenderer::rasterizeSSE2(const Triangle& tri, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY)
+{
+	__m128 edgeA[3], edgeOX[3], edgeTopLeft[3];
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		edgeA[i] = _mm_set1_ps(tri.edges[i].a);
+		edgeOX[i] = _mm_set1_ps(tri.edges[i].ox);
+		edgeTopLeft[i] = _mm_castsi128_ps(_mm_set1_epi32(tri.edges[i].topLeft ? -1 : 0));
+	}
+
+	const auto invArea = _mm_set1_ps(tri.invArea);
+	const auto laneCenters = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const auto laneIndices = _mm_setr_epi32(0, 1, 2, 3);
+	const auto endX = _mm_set1_epi32(maxX);
+	const auto inv255 = _mm_set1_ps(INV_255);
+	const auto one = _mm_set1_ps(1.0f);
+
+	__m128 c0[4], dc1[4], dc2[4];
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		c0[c] = _mm_set1_ps(tri.c0[c]);
+		dc1[c] = _mm_set1_ps(tri.dc1[c]);
+		dc2[c] = _mm_set1_ps(tri.dc2[c]);
+	}
+
+	const auto* texture = tri.texture;
+	const auto u0 = _mm_set1_ps(tri.u0), du1 = _mm_set1_ps(tri.du1), du2 = _mm_set1_ps(tri.du2);
+	const auto v0 = _mm_set1_ps(tri.v0), dv1 = _mm_set1_ps(tri.dv1), dv2 = _mm_set1_ps(tri.dv2);
+	const auto texWidth = _mm_set1_ps(texture ? (float)texture->width : 0.0f);
+	const auto texHeight = _mm_set1_ps(texture ? (float)texture->height : 0.0f);
+	const auto texMaxX = _mm_set1_ps(texture ? (float)(texture->width - 1) : 0.0f);
+	const auto texMaxY = _mm_set1_ps(texture ? (float)(texture->height - 1) : 0.0f);
+
+	for (int32_t y = minY; y < maxY; ++y)
+	{
+		const auto py = (float)y + 0.5f;
+
+		__m128 row[3];
+		for (uint32_t i = 0; i < 3; ++i)
+			row[i] = _mm_set1_ps(tri.edges[i].b * (py - tri.edges[i].oy));
+
+		auto* dst = m_target->pixels.data() + (size_t)y * m_target->width;
+
+		for (int32_t x = minX; x < maxX; x += 4)
+		{
+			const auto px = _mm_add_ps(_mm_set1_ps((float)x), laneCenters);
+			const auto w0 = _mm_add_ps(_mm_mul_ps(edgeA[0], _mm_sub_ps(px, edgeOX[0])), row[0]);
+			const auto w1 = _mm_add_ps(_mm_mul_ps(edgeA[1], _mm_sub_ps(px, edgeOX[1])), row[1]);
+			const auto w2 = _mm_add_ps(_mm_mul_ps(edgeA[2], _mm_sub_ps(px, edgeOX[2])), row[2]);
+
+			const auto covered = _mm_and_ps(CoversSSE2(w0, edgeTopLeft[0]), _mm_and_ps(CoversSSE2(w1, edgeTopLeft[1]), CoversSSE2(w2, edgeTopLeft[2])));
+			const auto inside = _mm_cmplt_epi32(_mm_add_epi32(_mm_set1_epi32(x), laneIndices), endX);
+			const auto mask = _mm_and_si128(_mm_castps_si128(covered), inside);
+			if (0 == _mm_movemask_epi8(mask))
+				continue;
+
+			const auto l1 = _mm_mul_ps(w1, invArea);
+			const auto l2 = _mm_mul_ps(w2, invArea);
+
+			__m128 col[4];
+			for (uint32_t c = 0; c < 4; ++c)
+				col[c] = tri.uniformColor ? c0[c] : _mm_add_ps(_mm_add_ps(c0[c], _mm_mul_ps(l1, dc1[c])), _mm_mul_ps(l2, dc2[c]));
+
+			if (texture)
+			{
+				const auto u = _mm_add_ps(_mm_add_ps(u0, _mm_mul_ps(l1, du1)), _mm_mul_ps(l2, du2));
+				const auto v = _mm_add_ps(_mm_add_ps(v0, _mm_mul_ps(l1, dv1)), _mm_mul_ps(l2, dv2));
+
+				alignas(16) int32_t tx[4], ty[4];
+				_mm_store_si128((__m128i*)tx, _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(u, texWidth), _mm_setzero_ps()), texMaxX)));
+				_mm_store_si128((__m128i*)ty, _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(v, texHeight), _mm_setzero_ps()), texMaxY)));
+
+				// no gather in SSE2
+				const auto* texels = texture->pixels;
+				const auto pitch = texture->width;
+				const auto texel = _mm_setr_epi32(
+					(int)texels[tx[0] + ty[0] * pitch], (int)texels[tx[1] + ty[1] * pitch],
+					(int)texels[tx[2] + ty[2] * pitch], (int)texels[tx[3] + ty[3] * pitch]);
+
+				for (uint32_t c = 0; c < 4; ++c)
+					col[c] = _mm_mul_ps(_mm_mul_ps(col[c], UnpackChannelSSE2(texel, 8 * c)), inv255);
+			}
+
+			// partial group at the end of the span must not touch pixels past it (may be the end of the buffer)
+			const auto fullGroup = (x + 4) <= maxX;
+
+			alignas(16) uint32_t partial[4] = { 0, 0, 0, 0 };
+			__m128i old;
+			if (fullGroup)
+			{
+				old = _mm_loadu_si128((const __m128i*)(dst + x));
+			}
+			else
+			{
+				for (int32_t i = 0; i < maxX - x; ++i)
+					partial[i] = dst[x + i];
+				old = _mm_load_si128((const __m128i*)partial);
+			}
+
+			const auto srcAlpha = _mm_mul_ps(col[3], inv255);
+			const auto invAlpha = _mm_sub_ps(one, srcAlpha);
+
+			auto pixel = PackChannelSSE2(_mm_add_ps(col[3], _mm_mul_ps(UnpackChannelSSE2(old, 24), invAlpha)), 24);
+			for (uint32_t c = 0; c < 3; ++c)
+				pixel = _mm_or_si128(pixel, PackChannelSSE2(_mm_add_ps(_mm_mul_ps(col[c], srcAlpha), _mm_mul_ps(UnpackChannelSSE2(old, 8 * c), invAlpha)), 8 * c));
+
+			const auto result = _mm_or_si128(_mm_and_si128(mask, pixel), _mm_andnot_si128(mask, old));
+
+			if (fullGroup)
+			{
+				_mm_storeu_si128((__m128i*)(dst + x), result);
+			}
+			else
+			{
+				_mm_store_si128((__m128i*)partial, result);
+				for (int32_t i = 0; i < maxX - x; ++i)
+					dst[x + i] = partial[i];
+			}
+		}
+	}
+}
+
+#else
+
+void SoftRenderer::rasterizeSSE2(const Triangle& tri, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY)
+{
+	rasterizeScalar(tri, minX, minY, maxX, maxY);
+}
+
+#endif
+
+//--
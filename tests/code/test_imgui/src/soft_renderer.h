@@ -0,0 +1,136 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include <imgui.h>
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <filesystem>
+
+//--
+
+class JobSystem;
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define SOFT_RENDERER_SSE2 1
+#else
+	#define SOFT_RENDERER_SSE2 0
+#endif
+
+// RGBA8 texture that can be used as ImTextureID, same pixel layout as ImFontAtlas::GetTexDataAsRGBA32 and IM_COL32
+struct SoftTexture
+{
+	const uint32_t* pixels = nullptr;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+// RGBA8 render target
+struct SoftFramebuffer
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint32_t> pixels;
+
+	void resize(uint32_t w, uint32_t h);
+	void clear(uint32_t color);
+
+	inline uint32_t pixel(uint32_t x, uint32_t y) const { return pixels[x + y * width]; }
+
+	// Uncompressed 32-bit TGA, good enough for golden images and easy to look at
+	bool saveTGA(const std::filesystem::path& path) const;
+	bool loadTGA(const std::filesystem::path& path);
+};
+
+struct SoftRendererSettings
+{
+	JobSystem* jobs = nullptr; // tiles are rendered as jobs on it, nullptr - everything is rendered on the calling thread
+	uint32_t tileSize = 64; // screen is split into tiles of this size, each tile is rendered by one job
+	bool simd = true; // use the SSE2 rasterizer when available, false - scalar reference path (same results)
+};
+
+struct SoftRenderStats
+{
+	uint32_t numTriangles = 0;
+	uint32_t numCulledTriangles = 0; // degenerate, clipped or outside of the target
+	uint32_t numBinnedTriangles = 0; // triangle-tile pairs
+	uint32_t numTiles = 0;
+	double setupTimeMs = 0.0;
+	double rasterTimeMs = 0.0;
+};
+
+// CPU rasterizer for ImDrawData - clip rects, per vertex color, textures (nearest) and alpha blending like the standard backends do it
+// Triangles are binned into screen tiles and tiles are rendered in parallel, each tile keeps the submission order so
+// the output does not depend on the thread count or tile size
+class SoftRenderer
+{
+public:
+	SoftRenderer(const SoftRendererSettings& settings = SoftRendererSettings());
+	~SoftRenderer();
+
+	SoftRenderer(const SoftRenderer&) = delete;
+	SoftRenderer& operator=(const SoftRenderer&) = delete;
+
+	inline const SoftRendererSettings& settings() const { return m_settings; }
+	inline const SoftRenderStats& stats() const { return m_stats; }
+	uint32_t numThreads() const;
+
+	// Use the RGBA32 pixels of the atlas (built if needed) as the font texture, draw commands without a texture use it as well
+	// NOTE: the atlas must outlive the renderer (or be set again after it's rebuilt)
+	void setFontAtlas(ImFontAtlas* atlas);
+
+	// Render the draw data on top of the current content of the target
+	void render(const ImDrawData* drawData, SoftFramebuffer& target);
+
+	// Is the SIMD path compiled in
+	static bool HasSIMD();
+
+private:
+	struct Edge
+	{
+		float a = 0.0f, b = 0.0f; // w = a * (x - ox) + b * (y - oy), positive inside
+		float ox = 0.0f, oy = 0.0f;
+		bool topLeft = false; // pixels exactly on the edge belong to the triangle
+	};
+
+	struct Triangle
+	{
+		Edge edges[3]; // edge i is opposite to vertex i so its function is the (scaled) barycentric of vertex i
+		float invArea = 0.0f;
+		float u0 = 0.0f, du1 = 0.0f, du2 = 0.0f;
+		float v0 = 0.0f, dv1 = 0.0f, dv2 = 0.0f;
+		float c0[4], dc1[4], dc2[4]; // RGBA, 0-255
+		bool uniformColor = false;
+		int32_t minX = 0, minY = 0, maxX = 0, maxY = 0; // pixel bounds clipped to the clip rect, max exclusive
+		const SoftTexture* texture = nullptr;
+	};
+
+	SoftRendererSettings m_settings;
+	SoftRenderStats m_stats;
+
+	SoftTexture m_fontTexture;
+
+	std::vector<Triangle> m_triangles;
+	std::vector<std::vector<uint32_t>> m_tileBins; // triangle indices in submission order
+	uint32_t m_tilesX = 0;
+	uint32_t m_tilesY = 0;
+
+	SoftFramebuffer* m_target = nullptr;
+
+	void setupTriangles(const ImDrawData* drawData);
+	bool setupTriangle(const ImDrawVert& v0, const ImDrawVert& v1, const ImDrawVert& v2, const ImVec2& offset, const ImVec2& scale, const int32_t* clip, const SoftTexture* texture);
+
+	void renderTiles();
+	void renderTile(uint32_t tileIndex);
+
+	void rasterizeScalar(const Triangle& tri, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY);
+	void rasterizeSSE2(const Triangle& tri, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY);
+};
+
+//--
@@ -0,0 +1,342 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "soft_renderer.h"
+#include "tool_ui.h"
+#include "../../common/job_system.h"
+
+#include <algorithm>
+#include <chrono>
+
+//--
+
+static const uint32_t CLEAR_COLOR = IM_COL32(0, 0, 0, 255);
+
+static uint32_t Channel(uint32_t color, uint32_t index)
+{
+	return (color >> (8 * index)) & 0xFF;
+}
+
+// Headless context with a renderer and a target of the same size
+class SoftRendererTest : public testing::Test
+{
+public:
+	static const uint32_t WIDTH = 128;
+	static const uint32_t HEIGHT = 96;
+
+	std::unique_ptr<HeadlessUIContext> context;
+	std::unique_ptr<SoftRenderer> renderer;
+	SoftFramebuffer target;
+
+	virtual void SetUp() override
+	{
+		context = std::make_unique<HeadlessUIContext>(ImVec2(WIDTH, HEIGHT));
+
+		SoftRendererSettings settings;
+		settings.tileSize = 32; // make sure the shapes span a few tiles
+		renderer = std::make_unique<SoftRenderer>(settings);
+		renderer->setFontAtlas(context->atlas());
+
+		target.resize(WIDTH, HEIGHT);
+		target.clear(CLEAR_COLOR);
+
+		ImGui::NewFrame();
+	}
+
+	virtual void TearDown() override
+	{
+		renderer.reset();
+		context.reset();
+	}
+
+	// draw list that is rendered on top of everything, we don't need any windows
+	ImDrawList* drawList()
+	{
+		return ImGui::GetForegroundDrawList();
+	}
+
+	void render()
+	{
+		ImGui::Render();
+		renderer->render(ImGui::GetDrawData(), target);
+	}
+};
+
+//--
+
+TEST_F(SoftRendererTest, SolidRect)
+{
+	drawList()->AddRectFilled(ImVec2(10, 20), ImVec2(50, 40), IM_COL32(255, 0, 0, 255));
+	render();
+
+	EXPECT_EQ(IM_COL32(255, 0, 0, 255), target.pixel(10, 20));
+	EXPECT_EQ(IM_COL32(255, 0, 0, 255), target.pixel(49, 39));
+	EXPECT_EQ(IM_COL32(255, 0, 0, 255), target.pixel(30, 30));
+
+	// rect max is exclusive, same as with any GPU backend
+	EXPECT_EQ(CLEAR_COLOR, target.pixel(9, 20));
+	EXPECT_EQ(CLEAR_COLOR, target.pixel(50, 20));
+	EXPECT_EQ(CLEAR_COLOR, target.pixel(10, 19));
+	EXPECT_EQ(CLEAR_COLOR, target.pixel(10, 40));
+
+	EXPECT_LT(0, renderer->stats().numTriangles);
+	EXPECT_LT(1, renderer->stats().numBinnedTriangles); // spans more than one tile
+}
+
+TEST_F(SoftRendererTest, AlphaBlending)
+{
+	drawList()->AddRectFilled(ImVec2(0, 0), ImVec2(40, 40), IM_COL32(255, 0, 0, 128));
+	drawList()->AddRectFilled(ImVec2(20, 20), ImVec2(60, 60), IM_COL32(0, 255, 0, 64));
+	render();
+
+	// red over black
+	{
+		const auto color = target.pixel(10, 10);
+		EXPECT_NEAR(128, Channel(color, 0), 1);
+		EXPECT_EQ(0, Channel(color, 1));
+		EXPECT_EQ(0, Channel(color, 2));
+		EXPECT_EQ(255, Channel(color, 3));
+	}
+
+	// green over red over black, blended in submission order
+	{
+		const auto color = target.pixel(30, 30);
+		EXPECT_NEAR(128 * (255 - 64) / 255, Channel(color, 0), 1);
+		EXPECT_NEAR(64, Channel(color, 1), 1);
+		EXPECT_EQ(0, Channel(color, 2));
+		EXPECT_EQ(255, Channel(color, 3));
+	}
+
+	// green over black
+	{
+		const auto color = target.pixel(50, 50);
+		EXPECT_EQ(0, Channel(color, 0));
+		EXPECT_NEAR(64, Channel(color, 1), 1);
+	}
+}
+
+TEST_F(SoftRendererTest, ClipRect)
+{
+	drawList()->PushClipRect(ImVec2(20, 30), ImVec2(40, 50));
+	drawList()->AddRectFilled(ImVec2(0, 0), ImVec2(WIDTH, HEIGHT), IM_COL32(255, 255, 255, 255));
+	drawList()->PopClipRect();
+	render();
+
+	uint32_t numWhite = 0;
+	for (uint32_t y = 0; y < HEIGHT; ++y)
+	{
+		for (uint32_t x = 0; x < WIDTH; ++x)
+		{
+			const auto inside = (x >= 20 && x < 40 && y >= 30 && y < 50);
+			const auto expected = inside ? IM_COL32(255, 255, 255, 255) : CLEAR_COLOR;
+			numWhite += inside ? 1 : 0;
+			ASSERT_EQ(expected, target.pixel(x, y)) << x << "," << y;
+		}
+	}
+
+	EXPECT_EQ(20 * 20, numWhite);
+}
+
+TEST_F(SoftRendererTest, TextUsesFontTexture)
+{
+	const char* text = "Hello";
+	const auto pos = ImVec2(10, 10);
+	drawList()->AddText(pos, IM_COL32(255, 255, 255, 255), text);
+	const auto size = ImGui::CalcTextSize(text);
+	render();
+
+	// glyphs are not solid boxes, some pixels of the text box stay clear
+	uint32_t numLit = 0, numLitOutside = 0;
+	for (uint32_t y = 0; y < HEIGHT; ++y)
+	{
+		for (uint32_t x = 0; x < WIDTH; ++x)
+		{
+			if (target.pixel(x, y) == CLEAR_COLOR)
+				continue;
+
+			const auto inside = x >= pos.x && x < pos.x + size.x && y >= pos.y && y < pos.y + size.y;
+			numLit += 1;
+			numLitOutside += inside ? 0 : 1;
+		}
+	}
+
+	EXPECT_LT(20, numLit);
+	EXPECT_GT((uint32_t)(size.x * size.y), numLit);
+	EXPECT_EQ(0, numLitOutside);
+}
+
+TEST_F(SoftRendererTest, AntiAliasedShapesDrawEachPixelOnce)
+{
+	// AA fringe triangles share edges with the shape, any pixel drawn twice would be brighter than the rest
+	drawList()->AddCircleFilled(ImVec2(64, 48), 40.0f, IM_COL32(255, 255, 255, 128), 64);
+	render();
+
+	uint32_t numInterior = 0;
+	for (uint32_t y = 0; y < HEIGHT; ++y)
+	{
+		for (uint32_t x = 0; x < WIDTH; ++x)
+		{
+			const auto dx = x + 0.5f - 64.0f;
+			const auto dy = y + 0.5f - 48.0f;
+			if (dx * dx + dy * dy > 38.0f * 38.0f)
+				continue;
+
+			ASSERT_NEAR(128, Channel(target.pixel(x, y), 0), 1) << x << "," << y;
+			numInterior += 1;
+		}
+	}
+
+	EXPECT_LT(4000, numInterior);
+}
+
+//--
+
+static void RenderToolUI(const ToolUISettings& settings, const SoftRendererSettings& rendererSettings, SoftFramebuffer& target)
+{
+	HeadlessUIContext context(settings.displaySize);
+	SoftRenderer renderer(rendererSettings);
+	renderer.setFontAtlas(context.atlas());
+
+	// windows need a few frames to settle their layout
+	for (uint32_t i = 0; i < 3; ++i)
+		RunToolUIFrame(settings, i);
+
+	target.resize((uint32_t)settings.displaySize.x, (uint32_t)settings.displaySize.y);
+	target.clear(IM_COL32(30, 30, 40, 255));
+	renderer.render(ImGui::GetDrawData(), target);
+}
+
+static uint32_t CountDifferentPixels(const SoftFramebuffer& a, const SoftFramebuffer& b, uint32_t tolerance)
+{
+	uint32_t ret = 0;
+	for (size_t i = 0; i < a.pixels.size(); ++i)
+	{
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			const auto ca = (int)Channel(a.pixels[i], c);
+			const auto cb = (int)Channel(b.pixels[i], c);
+			if ((uint32_t)abs(ca - cb) > tolerance)
+			{
+				ret += 1;
+				break;
+			}
+		}
+	}
+	return ret;
+}
+
+TEST(SoftRenderer, ThreadsAndTilesDoNotChangeOutput)
+{
+	ToolUISettings settings;
+	settings.displaySize = ImVec2(1280, 720);
+
+	// everything on the calling thread
+	SoftRendererSettings reference;
+	reference.tileSize = 64;
+
+	SoftFramebuffer expected;
+	RenderToolUI(settings, reference, expected);
+
+	JobSystem twoWorkers(2), eightWorkers(8);
+	for (auto* jobs : { &twoWorkers, &eightWorkers })
+	{
+		for (const auto tileSize : { 16u, 64u, 256u })
+		{
+			SoftRendererSettings rendererSettings;
+			rendererSettings.jobs = jobs;
+			rendererSettings.tileSize = tileSize;
+
+			SoftFramebuffer actual;
+			RenderToolUI(settings, rendererSettings, actual);
+			EXPECT_TRUE(expected.pixels == actual.pixels) << jobs->numThreads() << " threads, " << tileSize << " tile size";
+		}
+	}
+}
+
+TEST(SoftRenderer, ScalarMatchesSIMD)
+{
+	if (!SoftRenderer::HasSIMD())
+		GTEST_SKIP() << "SIMD path not compiled in";
+
+	ToolUISettings settings;
+	settings.displaySize = ImVec2(1280, 720);
+
+	SoftRendererSettings rendererSettings;
+	rendererSettings.simd = false;
+	SoftFramebuffer scalar;
+	RenderToolUI(settings, rendererSettings, scalar);
+
+	rendererSettings.simd = true;
+	SoftFramebuffer simd;
+	RenderToolUI(settings, rendererSettings, simd);
+
+	EXPECT_EQ(0, CountDifferentPixels(scalar, simd, 0));
+}
+
+//--
+
+TEST(SoftRenderer, DISABLED_FrameCostBenchmark)
+{
+	ToolUISettings settings;
+	settings.displaySize = ImVec2(1920, 1080);
+
+	const uint32_t numFrames = 30;
+	const auto maxThreads = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+
+	for (const auto simd : { false, true })
+	{
+		if (simd && !SoftRenderer::HasSIMD())
+			continue;
+
+		for (uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+		{
+			// single thread renders on the calling thread, no job overhead
+			std::unique_ptr<JobSystem> jobs;
+			if (numThreads > 1)
+				jobs = std::make_unique<JobSystem>(numThreads);
+
+			SoftRendererSettings rendererSettings;
+			rendererSettings.jobs = jobs.get();
+			rendererSettings.simd = simd;
+
+			HeadlessUIContext context(settings.displaySize);
+			SoftRenderer renderer(rendererSettings);
+			renderer.setFontAtlas(context.atlas());
+
+			SoftFramebuffer target;
+			target.resize((uint32_t)settings.displaySize.x, (uint32_t)settings.displaySize.y);
+
+			double uiTime = 0.0, setupTime = 0.0, rasterTime = 0.0;
+			uint32_t numTriangles = 0;
+
+			for (uint32_t i = 0; i < numFrames + 3; ++i)
+			{
+				const auto start = std::chrono::high_resolution_clock::now();
+				RunToolUIFrame(settings, i);
+				const auto frameUiTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+				target.clear(IM_COL32(30, 30, 40, 255));
+				renderer.render(ImGui::GetDrawData(), target);
+
+				// first frames settle the layout
+				if (i >= 3)
+				{
+					uiTime += frameUiTime;
+					setupTime += renderer.stats().setupTimeMs;
+					rasterTime += renderer.stats().rasterTimeMs;
+					numTriangles = renderer.stats().numTriangles;
+				}
+			}
+
+			printf("%-6s %2u threads: UI %6.2f ms, setup %6.2f ms, raster %6.2f ms, frame %6.2f ms, %u triangles\n",
+				simd ? "SSE2" : "scalar", numThreads,
+				uiTime / numFrames, setupTime / numFrames, rasterTime / numFrames, (uiTime + setupTime + rasterTime) / numFrames, numTriangles);
+		}
+	}
+}
+
+//--
@@ -0,0 +1,49 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "test_data.h"
+
+#ifdef __APPLE__
+#import <sys/proc_info.h>
+#import <libproc.h>
+#elif defined _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+//--
+
+#define TEST_DATA "../../../data/"
+
+static std::filesystem::path GetExecutablePath()
+{
+	char exepath[1024];
+	memset(exepath, 0, sizeof(exepath));
+
+#ifdef _WIN32
+	GetModuleFileNameA(GetModuleHandle(NULL), exepath, sizeof(exepath));
+#elif defined(__APPLE__)
+	proc_pidpath(getpid(), exepath, sizeof(exepath));
+#else
+	char arg1[20];
+	sprintf(arg1, "/proc/%d/exe", getpid());
+	readlink(arg1, exepath, 1024);
+#endif
+
+	return std::filesystem::path(exepath);
+}
+
+std::filesystem::path MakeTestDataPath(std::string_view name)
+{
+	static auto rootPath = std::filesystem::weakly_canonical(GetExecutablePath().parent_path() / TEST_DATA).make_preferred();
+	return (rootPath / name).make_preferred();
+}
+
+//--
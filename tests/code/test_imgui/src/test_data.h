@@ -0,0 +1,17 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+//--
+
+// Path to a file in the shared test data directory (tests/data)
+extern std::filesystem::path MakeTestDataPath(std::string_view name);
+
+//--
@@ -0,0 +1,243 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "tool_ui.h"
+
+#include <float.h>
+#include <math.h>
+
+//--
+
+HeadlessUIContext::HeadlessUIContext(const ImVec2& displaySize)
+{
+	m_atlas = IM_NEW(ImFontAtlas)();
+	m_context = ImGui::CreateContext(m_atlas);
+	ImGui::SetCurrentContext(m_context);
+
+	ImGui::StyleColorsDark();
+
+	auto& io = ImGui::GetIO();
+	io.DisplaySize = displaySize;
+	io.DeltaTime = 1.0f / 60.0f;
+	io.IniFilename = nullptr; // contexts may run on many threads, don't touch the disk
+	io.LogFilename = nullptr;
+
+	unsigned char* pixels = nullptr;
+	int width = 0, height = 0;
+	m_atlas->GetTexDataAsRGBA32(&pixels, &width, &height);
+}
+
+HeadlessUIContext::~HeadlessUIContext()
+{
+	ImGui::DestroyContext(m_context);
+	IM_DELETE(m_atlas);
+}
+
+void HeadlessUIContext::activate()
+{
+	ImGui::SetCurrentContext(m_context);
+}
+
+//--
+
+static uint32_t BuildAssetTable(const ToolUISettings& settings)
+{
+	static const char* AssetTypes[] = { "Mesh", "Texture", "Material", "Script", "Sound" };
+
+	const auto flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Sortable;
+	if (!ImGui::BeginTable("AssetTable", 5, flags))
+		return 0;
+
+	ImGui::TableSetupScrollFreeze(0, 1);
+	ImGui::TableSetupColumn("Name");
+	ImGui::TableSetupColumn("Type");
+	ImGui::TableSetupColumn("Size");
+	ImGui::TableSetupColumn("Modified");
+	ImGui::TableSetupColumn("Import");
+	ImGui::TableHeadersRow();
+
+	uint32_t numRows = 0;
+	const auto buildRow = [&numRows](int index)
+	{
+		numRows += 1;
+		ImGui::PushID(index);
+		ImGui::TableNextRow();
+
+		ImGui::TableSetColumnIndex(0);
+		ImGui::Text("asset_%05d", index);
+
+		ImGui::TableSetColumnIndex(1);
+		ImGui::TextUnformatted(AssetTypes[index % 5]);
+
+		ImGui::TableSetColumnIndex(2);
+		ImGui::Text("%d KB", (index * 7919) % 65536);
+
+		ImGui::TableSetColumnIndex(3);
+		ImGui::Text("2022-%02d-%02d %02d:%02d", 1 + index % 12, 1 + index % 28, index % 24, index % 60);
+
+		ImGui::TableSetColumnIndex(4);
+		ImGui::ProgressBar((index * 37 % 101) / 100.0f, ImVec2(-FLT_MIN, 0.0f));
+
+		ImGui::PopID();
+	};
+
+	if (settings.clipTable)
+	{
+		ImGuiListClipper clipper;
+		clipper.Begin((int)settings.tableRows);
+		while (clipper.Step())
+			for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+				buildRow(i);
+	}
+	else
+	{
+		for (int i = 0; i < (int)settings.tableRows; ++i)
+			buildRow(i);
+	}
+
+	ImGui::EndTable();
+	return numRows;
+}
+
+static void BuildSceneTree(uint32_t& nextNode, uint32_t maxNodes, uint32_t depth)
+{
+	// fixed fan-out so the tree looks the same every frame
+	for (uint32_t i = 0; i < 6 && nextNode < maxNodes; ++i)
+	{
+		const auto nodeIndex = nextNode++;
+		const auto isLeaf = depth >= 3 || (nodeIndex % 5) == 4;
+
+		if (isLeaf)
+		{
+			ImGui::TreeNodeEx((void*)(intptr_t)nodeIndex, ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen | ImGuiTreeNodeFlags_SpanAvailWidth, "Entity %u", nodeIndex);
+			continue;
+		}
+
+		ImGui::SetNextItemOpen(true, ImGuiCond_Once);
+		if (ImGui::TreeNodeEx((void*)(intptr_t)nodeIndex, ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_SpanAvailWidth, "Group %u", nodeIndex))
+		{
+			BuildSceneTree(nextNode, maxNodes, depth + 1);
+			ImGui::TreePop();
+		}
+	}
+}
+
+static void BuildProfilerPlots(const ToolUISettings& settings, uint32_t frameIndex)
+{
+	std::vector<float> values(settings.plotPoints);
+	for (uint32_t i = 0; i < settings.plotPoints; ++i)
+		values[i] = 8.0f + 4.0f * sinf((i + frameIndex) * 0.05f) + 2.0f * sinf((i * 7 + frameIndex) * 0.31f);
+
+	char overlay[64];
+	snprintf(overlay, sizeof(overlay), "frame %u", frameIndex);
+
+	ImGui::PlotLines("Frame time", values.data(), (int)values.size(), 0, overlay, 0.0f, 16.0f, ImVec2(-FLT_MIN, 150.0f));
+	ImGui::PlotHistogram("GPU time", values.data(), (int)values.size(), 0, nullptr, 0.0f, 16.0f, ImVec2(-FLT_MIN, 150.0f));
+	ImGui::PlotLines("Memory", values.data(), (int)values.size() / 4, 0, nullptr, FLT_MAX, FLT_MAX, ImVec2(-FLT_MIN, 80.0f));
+}
+
+static void BuildProperties(uint32_t frameIndex)
+{
+	float position[3] = { 1.0f, 2.0f, (float)frameIndex };
+	float color[4] = { 0.4f, 0.7f, 0.0f, 0.5f };
+	int count = (int)frameIndex % 100;
+	bool enabled = (frameIndex & 1) != 0;
+	char name[64] = "PlayerCharacter";
+
+	for (uint32_t section = 0; section < 8; ++section)
+	{
+		ImGui::PushID((int)section);
+
+		ImGui::SetNextItemOpen(true, ImGuiCond_Once);
+		if (ImGui::CollapsingHeader("Component"))
+		{
+			ImGui::InputText("Name", name, sizeof(name));
+			ImGui::DragFloat3("Position", position, 0.1f);
+			ImGui::SliderInt("Count", &count, 0, 100);
+			ImGui::Checkbox("Enabled", &enabled);
+			ImGui::ColorEdit4("Tint", color);
+			ImGui::Separator();
+			ImGui::TextWrapped("Component %u of the selected entity, values are rebuilt every frame so nothing here is persistent.", section);
+			ImGui::Button("Reset");
+			ImGui::SameLine();
+			ImGui::Button("Copy");
+		}
+
+		ImGui::PopID();
+	}
+}
+
+uint32_t BuildToolUI(const ToolUISettings& settings, uint32_t frameIndex)
+{
+	uint32_t numTableRows = 0;
+
+	const auto width = settings.displaySize.x;
+	const auto height = settings.displaySize.y;
+
+	ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f), ImGuiCond_Always);
+	ImGui::SetNextWindowSize(ImVec2(width * 0.5f, height * 0.6f), ImGuiCond_Always);
+	if (ImGui::Begin("Assets"))
+		numTableRows = BuildAssetTable(settings);
+	ImGui::End();
+
+	ImGui::SetNextWindowPos(ImVec2(0.0f, height * 0.6f), ImGuiCond_Always);
+	ImGui::SetNextWindowSize(ImVec2(width * 0.5f, height * 0.4f), ImGuiCond_Always);
+	if (ImGui::Begin("Profiler"))
+		BuildProfilerPlots(settings, frameIndex);
+	ImGui::End();
+
+	ImGui::SetNextWindowPos(ImVec2(width * 0.5f, 0.0f), ImGuiCond_Always);
+	ImGui::SetNextWindowSize(ImVec2(width * 0.25f, height), ImGuiCond_Always);
+	if (ImGui::Begin("Scene"))
+	{
+		uint32_t nextNode = 0;
+		BuildSceneTree(nextNode, settings.treeNodes, 0);
+	}
+	ImGui::End();
+
+	ImGui::SetNextWindowPos(ImVec2(width * 0.75f, 0.0f), ImGuiCond_Always);
+	ImGui::SetNextWindowSize(ImVec2(width * 0.25f, height), ImGuiCond_Always);
+	if (ImGui::Begin("Properties"))
+		BuildProperties(frameIndex);
+	ImGui::End();
+
+	return numTableRows;
+}
+
+ToolUIFrameStats GetFrameStats(const ImDrawData* drawData)
+{
+	ToolUIFrameStats ret;
+
+	if (drawData && drawData->Valid)
+	{
+		ret.numDrawLists = (uint32_t)drawData->CmdListsCount;
+		ret.numVertices = (uint32_t)drawData->TotalVtxCount;
+		ret.numIndices = (uint32_t)drawData->TotalIdxCount;
+
+		for (int i = 0; i < drawData->CmdListsCount; ++i)
+			ret.numDrawCommands += (uint32_t)drawData->CmdLists[i]->CmdBuffer.Size;
+	}
+
+	return ret;
+}
+
+ToolUIFrameStats RunToolUIFrame(const ToolUISettings& settings, uint32_t frameIndex)
+{
+	auto& io = ImGui::GetIO();
+	io.DisplaySize = settings.displaySize;
+	io.DeltaTime = 1.0f / 60.0f;
+
+	ImGui::NewFrame();
+	const auto numTableRows = BuildToolUI(settings, frameIndex);
+	ImGui::Render();
+
+	auto ret = GetFrameStats(ImGui::GetDrawData());
+	ret.numTableRows = numTableRows;
+	return ret;
+}
+
+//--
@@ -0,0 +1,70 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include <imgui.h>
+
+#include <stdint.h>
+#include <vector>
+
+//--
+
+// Content of the synthetic editor UI
+struct ToolUISettings
+{
+	uint32_t tableRows = 10000;
+	bool clipTable = true; // use ImGuiListClipper (as any real tool would), false - submit every row
+	uint32_t treeNodes = 500;
+	uint32_t plotPoints = 1000;
+	ImVec2 displaySize = ImVec2(1920, 1080);
+};
+
+// Draw data statistics of a frame
+struct ToolUIFrameStats
+{
+	uint32_t numDrawLists = 0;
+	uint32_t numDrawCommands = 0;
+	uint32_t numVertices = 0;
+	uint32_t numIndices = 0;
+	uint32_t numTableRows = 0; // asset table rows submitted to ImGui
+};
+
+// ImGui context with its own font atlas set up for running without any platform or renderer backend
+// NOTE: the context becomes current on the calling thread
+class HeadlessUIContext
+{
+public:
+	HeadlessUIContext(const ImVec2& displaySize);
+	~HeadlessUIContext();
+
+	HeadlessUIContext(const HeadlessUIContext&) = delete;
+	HeadlessUIContext& operator=(const HeadlessUIContext&) = delete;
+
+	inline ImGuiContext* context() const { return m_context; }
+	inline ImFontAtlas* atlas() const { return m_atlas; }
+
+	// make the context current on the calling thread
+	void activate();
+
+private:
+	ImGuiContext* m_context = nullptr;
+	ImFontAtlas* m_atlas = nullptr;
+};
+
+//--
+
+// Build all the windows of the synthetic tool UI, must be called between NewFrame and Render
+// Returns number of asset table rows that were submitted
+extern uint32_t BuildToolUI(const ToolUISettings& settings, uint32_t frameIndex);
+
+// Run a whole frame (NewFrame, BuildToolUI, Render) in the current context
+extern ToolUIFrameStats RunToolUIFrame(const ToolUISettings& settings, uint32_t frameIndex);
+
+// Gather draw data statistics of the last rendered frame
+extern ToolUIFrameStats GetFrameStats(const ImDrawData* drawData);
+
+//--
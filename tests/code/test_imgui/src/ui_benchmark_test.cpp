@@ -0,0 +1,173 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "tool_ui.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+//--
+
+TEST(ImGuiToolUI, ProducesDrawData)
+{
+	ToolUISettings settings;
+	HeadlessUIContext context(settings.displaySize);
+
+	ToolUIFrameStats stats;
+	for (uint32_t i = 0; i < 3; ++i)
+		stats = RunToolUIFrame(settings, i);
+
+	EXPECT_LE(4, stats.numDrawLists);
+	EXPECT_LT(0, stats.numDrawCommands);
+	EXPECT_LT(1000, stats.numVertices);
+	EXPECT_EQ(0, stats.numIndices % 3);
+}
+
+TEST(ImGuiToolUI, ClipperSkipsInvisibleRows)
+{
+	ToolUISettings settings;
+
+	settings.clipTable = true;
+	HeadlessUIContext clippedContext(settings.displaySize);
+	ToolUIFrameStats clipped;
+	for (uint32_t i = 0; i < 3; ++i)
+		clipped = RunToolUIFrame(settings, i);
+
+	settings.clipTable = false;
+	HeadlessUIContext fullContext(settings.displaySize);
+	ToolUIFrameStats full;
+	for (uint32_t i = 0; i < 3; ++i)
+		full = RunToolUIFrame(settings, i);
+
+	// without the clipper every row goes through ImGui, with it only the visible ones (plus the one used for measuring)
+	EXPECT_EQ(settings.tableRows, full.numTableRows);
+	EXPECT_LT(0, clipped.numTableRows);
+	EXPECT_GT(settings.displaySize.y / ImGui::GetTextLineHeight(), (float)clipped.numTableRows);
+
+	// rows outside of the view are culled by the draw list either way, the geometry is about the same
+	EXPECT_NEAR((double)clipped.numVertices, (double)full.numVertices, full.numVertices * 0.25);
+}
+
+//--
+
+struct ToolUITimings
+{
+	std::vector<double> frameTimes; // NewFrame..Render
+	ToolUIFrameStats lastFrame;
+
+	double average() const
+	{
+		double sum = 0.0;
+		for (const auto time : frameTimes)
+			sum += time;
+		return frameTimes.empty() ? 0.0 : sum / frameTimes.size();
+	}
+
+	double percentile(double p) const
+	{
+		if (frameTimes.empty())
+			return 0.0;
+
+		auto times = frameTimes;
+		const auto index = std::min<size_t>(times.size() - 1, (size_t)(times.size() * p / 100.0));
+		std::nth_element(times.begin(), times.begin() + index, times.end());
+		return times[index];
+	}
+};
+
+static ToolUITimings RunToolUIFrames(const ToolUISettings& settings, uint32_t numFrames, std::vector<ToolUIFrameStats>* outFrameStats = nullptr)
+{
+	ToolUITimings ret;
+
+	HeadlessUIContext context(settings.displaySize);
+	for (uint32_t i = 0; i < numFrames; ++i)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+		ret.lastFrame = RunToolUIFrame(settings, i);
+		ret.frameTimes.push_back(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count());
+
+		if (outFrameStats)
+			outFrameStats->push_back(ret.lastFrame);
+	}
+
+	return ret;
+}
+
+TEST(ImGuiToolUI, DISABLED_FrameBenchmark)
+{
+	const uint32_t numFrames = 200;
+
+	for (const bool clip : { true, false })
+	{
+		ToolUISettings settings;
+		settings.clipTable = clip;
+
+		const auto timings = RunToolUIFrames(settings, numFrames);
+		const auto& stats = timings.lastFrame;
+
+		printf("%u rows %s: avg %.3f ms, p99 %.3f ms | %u lists, %u cmds, %u vertices, %u indices\n",
+			settings.tableRows, clip ? "clipped" : "unclipped",
+			timings.average() * 1000.0, timings.percentile(99) * 1000.0,
+			stats.numDrawLists, stats.numDrawCommands, stats.numVertices, stats.numIndices);
+	}
+}
+
+//--
+
+TEST(ImGuiToolUI, IndependentContextsOnThreads)
+{
+#ifndef IMGUI_THREAD_LOCAL_CONTEXT
+	GTEST_SKIP() << "ImGui built without IMGUI_THREAD_LOCAL_CONTEXT, the current context is shared by all threads";
+#endif
+
+	const uint32_t numFrames = 30;
+	const uint32_t numThreads = std::max<uint32_t>(2, std::min<uint32_t>(8, std::thread::hardware_concurrency()));
+
+	ToolUISettings settings;
+
+	// reference from this thread
+	std::vector<ToolUIFrameStats> reference;
+	const auto referenceTimings = RunToolUIFrames(settings, numFrames, &reference);
+
+	// current context is per thread, this thread has none after the reference context was destroyed
+	EXPECT_EQ(nullptr, ImGui::GetCurrentContext());
+
+	std::vector<std::vector<ToolUIFrameStats>> threadStats(numThreads);
+	std::vector<std::thread> threads;
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < numThreads; ++i)
+	{
+		threads.emplace_back([&settings, &threadStats, i, numFrames]()
+			{
+				RunToolUIFrames(settings, numFrames, &threadStats[i]);
+			});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+	const auto time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	// every context produced exactly the same geometry as the reference
+	for (uint32_t i = 0; i < numThreads; ++i)
+	{
+		ASSERT_EQ(reference.size(), threadStats[i].size()) << "thread " << i;
+		for (uint32_t frame = 0; frame < numFrames; ++frame)
+		{
+			EXPECT_EQ(reference[frame].numVertices, threadStats[i][frame].numVertices) << "thread " << i << ", frame " << frame;
+			EXPECT_EQ(reference[frame].numIndices, threadStats[i][frame].numIndices) << "thread " << i << ", frame " << frame;
+			EXPECT_EQ(reference[frame].numDrawCommands, threadStats[i][frame].numDrawCommands) << "thread " << i << ", frame " << frame;
+		}
+	}
+
+	const auto serialTime = referenceTimings.average() * numFrames * numThreads;
+	printf("%u contexts x %u frames: %.2f ms on %u threads, %.2f ms serial estimate (%.2fx)\n",
+		numThreads, numFrames, time * 1000.0, numThreads, serialTime * 1000.0, serialTime / time);
+}
+
+//--
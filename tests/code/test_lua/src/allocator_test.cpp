@@ -0,0 +1,367 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "lua_allocator.h"
+
+extern "C" {
+#include <lua/lua.h>
+#include <lua/lualib.h>
+#include <lua/lauxlib.h>
+}
+
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//--
+
+static void* ReallocAlloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+	(void)ud; (void)osize;
+	if (nsize == 0)
+	{
+		free(ptr);
+		return NULL;
+	}
+
+	return realloc(ptr, nsize);
+}
+
+// Typical gameplay churn - short lived tables, closures and strings
+static const char* ALLOCATION_HEAVY_SCRIPT = R"(
+local count = ...
+local sum = 0
+for i = 1, count do
+	local t = { x = i, y = i * 2, name = "entity_" .. i }
+	local f = function() return t.x + t.y end
+	local parts = {}
+	for j = 1, 8 do
+		parts[j] = tostring(j * i)
+	end
+	sum = sum + f() + #table.concat(parts, ",")
+end
+return sum
+)";
+
+static bool RunScript(lua_State* L, const char* code, lua_Integer arg, lua_Integer* outResult = nullptr)
+{
+	if (LUA_OK != luaL_loadstring(L, code))
+		return false;
+
+	lua_pushinteger(L, arg);
+	if (LUA_OK != lua_pcall(L, 1, 1, 0))
+	{
+		lua_pop(L, 1);
+		return false;
+	}
+
+	if (outResult)
+		*outResult = lua_tointeger(L, -1);
+
+	lua_pop(L, 1);
+	return true;
+}
+
+static void ExpectNoLiveBlocks(const LuaPoolAllocator::Stats& stats)
+{
+	EXPECT_EQ(0, stats.bytesInUse);
+	EXPECT_EQ(0, stats.liveLargeBlocks);
+	EXPECT_EQ(stats.numAllocs, stats.numFrees);
+
+	for (uint32_t i = 0; i < LuaPoolAllocator::NUM_SIZE_CLASSES; ++i)
+		EXPECT_EQ(0, stats.liveBlocks[i]) << "size class " << i;
+}
+
+//--
+
+TEST(LuaPoolAllocator, SmallBlocksReused)
+{
+	LuaPoolAllocator allocator;
+
+	auto* a = allocator.allocate(24);
+	auto* b = allocator.allocate(24);
+	ASSERT_NE(nullptr, a);
+	ASSERT_NE(nullptr, b);
+	EXPECT_NE(a, b);
+	EXPECT_EQ(2, allocator.stats().liveBlocks[1]); // 17-32 bytes
+
+	allocator.free(a, 24);
+
+	// freed block is the first one to be handed out again
+	auto* c = allocator.allocate(32);
+	EXPECT_EQ(a, c);
+
+	allocator.free(b, 24);
+	allocator.free(c, 32);
+	ExpectNoLiveBlocks(allocator.stats());
+	EXPECT_EQ(LuaPoolAllocator::PAGE_SIZE, allocator.stats().bytesInPages);
+}
+
+TEST(LuaPoolAllocator, LargeBlocksUseMalloc)
+{
+	LuaPoolAllocator allocator;
+
+	auto* ptr = allocator.allocate(LuaPoolAllocator::MAX_SMALL_BLOCK_SIZE + 1);
+	ASSERT_NE(nullptr, ptr);
+	EXPECT_EQ(1, allocator.stats().numLargeAllocs);
+	EXPECT_EQ(1, allocator.stats().liveLargeBlocks);
+	EXPECT_EQ(0, allocator.stats().bytesInPages);
+
+	allocator.free(ptr, LuaPoolAllocator::MAX_SMALL_BLOCK_SIZE + 1);
+	ExpectNoLiveBlocks(allocator.stats());
+}
+
+TEST(LuaPoolAllocator, ReallocWithinSizeClassInPlace)
+{
+	LuaPoolAllocator allocator;
+
+	auto* ptr = (uint8_t*)allocator.allocate(33);
+	ASSERT_NE(nullptr, ptr);
+	memset(ptr, 0xAB, 33);
+
+	// 33 and 48 are in the same class
+	EXPECT_EQ(ptr, allocator.reallocate(ptr, 33, 48));
+	EXPECT_EQ(1, allocator.stats().numReallocsInPlace);
+
+	// moving to a different class keeps the content
+	auto* moved = (uint8_t*)allocator.reallocate(ptr, 48, 100);
+	ASSERT_NE(nullptr, moved);
+	EXPECT_NE(ptr, moved);
+	for (uint32_t i = 0; i < 33; ++i)
+		ASSERT_EQ(0xAB, moved[i]);
+
+	// and into the large blocks and back
+	auto* large = (uint8_t*)allocator.reallocate(moved, 100, 4000);
+	ASSERT_NE(nullptr, large);
+	EXPECT_EQ(1, allocator.stats().liveLargeBlocks);
+	for (uint32_t i = 0; i < 33; ++i)
+		ASSERT_EQ(0xAB, large[i]);
+
+	auto* small = (uint8_t*)allocator.reallocate(large, 4000, 40);
+	ASSERT_NE(nullptr, small);
+	EXPECT_EQ(0, allocator.stats().liveLargeBlocks);
+	for (uint32_t i = 0; i < 33; ++i)
+		ASSERT_EQ(0xAB, small[i]);
+
+	allocator.free(small, 40);
+	ExpectNoLiveBlocks(allocator.stats());
+}
+
+//--
+
+TEST(LuaPoolAllocator, StateRunsAndReleasesEverything)
+{
+	LuaPoolAllocator allocator;
+
+	lua_State* L = lua_newstate(&LuaPoolAllocator::Alloc, &allocator);
+	ASSERT_NE(nullptr, L);
+	luaL_openlibs(L);
+
+	lua_Integer result = 0;
+	ASSERT_TRUE(RunScript(L, ALLOCATION_HEAVY_SCRIPT, 1000, &result));
+	EXPECT_LT(0, result);
+
+	const auto& stats = allocator.stats();
+	EXPECT_LT(0, stats.bytesInUse);
+	EXPECT_LE(stats.bytesInUse, stats.peakBytesInUse);
+	EXPECT_LT(0, stats.numReallocsInPlace);
+
+	// Lua's own accounting matches ours
+	const auto luaBytes = (uint64_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0);
+	EXPECT_EQ(stats.bytesInUse, luaBytes);
+
+	// most of the traffic is small blocks
+	EXPECT_LT(stats.numLargeAllocs * 10, stats.numAllocs);
+
+	lua_close(L);
+	ExpectNoLiveBlocks(allocator.stats());
+}
+
+TEST(LuaPoolAllocator, SameResultsAsReallocAllocator)
+{
+	lua_Integer poolResult = 0, reallocResult = 0;
+
+	{
+		LuaPoolAllocator allocator;
+		lua_State* L = lua_newstate(&LuaPoolAllocator::Alloc, &allocator);
+		luaL_openlibs(L);
+		ASSERT_TRUE(RunScript(L, ALLOCATION_HEAVY_SCRIPT, 5000, &poolResult));
+		lua_close(L);
+	}
+
+	{
+		lua_State* L = lua_newstate(&ReallocAlloc, nullptr);
+		luaL_openlibs(L);
+		ASSERT_TRUE(RunScript(L, ALLOCATION_HEAVY_SCRIPT, 5000, &reallocResult));
+		lua_close(L);
+	}
+
+	EXPECT_EQ(reallocResult, poolResult);
+}
+
+//--
+
+struct HookCounter
+{
+	uint64_t numNew = 0;
+	uint64_t numFree = 0;
+	uint64_t numResize = 0;
+	int64_t bytes = 0;
+};
+
+static void CountingHook(void* userData, const void* ptr, const void* newPtr, size_t oldSize, size_t newSize)
+{
+	auto* counter = (HookCounter*)userData;
+
+	if (!ptr)
+		counter->numNew += 1;
+	else if (!newPtr)
+		counter->numFree += 1;
+	else
+		counter->numResize += 1;
+
+	counter->bytes += (int64_t)newSize - (int64_t)oldSize;
+}
+
+TEST(LuaPoolAllocator, HookSeesAllEvents)
+{
+	HookCounter counter;
+
+	LuaPoolAllocator allocator;
+	allocator.hook(&CountingHook, &counter);
+
+	lua_State* L = lua_newstate(&LuaPoolAllocator::Alloc, &allocator);
+	luaL_openlibs(L);
+	ASSERT_TRUE(RunScript(L, ALLOCATION_HEAVY_SCRIPT, 100));
+
+	EXPECT_EQ(allocator.stats().numAllocs, counter.numNew);
+	EXPECT_EQ(allocator.stats().numFrees, counter.numFree);
+	EXPECT_EQ(allocator.stats().numReallocs, counter.numResize);
+	EXPECT_EQ((int64_t)allocator.stats().bytesInUse, counter.bytes);
+
+	lua_close(L);
+	EXPECT_EQ(0, counter.bytes);
+	EXPECT_EQ(counter.numNew, counter.numFree);
+}
+
+TEST(LuaPoolAllocator, FailedShrinkKeepsBlock)
+{
+	LuaPoolAllocator allocator;
+
+	auto* small = (uint8_t*)allocator.allocate(256);
+	auto* large = (uint8_t*)allocator.allocate(4000);
+	ASSERT_NE(nullptr, small);
+	ASSERT_NE(nullptr, large);
+	memset(small, 0xAB, 256);
+	memset(large, 0xCD, 4000);
+
+	// no new pages, the smaller size classes have nothing to give
+	allocator.limitPages(allocator.stats().bytesInPages);
+
+	EXPECT_EQ(small, allocator.reallocate(small, 256, 20));
+	EXPECT_EQ(large, allocator.reallocate(large, 4000, 40));
+	EXPECT_EQ(2, allocator.stats().numKeptShrinks);
+	EXPECT_EQ(0, allocator.stats().numFailedAllocs);
+	EXPECT_EQ(60, allocator.stats().bytesInUse);
+	EXPECT_EQ(0, allocator.stats().liveLargeBlocks);
+	EXPECT_EQ(1, allocator.stats().liveBlocks[1]);
+	EXPECT_EQ(1, allocator.stats().liveBlocks[2]);
+
+	for (uint32_t i = 0; i < 20; ++i)
+		ASSERT_EQ(0xAB, small[i]);
+	for (uint32_t i = 0; i < 40; ++i)
+		ASSERT_EQ(0xCD, large[i]);
+
+	// growing still fails
+	EXPECT_EQ(nullptr, allocator.reallocate(small, 20, 300));
+	EXPECT_EQ(1, allocator.stats().numFailedAllocs);
+
+	// Lua frees the blocks with the new sizes, they are reused by the smaller classes
+	allocator.free(small, 20);
+	allocator.free(large, 40);
+	ExpectNoLiveBlocks(allocator.stats());
+
+	EXPECT_EQ(large, allocator.allocate(40));
+	allocator.free(large, 40);
+}
+
+TEST(LuaPoolAllocator, LimitRaisesMemoryError)
+{
+	LuaPoolAllocator allocator;
+
+	lua_State* L = lua_newstate(&LuaPoolAllocator::Alloc, &allocator);
+	luaL_openlibs(L);
+
+	const auto maxBytes = allocator.stats().bytesInUse + 256 * 1024;
+	allocator.limit(maxBytes);
+
+	const char* code = "local t = {} for i = 1, 10000000 do t[i] = 'item' .. i end";
+	ASSERT_EQ(LUA_OK, luaL_loadstring(L, code));
+	EXPECT_EQ(LUA_ERRMEM, lua_pcall(L, 0, 0, 0));
+	lua_pop(L, 1);
+
+	EXPECT_LT(0, allocator.stats().numFailedAllocs);
+	EXPECT_LE(allocator.stats().peakBytesInUse, maxBytes);
+
+	// state is still usable after the error
+	allocator.limit(0);
+	lua_Integer result = 0;
+	ASSERT_TRUE(RunScript(L, ALLOCATION_HEAVY_SCRIPT, 10, &result));
+
+	lua_close(L);
+	ExpectNoLiveBlocks(allocator.stats());
+}
+
+//--
+
+static double RunBenchmark(bool usePool, uint32_t numStates, uint32_t iterations)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 0; i < numStates; ++i)
+	{
+		threads.emplace_back([usePool, iterations]()
+			{
+				LuaPoolAllocator allocator;
+
+				auto* L = usePool
+					? lua_newstate(&LuaPoolAllocator::Alloc, &allocator)
+					: lua_newstate(&ReallocAlloc, nullptr);
+				luaL_openlibs(L);
+
+				RunScript(L, ALLOCATION_HEAVY_SCRIPT, iterations);
+				lua_close(L);
+			});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+TEST(LuaPoolAllocator, DISABLED_Benchmark)
+{
+	const uint32_t iterations = 200000;
+	const auto maxStates = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+
+	for (uint32_t numStates = 1; ; numStates = std::min(numStates * 4, maxStates))
+	{
+		const auto reallocTime = RunBenchmark(false, numStates, iterations);
+		const auto poolTime = RunBenchmark(true, numStates, iterations);
+
+		printf("%u states: realloc %.2f ms, pool %.2f ms (%.2fx)\n",
+			numStates, reallocTime * 1000.0, poolTime * 1000.0, reallocTime / poolTime);
+
+		if (numStates == maxStates)
+			break;
+	}
+}
+
+//--
@@ -0,0 +1,249 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "lua_binder.h"
+
+extern "C" {
+#include <lua/lualib.h>
+}
+
+#include <chrono>
+
+//--
+
+extern "C" int api_mul(lua_State* lua);
+
+static int64_t BoundMul(int64_t a, int64_t b)
+{
+	return a * b;
+}
+
+static int BoundGetVal()
+{
+	return 5;
+}
+
+static double BoundLerp(double a, double b, float t)
+{
+	return a + (b - a) * t;
+}
+
+static bool BoundNot(bool value)
+{
+	return !value;
+}
+
+static size_t BoundLength(std::string_view text)
+{
+	return text.size();
+}
+
+static const char* BoundName(int index)
+{
+	return index == 0 ? "zero" : "other";
+}
+
+static std::tuple<int, int> BoundDivMod(int a, int b)
+{
+	return { a / b, a % b };
+}
+
+static int BoundCallCount = 0;
+
+static void BoundNothing()
+{
+	BoundCallCount += 1;
+}
+
+enum class EntityTeam : uint8_t
+{
+	Red = 1,
+	Blue = 2,
+};
+
+struct Entity
+{
+	int health = 100;
+	EntityTeam team = EntityTeam::Red;
+
+	int damage(int amount) { health -= amount; return health; }
+	int getHealth() const { return health; }
+	EntityTeam getTeam() const { return team; }
+	void setTeam(EntityTeam newTeam) { team = newTeam; }
+};
+
+static Entity* BoundSpawn()
+{
+	static Entity entity;
+	entity = Entity();
+	return &entity;
+}
+
+//--
+
+class LuaBinderTest : public testing::Test
+{
+public:
+	lua_State* L = nullptr;
+
+	virtual void SetUp() override
+	{
+		L = luaL_newstate();
+		ASSERT_NE(nullptr, L);
+		luaL_openlibs(L);
+
+		LuaBind::Register<&BoundMul>(L, "mul");
+		LuaBind::Register<&BoundGetVal>(L, "getVal");
+		LuaBind::Register<&BoundLerp>(L, "lerp");
+		LuaBind::Register<&BoundNot>(L, "not_");
+		LuaBind::Register<&BoundLength>(L, "length");
+		LuaBind::Register<&BoundName>(L, "name");
+		LuaBind::Register<&BoundDivMod>(L, "divmod");
+		LuaBind::Register<&BoundNothing>(L, "nothing");
+		LuaBind::Register<&BoundSpawn>(L, "spawn");
+		LuaBind::Register<&Entity::damage>(L, "entity_damage");
+		LuaBind::Register<&Entity::getHealth>(L, "entity_health");
+		LuaBind::Register<&Entity::getTeam>(L, "entity_team");
+		LuaBind::Register<&Entity::setTeam>(L, "entity_set_team");
+	}
+
+	virtual void TearDown() override
+	{
+		lua_close(L);
+	}
+
+	void run(const char* code, int numResults)
+	{
+		ASSERT_EQ(LUA_OK, luaL_loadstring(L, code));
+		ASSERT_EQ(LUA_OK, lua_pcall(L, 0, numResults, 0)) << lua_tostring(L, -1);
+	}
+
+	std::string runError(const char* code)
+	{
+		EXPECT_EQ(LUA_OK, luaL_loadstring(L, code));
+		EXPECT_EQ(LUA_ERRRUN, lua_pcall(L, 0, 0, 0));
+
+		std::string ret = lua_tostring(L, -1);
+		lua_pop(L, 1);
+		return ret;
+	}
+};
+
+//--
+
+TEST_F(LuaBinderTest, Numbers)
+{
+	run("return mul(3, 5), getVal(), lerp(10, 20, 0.25)", 3);
+
+	EXPECT_TRUE(lua_isinteger(L, 1));
+	EXPECT_EQ(15, lua_tointeger(L, 1));
+	EXPECT_EQ(5, lua_tointeger(L, 2));
+	EXPECT_DOUBLE_EQ(12.5, lua_tonumber(L, 3));
+}
+
+TEST_F(LuaBinderTest, BoolsAndStrings)
+{
+	run("return not_(false), length('hello\\0world'), name(0), name(1)", 4);
+
+	EXPECT_TRUE(lua_toboolean(L, 1));
+	EXPECT_EQ(11, lua_tointeger(L, 2));
+	EXPECT_STREQ("zero", lua_tostring(L, 3));
+	EXPECT_STREQ("other", lua_tostring(L, 4));
+}
+
+TEST_F(LuaBinderTest, MultipleResults)
+{
+	run("return divmod(17, 5)", 2);
+
+	EXPECT_EQ(3, lua_tointeger(L, 1));
+	EXPECT_EQ(2, lua_tointeger(L, 2));
+}
+
+TEST_F(LuaBinderTest, NoResults)
+{
+	BoundCallCount = 0;
+	run("return nothing()", LUA_MULTRET);
+
+	EXPECT_EQ(1, BoundCallCount);
+	EXPECT_EQ(0, lua_gettop(L));
+}
+
+TEST_F(LuaBinderTest, EngineObjects)
+{
+	run(R"(
+		local e = spawn()
+		entity_damage(e, 30)
+		entity_set_team(e, 2)
+		return e, entity_health(e), entity_team(e)
+	)", 3);
+
+	auto* entity = (Entity*)lua_touserdata(L, 1);
+	ASSERT_NE(nullptr, entity);
+	EXPECT_TRUE(lua_islightuserdata(L, 1));
+	EXPECT_EQ(70, entity->health);
+	EXPECT_EQ(EntityTeam::Blue, entity->team);
+	EXPECT_EQ(70, lua_tointeger(L, 2));
+	EXPECT_EQ(2, lua_tointeger(L, 3));
+}
+
+TEST_F(LuaBinderTest, WrongArgumentsRaiseErrors)
+{
+	EXPECT_NE(std::string::npos, runError("mul('x', 2)").find("integer expected"));
+	EXPECT_NE(std::string::npos, runError("mul(1.5, 2)").find("integer expected"));
+	EXPECT_NE(std::string::npos, runError("lerp(1, {}, 0)").find("number expected"));
+	EXPECT_NE(std::string::npos, runError("length(nil)").find("string expected"));
+	EXPECT_NE(std::string::npos, runError("entity_health(5)").find("light userdata expected"));
+	EXPECT_NE(std::string::npos, runError("entity_health(nil)").find("object expected"));
+
+	// numeric strings are converted the same way lua_tointegerx does
+	run("return mul('4', 5)", 1);
+	EXPECT_EQ(20, lua_tointeger(L, 1));
+}
+
+//--
+
+static double MeasureCalls(lua_State* L, const char* code, uint32_t numCalls)
+{
+	EXPECT_EQ(LUA_OK, luaL_loadstring(L, code));
+	lua_pushinteger(L, numCalls);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	EXPECT_EQ(LUA_OK, lua_pcall(L, 1, 0, 0));
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+TEST(LuaBinder, DISABLED_CallOverheadBenchmark)
+{
+	const uint32_t numCalls = 10000000;
+
+	auto* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	lua_register(L, "handMul", &api_mul);
+	LuaBind::Register<&BoundMul>(L, "boundMul");
+
+	// loop with a pure Lua multiply is the baseline to subtract
+	const auto loopTime = MeasureCalls(L, "local n = ... local s = 0 for i = 1, n do s = s + i * 3 end", numCalls);
+
+	for (uint32_t pass = 0; pass < 2; ++pass)
+	{
+		const auto handTime = MeasureCalls(L, "local n = ... local f = handMul local s = 0 for i = 1, n do s = s + f(i, 3) end", numCalls);
+		const auto boundTime = MeasureCalls(L, "local n = ... local f = boundMul local s = 0 for i = 1, n do s = s + f(i, 3) end", numCalls);
+
+		if (pass == 0)
+			continue; // warm up
+
+		const auto handCall = (handTime - loopTime) / numCalls * 1e9;
+		const auto boundCall = (boundTime - loopTime) / numCalls * 1e9;
+		printf("Lua loop: %.2f ms, hand written: %.2f ms (%.2f ns/call), bound: %.2f ms (%.2f ns/call)\n",
+			loopTime * 1000.0, handTime * 1000.0, handCall, boundTime * 1000.0, boundCall);
+	}
+
+	lua_close(L);
+}
+
+//--
@@ -0,0 +1,331 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "lua_bytecode_cache.h"
+
+extern "C" {
+#include <lua/lua.h>
+#include <lua/lualib.h>
+#include <lua/lauxlib.h>
+}
+
+#include <chrono>
+
+//--
+
+static const char* TEST_SCRIPT = R"(
+local function fib(n)
+	if n < 2 then return n end
+	return fib(n - 1) + fib(n - 2)
+end
+return fib(20) + select('#', ...)
+)";
+
+static const lua_Integer TEST_SCRIPT_RESULT = 6765;
+
+class LuaBytecodeCacheTest : public testing::Test
+{
+public:
+	lua_State* L = nullptr;
+
+	virtual void SetUp() override
+	{
+		L = luaL_newstate();
+		ASSERT_NE(nullptr, L);
+		luaL_openlibs(L);
+	}
+
+	virtual void TearDown() override
+	{
+		lua_close(L);
+	}
+
+	lua_Integer loadAndRun(LuaBytecodeCache& cache, const char* code = TEST_SCRIPT)
+	{
+		EXPECT_EQ(LUA_OK, cache.load(L, code, strlen(code), "=test"));
+		EXPECT_EQ(LUA_OK, lua_pcall(L, 0, 1, 0));
+
+		const auto ret = lua_tointeger(L, -1);
+		lua_pop(L, 1);
+		return ret;
+	}
+};
+
+//--
+
+TEST_F(LuaBytecodeCacheTest, MissThenHit)
+{
+	LuaBytecodeCache cache;
+
+	EXPECT_EQ(TEST_SCRIPT_RESULT, loadAndRun(cache));
+	EXPECT_EQ(1, cache.stats().numMisses);
+	EXPECT_EQ(0, cache.stats().numHits);
+	EXPECT_EQ(1, cache.size());
+
+	EXPECT_EQ(TEST_SCRIPT_RESULT, loadAndRun(cache));
+	EXPECT_EQ(1, cache.stats().numMisses);
+	EXPECT_EQ(1, cache.stats().numHits);
+	EXPECT_EQ(1, cache.size());
+}
+
+TEST_F(LuaBytecodeCacheTest, StrippedBytecodeIsSmaller)
+{
+	LuaBytecodeCacheSettings settings;
+	settings.strip = true;
+
+	LuaBytecodeCache strippedCache(settings);
+	LuaBytecodeCache fullCache;
+
+	EXPECT_EQ(TEST_SCRIPT_RESULT, loadAndRun(strippedCache));
+	EXPECT_EQ(TEST_SCRIPT_RESULT, loadAndRun(strippedCache));
+	EXPECT_EQ(1, strippedCache.stats().numHits);
+
+	EXPECT_EQ(TEST_SCRIPT_RESULT, loadAndRun(fullCache));
+
+	const auto* stripped = strippedCache.findEntry(TEST_SCRIPT, strlen(TEST_SCRIPT), "=test");
+	const auto* full = fullCache.findEntry(TEST_SCRIPT, strlen(TEST_SCRIPT), "=test");
+	ASSERT_NE(nullptr, stripped);
+	ASSERT_NE(nullptr, full);
+	EXPECT_LT(stripped->size(), full->size());
+}
+
+TEST_F(LuaBytecodeCacheTest, ChangedSourceIsNotServedFromCache)
+{
+	LuaBytecodeCache cache;
+
+	EXPECT_EQ(TEST_SCRIPT_RESULT, loadAndRun(cache));
+	EXPECT_EQ(42, loadAndRun(cache, "return 42"));
+	EXPECT_EQ(2, cache.stats().numMisses);
+	EXPECT_EQ(0, cache.stats().numHits);
+	EXPECT_EQ(2, cache.size());
+}
+
+TEST_F(LuaBytecodeCacheTest, CompileErrorIsNotCached)
+{
+	LuaBytecodeCache cache;
+
+	const char* code = "return (";
+	EXPECT_EQ(LUA_ERRSYNTAX, cache.load(L, code, strlen(code), "=broken"));
+	EXPECT_TRUE(lua_isstring(L, -1));
+	lua_pop(L, 1);
+
+	EXPECT_EQ(1, cache.stats().numCompileErrors);
+	EXPECT_EQ(0, cache.size());
+}
+
+//--
+
+static void ExpectStaleEntryRejected(lua_State* L, LuaBytecodeCache& cache, void (*tamper)(std::vector<uint8_t>& entry))
+{
+	const auto size = strlen(TEST_SCRIPT);
+
+	ASSERT_EQ(LUA_OK, cache.load(L, TEST_SCRIPT, size, "=test"));
+	lua_pop(L, 1);
+
+	auto* entry = cache.findEntry(TEST_SCRIPT, size, "=test");
+	ASSERT_NE(nullptr, entry);
+	tamper(*entry);
+
+	// recompiled from source, still correct
+	ASSERT_EQ(LUA_OK, cache.load(L, TEST_SCRIPT, size, "=test"));
+	ASSERT_EQ(LUA_OK, lua_pcall(L, 0, 1, 0));
+	EXPECT_EQ(TEST_SCRIPT_RESULT, lua_tointeger(L, -1));
+	lua_pop(L, 1);
+
+	EXPECT_EQ(1, cache.stats().numRejected);
+	EXPECT_EQ(0, cache.stats().numHits);
+
+	// and the fresh entry is used next time
+	ASSERT_EQ(LUA_OK, cache.load(L, TEST_SCRIPT, size, "=test"));
+	lua_pop(L, 1);
+	EXPECT_EQ(1, cache.stats().numHits);
+}
+
+TEST_F(LuaBytecodeCacheTest, StaleLuaVersionRejected)
+{
+	LuaBytecodeCache cache;
+	ExpectStaleEntryRejected(L, cache, [](std::vector<uint8_t>& entry)
+		{
+			auto* header = (LuaBytecodeHeader*)entry.data();
+			header->luaVersion -= 1;
+		});
+}
+
+TEST_F(LuaBytecodeCacheTest, StaleNumberFormatRejected)
+{
+	LuaBytecodeCache cache;
+	ExpectStaleEntryRejected(L, cache, [](std::vector<uint8_t>& entry)
+		{
+			auto* header = (LuaBytecodeHeader*)entry.data();
+			header->sizeOfNumber = 4;
+		});
+}
+
+TEST_F(LuaBytecodeCacheTest, CorruptedBytecodeRejected)
+{
+	LuaBytecodeCache cache;
+	ExpectStaleEntryRejected(L, cache, [](std::vector<uint8_t>& entry)
+		{
+			entry[sizeof(LuaBytecodeHeader) + (entry.size() - sizeof(LuaBytecodeHeader)) / 2] ^= 0x5A;
+		});
+}
+
+TEST_F(LuaBytecodeCacheTest, TruncatedEntryRejected)
+{
+	LuaBytecodeCache cache;
+	ExpectStaleEntryRejected(L, cache, [](std::vector<uint8_t>& entry)
+		{
+			entry.resize(entry.size() - 10);
+		});
+}
+
+TEST_F(LuaBytecodeCacheTest, TextPayloadRejected)
+{
+	LuaBytecodeCache cache;
+	ExpectStaleEntryRejected(L, cache, [](std::vector<uint8_t>& entry)
+		{
+			// valid checksum but not a binary chunk, lua_load must not parse it as source
+			const char* code = "return 666";
+			entry.resize(sizeof(LuaBytecodeHeader));
+			entry.insert(entry.end(), code, code + strlen(code));
+
+			auto* header = (LuaBytecodeHeader*)entry.data();
+			header->bytecodeSize = strlen(code);
+			header->bytecodeHash = LuaHashData(code, strlen(code));
+		});
+}
+
+//--
+
+static std::filesystem::path MakeTempCacheDirectory(const char* name)
+{
+	const auto path = std::filesystem::temp_directory_path() / name;
+
+	std::error_code ec;
+	std::filesystem::remove_all(path, ec);
+	return path;
+}
+
+TEST_F(LuaBytecodeCacheTest, PersistedToDisk)
+{
+	LuaBytecodeCacheSettings settings;
+	settings.directory = MakeTempCacheDirectory("bme_lua_bytecode_cache_test");
+
+	{
+		LuaBytecodeCache cache(settings);
+		EXPECT_EQ(TEST_SCRIPT_RESULT, loadAndRun(cache));
+		EXPECT_EQ(1, cache.stats().numMisses);
+	}
+
+	{
+		LuaBytecodeCache cache(settings);
+		EXPECT_EQ(TEST_SCRIPT_RESULT, loadAndRun(cache));
+		EXPECT_EQ(0, cache.stats().numMisses);
+		EXPECT_EQ(1, cache.stats().numHits);
+	}
+
+	std::error_code ec;
+	std::filesystem::remove_all(settings.directory, ec);
+}
+
+//--
+
+// Something resembling a gameplay script - a module table with a bunch of functions
+static std::string GenerateScript(uint32_t index)
+{
+	std::string code;
+	code += "local M = {}\n";
+
+	for (uint32_t i = 0; i < 20; ++i)
+	{
+		char buf[512];
+		snprintf(buf, sizeof(buf),
+			"function M.update_%u_%u(self, dt)\n"
+			"  local speed = self.speed or %u\n"
+			"  if self.target then\n"
+			"    local dx, dy = self.target.x - self.x, self.target.y - self.y\n"
+			"    local len = math.sqrt(dx * dx + dy * dy)\n"
+			"    if len > 0.001 then self.x = self.x + dx / len * speed * dt end\n"
+			"  end\n"
+			"  return { state = \"moving_%u\", time = dt * %u }\n"
+			"end\n", index, i, i + 1, i, index);
+		code += buf;
+	}
+
+	code += "return M\n";
+	return code;
+}
+
+TEST(LuaBytecodeCache, DISABLED_StartupBenchmark)
+{
+	const uint32_t numScripts = 3000;
+
+	std::vector<std::string> scripts;
+	size_t totalSourceSize = 0;
+	for (uint32_t i = 0; i < numScripts; ++i)
+	{
+		scripts.push_back(GenerateScript(i));
+		totalSourceSize += scripts.back().size();
+	}
+
+	const auto loadAll = [&](LuaBytecodeCache* cache) -> double
+	{
+		auto* L = luaL_newstate();
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < numScripts; ++i)
+		{
+			char name[64];
+			snprintf(name, sizeof(name), "=script_%u", i);
+
+			const auto& code = scripts[i];
+			const auto status = cache
+				? cache->load(L, code.c_str(), code.size(), name)
+				: luaL_loadbufferx(L, code.c_str(), code.size(), name, "t");
+			EXPECT_EQ(LUA_OK, status);
+			lua_pop(L, 1);
+		}
+		const auto time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		lua_close(L);
+		return time;
+	};
+
+	printf("%u scripts, %.2f MB of source\n", numScripts, totalSourceSize / (1024.0 * 1024.0));
+
+	const auto parseTime = loadAll(nullptr);
+	printf("Parse only: %.2f ms\n", parseTime * 1000.0);
+
+	for (const bool strip : { false, true })
+	{
+		LuaBytecodeCacheSettings settings;
+		settings.strip = strip;
+		settings.directory = MakeTempCacheDirectory("bme_lua_bytecode_cache_benchmark");
+
+		LuaBytecodeCache cache(settings);
+		const auto coldTime = loadAll(&cache);
+		EXPECT_EQ(numScripts, cache.stats().numMisses);
+
+		const auto warmTime = loadAll(&cache);
+		EXPECT_EQ(numScripts, cache.stats().numHits);
+
+		// fresh process - entries come from disk
+		LuaBytecodeCache diskCache(settings);
+		const auto diskTime = loadAll(&diskCache);
+		EXPECT_EQ(numScripts, diskCache.stats().numHits);
+
+		printf("%s: cold %.2f ms, warm %.2f ms (%.1fx), warm from disk %.2f ms (%.1fx)\n",
+			strip ? "Stripped" : "Full",
+			coldTime * 1000.0, warmTime * 1000.0, parseTime / warmTime,
+			diskTime * 1000.0, parseTime / diskTime);
+
+		std::error_code ec;
+		std::filesystem::remove_all(settings.directory, ec);
+	}
+}
+
+//--
@@ -0,0 +1,270 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "lua_gc_driver.h"
+
+extern "C" {
+#include <lua/lualib.h>
+#include <lua/lauxlib.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+//--
+
+// Replay of a typical gameplay frame - long lived entity state that slowly changes plus lots of per frame garbage
+static const char* FRAME_SCRIPT = R"(
+entities = {}
+frame_index = 0
+
+function init(count)
+	for i = 1, count do
+		entities[i] = { id = i, name = "entity_" .. i, pos = { x = i, y = 0 }, inventory = {} }
+	end
+end
+
+function tick(garbage)
+	frame_index = frame_index + 1
+
+	local visible = {}
+	for i = 1, garbage do
+		local e = entities[(i * 7 + frame_index) % #entities + 1]
+		visible[#visible + 1] = { e = e, dist = math.abs(e.pos.x - frame_index), tag = "v" .. i }
+	end
+
+	-- some entities get new state, the old one becomes garbage
+	for i = 1, 50 do
+		local e = entities[(frame_index * 31 + i) % #entities + 1]
+		e.pos = { x = e.pos.x + 1, y = e.pos.y }
+		e.inventory[#e.inventory % 8 + 1] = { item = "item_" .. frame_index }
+	end
+
+	return #visible
+end
+)";
+
+static lua_State* CreateFrameState(uint32_t numEntities)
+{
+	auto* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	EXPECT_EQ(LUA_OK, luaL_loadstring(L, FRAME_SCRIPT));
+	EXPECT_EQ(LUA_OK, lua_pcall(L, 0, 0, 0));
+
+	lua_getglobal(L, "init");
+	lua_pushinteger(L, numEntities);
+	EXPECT_EQ(LUA_OK, lua_pcall(L, 1, 0, 0));
+
+	return L;
+}
+
+static void RunFrame(lua_State* L, uint32_t garbage)
+{
+	lua_getglobal(L, "tick");
+	lua_pushinteger(L, garbage);
+	EXPECT_EQ(LUA_OK, lua_pcall(L, 1, 1, 0));
+	lua_pop(L, 1);
+}
+
+//--
+
+TEST(LuaGCDriver, AutomaticCollectionStopped)
+{
+	auto* L = CreateFrameState(100);
+
+	{
+		LuaGCDriver driver(L);
+		EXPECT_EQ(0, lua_gc(L, LUA_GCISRUNNING, 0));
+	}
+
+	EXPECT_EQ(1, lua_gc(L, LUA_GCISRUNNING, 0));
+	lua_close(L);
+}
+
+static void ExpectHeapBounded(LuaGCMode mode)
+{
+	auto* L = CreateFrameState(5000);
+	lua_gc(L, LUA_GCCOLLECT, 0);
+	const auto liveBytes = LuaGCDriver::HeapBytes(L);
+
+	LuaGCDriverSettings settings;
+	settings.mode = mode;
+	settings.frameBudgetUs = 2000;
+
+	uint64_t maxHeapBytes = 0;
+	{
+		LuaGCDriver driver(L, settings);
+		for (uint32_t i = 0; i < 500; ++i)
+		{
+			RunFrame(L, 2000);
+			driver.frame();
+			maxHeapBytes = std::max(maxHeapBytes, LuaGCDriver::HeapBytes(L));
+		}
+
+		const auto& stats = driver.stats();
+		EXPECT_EQ(500, stats.numFrames);
+		EXPECT_LT(0, stats.numCycles);
+		EXPECT_LT(0.0, stats.allocationRateKB);
+
+		uint64_t histogramFrames = 0;
+		for (const auto count : stats.histogram)
+			histogramFrames += count;
+		EXPECT_EQ(stats.numFrames, histogramFrames);
+		EXPECT_EQ(stats.numFrames, stats.numFrameTimes);
+		EXPECT_LE(stats.percentileUs(50), stats.percentileUs(99));
+	}
+
+	// without the driver the heap would grow without limit (collector is stopped)
+	EXPECT_LT(maxHeapBytes, liveBytes * 6) << "live " << liveBytes << ", max " << maxHeapBytes;
+
+	lua_close(L);
+}
+
+TEST(LuaGCDriver, IncrementalKeepsHeapBounded)
+{
+	ExpectHeapBounded(LuaGCMode::Incremental);
+}
+
+TEST(LuaGCDriver, GenerationalKeepsHeapBounded)
+{
+	ExpectHeapBounded(LuaGCMode::Generational);
+}
+
+TEST(LuaGCDriver, FrameHistoryBounded)
+{
+	auto* L = CreateFrameState(100);
+
+	{
+		LuaGCDriver driver(L);
+		for (uint32_t i = 0; i < LUA_GC_FRAME_HISTORY * 3 + 10; ++i)
+		{
+			RunFrame(L, 10);
+			driver.frame();
+		}
+
+		const auto& stats = driver.stats();
+		EXPECT_EQ(LUA_GC_FRAME_HISTORY * 3 + 10, stats.numFrames);
+		EXPECT_EQ(LUA_GC_FRAME_HISTORY, stats.numFrameTimes);
+		EXPECT_LE(stats.percentileUs(0), stats.percentileUs(50));
+		EXPECT_LE(stats.percentileUs(50), stats.percentileUs(100));
+	}
+
+	lua_close(L);
+}
+
+TEST(LuaGCDriver, StepSizeAdapts)
+{
+	auto* L = CreateFrameState(5000);
+
+	LuaGCDriverSettings settings;
+	settings.frameBudgetUs = 400;
+	settings.minStepKB = 1;
+
+	LuaGCDriver driver(L, settings);
+	for (uint32_t i = 0; i < 100; ++i)
+	{
+		RunFrame(L, 2000);
+		driver.frame();
+	}
+
+	const auto& stats = driver.stats();
+	EXPECT_LE(settings.minStepKB, stats.stepKB);
+	EXPECT_GE(settings.maxStepKB, stats.stepKB);
+	EXPECT_LT(0, stats.numSteps);
+
+	lua_close(L);
+}
+
+//--
+
+struct GCBenchmarkResult
+{
+	std::vector<float> frameTimesUs; // script + GC
+	LuaGCStats gcStats;
+};
+
+static float Percentile(std::vector<float> values, float percentile)
+{
+	if (values.empty())
+		return 0.0f;
+
+	const auto index = std::min<size_t>(values.size() - 1, (size_t)(values.size() * percentile / 100.0f));
+	std::nth_element(values.begin(), values.begin() + index, values.end());
+	return values[index];
+}
+
+static GCBenchmarkResult RunGCBenchmark(const LuaGCDriverSettings* settings, uint32_t numFrames)
+{
+	GCBenchmarkResult ret;
+
+	auto* L = CreateFrameState(20000);
+
+	{
+		std::unique_ptr<LuaGCDriver> driver;
+		if (settings)
+			driver = std::make_unique<LuaGCDriver>(L, *settings);
+
+		for (uint32_t i = 0; i < numFrames; ++i)
+		{
+			const auto start = std::chrono::high_resolution_clock::now();
+			RunFrame(L, 5000);
+			if (driver)
+				driver->frame();
+			ret.frameTimesUs.push_back((float)std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count());
+		}
+
+		if (driver)
+			ret.gcStats = driver->stats();
+	}
+
+	lua_close(L);
+	return ret;
+}
+
+TEST(LuaGCDriver, DISABLED_PauseBenchmark)
+{
+	const uint32_t numFrames = 1000;
+
+	{
+		// Lua collector running at allocation points, GC time is hidden inside the frame time
+		const auto result = RunGCBenchmark(nullptr, numFrames);
+		printf("%-28s frame p50 %7.1f us, p99 %7.1f us, max %7.1f us\n", "automatic",
+			Percentile(result.frameTimesUs, 50), Percentile(result.frameTimesUs, 99), Percentile(result.frameTimesUs, 100));
+	}
+
+	for (const auto mode : { LuaGCMode::Incremental, LuaGCMode::Generational })
+	{
+		for (const uint32_t budget : { 250u, 1000u })
+		{
+			LuaGCDriverSettings settings;
+			settings.mode = mode;
+			settings.frameBudgetUs = budget;
+
+			const auto result = RunGCBenchmark(&settings, numFrames);
+			const auto& gc = result.gcStats;
+
+			char name[64];
+			snprintf(name, sizeof(name), "%s, %u us budget", mode == LuaGCMode::Incremental ? "incremental" : "generational", budget);
+
+			printf("%-28s frame p50 %7.1f us, p99 %7.1f us, max %7.1f us | GC p50 %7.1f us, p99 %7.1f us, max %7.1f us, %u cycles, %u over budget, heap %.1f MB\n",
+				name,
+				Percentile(result.frameTimesUs, 50), Percentile(result.frameTimesUs, 99), Percentile(result.frameTimesUs, 100),
+				gc.percentileUs(50), gc.percentileUs(99), gc.percentileUs(100),
+				(uint32_t)gc.numCycles, (uint32_t)gc.numOverBudgetFrames, gc.heapBytes / (1024.0 * 1024.0));
+
+			printf("  GC time histogram:");
+			for (uint32_t i = 0; i < LUA_GC_HISTOGRAM_BUCKETS; ++i)
+				if (gc.histogram[i])
+					printf(" <%uus:%u", 1u << i, (uint32_t)gc.histogram[i]);
+			printf("\n");
+		}
+	}
+}
+
+//--
@@ -0,0 +1,255 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "lua_allocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+//--
+
+LuaPoolAllocator::LuaPoolAllocator()
+{}
+
+LuaPoolAllocator::~LuaPoolAllocator()
+{
+	for (auto* page : m_pages)
+		::free(page);
+	m_pages.clear();
+
+	for (auto* block : m_adoptedBlocks)
+		::free(block);
+	m_adoptedBlocks.clear();
+}
+
+void* LuaPoolAllocator::Alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+	auto* self = (LuaPoolAllocator*)ud;
+
+	if (nsize == 0)
+	{
+		if (ptr)
+			self->free(ptr, osize);
+		return nullptr;
+	}
+
+	// NOTE: for new blocks osize is the type of the object being created, not a size
+	if (!ptr)
+		return self->allocate(nsize);
+
+	return self->reallocate(ptr, osize, nsize);
+}
+
+//--
+
+bool LuaPoolAllocator::reserve(size_t oldSize, size_t newSize)
+{
+	// only growing can fail, Lua assumes shrinking always works
+	if (m_limit && newSize > oldSize && (m_stats.bytesInUse - oldSize + newSize) > m_limit)
+	{
+		m_stats.numFailedAllocs += 1;
+		return false;
+	}
+
+	m_stats.bytesInUse = m_stats.bytesInUse - oldSize + newSize;
+	m_stats.peakBytesInUse = std::max(m_stats.peakBytesInUse, m_stats.bytesInUse);
+	return true;
+}
+
+void* LuaPoolAllocator::allocateSmall(uint32_t classIndex)
+{
+	auto& sizeClass = m_classes[classIndex];
+
+	if (auto* block = sizeClass.freeList)
+	{
+		sizeClass.freeList = block->next;
+		return block;
+	}
+
+	const auto blockSize = (classIndex + 1) * BLOCK_GRANULARITY;
+	if (sizeClass.bumpPos + blockSize > sizeClass.bumpEnd)
+	{
+		if (m_pageLimit && m_stats.bytesInPages + PAGE_SIZE > m_pageLimit)
+			return nullptr;
+
+		auto* page = (uint8_t*)malloc(PAGE_SIZE);
+		if (!page)
+			return nullptr;
+
+		m_pages.push_back(page);
+		m_stats.bytesInPages += PAGE_SIZE;
+
+		sizeClass.bumpPos = page;
+		sizeClass.bumpEnd = page + PAGE_SIZE;
+	}
+
+	auto* ret = sizeClass.bumpPos;
+	sizeClass.bumpPos += blockSize;
+	return ret;
+}
+
+void LuaPoolAllocator::freeSmall(void* ptr, uint32_t classIndex)
+{
+	auto& sizeClass = m_classes[classIndex];
+
+	auto* block = (FreeBlock*)ptr;
+	block->next = sizeClass.freeList;
+	sizeClass.freeList = block;
+}
+
+//--
+
+void* LuaPoolAllocator::allocate(size_t size)
+{
+	if (!reserve(0, size))
+		return nullptr;
+
+	void* ret = nullptr;
+	if (size <= MAX_SMALL_BLOCK_SIZE)
+	{
+		const auto classIndex = SizeClassIndex(size);
+		ret = allocateSmall(classIndex);
+		if (ret)
+			m_stats.liveBlocks[classIndex] += 1;
+	}
+	else
+	{
+		ret = malloc(size);
+		if (ret)
+		{
+			m_stats.numLargeAllocs += 1;
+			m_stats.liveLargeBlocks += 1;
+		}
+	}
+
+	if (!ret)
+	{
+		m_stats.bytesInUse -= size;
+		m_stats.numFailedAllocs += 1;
+		return nullptr;
+	}
+
+	m_stats.numAllocs += 1;
+
+	if (m_hook)
+		m_hook(m_hookUserData, nullptr, ret, 0, size);
+
+	return ret;
+}
+
+void LuaPoolAllocator::free(void* ptr, size_t size)
+{
+	if (size <= MAX_SMALL_BLOCK_SIZE)
+	{
+		const auto classIndex = SizeClassIndex(size);
+		freeSmall(ptr, classIndex);
+		m_stats.liveBlocks[classIndex] -= 1;
+	}
+	else
+	{
+		::free(ptr);
+		m_stats.liveLargeBlocks -= 1;
+	}
+
+	m_stats.bytesInUse -= size;
+	m_stats.numFrees += 1;
+
+	if (m_hook)
+		m_hook(m_hookUserData, ptr, nullptr, size, 0);
+}
+
+void* LuaPoolAllocator::reallocate(void* ptr, size_t oldSize, size_t newSize)
+{
+	if (!reserve(oldSize, newSize))
+		return nullptr;
+
+	const auto oldSmall = oldSize <= MAX_SMALL_BLOCK_SIZE;
+	const auto newSmall = newSize <= MAX_SMALL_BLOCK_SIZE;
+
+	void* ret = nullptr;
+	if (oldSmall && newSmall && SizeClassIndex(oldSize) == SizeClassIndex(newSize))
+	{
+		ret = ptr;
+		m_stats.numReallocsInPlace += 1;
+	}
+	else if (!oldSmall && !newSmall)
+	{
+		ret = realloc(ptr, newSize);
+	}
+	else
+	{
+		if (newSmall)
+		{
+			const auto classIndex = SizeClassIndex(newSize);
+			ret = allocateSmall(classIndex);
+			if (ret)
+				m_stats.liveBlocks[classIndex] += 1;
+		}
+		else
+		{
+			ret = malloc(newSize);
+			if (ret)
+			{
+				m_stats.numLargeAllocs += 1;
+				m_stats.liveLargeBlocks += 1;
+			}
+		}
+
+		if (ret)
+		{
+			memcpy(ret, ptr, std::min(oldSize, newSize));
+
+			if (oldSmall)
+			{
+				const auto classIndex = SizeClassIndex(oldSize);
+				freeSmall(ptr, classIndex);
+				m_stats.liveBlocks[classIndex] -= 1;
+			}
+			else
+			{
+				::free(ptr);
+				m_stats.liveLargeBlocks -= 1;
+			}
+		}
+	}
+
+	// Lua assumes shrinking never fails, keep the old block - it's big enough
+	// From now on Lua frees it with the new size so it's accounted in the new size class
+	if (!ret && newSize <= oldSize)
+	{
+		if (oldSmall)
+			m_stats.liveBlocks[SizeClassIndex(oldSize)] -= 1;
+		else if (newSmall)
+			m_stats.liveLargeBlocks -= 1;
+
+		if (newSmall)
+			m_stats.liveBlocks[SizeClassIndex(newSize)] += 1;
+
+		if (!oldSmall && newSmall)
+			m_adoptedBlocks.push_back(ptr);
+
+		m_stats.numKeptShrinks += 1;
+		ret = ptr;
+	}
+
+	if (!ret)
+	{
+		m_stats.bytesInUse = m_stats.bytesInUse - newSize + oldSize;
+		m_stats.numFailedAllocs += 1;
+		return nullptr;
+	}
+
+	m_stats.numReallocs += 1;
+
+	if (m_hook)
+		m_hook(m_hookUserData, ptr, ret, oldSize, newSize);
+
+	return ret;
+}
+
+//--
@@ -0,0 +1,104 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+//--
+
+// Allocator for a single lua_State, small blocks (up to 512 bytes) come from per size-class slabs, bigger ones go to malloc
+// Lua passes the old block size on free/realloc so we always know the class of the block without any headers
+// NOTE: not thread safe, same as the lua_State it's used by
+class LuaPoolAllocator
+{
+public:
+	static const uint32_t BLOCK_GRANULARITY = 16;
+	static const uint32_t MAX_SMALL_BLOCK_SIZE = 512;
+	static const uint32_t NUM_SIZE_CLASSES = MAX_SMALL_BLOCK_SIZE / BLOCK_GRANULARITY;
+	static const uint32_t PAGE_SIZE = 64 * 1024;
+
+	struct Stats
+	{
+		uint64_t numAllocs = 0; // new blocks
+		uint64_t numFrees = 0;
+		uint64_t numReallocs = 0; // resizes of existing blocks
+		uint64_t numReallocsInPlace = 0; // resizes that stayed in the same size class
+		uint64_t numLargeAllocs = 0; // blocks that went to malloc
+		uint64_t numFailedAllocs = 0;
+		uint64_t numKeptShrinks = 0; // shrinks that could not move to the smaller block and kept the old one
+
+		uint64_t bytesInUse = 0; // as requested by Lua
+		uint64_t peakBytesInUse = 0;
+		uint64_t bytesInPages = 0; // memory reserved for small blocks
+
+		uint64_t liveBlocks[NUM_SIZE_CLASSES] = {}; // small blocks currently in use, per size class
+		uint64_t liveLargeBlocks = 0;
+	};
+
+	// Called on every allocator event, ptr is NULL for new blocks, newPtr is NULL for frees
+	typedef void (*Hook)(void* userData, const void* ptr, const void* newPtr, size_t oldSize, size_t newSize);
+
+	LuaPoolAllocator();
+	~LuaPoolAllocator();
+
+	LuaPoolAllocator(const LuaPoolAllocator&) = delete;
+	LuaPoolAllocator& operator=(const LuaPoolAllocator&) = delete;
+
+	// lua_Alloc compatible entry point, pass the allocator as the user data
+	static void* Alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+	// Memory limit for the state, allocations above the limit fail and Lua raises LUA_ERRMEM, 0 - no limit
+	inline void limit(uint64_t maxBytesInUse) { m_limit = maxBytesInUse; }
+
+	// Limit for the memory reserved for small block pages, mostly to test running out of memory, 0 - no limit
+	inline void limitPages(uint64_t maxBytesInPages) { m_pageLimit = maxBytesInPages; }
+
+	inline void hook(Hook func, void* userData) { m_hook = func; m_hookUserData = userData; }
+
+	inline const Stats& stats() const { return m_stats; }
+
+	void* allocate(size_t size);
+	void* reallocate(void* ptr, size_t oldSize, size_t newSize);
+	void free(void* ptr, size_t size);
+
+private:
+	struct FreeBlock
+	{
+		FreeBlock* next;
+	};
+
+	struct SizeClass
+	{
+		FreeBlock* freeList = nullptr;
+		uint8_t* bumpPos = nullptr; // carving position in the current page
+		uint8_t* bumpEnd = nullptr;
+	};
+
+	SizeClass m_classes[NUM_SIZE_CLASSES];
+	std::vector<void*> m_pages;
+	std::vector<void*> m_adoptedBlocks; // large blocks kept by a failed shrink, they live in the small free lists now
+
+	Stats m_stats;
+	uint64_t m_limit = 0;
+	uint64_t m_pageLimit = 0;
+
+	Hook m_hook = nullptr;
+	void* m_hookUserData = nullptr;
+
+	static inline uint32_t SizeClassIndex(size_t size)
+	{
+		return (uint32_t)((size + BLOCK_GRANULARITY - 1) / BLOCK_GRANULARITY) - 1;
+	}
+
+	void* allocateSmall(uint32_t classIndex);
+	void freeSmall(void* ptr, uint32_t classIndex);
+	bool reserve(size_t oldSize, size_t newSize);
+};
+
+//--
@@ -0,0 +1,253 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+extern "C" {
+#include <lua/lua.h>
+#include <lua/lauxlib.h>
+}
+
+#include <stdint.h>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+//--
+
+// Compile time generated trampolines for native functions, the C++ signature decides how the stack is read
+// Everything is resolved at compile time, a call costs the same as the hand written lua_tointegerx/lua_pushinteger code
+//
+//   static int64_t Mul(int64_t a, int64_t b) { return a * b; }
+//   LuaBind::Register<&Mul>(L, "mul");
+//
+// Engine objects are passed as light userdata, methods take the object as the first argument:
+//
+//   LuaBind::Register<&Entity::health>(L, "entity_health"); -- entity_health(entity)
+namespace LuaBind
+{
+	//--
+
+	// Conversion of a single type to/from the Lua stack, specialize for more types
+	template< typename T, typename Enable = void >
+	struct Stack;
+
+	template<>
+	struct Stack<bool>
+	{
+		static inline bool Get(lua_State* L, int index) { return lua_toboolean(L, index) != 0; }
+		static inline int Push(lua_State* L, bool value) { lua_pushboolean(L, value ? 1 : 0); return 1; }
+	};
+
+	template< typename T >
+	struct Stack<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+	{
+		static inline T Get(lua_State* L, int index)
+		{
+			int isnum = 0;
+			const auto value = lua_tointegerx(L, index, &isnum);
+			if (!isnum)
+				luaL_typeerror(L, index, "integer");
+			return (T)value;
+		}
+
+		static inline int Push(lua_State* L, T value) { lua_pushinteger(L, (lua_Integer)value); return 1; }
+	};
+
+	template< typename T >
+	struct Stack<T, std::enable_if_t<std::is_enum_v<T>>>
+	{
+		static inline T Get(lua_State* L, int index) { return (T)Stack<std::underlying_type_t<T>>::Get(L, index); }
+		static inline int Push(lua_State* L, T value) { lua_pushinteger(L, (lua_Integer)value); return 1; }
+	};
+
+	template< typename T >
+	struct Stack<T, std::enable_if_t<std::is_floating_point_v<T>>>
+	{
+		static inline T Get(lua_State* L, int index)
+		{
+			int isnum = 0;
+			const auto value = lua_tonumberx(L, index, &isnum);
+			if (!isnum)
+				luaL_typeerror(L, index, "number");
+			return (T)value;
+		}
+
+		static inline int Push(lua_State* L, T value) { lua_pushnumber(L, (lua_Number)value); return 1; }
+	};
+
+	// NOTE: strings point into the Lua string, valid only during the call
+	template<>
+	struct Stack<const char*>
+	{
+		static inline const char* Get(lua_State* L, int index)
+		{
+			const auto* str = lua_tostring(L, index);
+			if (!str)
+				luaL_typeerror(L, index, "string");
+			return str;
+		}
+
+		static inline int Push(lua_State* L, const char* value) { lua_pushstring(L, value); return 1; }
+	};
+
+	template<>
+	struct Stack<std::string_view>
+	{
+		static inline std::string_view Get(lua_State* L, int index)
+		{
+			size_t length = 0;
+			const auto* str = lua_tolstring(L, index, &length);
+			if (!str)
+				luaL_typeerror(L, index, "string");
+			return std::string_view(str, length);
+		}
+
+		static inline int Push(lua_State* L, std::string_view value) { lua_pushlstring(L, value.data(), value.size()); return 1; }
+	};
+
+	// Engine objects, passed around as light userdata (no allocation, no metatable), nil is NULL
+	template< typename T >
+	struct Stack<T*, std::enable_if_t<!std::is_same_v<std::remove_cv_t<T>, char>>>
+	{
+		static inline T* Get(lua_State* L, int index)
+		{
+			if (lua_islightuserdata(L, index))
+				return (T*)lua_touserdata(L, index);
+			if (!lua_isnoneornil(L, index))
+				luaL_typeerror(L, index, "light userdata");
+			return nullptr;
+		}
+
+		static inline int Push(lua_State* L, T* value)
+		{
+			if (value)
+				lua_pushlightuserdata(L, (void*)value);
+			else
+				lua_pushnil(L);
+			return 1;
+		}
+	};
+
+	// Multiple return values
+	template< typename... T >
+	struct Stack<std::tuple<T...>>
+	{
+		static inline int Push(lua_State* L, const std::tuple<T...>& values)
+		{
+			return std::apply([L](const auto&... value) { return (0 + ... + Stack<std::decay_t<decltype(value)>>::Push(L, value)); }, values);
+		}
+	};
+
+	//--
+
+	namespace prv
+	{
+		template< typename T >
+		using ArgType = std::remove_cv_t<std::remove_reference_t<T>>;
+
+		template< typename R, typename Call >
+		static inline int PushResult(lua_State* L, Call&& call)
+		{
+			if constexpr (std::is_void_v<R>)
+			{
+				call();
+				return 0;
+			}
+			else
+			{
+				return Stack<ArgType<R>>::Push(L, call());
+			}
+		}
+
+		template< typename F >
+		struct Invoker;
+
+		// free functions
+		template< typename R, typename... Args >
+		struct Invoker<R(*)(Args...)>
+		{
+			template< R(*Func)(Args...), size_t... I >
+			static inline int Call(lua_State* L, std::index_sequence<I...>)
+			{
+				// NOTE: arguments are fetched in order, an error leaves via longjmp before the call
+				std::tuple<ArgType<Args>...> args{ Stack<ArgType<Args>>::Get(L, (int)I + 1)... };
+				return PushResult<R>(L, [&args]() -> R { return Func(std::get<I>(args)...); });
+			}
+
+			template< R(*Func)(Args...) >
+			static int Trampoline(lua_State* L)
+			{
+				return Call<Func>(L, std::index_sequence_for<Args...>());
+			}
+		};
+
+		// methods of engine objects, object is the first argument
+		template< typename C, typename R, typename... Args >
+		struct MethodInvoker
+		{
+			template< typename M, M Method, size_t... I >
+			static inline int Call(lua_State* L, std::index_sequence<I...>)
+			{
+				auto* self = Stack<C*>::Get(L, 1);
+				if (!self)
+					luaL_argerror(L, 1, "object expected");
+
+				std::tuple<ArgType<Args>...> args{ Stack<ArgType<Args>>::Get(L, (int)I + 2)... };
+				return PushResult<R>(L, [self, &args]() -> R { return (self->*Method)(std::get<I>(args)...); });
+			}
+		};
+
+		template< typename R, typename C, typename... Args >
+		struct Invoker<R(C::*)(Args...)> : MethodInvoker<C, R, Args...>
+		{
+			template< R(C::*Method)(Args...) >
+			static int Trampoline(lua_State* L)
+			{
+				return MethodInvoker<C, R, Args...>::template Call<R(C::*)(Args...), Method>(L, std::index_sequence_for<Args...>());
+			}
+		};
+
+		template< typename R, typename C, typename... Args >
+		struct Invoker<R(C::*)(Args...) const> : MethodInvoker<const C, R, Args...>
+		{
+			template< R(C::*Method)(Args...) const >
+			static int Trampoline(lua_State* L)
+			{
+				return MethodInvoker<const C, R, Args...>::template Call<R(C::*)(Args...) const, Method>(L, std::index_sequence_for<Args...>());
+			}
+		};
+	}
+
+	//--
+
+	// lua_CFunction for given native function or method
+	template< auto Func >
+	static constexpr lua_CFunction Function()
+	{
+		return &prv::Invoker<decltype(Func)>::template Trampoline<Func>;
+	}
+
+	// Register native function or method as a global
+	template< auto Func >
+	static inline void Register(lua_State* L, const char* name)
+	{
+		lua_register(L, name, Function<Func>());
+	}
+
+	// Push value of any bindable type
+	template< typename T >
+	static inline int Push(lua_State* L, const T& value)
+	{
+		return Stack<prv::ArgType<T>>::Push(L, value);
+	}
+
+	//--
+
+} // LuaBind
+
+//--
@@ -0,0 +1,231 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "lua_bytecode_cache.h"
+
+extern "C" {
+#include <lua/lua.h>
+#include <lua/lauxlib.h>
+}
+
+#include <fstream>
+
+//--
+
+uint64_t LuaHashData(const void* data, size_t size, uint64_t hash)
+{
+	const auto* ptr = (const uint8_t*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= ptr[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+//--
+
+struct LuaMemoryReader
+{
+	const char* data = nullptr;
+	size_t size = 0;
+};
+
+static const char* ReadFromMemory(lua_State* L, void* ud, size_t* size)
+{
+	(void)L;
+
+	auto* reader = (LuaMemoryReader*)ud;
+	if (!reader->size)
+		return nullptr;
+
+	*size = reader->size;
+	reader->size = 0;
+	return reader->data;
+}
+
+static int WriteToVector(lua_State* L, const void* p, size_t sz, void* ud)
+{
+	(void)L;
+
+	auto* buffer = (std::vector<uint8_t>*)ud;
+	const auto* ptr = (const uint8_t*)p;
+	buffer->insert(buffer->end(), ptr, ptr + sz);
+	return 0;
+}
+
+static bool LoadFileToVector(const std::filesystem::path& path, std::vector<uint8_t>& outBuffer)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+
+	const auto size = (size_t)file.tellg();
+	file.seekg(0);
+
+	outBuffer.resize(size);
+	return (bool)file.read((char*)outBuffer.data(), size);
+}
+
+static void SaveVectorToFile(const std::filesystem::path& path, const std::vector<uint8_t>& buffer)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (file)
+		file.write((const char*)buffer.data(), buffer.size());
+}
+
+//--
+
+LuaBytecodeCache::LuaBytecodeCache(const LuaBytecodeCacheSettings& settings)
+	: m_settings(settings)
+{
+	if (!m_settings.directory.empty())
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(m_settings.directory, ec);
+	}
+}
+
+uint64_t LuaBytecodeCache::entryKey(uint64_t sourceHash, const char* chunkName) const
+{
+	// chunk name ends up in the debug info so it's part of the key, same with stripping
+	auto key = LuaHashData(chunkName, chunkName ? strlen(chunkName) : 0, sourceHash);
+	const uint8_t strip = m_settings.strip ? 1 : 0;
+	return LuaHashData(&strip, 1, key);
+}
+
+std::filesystem::path LuaBytecodeCache::entryPath(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.luac", (unsigned long long)key);
+	return m_settings.directory / name;
+}
+
+std::vector<uint8_t>* LuaBytecodeCache::findEntry(const char* source, size_t sourceSize, const char* chunkName)
+{
+	const auto key = entryKey(LuaHashData(source, sourceSize), chunkName);
+
+	auto it = m_entries.find(key);
+	if (it != m_entries.end())
+		return &it->second;
+
+	if (!m_settings.directory.empty())
+	{
+		std::vector<uint8_t> data;
+		if (LoadFileToVector(entryPath(key), data))
+			return &(m_entries[key] = std::move(data));
+	}
+
+	return nullptr;
+}
+
+void LuaBytecodeCache::clear()
+{
+	m_entries.clear();
+}
+
+bool LuaBytecodeCache::validateEntry(const std::vector<uint8_t>& entry, uint64_t sourceHash, size_t sourceSize) const
+{
+	if (entry.size() < sizeof(LuaBytecodeHeader))
+		return false;
+
+	LuaBytecodeHeader header;
+	memcpy(&header, entry.data(), sizeof(header));
+
+	if (header.magic != LUA_BYTECODE_CACHE_MAGIC || header.version != LUA_BYTECODE_CACHE_VERSION)
+		return false;
+
+	if (header.luaVersion != LUA_VERSION_NUM || header.sizeOfInteger != sizeof(lua_Integer) || header.sizeOfNumber != sizeof(lua_Number) || header.sizeOfPointer != sizeof(void*))
+		return false;
+
+	if (header.stripped != (m_settings.strip ? 1 : 0))
+		return false;
+
+	if (header.sourceHash != sourceHash || header.sourceSize != sourceSize)
+		return false;
+
+	if (header.bytecodeSize != entry.size() - sizeof(header))
+		return false;
+
+	return header.bytecodeHash == LuaHashData(entry.data() + sizeof(header), header.bytecodeSize);
+}
+
+bool LuaBytecodeCache::compileEntry(lua_State* L, uint64_t sourceHash, size_t sourceSize, std::vector<uint8_t>& outEntry) const
+{
+	outEntry.clear();
+	outEntry.resize(sizeof(LuaBytecodeHeader));
+
+	// function to dump is on top of the stack
+	if (0 != lua_dump(L, &WriteToVector, &outEntry, m_settings.strip ? 1 : 0))
+		return false;
+
+	LuaBytecodeHeader header;
+	header.luaVersion = LUA_VERSION_NUM;
+	header.sizeOfInteger = sizeof(lua_Integer);
+	header.sizeOfNumber = sizeof(lua_Number);
+	header.sizeOfPointer = sizeof(void*);
+	header.stripped = m_settings.strip ? 1 : 0;
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	header.bytecodeSize = outEntry.size() - sizeof(header);
+	header.bytecodeHash = LuaHashData(outEntry.data() + sizeof(header), header.bytecodeSize);
+	memcpy(outEntry.data(), &header, sizeof(header));
+
+	return true;
+}
+
+int LuaBytecodeCache::load(lua_State* L, const char* source, size_t sourceSize, const char* chunkName)
+{
+	const auto sourceHash = LuaHashData(source, sourceSize);
+	const auto key = entryKey(sourceHash, chunkName);
+
+	if (auto* entry = findEntry(source, sourceSize, chunkName))
+	{
+		if (validateEntry(*entry, sourceHash, sourceSize))
+		{
+			LuaMemoryReader reader;
+			reader.data = (const char*)entry->data() + sizeof(LuaBytecodeHeader);
+			reader.size = entry->size() - sizeof(LuaBytecodeHeader);
+
+			// binary only, never fall back to parsing whatever is in the cache as text
+			if (LUA_OK == lua_load(L, &ReadFromMemory, &reader, chunkName, "b"))
+			{
+				m_stats.numHits += 1;
+				return LUA_OK;
+			}
+
+			lua_pop(L, 1);
+		}
+
+		m_stats.numRejected += 1;
+		m_entries.erase(key);
+	}
+	else
+	{
+		m_stats.numMisses += 1;
+	}
+
+	const auto status = luaL_loadbufferx(L, source, sourceSize, chunkName, "t");
+	if (status != LUA_OK)
+	{
+		m_stats.numCompileErrors += 1;
+		return status;
+	}
+
+	std::vector<uint8_t> entry;
+	if (compileEntry(L, sourceHash, sourceSize, entry))
+	{
+		if (!m_settings.directory.empty())
+			SaveVectorToFile(entryPath(key), entry);
+
+		m_entries[key] = std::move(entry);
+	}
+
+	return LUA_OK;
+}
+
+//--
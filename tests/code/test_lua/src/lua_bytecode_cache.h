@@ -0,0 +1,92 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+
+struct lua_State;
+
+//--
+
+static const uint32_t LUA_BYTECODE_CACHE_MAGIC = 0x434C4D42; // "BMLC"
+static const uint32_t LUA_BYTECODE_CACHE_VERSION = 1;
+
+// Header in front of every cached chunk, anything that does not match exactly makes the entry stale
+#pragma pack(push, 1)
+struct LuaBytecodeHeader
+{
+	uint32_t magic = LUA_BYTECODE_CACHE_MAGIC;
+	uint32_t version = LUA_BYTECODE_CACHE_VERSION;
+	uint32_t luaVersion = 0; // LUA_VERSION_NUM
+	uint8_t sizeOfInteger = 0; // sizeof(lua_Integer)
+	uint8_t sizeOfNumber = 0; // sizeof(lua_Number)
+	uint8_t sizeOfPointer = 0;
+	uint8_t stripped = 0;
+	uint64_t sourceHash = 0; // full hash of the source, not only the key
+	uint64_t sourceSize = 0;
+	uint64_t bytecodeHash = 0; // undump is not safe against corrupted data, never pass it anything we did not write
+	uint64_t bytecodeSize = 0;
+};
+#pragma pack(pop)
+
+struct LuaBytecodeCacheSettings
+{
+	bool strip = false; // drop debug info (line numbers, local names) - smaller and faster to load but worse error messages
+	std::filesystem::path directory; // persist entries as files, empty - memory only
+};
+
+struct LuaBytecodeCacheStats
+{
+	uint32_t numHits = 0;
+	uint32_t numMisses = 0;
+	uint32_t numRejected = 0; // stale or corrupted entries that were recompiled
+	uint32_t numCompileErrors = 0;
+};
+
+// Cache of compiled Lua chunks keyed by the hash of the source
+// NOTE: not thread safe, use one per loading thread
+class LuaBytecodeCache
+{
+public:
+	LuaBytecodeCache(const LuaBytecodeCacheSettings& settings = LuaBytecodeCacheSettings());
+
+	inline const LuaBytecodeCacheStats& stats() const { return m_stats; }
+	inline uint32_t size() const { return (uint32_t)m_entries.size(); }
+
+	// Load chunk from the cache or compile it and update the cache, same contract as luaL_loadbuffer
+	// On success the compiled function is pushed on the stack, on error the error message is
+	int load(lua_State* L, const char* source, size_t sourceSize, const char* chunkName);
+
+	// Raw cache entry (header + bytecode) for the given source, NULL if not cached
+	std::vector<uint8_t>* findEntry(const char* source, size_t sourceSize, const char* chunkName);
+
+	// Drop all entries from memory, files on disk are not touched
+	void clear();
+
+private:
+	LuaBytecodeCacheSettings m_settings;
+	LuaBytecodeCacheStats m_stats;
+
+	std::unordered_map<uint64_t, std::vector<uint8_t>> m_entries;
+
+	uint64_t entryKey(uint64_t sourceHash, const char* chunkName) const;
+	std::filesystem::path entryPath(uint64_t key) const;
+
+	bool validateEntry(const std::vector<uint8_t>& entry, uint64_t sourceHash, size_t sourceSize) const;
+	bool compileEntry(lua_State* L, uint64_t sourceHash, size_t sourceSize, std::vector<uint8_t>& outEntry) const;
+};
+
+//--
+
+// 64-bit FNV-1a
+extern uint64_t LuaHashData(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL);
+
+//--
@@ -0,0 +1,188 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "lua_gc_driver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+//--
+
+typedef std::chrono::high_resolution_clock GCClock;
+
+static double ElapsedUs(GCClock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(GCClock::now() - start).count();
+}
+
+float LuaGCStats::percentileUs(float percentile) const
+{
+	if (!numFrameTimes)
+		return 0.0f;
+
+	std::vector<float> times(frameTimesUs, frameTimesUs + numFrameTimes);
+	const auto index = std::min<size_t>(times.size() - 1, (size_t)(times.size() * std::clamp(percentile, 0.0f, 100.0f) / 100.0f));
+	std::nth_element(times.begin(), times.begin() + index, times.end());
+	return times[index];
+}
+
+//--
+
+LuaGCDriver::LuaGCDriver(lua_State* L, const LuaGCDriverSettings& settings)
+	: m_state(L)
+	, m_settings(settings)
+{
+	if (settings.mode == LuaGCMode::Generational)
+		lua_gc(L, LUA_GCGEN, settings.minorMul, settings.majorMul);
+	else
+		lua_gc(L, LUA_GCINC, settings.pause, settings.stepMul, settings.stepSize);
+
+	// from now on the collector runs only when we say so
+	lua_gc(L, LUA_GCSTOP, 0);
+
+	m_stats.stepKB = std::clamp<uint32_t>(64, settings.minStepKB, settings.maxStepKB);
+	m_stats.heapBytes = HeapBytes(L);
+	m_stats.heapBytesAfterCycle = m_stats.heapBytes;
+	m_lastFrameHeapBytes = m_stats.heapBytes;
+}
+
+LuaGCDriver::~LuaGCDriver()
+{
+	lua_gc(m_state, LUA_GCRESTART, 0);
+}
+
+uint64_t LuaGCDriver::HeapBytes(lua_State* L)
+{
+	return (uint64_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + (uint64_t)lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+void LuaGCDriver::frame()
+{
+	const auto start = GCClock::now();
+
+	// collector is stopped outside of frame() so any growth since the last frame is new allocations
+	const auto heapBytes = HeapBytes(m_state);
+	const auto allocated = heapBytes > m_lastFrameHeapBytes ? heapBytes - m_lastFrameHeapBytes : 0;
+	m_allocatedSinceCycle += allocated;
+
+	const auto allocatedKB = allocated / 1024.0;
+	m_stats.allocationRateKB = m_stats.numFrames ? (m_stats.allocationRateKB * 0.9 + allocatedKB * 0.1) : allocatedKB;
+	m_stats.heapBytes = heapBytes;
+
+	const auto overBudget = (m_settings.mode == LuaGCMode::Generational) ? generationalFrame() : incrementalFrame();
+	if (overBudget)
+		m_stats.numOverBudgetFrames += 1;
+
+	m_lastFrameHeapBytes = HeapBytes(m_state);
+	m_stats.heapBytes = m_lastFrameHeapBytes;
+
+	recordFrame(ElapsedUs(start));
+}
+
+void LuaGCDriver::recordFrame(double timeUs)
+{
+	uint32_t bucket = 0;
+	if (timeUs >= 1.0)
+		bucket = std::min<uint32_t>(LUA_GC_HISTOGRAM_BUCKETS - 1, (uint32_t)std::log2(timeUs) + 1);
+
+	m_stats.histogram[bucket] += 1;
+	m_stats.frameTimesUs[m_stats.numFrames % LUA_GC_FRAME_HISTORY] = (float)timeUs;
+	m_stats.numFrameTimes = std::min(m_stats.numFrameTimes + 1, LUA_GC_FRAME_HISTORY);
+	m_stats.numFrames += 1;
+}
+
+bool LuaGCDriver::incrementalFrame()
+{
+	const auto start = GCClock::now();
+	const auto budgetUs = (double)m_settings.frameBudgetUs;
+
+	// way behind the scripts, finish the cycle no matter what it costs
+	const auto emergency = m_stats.heapBytes > m_stats.heapBytesAfterCycle * m_settings.maxHeapGrowth;
+	auto finishCycle = emergency;
+
+	// to keep pace the collector has to traverse at least as much as was allocated, twice that when the heap keeps growing
+	auto requiredKB = std::max<double>(m_stats.allocationRateKB, m_settings.minStepKB);
+	if (m_stats.heapBytes > m_stats.heapBytesAfterCycle * 2)
+		requiredKB *= 2.0;
+
+	double doneKB = 0.0;
+	for (;;)
+	{
+		if (!finishCycle)
+		{
+			const auto elapsedUs = ElapsedUs(start);
+			if (doneKB >= requiredKB || elapsedUs >= budgetUs)
+				break;
+
+			// don't start a step that is not going to fit
+			if (m_stepCostUsPerKB > 0.0 && elapsedUs + m_stepCostUsPerKB * m_stats.stepKB > budgetUs && doneKB > 0.0)
+				break;
+		}
+
+		const auto stepStart = GCClock::now();
+		const auto cycleFinished = 0 != lua_gc(m_state, LUA_GCSTEP, (int)m_stats.stepKB);
+		const auto stepUs = ElapsedUs(stepStart);
+
+		m_stats.numSteps += 1;
+		doneKB += m_stats.stepKB;
+
+		// aim for steps of a quarter of the budget so a frame has a few chances to stop
+		const auto costPerKB = stepUs / m_stats.stepKB;
+		m_stepCostUsPerKB = (m_stepCostUsPerKB > 0.0) ? (m_stepCostUsPerKB * 0.8 + costPerKB * 0.2) : costPerKB;
+		if (m_stepCostUsPerKB > 0.0)
+			m_stats.stepKB = (uint32_t)std::clamp<double>((budgetUs / 4.0) / m_stepCostUsPerKB, m_settings.minStepKB, m_settings.maxStepKB);
+
+		if (cycleFinished)
+		{
+			m_stats.numCycles += 1;
+			m_stats.heapBytesAfterCycle = HeapBytes(m_state);
+			m_allocatedSinceCycle = 0;
+			finishCycle = false;
+
+			if (doneKB >= requiredKB)
+				break;
+		}
+	}
+
+	return emergency;
+}
+
+bool LuaGCDriver::generationalFrame()
+{
+	const auto budgetUs = (double)m_settings.frameBudgetUs;
+
+	const auto emergency = m_stats.heapBytes > m_stats.heapBytesAfterCycle * m_settings.maxHeapGrowth;
+
+	// minor collection after the young generation grows by minorMul percent of the heap, same as Lua does it
+	const auto minorMul = m_settings.minorMul ? m_settings.minorMul : 20;
+	const auto threshold = m_stats.heapBytesAfterCycle * minorMul / 100;
+	if (!emergency && m_allocatedSinceCycle < threshold)
+		return false;
+
+	// minor collection can't be split, postpone it to a later frame if it's not going to fit but never by more than the threshold
+	const auto predictedUs = m_stepCostUsPerKB * (m_allocatedSinceCycle / 1024.0);
+	if (!emergency && predictedUs > budgetUs && m_allocatedSinceCycle < threshold * 2)
+		return false;
+
+	const auto stepStart = GCClock::now();
+	lua_gc(m_state, LUA_GCSTEP, 0);
+	const auto stepUs = ElapsedUs(stepStart);
+
+	const auto costPerKB = stepUs / std::max(1.0, m_allocatedSinceCycle / 1024.0);
+	m_stepCostUsPerKB = (m_stepCostUsPerKB > 0.0) ? (m_stepCostUsPerKB * 0.8 + costPerKB * 0.2) : costPerKB;
+
+	m_stats.numSteps += 1;
+	m_stats.numCycles += 1;
+	m_stats.heapBytesAfterCycle = HeapBytes(m_state);
+	m_allocatedSinceCycle = 0;
+
+	return emergency;
+}
+
+//--
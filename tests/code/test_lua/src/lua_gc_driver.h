@@ -0,0 +1,100 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+extern "C" {
+#include <lua/lua.h>
+}
+
+#include <stdint.h>
+
+//--
+
+enum class LuaGCMode : uint8_t
+{
+	Incremental, // LUA_GCINC, mark & sweep in small steps spread over frames
+	Generational, // LUA_GCGEN, minor collections of young objects, one minor collection per step
+};
+
+struct LuaGCDriverSettings
+{
+	LuaGCMode mode = LuaGCMode::Incremental;
+
+	uint32_t frameBudgetUs = 1000; // time per frame the collector is allowed to take
+	float maxHeapGrowth = 3.0f; // above this size relative to the heap after the last cycle the budget is ignored
+
+	// incremental mode (see lua_gc LUA_GCINC), 0 - Lua default
+	int pause = 0;
+	int stepMul = 0;
+	int stepSize = 0;
+
+	// generational mode (see lua_gc LUA_GCGEN), 0 - Lua default
+	int minorMul = 0;
+	int majorMul = 0;
+
+	uint32_t minStepKB = 4; // limits of the adaptive step size
+	uint32_t maxStepKB = 4096;
+};
+
+static const uint32_t LUA_GC_HISTOGRAM_BUCKETS = 16; // power of two microsecond buckets, last one collects everything above
+static const uint32_t LUA_GC_FRAME_HISTORY = 1024; // number of most recent frames kept for the percentiles
+
+struct LuaGCStats
+{
+	uint64_t numFrames = 0;
+	uint64_t numSteps = 0;
+	uint64_t numCycles = 0; // completed incremental cycles or minor collections
+	uint64_t numOverBudgetFrames = 0; // frames where heap growth forced the collector past the budget
+
+	double allocationRateKB = 0.0; // smoothed allocation per frame
+	uint32_t stepKB = 0; // current adaptive step size
+	uint64_t heapBytes = 0;
+	uint64_t heapBytesAfterCycle = 0;
+
+	uint64_t histogram[LUA_GC_HISTOGRAM_BUCKETS] = {}; // per frame GC time, bucket i holds [2^(i-1), 2^i) us
+	float frameTimesUs[LUA_GC_FRAME_HISTORY] = {}; // per frame GC time, ring buffer indexed by the frame number
+	uint32_t numFrameTimes = 0; // valid entries in frameTimesUs
+
+	// Per frame GC time at given percentile (0-100) over the recent frames
+	float percentileUs(float percentile) const;
+};
+
+// Runs the Lua collector in time slices at the end of each frame instead of at random allocation points
+// Automatic collection is stopped while the driver exists, the step size adapts to the measured step cost
+// and the allocation rate so the collector keeps up with the scripts within the budget
+class LuaGCDriver
+{
+public:
+	LuaGCDriver(lua_State* L, const LuaGCDriverSettings& settings = LuaGCDriverSettings());
+	~LuaGCDriver();
+
+	LuaGCDriver(const LuaGCDriver&) = delete;
+	LuaGCDriver& operator=(const LuaGCDriver&) = delete;
+
+	inline const LuaGCStats& stats() const { return m_stats; }
+
+	// Do the GC work for this frame, call once per frame after the scripts ran
+	void frame();
+
+	// Current size of the Lua heap
+	static uint64_t HeapBytes(lua_State* L);
+
+private:
+	lua_State* m_state = nullptr;
+	LuaGCDriverSettings m_settings;
+	LuaGCStats m_stats;
+
+	uint64_t m_lastFrameHeapBytes = 0;
+	uint64_t m_allocatedSinceCycle = 0;
+	double m_stepCostUsPerKB = 0.0;
+
+	void recordFrame(double timeUs);
+	bool incrementalFrame();
+	bool generationalFrame();
+};
+
+//--
@@ -0,0 +1,230 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "lua_profiler.h"
+
+#include <algorithm>
+
+//--
+
+void LuaProfileReport::add(const LuaProfilerSample& sample)
+{
+	if (!sample.depth)
+		return;
+
+	std::string stack;
+	stack.reserve(sample.depth * 32);
+
+	// folded stacks go from the root to the leaf
+	for (int i = (int)sample.depth - 1; i >= 0; --i)
+	{
+		if (!stack.empty())
+			stack += ';';
+
+		for (const char* ch = sample.frames[i]; *ch; ++ch)
+			stack += (*ch == ';') ? ':' : *ch;
+	}
+
+	if (sample.truncated)
+		stack.insert(0, "[truncated];");
+
+	m_stacks[stack] += 1;
+	m_self[sample.frames[0]] += 1;
+
+	// recursion should count once per sample
+	for (uint32_t i = 0; i < sample.depth; ++i)
+	{
+		bool seen = false;
+		for (uint32_t j = 0; j < i && !seen; ++j)
+			seen = 0 == strcmp(sample.frames[i], sample.frames[j]);
+
+		if (!seen)
+			m_inclusive[sample.frames[i]] += 1;
+	}
+
+	m_numSamples += 1;
+}
+
+void LuaProfileReport::clear()
+{
+	m_stacks.clear();
+	m_self.clear();
+	m_inclusive.clear();
+	m_numSamples = 0;
+}
+
+std::string LuaProfileReport::folded() const
+{
+	std::vector<std::pair<std::string, uint64_t>> stacks(m_stacks.begin(), m_stacks.end());
+	std::sort(stacks.begin(), stacks.end());
+
+	std::string ret;
+	for (const auto& stack : stacks)
+	{
+		ret += stack.first;
+		ret += ' ';
+		ret += std::to_string(stack.second);
+		ret += '\n';
+	}
+
+	return ret;
+}
+
+static std::vector<std::pair<std::string, uint64_t>> SortByCount(const std::unordered_map<std::string, uint64_t>& counts)
+{
+	std::vector<std::pair<std::string, uint64_t>> ret(counts.begin(), counts.end());
+	std::sort(ret.begin(), ret.end(), [](const auto& a, const auto& b)
+		{
+			return (a.second != b.second) ? (a.second > b.second) : (a.first < b.first);
+		});
+	return ret;
+}
+
+std::vector<std::pair<std::string, uint64_t>> LuaProfileReport::hottestFunctions() const
+{
+	return SortByCount(m_self);
+}
+
+std::vector<std::pair<std::string, uint64_t>> LuaProfileReport::inclusiveFunctions() const
+{
+	return SortByCount(m_inclusive);
+}
+
+//--
+
+static const char LuaProfilerRegistryKey = 0;
+
+static uint32_t RoundUpToPowerOfTwo(uint32_t value)
+{
+	uint32_t ret = 1;
+	while (ret < value)
+		ret <<= 1;
+	return ret;
+}
+
+LuaProfiler::LuaProfiler(const LuaProfilerSettings& settings)
+	: m_settings(settings)
+{
+	const auto bufferSize = RoundUpToPowerOfTwo(std::max<uint32_t>(2, settings.bufferSize));
+	m_samples.reset(new LuaProfilerSample[bufferSize]);
+	m_sampleMask = bufferSize - 1;
+
+	m_samplePeriod = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / std::max<uint32_t>(1, settings.sampleRate)));
+}
+
+LuaProfiler::~LuaProfiler()
+{
+	detach();
+}
+
+void LuaProfiler::attach(lua_State* L)
+{
+	detach();
+
+	m_state = L;
+	m_nextSampleTime = std::chrono::steady_clock::now() + m_samplePeriod;
+
+	lua_pushlightuserdata(L, this);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &LuaProfilerRegistryKey);
+
+	lua_sethook(L, &Hook, LUA_MASKCOUNT, (int)std::max<uint32_t>(1, m_settings.instructionInterval));
+}
+
+void LuaProfiler::detach()
+{
+	if (m_state)
+	{
+		lua_sethook(m_state, nullptr, 0, 0);
+
+		lua_pushnil(m_state);
+		lua_rawsetp(m_state, LUA_REGISTRYINDEX, &LuaProfilerRegistryKey);
+
+		m_state = nullptr;
+	}
+}
+
+uint32_t LuaProfiler::drain(LuaProfileReport& report)
+{
+	auto readPos = m_readPos.load(std::memory_order_relaxed);
+	const auto writePos = m_writePos.load(std::memory_order_acquire);
+
+	const auto count = (uint32_t)(writePos - readPos);
+	for (; readPos < writePos; ++readPos)
+		report.add(m_samples[readPos & m_sampleMask]);
+
+	m_readPos.store(readPos, std::memory_order_release);
+	return count;
+}
+
+void LuaProfiler::Hook(lua_State* L, lua_Debug* ar)
+{
+	(void)ar;
+
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &LuaProfilerRegistryKey);
+	auto* self = (LuaProfiler*)lua_touserdata(L, -1);
+	lua_pop(L, 1);
+
+	if (!self)
+		return;
+
+	self->m_numHookCalls += 1;
+
+	// count hook fires every N instructions, only a small fraction of them becomes a sample
+	const auto now = std::chrono::steady_clock::now();
+	if (now < self->m_nextSampleTime)
+		return;
+
+	self->m_nextSampleTime = now + self->m_samplePeriod;
+	self->sample(L);
+}
+
+static void FormatFrame(const lua_Debug& ar, bool lineLevel, char* outName)
+{
+	const auto* name = ar.name ? ar.name : "?";
+
+	if (0 == strcmp(ar.what, "C"))
+		snprintf(outName, LUA_PROFILER_FRAME_NAME_LENGTH, "%s [C]", name);
+	else if (0 == strcmp(ar.what, "main"))
+		snprintf(outName, LUA_PROFILER_FRAME_NAME_LENGTH, "main chunk (%s)", ar.short_src);
+	else
+		snprintf(outName, LUA_PROFILER_FRAME_NAME_LENGTH, "%s (%s:%d)", name, ar.short_src, lineLevel ? ar.currentline : ar.linedefined);
+}
+
+void LuaProfiler::sample(lua_State* L)
+{
+	const auto writePos = m_writePos.load(std::memory_order_relaxed);
+	const auto readPos = m_readPos.load(std::memory_order_acquire);
+
+	// never block the script, drop the sample if nobody drains the buffer
+	if (writePos - readPos > m_sampleMask)
+	{
+		m_numDropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	auto& sample = m_samples[writePos & m_sampleMask];
+	sample.depth = 0;
+	sample.truncated = false;
+
+	lua_Debug ar;
+	for (int level = 0; lua_getstack(L, level, &ar); ++level)
+	{
+		if (sample.depth == LUA_PROFILER_MAX_DEPTH)
+		{
+			sample.truncated = true;
+			break;
+		}
+
+		lua_getinfo(L, m_settings.lineLevel ? "Snl" : "Sn", &ar);
+		FormatFrame(ar, m_settings.lineLevel, sample.frames[sample.depth++]);
+	}
+
+	m_writePos.store(writePos + 1, std::memory_order_release);
+	m_numSamples.fetch_add(1, std::memory_order_relaxed);
+}
+
+//--
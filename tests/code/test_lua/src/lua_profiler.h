@@ -0,0 +1,114 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+extern "C" {
+#include <lua/lua.h>
+}
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//--
+
+static const uint32_t LUA_PROFILER_MAX_DEPTH = 24;
+static const uint32_t LUA_PROFILER_FRAME_NAME_LENGTH = 64;
+
+struct LuaProfilerSettings
+{
+	uint32_t sampleRate = 1000; // samples per second
+	uint32_t instructionInterval = 1000; // how often the count hook checks the clock, lower - more precise timing but higher overhead
+	uint32_t bufferSize = 4096; // samples in the ring buffer, rounded up to power of two
+	bool lineLevel = false; // attribute samples to lines instead of functions
+};
+
+// Single captured call stack, frames are copied so the sample stays valid after the functions are collected
+struct LuaProfilerSample
+{
+	uint32_t depth = 0;
+	bool truncated = false; // stack was deeper than LUA_PROFILER_MAX_DEPTH
+	char frames[LUA_PROFILER_MAX_DEPTH][LUA_PROFILER_FRAME_NAME_LENGTH]; // leaf first
+};
+
+// Aggregated samples
+class LuaProfileReport
+{
+public:
+	void add(const LuaProfilerSample& sample);
+	void clear();
+
+	inline uint64_t numSamples() const { return m_numSamples; }
+
+	// Folded stacks ("root;child;leaf count" per line), input for flamegraph.pl and speedscope
+	std::string folded() const;
+
+	// Functions sorted by self samples (time spent in the function itself), most expensive first
+	std::vector<std::pair<std::string, uint64_t>> hottestFunctions() const;
+
+	// Functions sorted by total samples (function or anything it called)
+	std::vector<std::pair<std::string, uint64_t>> inclusiveFunctions() const;
+
+private:
+	std::unordered_map<std::string, uint64_t> m_stacks;
+	std::unordered_map<std::string, uint64_t> m_self;
+	std::unordered_map<std::string, uint64_t> m_inclusive;
+	uint64_t m_numSamples = 0;
+};
+
+// Sampling profiler for a single lua_State (and coroutines created after attaching), built on the count hook
+// Samples are written from the Lua thread into a lock free single producer/single consumer ring buffer,
+// drain() can be called from any one thread
+// NOTE: the profiler is found through the registry so coroutines that inherited the hook stop sampling after detach()
+class LuaProfiler
+{
+public:
+	LuaProfiler(const LuaProfilerSettings& settings = LuaProfilerSettings());
+	~LuaProfiler();
+
+	LuaProfiler(const LuaProfiler&) = delete;
+	LuaProfiler& operator=(const LuaProfiler&) = delete;
+
+	// Start sampling given state, must be called on the thread running the state
+	void attach(lua_State* L);
+
+	// Stop sampling, must be called on the thread running the state and before the state is closed
+	void detach();
+
+	// Move captured samples into the report, returns number of samples moved
+	uint32_t drain(LuaProfileReport& report);
+
+	inline uint64_t numSamples() const { return m_numSamples.load(std::memory_order_relaxed); }
+	inline uint64_t numDropped() const { return m_numDropped.load(std::memory_order_relaxed); }
+	inline uint64_t numHookCalls() const { return m_numHookCalls; }
+
+private:
+	LuaProfilerSettings m_settings;
+	lua_State* m_state = nullptr;
+
+	std::unique_ptr<LuaProfilerSample[]> m_samples;
+	uint32_t m_sampleMask = 0;
+	std::atomic<uint64_t> m_writePos = 0;
+	std::atomic<uint64_t> m_readPos = 0;
+
+	std::atomic<uint64_t> m_numSamples = 0;
+	std::atomic<uint64_t> m_numDropped = 0;
+	uint64_t m_numHookCalls = 0;
+
+	std::chrono::steady_clock::duration m_samplePeriod;
+	std::chrono::steady_clock::time_point m_nextSampleTime;
+
+	static void Hook(lua_State* L, lua_Debug* ar);
+
+	void sample(lua_State* L);
+};
+
+//--
@@ -0,0 +1,220 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "lua_state_pool.h"
+
+#include "../../common/job_system.h"
+
+extern "C" {
+#include <lua/lualib.h>
+#include <lua/lauxlib.h>
+}
+
+//--
+
+void PushLuaValue(lua_State* L, const LuaValue& value)
+{
+	if (const auto* b = std::get_if<bool>(&value))
+		lua_pushboolean(L, *b ? 1 : 0);
+	else if (const auto* i = std::get_if<lua_Integer>(&value))
+		lua_pushinteger(L, *i);
+	else if (const auto* n = std::get_if<lua_Number>(&value))
+		lua_pushnumber(L, *n);
+	else if (const auto* s = std::get_if<std::string>(&value))
+		lua_pushlstring(L, s->c_str(), s->size());
+	else
+		lua_pushnil(L);
+}
+
+bool ReadLuaValue(lua_State* L, int index, LuaValue& outValue)
+{
+	switch (lua_type(L, index))
+	{
+	case LUA_TNIL:
+		outValue = std::monostate();
+		return true;
+
+	case LUA_TBOOLEAN:
+		outValue = lua_toboolean(L, index) != 0;
+		return true;
+
+	case LUA_TNUMBER:
+		if (lua_isinteger(L, index))
+			outValue = lua_tointeger(L, index);
+		else
+			outValue = lua_tonumber(L, index);
+		return true;
+
+	case LUA_TSTRING:
+	{
+		size_t length = 0;
+		const auto* str = lua_tolstring(L, index, &length);
+		outValue = std::string(str, length);
+		return true;
+	}
+	}
+
+	// tables, functions, userdata are bound to the state they were created in
+	return false;
+}
+
+//--
+
+LuaStatePool::LuaStatePool(JobSystem& jobs, const LuaStatePoolSettings& settings)
+	: m_jobs(jobs)
+{
+	// states are created up front on this thread so the workers start with identical, fully initialized states
+	for (uint32_t i = 0; i < jobs.numThreads(); ++i)
+	{
+		auto state = std::make_unique<State>();
+
+		state->L = lua_newstate(&LuaPoolAllocator::Alloc, &state->allocator);
+		if (!state->L)
+		{
+			m_valid = false;
+			break;
+		}
+
+		luaL_openlibs(state->L);
+
+		for (const auto& native : settings.natives)
+			lua_register(state->L, native.first.c_str(), native.second);
+
+		if (settings.initFunc && !settings.initFunc(state->L, i))
+			m_valid = false;
+
+		lua_settop(state->L, 0);
+		m_states.push_back(std::move(state));
+	}
+}
+
+LuaStatePool::~LuaStatePool()
+{
+	for (auto& state : m_states)
+	{
+		if (state->L)
+			lua_close(state->L);
+	}
+
+	m_states.clear();
+}
+
+uint32_t LuaStatePool::run(std::vector<LuaJob>& jobs)
+{
+	if (jobs.empty())
+		return 0;
+
+	// states that failed to initialize can't run anything, every job fails
+	if (!m_valid || m_states.size() != m_jobs.numThreads())
+	{
+		for (auto& job : jobs)
+		{
+			job.results.clear();
+			job.error = "State pool failed to initialize";
+			job.success = false;
+		}
+
+		return (uint32_t)jobs.size();
+	}
+
+	m_numFailed = 0;
+
+	// only the job system workers run the jobs so the worker index owns the state
+	m_jobs.parallelFor((uint32_t)jobs.size(), [this, &jobs](uint32_t jobIndex)
+		{
+			const auto stateIndex = (uint32_t)m_jobs.currentWorker();
+			executeJob(*m_states[stateIndex], stateIndex, jobs[jobIndex]);
+		});
+
+	return m_numFailed;
+}
+
+void LuaStatePool::executeJob(State& state, uint32_t index, LuaJob& job)
+{
+	auto* L = state.L;
+
+	job.results.clear();
+	job.error.clear();
+	job.success = false;
+	job.stateIndex = index;
+
+	state.jobsExecuted += 1;
+
+	lua_settop(L, 0);
+
+	if (LUA_TFUNCTION != lua_getglobal(L, job.function.c_str()))
+	{
+		job.error = "Function '" + job.function + "' not found";
+		lua_settop(L, 0);
+		m_numFailed += 1;
+		return;
+	}
+
+	if (!lua_checkstack(L, (int)job.args.size() + LUA_MINSTACK))
+	{
+		job.error = "Too many arguments";
+		lua_settop(L, 0);
+		m_numFailed += 1;
+		return;
+	}
+
+	for (const auto& arg : job.args)
+		PushLuaValue(L, arg);
+
+	if (LUA_OK != lua_pcall(L, (int)job.args.size(), LUA_MULTRET, 0))
+	{
+		const auto* message = lua_tostring(L, -1);
+		job.error = message ? message : "Unknown error";
+		lua_settop(L, 0);
+		m_numFailed += 1;
+		return;
+	}
+
+	const auto numResults = lua_gettop(L);
+	job.results.resize(numResults);
+
+	job.success = true;
+	for (int i = 0; i < numResults; ++i)
+	{
+		if (!ReadLuaValue(L, i + 1, job.results[i]))
+		{
+			job.error = std::string("Result ") + std::to_string(i + 1) + " has unsupported type " + luaL_typename(L, i + 1);
+			job.results.clear();
+			job.success = false;
+			m_numFailed += 1;
+			break;
+		}
+	}
+
+	lua_settop(L, 0);
+}
+
+//--
+
+void LuaStatePool::forEachState(const std::function<void(lua_State* L, uint32_t stateIndex)>& func)
+{
+	for (uint32_t i = 0; i < m_states.size(); ++i)
+		func(m_states[i]->L, i);
+}
+
+void LuaStatePool::collectGarbage()
+{
+	for (auto& state : m_states)
+		lua_gc(state->L, LUA_GCCOLLECT, 0);
+}
+
+const LuaPoolAllocator::Stats& LuaStatePool::stats(uint32_t stateIndex) const
+{
+	return m_states[stateIndex]->allocator.stats();
+}
+
+uint64_t LuaStatePool::jobsExecuted(uint32_t stateIndex) const
+{
+	return m_states[stateIndex]->jobsExecuted;
+}
+
+//--
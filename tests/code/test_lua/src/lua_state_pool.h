@@ -0,0 +1,107 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include "lua_allocator.h"
+
+extern "C" {
+#include <lua/lua.h>
+}
+
+#include <string>
+#include <vector>
+#include <variant>
+#include <functional>
+#include <atomic>
+#include <memory>
+
+class JobSystem;
+
+//--
+
+// Value passed in and out of jobs, only plain values can cross between states
+typedef std::variant<std::monostate, bool, lua_Integer, lua_Number, std::string> LuaValue;
+
+struct LuaJob
+{
+	std::string function; // global function to call
+	std::vector<LuaValue> args;
+
+	// filled in by the pool
+	std::vector<LuaValue> results;
+	std::string error;
+	bool success = false;
+	uint32_t stateIndex = 0; // state the job ran on
+};
+
+struct LuaStatePoolSettings
+{
+	// natives registered as globals in every state
+	std::vector<std::pair<std::string, lua_CFunction>> natives;
+
+	// called once per state after libraries and natives are registered, usually loads the scripts
+	std::function<bool(lua_State* L, uint32_t stateIndex)> initFunc;
+};
+
+// Pool of identically initialized lua_States, one for each worker of the job system
+// NOTE: jobs are independent, a job can run on any state so scripts should not rely on globals changed by other jobs
+class LuaStatePool
+{
+public:
+	LuaStatePool(JobSystem& jobs, const LuaStatePoolSettings& settings = LuaStatePoolSettings());
+	~LuaStatePool();
+
+	LuaStatePool(const LuaStatePool&) = delete;
+	LuaStatePool& operator=(const LuaStatePool&) = delete;
+
+	// false if any of the states failed to initialize
+	inline bool valid() const { return m_valid; }
+
+	inline uint32_t numStates() const { return (uint32_t)m_states.size(); }
+
+	// Run jobs on the job system workers, blocks until all are done, returns number of failed jobs
+	// NOTE: on an invalid pool nothing runs and all jobs are reported as failed
+	// NOTE: must be called from outside of the job system, the state is picked by the worker index
+	uint32_t run(std::vector<LuaJob>& jobs);
+
+	// Visit each state on the calling thread, only valid outside of run()
+	void forEachState(const std::function<void(lua_State* L, uint32_t stateIndex)>& func);
+
+	// Full GC in every state
+	void collectGarbage();
+
+	// Memory stats of given state
+	const LuaPoolAllocator::Stats& stats(uint32_t stateIndex) const;
+
+	// Total number of jobs that ran on given state
+	uint64_t jobsExecuted(uint32_t stateIndex) const;
+
+private:
+	struct State
+	{
+		LuaPoolAllocator allocator;
+		lua_State* L = nullptr;
+		uint64_t jobsExecuted = 0;
+	};
+
+	JobSystem& m_jobs;
+
+	std::vector<std::unique_ptr<State>> m_states;
+	bool m_valid = true;
+
+	std::atomic<uint32_t> m_numFailed = 0;
+
+	void executeJob(State& state, uint32_t index, LuaJob& job);
+};
+
+//--
+
+// Helpers to move values across the Lua stack
+extern void PushLuaValue(lua_State* L, const LuaValue& value);
+extern bool ReadLuaValue(lua_State* L, int index, LuaValue& outValue);
+
+//--
@@ -0,0 +1,350 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "lua_profiler.h"
+
+extern "C" {
+#include <lua/lualib.h>
+#include <lua/lauxlib.h>
+}
+
+#include <thread>
+
+//--
+
+// hot() does ~10x the work of cold(), both called from update()
+static const char* HOT_LOOP_SCRIPT = R"(
+local function hot(n)
+	local s = 0
+	for i = 1, n * 10 do
+		s = s + math.sin(i) * i
+	end
+	return s
+end
+
+local function cold(n)
+	local s = 0
+	for i = 1, n do
+		s = s + math.sin(i) * i
+	end
+	return s
+end
+
+function update(n)
+	return hot(n) + cold(n)
+end
+
+function run(duration)
+	local total = 0
+	local start = os.clock()
+	while os.clock() - start < duration do
+		total = total + update(1000)
+	end
+	return total
+end
+
+function runCoroutine(duration)
+	local co = coroutine.wrap(function() return run(duration) end)
+	return co()
+end
+)";
+
+class LuaProfilerTest : public testing::Test
+{
+public:
+	lua_State* L = nullptr;
+
+	virtual void SetUp() override
+	{
+		L = luaL_newstate();
+		ASSERT_NE(nullptr, L);
+		luaL_openlibs(L);
+
+		ASSERT_EQ(LUA_OK, luaL_loadstring(L, HOT_LOOP_SCRIPT));
+		ASSERT_EQ(LUA_OK, lua_pcall(L, 0, 0, 0));
+	}
+
+	virtual void TearDown() override
+	{
+		lua_close(L);
+	}
+
+	void run(double duration, const char* func = "run")
+	{
+		lua_getglobal(L, func);
+		lua_pushnumber(L, duration);
+		ASSERT_EQ(LUA_OK, lua_pcall(L, 1, 0, 0));
+	}
+};
+
+static bool StartsWith(const std::string& text, const char* prefix)
+{
+	return 0 == text.compare(0, strlen(prefix), prefix);
+}
+
+//--
+
+TEST_F(LuaProfilerTest, HottestFunctionAttributed)
+{
+	LuaProfilerSettings settings;
+	settings.sampleRate = 5000;
+
+	LuaProfiler profiler(settings);
+	profiler.attach(L);
+	run(0.3);
+	profiler.detach();
+
+	LuaProfileReport report;
+	profiler.drain(report);
+
+	EXPECT_EQ(0, profiler.numDropped());
+	ASSERT_LE(100, report.numSamples());
+
+	// most of the samples land in hot(), the C function math.sin called from it is a separate frame
+	uint64_t hotSamples = 0, coldSamples = 0;
+	for (const auto& func : report.inclusiveFunctions())
+	{
+		if (StartsWith(func.first, "hot ("))
+			hotSamples = func.second;
+		else if (StartsWith(func.first, "cold ("))
+			coldSamples = func.second;
+	}
+
+	EXPECT_LT(coldSamples * 4, hotSamples);
+
+	// among the Lua frames hot() has the most self samples and ranks above cold()
+	const auto hottest = report.hottestFunctions();
+	int hotRank = -1, coldRank = -1, luaRank = 0;
+	for (const auto& func : hottest)
+	{
+		if (std::string::npos != func.first.find(" [C]"))
+			continue;
+
+		if (hotRank < 0 && StartsWith(func.first, "hot ("))
+			hotRank = luaRank;
+		else if (coldRank < 0 && StartsWith(func.first, "cold ("))
+			coldRank = luaRank;
+
+		luaRank += 1;
+	}
+
+	EXPECT_EQ(0, hotRank);
+	EXPECT_TRUE(coldRank < 0 || hotRank < coldRank) << "hot " << hotRank << ", cold " << coldRank;
+
+	// and the stack is complete down to the main entry point
+	const auto inclusive = report.inclusiveFunctions();
+	ASSERT_FALSE(inclusive.empty());
+	EXPECT_TRUE(StartsWith(inclusive[0].first, "run (")) << inclusive[0].first;
+}
+
+TEST_F(LuaProfilerTest, FoldedStacks)
+{
+	LuaProfilerSettings settings;
+	settings.sampleRate = 5000;
+
+	LuaProfiler profiler(settings);
+	profiler.attach(L);
+	run(0.1);
+	profiler.detach();
+
+	LuaProfileReport report;
+	profiler.drain(report);
+
+	const auto folded = report.folded();
+	ASSERT_FALSE(folded.empty());
+
+	// "run (...);update (...);hot (...) 123"
+	uint64_t total = 0;
+	size_t pos = 0;
+	while (pos < folded.size())
+	{
+		const auto end = folded.find('\n', pos);
+		ASSERT_NE(std::string::npos, end);
+
+		const auto line = folded.substr(pos, end - pos);
+		const auto space = line.rfind(' ');
+		ASSERT_NE(std::string::npos, space);
+		EXPECT_TRUE(StartsWith(line, "run (")) << line;
+
+		total += std::stoull(line.substr(space + 1));
+		pos = end + 1;
+	}
+
+	EXPECT_EQ(report.numSamples(), total);
+	EXPECT_NE(std::string::npos, folded.find(";update ("));
+	EXPECT_NE(std::string::npos, folded.find(";hot ("));
+}
+
+TEST_F(LuaProfilerTest, LineLevelSamples)
+{
+	LuaProfilerSettings settings;
+	settings.sampleRate = 5000;
+	settings.lineLevel = true;
+
+	LuaProfiler profiler(settings);
+	profiler.attach(L);
+	run(0.1);
+	profiler.detach();
+
+	LuaProfileReport report;
+	profiler.drain(report);
+
+	// hot() loop body is on line 5 of the chunk
+	bool found = false;
+	for (const auto& func : report.hottestFunctions())
+		found |= StartsWith(func.first, "hot (") && std::string::npos != func.first.find(":5)");
+
+	EXPECT_TRUE(found);
+}
+
+TEST_F(LuaProfilerTest, CoroutinesSampled)
+{
+	LuaProfilerSettings settings;
+	settings.sampleRate = 5000;
+
+	LuaProfiler profiler(settings);
+	profiler.attach(L);
+	run(0.1, "runCoroutine");
+	profiler.detach();
+
+	LuaProfileReport report;
+	profiler.drain(report);
+
+	EXPECT_NE(std::string::npos, report.folded().find(";hot ("));
+}
+
+TEST_F(LuaProfilerTest, FullBufferDropsSamples)
+{
+	LuaProfilerSettings settings;
+	settings.sampleRate = 10000;
+	settings.bufferSize = 16;
+
+	LuaProfiler profiler(settings);
+	profiler.attach(L);
+	run(0.05);
+	profiler.detach();
+
+	EXPECT_LT(0, profiler.numDropped());
+
+	LuaProfileReport report;
+	EXPECT_EQ(16, profiler.drain(report));
+	EXPECT_EQ(16, report.numSamples());
+}
+
+TEST_F(LuaProfilerTest, DrainFromAnotherThread)
+{
+	LuaProfilerSettings settings;
+	settings.sampleRate = 10000;
+	settings.bufferSize = 64;
+
+	LuaProfiler profiler(settings);
+	LuaProfileReport report;
+
+	std::atomic<bool> done = false;
+	std::thread consumer([&]()
+		{
+			while (!done)
+			{
+				profiler.drain(report);
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		});
+
+	profiler.attach(L);
+	run(0.2);
+	profiler.detach();
+
+	done = true;
+	consumer.join();
+	profiler.drain(report);
+
+	EXPECT_EQ(profiler.numSamples(), report.numSamples());
+	EXPECT_LT(0, report.numSamples());
+}
+
+TEST_F(LuaProfilerTest, HookCallsFollowInstructionInterval)
+{
+	// the overhead comes from the count hook, it fires once per instructionInterval instructions of the same work
+	const auto countHookCalls = [this](uint32_t instructionInterval) -> uint64_t
+	{
+		LuaProfilerSettings settings;
+		settings.instructionInterval = instructionInterval;
+
+		LuaProfiler profiler(settings);
+		profiler.attach(L);
+
+		lua_getglobal(L, "update");
+		lua_pushinteger(L, 20000);
+		EXPECT_EQ(LUA_OK, lua_pcall(L, 1, 0, 0));
+
+		profiler.detach();
+		return profiler.numHookCalls();
+	};
+
+	const auto calls100 = countHookCalls(100);
+	const auto calls1000 = countHookCalls(1000);
+	const auto calls10000 = countHookCalls(10000);
+
+	ASSERT_LT(0, calls10000);
+	EXPECT_NEAR((double)calls100, 10.0 * calls1000, 0.01 * calls100);
+	EXPECT_NEAR((double)calls1000, 10.0 * calls10000, 0.01 * calls1000 + 10.0);
+
+	// same work gives the same number of calls
+	EXPECT_EQ(calls1000, countHookCalls(1000));
+}
+
+//--
+
+TEST_F(LuaProfilerTest, DISABLED_OverheadBenchmark)
+{
+	const auto measure = [this](LuaProfiler* profiler) -> double
+	{
+		if (profiler)
+			profiler->attach(L);
+
+		lua_getglobal(L, "update");
+		lua_pushinteger(L, 2000000);
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		EXPECT_EQ(LUA_OK, lua_pcall(L, 1, 0, 0));
+		const auto time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (profiler)
+			profiler->detach();
+
+		return time;
+	};
+
+	measure(nullptr); // warm up
+
+	double baseTime = 1e10;
+	for (uint32_t i = 0; i < 3; ++i)
+		baseTime = std::min(baseTime, measure(nullptr));
+
+	for (const uint32_t instructionInterval : { 100u, 1000u, 10000u })
+	{
+		LuaProfilerSettings settings;
+		settings.sampleRate = 1000;
+		settings.instructionInterval = instructionInterval;
+
+		LuaProfiler profiler(settings);
+
+		double profiledTime = 1e10;
+		for (uint32_t i = 0; i < 3; ++i)
+			profiledTime = std::min(profiledTime, measure(&profiler));
+
+		LuaProfileReport report;
+		profiler.drain(report);
+
+		const auto overhead = profiledTime / baseTime - 1.0;
+		printf("1 kHz, hook every %5u instructions: %.2f ms vs %.2f ms, overhead %.2f%%, %u samples, %u hook calls\n",
+			instructionInterval, profiledTime * 1000.0, baseTime * 1000.0, overhead * 100.0,
+			(uint32_t)report.numSamples(), (uint32_t)profiler.numHookCalls());
+	}
+}
+
+//--
@@ -0,0 +1,337 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "lua_state_pool.h"
+
+#include "../../common/job_system.h"
+
+extern "C" {
+#include <lua/lauxlib.h>
+}
+
+#include <chrono>
+
+//--
+
+static std::atomic<uint32_t> NumNativeCalls = 0;
+
+extern "C" int api_pool_mul(lua_State* lua)
+{
+	lua_settop(lua, 2);
+
+	const auto num = luaL_checkinteger(lua, 1);
+	const auto num2 = luaL_checkinteger(lua, 2);
+
+	lua_pushinteger(lua, num * num2);
+	NumNativeCalls += 1;
+	return 1;
+}
+
+// Stand-in for an AI behaviour script, some math and a bit of garbage per tick
+static const char* BEHAVIOUR_SCRIPT = R"(
+tick_count = 0
+
+function Mul(a, b)
+	return mul(a, b)
+end
+
+function Echo(...)
+	return ...
+end
+
+function Fail(message)
+	error(message)
+end
+
+function ReturnTable()
+	return {}
+end
+
+function CountTick()
+	tick_count = tick_count + 1
+	return tick_count
+end
+
+function Think(id, x, y, targetX, targetY)
+	tick_count = tick_count + 1
+
+	local dx, dy = targetX - x, targetY - y
+	local dist = math.sqrt(dx * dx + dy * dy)
+
+	local memory = { id = id, seen = {} }
+	for i = 1, 16 do
+		memory.seen[i] = { x = x + i, y = y - i }
+	end
+
+	local state = "idle"
+	if dist < 10 then
+		state = "attack"
+	elseif dist < 100 then
+		state = "chase"
+	end
+
+	return state, dist, mul(id, 2)
+end
+)";
+
+static LuaStatePoolSettings MakePoolSettings()
+{
+	LuaStatePoolSettings settings;
+	settings.natives.emplace_back("mul", &api_pool_mul);
+	settings.initFunc = [](lua_State* L, uint32_t stateIndex)
+	{
+		(void)stateIndex;
+		return LUA_OK == luaL_loadstring(L, BEHAVIOUR_SCRIPT) && LUA_OK == lua_pcall(L, 0, 0, 0);
+	};
+	return settings;
+}
+
+static LuaJob MakeThinkJob(lua_Integer id)
+{
+	LuaJob job;
+	job.function = "Think";
+	job.args.push_back(id);
+	job.args.push_back((lua_Number)(id % 100));
+	job.args.push_back((lua_Number)(id % 37));
+	job.args.push_back(50.0);
+	job.args.push_back(20.0);
+	return job;
+}
+
+//--
+
+TEST(LuaStatePool, StatesCreated)
+{
+	JobSystem jobSystem(4);
+	LuaStatePool pool(jobSystem, MakePoolSettings());
+	ASSERT_TRUE(pool.valid());
+	EXPECT_EQ(4, pool.numStates());
+
+	pool.forEachState([](lua_State* L, uint32_t)
+		{
+			EXPECT_EQ(0, lua_gettop(L));
+			EXPECT_EQ(LUA_TFUNCTION, lua_getglobal(L, "mul"));
+			EXPECT_EQ(LUA_TFUNCTION, lua_getglobal(L, "Think"));
+			lua_settop(L, 0);
+		});
+}
+
+TEST(LuaStatePool, InitFailureReported)
+{
+	LuaStatePoolSettings settings;
+	settings.initFunc = [](lua_State* L, uint32_t)
+	{
+		return LUA_OK == luaL_loadstring(L, "this is not lua");
+	};
+
+	JobSystem jobSystem(2);
+	LuaStatePool pool(jobSystem, settings);
+	EXPECT_FALSE(pool.valid());
+}
+
+TEST(LuaStatePool, InvalidPoolFailsAllJobs)
+{
+	LuaStatePoolSettings settings;
+	settings.natives.emplace_back("mul", &api_pool_mul);
+	settings.initFunc = [](lua_State* L, uint32_t stateIndex)
+	{
+		// only the last state is broken
+		return stateIndex == 0 && LUA_OK == luaL_loadstring(L, "function Mul(a, b) return mul(a, b) end") && LUA_OK == lua_pcall(L, 0, 0, 0);
+	};
+
+	JobSystem jobSystem(2);
+	LuaStatePool pool(jobSystem, settings);
+	ASSERT_FALSE(pool.valid());
+
+	std::vector<LuaJob> jobs(4);
+	for (auto& job : jobs)
+	{
+		job.function = "Mul";
+		job.args = { (lua_Integer)2, (lua_Integer)3 };
+		job.success = true;
+	}
+
+	NumNativeCalls = 0;
+	EXPECT_EQ(jobs.size(), pool.run(jobs));
+	EXPECT_EQ(0, NumNativeCalls);
+
+	for (const auto& job : jobs)
+	{
+		EXPECT_FALSE(job.success);
+		EXPECT_FALSE(job.error.empty());
+		EXPECT_TRUE(job.results.empty());
+	}
+
+	// nothing to run is not a failure
+	std::vector<LuaJob> noJobs;
+	EXPECT_EQ(0, pool.run(noJobs));
+}
+
+TEST(LuaStatePool, ResultsMarshalledBack)
+{
+	JobSystem jobSystem(2);
+	LuaStatePool pool(jobSystem, MakePoolSettings());
+
+	std::vector<LuaJob> jobs(2);
+	jobs[0].function = "Mul";
+	jobs[0].args = { (lua_Integer)6, (lua_Integer)7 };
+
+	jobs[1].function = "Echo";
+	jobs[1].args = { LuaValue(), true, (lua_Integer)-5, 2.5, std::string("text\0with zero", 14) };
+
+	NumNativeCalls = 0;
+	ASSERT_EQ(0, pool.run(jobs));
+	EXPECT_EQ(1, NumNativeCalls);
+
+	ASSERT_TRUE(jobs[0].success);
+	ASSERT_EQ(1, jobs[0].results.size());
+	EXPECT_EQ(LuaValue((lua_Integer)42), jobs[0].results[0]);
+
+	ASSERT_TRUE(jobs[1].success);
+	EXPECT_EQ(jobs[1].args, jobs[1].results);
+}
+
+TEST(LuaStatePool, ErrorsReported)
+{
+	JobSystem jobSystem(2);
+	LuaStatePool pool(jobSystem, MakePoolSettings());
+
+	std::vector<LuaJob> jobs(4);
+	jobs[0].function = "Fail";
+	jobs[0].args = { std::string("custom error") };
+	jobs[1].function = "DoesNotExist";
+	jobs[2].function = "ReturnTable";
+	jobs[3].function = "Mul";
+	jobs[3].args = { (lua_Integer)2, (lua_Integer)3 };
+
+	EXPECT_EQ(3, pool.run(jobs));
+
+	EXPECT_FALSE(jobs[0].success);
+	EXPECT_NE(std::string::npos, jobs[0].error.find("custom error"));
+	EXPECT_FALSE(jobs[1].success);
+	EXPECT_NE(std::string::npos, jobs[1].error.find("DoesNotExist"));
+	EXPECT_FALSE(jobs[2].success);
+	EXPECT_TRUE(jobs[2].results.empty());
+
+	// failures don't poison the state
+	EXPECT_TRUE(jobs[3].success);
+
+	pool.forEachState([](lua_State* L, uint32_t)
+		{
+			EXPECT_EQ(0, lua_gettop(L));
+		});
+}
+
+TEST(LuaStatePool, StatesAreIsolated)
+{
+	JobSystem jobSystem(4);
+	LuaStatePool pool(jobSystem, MakePoolSettings());
+
+	std::vector<LuaJob> jobs(1000);
+	for (auto& job : jobs)
+		job.function = "CountTick";
+
+	ASSERT_EQ(0, pool.run(jobs));
+
+	// each state counts only its own jobs
+	uint64_t totalTicks = 0;
+	pool.forEachState([&pool, &totalTicks](lua_State* L, uint32_t stateIndex)
+		{
+			lua_getglobal(L, "tick_count");
+			const auto ticks = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+
+			EXPECT_EQ(pool.jobsExecuted(stateIndex), (uint64_t)ticks);
+			totalTicks += ticks;
+		});
+
+	EXPECT_EQ(jobs.size(), totalTicks);
+
+	for (const auto& job : jobs)
+	{
+		ASSERT_EQ(1, job.results.size());
+		EXPECT_LE(1, std::get<lua_Integer>(job.results[0]));
+	}
+}
+
+TEST(LuaStatePool, StressNoLeaks)
+{
+	JobSystem jobSystem(8);
+	LuaStatePool pool(jobSystem, MakePoolSettings());
+
+	std::vector<LuaJob> jobs;
+	for (uint32_t i = 0; i < 2000; ++i)
+		jobs.push_back(MakeThinkJob(i));
+
+	// warm up so all the internal tables reach their final size
+	ASSERT_EQ(0, pool.run(jobs));
+	pool.collectGarbage();
+
+	std::vector<uint64_t> baseline;
+	for (uint32_t i = 0; i < pool.numStates(); ++i)
+		baseline.push_back(pool.stats(i).bytesInUse);
+
+	for (uint32_t batch = 0; batch < 50; ++batch)
+	{
+		ASSERT_EQ(0, pool.run(jobs));
+
+		for (uint32_t i = 0; i < jobs.size(); ++i)
+		{
+			ASSERT_TRUE(jobs[i].success);
+			ASSERT_EQ(3, jobs[i].results.size());
+			ASSERT_EQ(LuaValue((lua_Integer)(i * 2)), jobs[i].results[2]);
+		}
+	}
+
+	pool.collectGarbage();
+
+	// nothing survives a job except the tick counter, memory goes back to the baseline
+	for (uint32_t i = 0; i < pool.numStates(); ++i)
+	{
+		const auto& stats = pool.stats(i);
+		EXPECT_LE(stats.bytesInUse, baseline[i] + 1024) << "state " << i;
+		EXPECT_LT(0, stats.numAllocs);
+	}
+
+	pool.forEachState([](lua_State* L, uint32_t)
+		{
+			EXPECT_EQ(0, lua_gettop(L));
+		});
+}
+
+//--
+
+TEST(LuaStatePool, DISABLED_ScalingBenchmark)
+{
+	const uint32_t numJobs = 20000;
+	const uint32_t numBatches = 10;
+
+	std::vector<LuaJob> jobs;
+	for (uint32_t i = 0; i < numJobs; ++i)
+		jobs.push_back(MakeThinkJob(i));
+
+	double singleThreadTime = 0.0;
+	for (const uint32_t numThreads : { 1u, 2u, 4u, 8u, 16u, 32u })
+	{
+		JobSystem jobSystem(numThreads);
+		LuaStatePool pool(jobSystem, MakePoolSettings());
+		ASSERT_TRUE(pool.valid());
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < numBatches; ++i)
+			ASSERT_EQ(0, pool.run(jobs));
+		const auto time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (numThreads == 1)
+			singleThreadTime = time;
+
+		printf("%2u threads: %.2f ms per tick, %.0f jobs/s, %.2fx\n",
+			numThreads, time * 1000.0 / numBatches, numJobs * numBatches / time, singleThreadTime / time);
+	}
+}
+
+//--
@@ -0,0 +1,229 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+
+extern "C" {
+#include <lua/lua.h>
+#include <lua/lualib.h>
+#include <lua/lauxlib.h>
+}
+
+#include <chrono>
+
+//--
+
+// Standard interpreter workloads, used to compare builds of the Lua library (flags, LTO, dispatch)
+
+static const char* BINARY_TREES_SCRIPT = R"(
+local depth = ...
+
+local function BottomUpTree(depth)
+	if depth > 0 then
+		depth = depth - 1
+		local left, right = BottomUpTree(depth), BottomUpTree(depth)
+		return { left, right }
+	else
+		return { }
+	end
+end
+
+local function ItemCheck(tree)
+	if tree[1] then
+		return 1 + ItemCheck(tree[1]) + ItemCheck(tree[2])
+	else
+		return 1
+	end
+end
+
+local total = 0
+local maxdepth = math.max(6, depth)
+local longlived = BottomUpTree(maxdepth)
+for d = 4, maxdepth, 2 do
+	local iters = 2 ^ (maxdepth - d + 4)
+	for i = 1, iters do
+		total = total + ItemCheck(BottomUpTree(d))
+	end
+end
+return total + ItemCheck(longlived)
+)";
+
+static const char* NBODY_SCRIPT = R"(
+local steps = ...
+
+local sqrt = math.sqrt
+local PI = math.pi
+local SOLAR_MASS = 4 * PI * PI
+local DAYS_PER_YEAR = 365.24
+
+local bodies = {
+	{ x = 0, y = 0, z = 0, vx = 0, vy = 0, vz = 0, mass = SOLAR_MASS },
+	{ x = 4.84143144246472090e+00, y = -1.16032004402742839e+00, z = -1.03622044471123109e-01,
+	  vx = 1.66007664274403694e-03 * DAYS_PER_YEAR, vy = 7.69901118419740425e-03 * DAYS_PER_YEAR, vz = -6.90460016972063023e-05 * DAYS_PER_YEAR,
+	  mass = 9.54791938424326609e-04 * SOLAR_MASS },
+	{ x = 8.34336671824457987e+00, y = 4.12479856412430479e+00, z = -4.03523417114321381e-01,
+	  vx = -2.76742510726862411e-03 * DAYS_PER_YEAR, vy = 4.99852801234917238e-03 * DAYS_PER_YEAR, vz = 2.30417297573763929e-05 * DAYS_PER_YEAR,
+	  mass = 2.85885980666130812e-04 * SOLAR_MASS },
+	{ x = 1.28943695621391310e+01, y = -1.51111514016986312e+01, z = -2.23307578892655734e-01,
+	  vx = 2.96460137564761618e-03 * DAYS_PER_YEAR, vy = 2.37847173959480950e-03 * DAYS_PER_YEAR, vz = -2.96589568540237556e-05 * DAYS_PER_YEAR,
+	  mass = 4.36624404335156298e-05 * SOLAR_MASS },
+	{ x = 1.53796971148509165e+01, y = -2.59193146099879641e+01, z = 1.79258772950371181e-01,
+	  vx = 2.68067772490389322e-03 * DAYS_PER_YEAR, vy = 1.62824170038242295e-03 * DAYS_PER_YEAR, vz = -9.51592254519715870e-05 * DAYS_PER_YEAR,
+	  mass = 5.15138902046611451e-05 * SOLAR_MASS },
+}
+
+local function advance(bodies, nbody, dt)
+	for i = 1, nbody do
+		local bi = bodies[i]
+		local bix, biy, biz, bimass = bi.x, bi.y, bi.z, bi.mass
+		local bivx, bivy, bivz = bi.vx, bi.vy, bi.vz
+		for j = i + 1, nbody do
+			local bj = bodies[j]
+			local dx, dy, dz = bix - bj.x, biy - bj.y, biz - bj.z
+			local d2 = dx * dx + dy * dy + dz * dz
+			local mag = dt / (d2 * sqrt(d2))
+			local bm = bj.mass * mag
+			bivx = bivx - (dx * bm)
+			bivy = bivy - (dy * bm)
+			bivz = bivz - (dz * bm)
+			bm = bimass * mag
+			bj.vx = bj.vx + (dx * bm)
+			bj.vy = bj.vy + (dy * bm)
+			bj.vz = bj.vz + (dz * bm)
+		end
+		bi.vx = bivx
+		bi.vy = bivy
+		bi.vz = bivz
+		bi.x = bix + dt * bivx
+		bi.y = biy + dt * bivy
+		bi.z = biz + dt * bivz
+	end
+end
+
+local function energy(bodies, nbody)
+	local e = 0
+	for i = 1, nbody do
+		local bi = bodies[i]
+		local vx, vy, vz, bim = bi.vx, bi.vy, bi.vz, bi.mass
+		e = e + (0.5 * bim * (vx * vx + vy * vy + vz * vz))
+		for j = i + 1, nbody do
+			local bj = bodies[j]
+			local dx, dy, dz = bi.x - bj.x, bi.y - bj.y, bi.z - bj.z
+			e = e - ((bim * bj.mass) / sqrt(dx * dx + dy * dy + dz * dz))
+		end
+	end
+	return e
+end
+
+local function offsetMomentum(bodies, nbody)
+	local px, py, pz = 0, 0, 0
+	for i = 1, nbody do
+		local bi = bodies[i]
+		local bim = bi.mass
+		px = px + (bi.vx * bim)
+		py = py + (bi.vy * bim)
+		pz = pz + (bi.vz * bim)
+	end
+	bodies[1].vx = -px / SOLAR_MASS
+	bodies[1].vy = -py / SOLAR_MASS
+	bodies[1].vz = -pz / SOLAR_MASS
+end
+
+local nbody = #bodies
+offsetMomentum(bodies, nbody)
+for i = 1, steps do
+	advance(bodies, nbody, 0.01)
+end
+return energy(bodies, nbody)
+)";
+
+static const char* STRING_OPS_SCRIPT = R"(
+local count = ...
+
+local total = 0
+local parts = {}
+for i = 1, count do
+	local s = string.format("entity_%d:%s", i, i % 3 == 0 and "enemy" or "friend")
+	local name, kind = s:match("^(%w+_%d+):(%w+)$")
+	s = s:upper():gsub("_", "-")
+	parts[#parts + 1] = s:sub(1, 8)
+	if #parts >= 64 then
+		total = total + #table.concat(parts, ";")
+		parts = {}
+	end
+	total = total + #name + #kind + (s:find("ENEMY", 1, true) and 1 or 0)
+end
+return total
+)";
+
+//--
+
+struct LuaWorkload
+{
+	const char* name;
+	const char* code;
+	lua_Integer arg;
+};
+
+static double RunWorkload(const LuaWorkload& workload, lua_Number* outResult)
+{
+	auto* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	EXPECT_EQ(LUA_OK, luaL_loadstring(L, workload.code));
+	lua_pushinteger(L, workload.arg);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	EXPECT_EQ(LUA_OK, lua_pcall(L, 1, 1, 0));
+	const auto time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	*outResult = lua_tonumber(L, -1);
+	lua_close(L);
+	return time;
+}
+
+TEST(LuaVM, WorkloadsProduceExpectedResults)
+{
+	lua_Number result = 0;
+
+	// small sizes with known answers
+	RunWorkload({ "binary-trees", BINARY_TREES_SCRIPT, 6 }, &result);
+	EXPECT_EQ(4143, (lua_Integer)result);
+
+	RunWorkload({ "n-body", NBODY_SCRIPT, 1000 }, &result);
+	EXPECT_NEAR(-0.169087605, result, 1e-8);
+}
+
+TEST(LuaVM, DISABLED_Benchmark)
+{
+	const LuaWorkload workloads[] = {
+		{ "binary-trees", BINARY_TREES_SCRIPT, 16 },
+		{ "n-body", NBODY_SCRIPT, 1000000 },
+		{ "string ops", STRING_OPS_SCRIPT, 500000 },
+	};
+
+	printf("%s\n", LUA_RELEASE);
+
+	double totalTime = 0.0;
+	for (const auto& workload : workloads)
+	{
+		// best of 3 to filter out the noise
+		double bestTime = 0.0;
+		lua_Number result = 0;
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			const auto time = RunWorkload(workload, &result);
+			bestTime = i ? std::min(bestTime, time) : time;
+		}
+
+		printf("%-14s %8.2f ms (result %.9g)\n", workload.name, bestTime * 1000.0, result);
+		totalTime += bestTime;
+	}
+
+	printf("%-14s %8.2f ms\n", "total", totalTime * 1000.0);
+}
+
+//--
@@ -0,0 +1,394 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "mesh_format.h"
+
+#include <meshoptimizer/meshoptimizer.h>
+#include <lz4.h>
+#include <lz4hc.h>
+#include <zstd.h>
+
+//--
+
+static const int ZSTD_COMPRESSION_LEVEL = 19;
+static const uint32_t STAGING_ALIGNMENT = 16;
+
+//--
+
+static bool CompressStream(MeshFileCompression compression, const std::vector<uint8_t>& encoded, std::vector<uint8_t>& outData)
+{
+	switch (compression)
+	{
+		case MeshFileCompression::None:
+		{
+			outData.insert(outData.end(), encoded.begin(), encoded.end());
+			return true;
+		}
+
+		case MeshFileCompression::LZ4:
+		{
+			const auto pos = outData.size();
+			outData.resize(pos + LZ4_compressBound((int)encoded.size()));
+
+			const auto compressedSize = LZ4_compress_HC((const char*)encoded.data(), (char*)outData.data() + pos, (int)encoded.size(), (int)(outData.size() - pos), LZ4HC_CLEVEL_OPT_MIN);
+			if (compressedSize <= 0)
+				return false;
+
+			outData.resize(pos + compressedSize);
+			return true;
+		}
+
+		case MeshFileCompression::Zstd:
+		{
+			const auto pos = outData.size();
+			outData.resize(pos + ZSTD_compressBound(encoded.size()));
+
+			const auto compressedSize = ZSTD_compress(outData.data() + pos, outData.size() - pos, encoded.data(), encoded.size(), ZSTD_COMPRESSION_LEVEL);
+			if (ZSTD_isError(compressedSize))
+				return false;
+
+			outData.resize(pos + compressedSize);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Zstd decompression context, one per thread, released when the thread exits
+struct ZstdDecompressionContext
+{
+	ZSTD_DCtx* context = ZSTD_createDCtx();
+
+	ZstdDecompressionContext() = default;
+	ZstdDecompressionContext(const ZstdDecompressionContext&) = delete;
+	ZstdDecompressionContext& operator=(const ZstdDecompressionContext&) = delete;
+
+	~ZstdDecompressionContext()
+	{
+		ZSTD_freeDCtx(context);
+	}
+};
+
+static bool DecompressStream(MeshFileCompression compression, const uint8_t* data, uint32_t dataSize, uint8_t* outData, uint32_t outSize)
+{
+	switch (compression)
+	{
+		case MeshFileCompression::LZ4:
+		{
+			const auto decompressedSize = LZ4_decompress_safe((const char*)data, (char*)outData, (int)dataSize, (int)outSize);
+			return decompressedSize == (int)outSize;
+		}
+
+		case MeshFileCompression::Zstd:
+		{
+			thread_local ZstdDecompressionContext zstd;
+			if (!zstd.context)
+				return false;
+
+			const auto decompressedSize = ZSTD_decompressDCtx(zstd.context, outData, outSize, data, dataSize);
+			return !ZSTD_isError(decompressedSize) && decompressedSize == outSize;
+		}
+
+		default:
+			break;
+	}
+
+	return false;
+}
+
+template< typename T >
+static bool IndicesInRange(const T* indices, uint32_t indexCount, uint32_t vertexCount)
+{
+	for (uint32_t i = 0; i < indexCount; ++i)
+		if (indices[i] >= vertexCount)
+			return false;
+
+	return true;
+}
+
+//--
+
+bool EncodeMeshFile(const ProcessedMesh& mesh, MeshFileCompression compression, std::vector<uint8_t>& outData)
+{
+	if (mesh.indices.empty() || (mesh.indices.size() % 3) != 0 || mesh.vertexCount == 0)
+		return false;
+
+	struct SourceStream
+	{
+		MeshFileStreamType type;
+		const void* data;
+		uint32_t elementSize;
+	};
+
+	const SourceStream vertexStreams[] = {
+		{ MeshFileStreamType::Positions, mesh.positions.data(), 4 * sizeof(uint16_t) },
+		{ MeshFileStreamType::Normals, mesh.normals.data(), 4 * sizeof(int8_t) },
+		{ MeshFileStreamType::Tangents, mesh.tangents.data(), 4 * sizeof(int8_t) },
+		{ MeshFileStreamType::UVs, mesh.uvs.data(), 2 * sizeof(uint16_t) },
+	};
+
+	const auto numStreams = (uint32_t)(sizeof(vertexStreams) / sizeof(vertexStreams[0])) + 1;
+
+	MeshFileHeader header;
+	header.compression = compression;
+	header.numStreams = (uint8_t)numStreams;
+	header.vertexCount = mesh.vertexCount;
+	header.indexCount = (uint32_t)mesh.indices.size();
+	memcpy(header.boundsMin, mesh.boundsMin, sizeof(header.boundsMin));
+	memcpy(header.boundsMax, mesh.boundsMax, sizeof(header.boundsMax));
+
+	std::vector<MeshFileStream> streams(numStreams);
+
+	outData.clear();
+	outData.resize(sizeof(MeshFileHeader) + numStreams * sizeof(MeshFileStream));
+
+	std::vector<uint8_t> encoded;
+	auto storeStream = [&](MeshFileStream& stream)
+	{
+		stream.encodedSize = (uint32_t)encoded.size();
+		stream.dataOffset = (uint32_t)outData.size();
+
+		if (!CompressStream(compression, encoded, outData))
+			return false;
+
+		stream.storedSize = (uint32_t)(outData.size() - stream.dataOffset);
+		return true;
+	};
+
+	for (uint32_t i = 0; i < numStreams - 1; ++i)
+	{
+		const auto& source = vertexStreams[i];
+
+		encoded.resize(meshopt_encodeVertexBufferBound(mesh.vertexCount, source.elementSize));
+		encoded.resize(meshopt_encodeVertexBuffer(encoded.data(), encoded.size(), source.data, mesh.vertexCount, source.elementSize));
+		if (encoded.empty())
+			return false;
+
+		auto& stream = streams[i];
+		stream.type = source.type;
+		stream.elementSize = (uint16_t)source.elementSize;
+		stream.elementCount = mesh.vertexCount;
+		if (!storeStream(stream))
+			return false;
+	}
+
+	{
+		encoded.resize(meshopt_encodeIndexBufferBound(mesh.indices.size(), mesh.vertexCount));
+		encoded.resize(meshopt_encodeIndexBuffer(encoded.data(), encoded.size(), mesh.indices.data(), mesh.indices.size()));
+		if (encoded.empty())
+			return false;
+
+		auto& stream = streams[numStreams - 1];
+		stream.type = MeshFileStreamType::Indices;
+		stream.elementSize = (mesh.vertexCount <= 65536) ? sizeof(uint16_t) : sizeof(uint32_t);
+		stream.elementCount = (uint32_t)mesh.indices.size();
+		if (!storeStream(stream))
+			return false;
+	}
+
+	memcpy(outData.data(), &header, sizeof(header));
+	memcpy(outData.data() + sizeof(header), streams.data(), numStreams * sizeof(MeshFileStream));
+	return true;
+}
+
+//--
+
+bool ReadMeshFileHeader(const uint8_t* data, size_t dataSize, MeshFileHeader& outHeader, MeshStagingLayout& outLayout)
+{
+	if (!data || dataSize < sizeof(MeshFileHeader))
+		return false;
+
+	memcpy(&outHeader, data, sizeof(MeshFileHeader));
+	if (outHeader.magic != MESH_FILE_MAGIC || outHeader.version != MESH_FILE_VERSION)
+		return false;
+
+	if (outHeader.compression != MeshFileCompression::None && outHeader.compression != MeshFileCompression::LZ4 && outHeader.compression != MeshFileCompression::Zstd)
+		return false;
+
+	if (outHeader.numStreams == 0 || outHeader.numStreams > (int)MeshFileStreamType::MAX)
+		return false;
+
+	if (outHeader.vertexCount == 0 || outHeader.indexCount == 0 || (outHeader.indexCount % 3) != 0)
+		return false;
+
+	const auto streamTableEnd = sizeof(MeshFileHeader) + outHeader.numStreams * sizeof(MeshFileStream);
+	if (dataSize < streamTableEnd)
+		return false;
+
+	outLayout = MeshStagingLayout();
+
+	const auto* streams = (const MeshFileStream*)(data + sizeof(MeshFileHeader));
+	for (uint32_t i = 0; i < outHeader.numStreams; ++i)
+	{
+		const auto& stream = streams[i];
+		if (stream.type >= MeshFileStreamType::MAX)
+			return false;
+
+		// same constraints as the meshoptimizer decoders, they assert on anything else
+		if (stream.type == MeshFileStreamType::Indices)
+		{
+			if (stream.elementSize != sizeof(uint16_t) && stream.elementSize != sizeof(uint32_t))
+				return false;
+
+			if (stream.elementSize == sizeof(uint16_t) && outHeader.vertexCount > 65536)
+				return false;
+		}
+		else
+		{
+			if (stream.elementSize == 0 || (stream.elementSize % 4) != 0 || stream.elementSize > MESH_FILE_MAX_VERTEX_SIZE)
+				return false;
+		}
+
+		if (stream.dataOffset < streamTableEnd || (uint64_t)stream.dataOffset + stream.storedSize > dataSize)
+			return false;
+
+		if (outHeader.compression == MeshFileCompression::None && stream.storedSize != stream.encodedSize)
+			return false;
+
+		const auto expectedCount = (stream.type == MeshFileStreamType::Indices) ? outHeader.indexCount : outHeader.vertexCount;
+		if (stream.elementCount != expectedCount)
+			return false;
+
+		const auto streamIndex = (int)stream.type;
+		if (outLayout.sizes[streamIndex] != 0)
+			return false; // duplicated stream
+
+		// sizes are computed in 64 bits so the counts from the file can't wrap them around
+		const auto streamSize = (uint64_t)stream.elementSize * stream.elementCount;
+		const auto alignedSize = (streamSize + STAGING_ALIGNMENT - 1) & ~(uint64_t)(STAGING_ALIGNMENT - 1);
+		if (outLayout.totalSize + alignedSize > MESH_FILE_MAX_STAGING_SIZE)
+			return false;
+
+		// encoded data is never bigger than the encoder bound, this also limits the decompression buffer
+		const auto maxEncodedSize = (stream.type == MeshFileStreamType::Indices)
+			? meshopt_encodeIndexBufferBound(stream.elementCount, outHeader.vertexCount)
+			: meshopt_encodeVertexBufferBound(stream.elementCount, stream.elementSize);
+		if (stream.encodedSize == 0 || stream.encodedSize > maxEncodedSize)
+			return false;
+
+		outLayout.offsets[streamIndex] = outLayout.totalSize;
+		outLayout.sizes[streamIndex] = (uint32_t)streamSize;
+		outLayout.totalSize += (uint32_t)alignedSize;
+	}
+
+	return true;
+}
+
+bool DecodeMeshFile(const uint8_t* data, size_t dataSize, const MeshStagingLayout& layout, const MeshStagingTarget& target)
+{
+	if (!target.memory || target.size < layout.totalSize)
+		return false;
+
+	MeshFileHeader header;
+	MeshStagingLayout fileLayout;
+	if (!ReadMeshFileHeader(data, dataSize, header, fileLayout))
+		return false;
+
+	if (0 != memcmp(&fileLayout, &layout, sizeof(layout)))
+		return false;
+
+	thread_local std::vector<uint8_t> decompressed;
+
+	const auto* streams = (const MeshFileStream*)(data + sizeof(MeshFileHeader));
+	for (uint32_t i = 0; i < header.numStreams; ++i)
+	{
+		const auto& stream = streams[i];
+
+		const uint8_t* encoded = data + stream.dataOffset;
+		if (header.compression != MeshFileCompression::None)
+		{
+			decompressed.resize(stream.encodedSize);
+			if (!DecompressStream(header.compression, encoded, stream.storedSize, decompressed.data(), stream.encodedSize))
+				return false;
+
+			encoded = decompressed.data();
+		}
+
+		auto* writePtr = target.memory + layout.offsets[(int)stream.type];
+
+		// meshoptimizer decoders pick SSE/NEON code paths on their own
+		if (stream.type == MeshFileStreamType::Indices)
+		{
+			if (0 != meshopt_decodeIndexBuffer(writePtr, stream.elementCount, stream.elementSize, encoded, stream.encodedSize))
+				return false;
+
+			// the decoder accepts any index, a corrupted file must not reach the GPU with out of range indices
+			const auto inRange = (stream.elementSize == sizeof(uint16_t))
+				? IndicesInRange((const uint16_t*)writePtr, stream.elementCount, header.vertexCount)
+				: IndicesInRange((const uint32_t*)writePtr, stream.elementCount, header.vertexCount);
+			if (!inRange)
+				return false;
+		}
+		else
+		{
+			if (0 != meshopt_decodeVertexBuffer(writePtr, stream.elementCount, stream.elementSize, encoded, stream.encodedSize))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool DecodeMeshFile(const uint8_t* data, size_t dataSize, ProcessedMesh& outMesh)
+{
+	MeshFileHeader header;
+	MeshStagingLayout layout;
+	if (!ReadMeshFileHeader(data, dataSize, header, layout))
+		return false;
+
+	// all streams are required by the processed mesh
+	for (const auto size : layout.sizes)
+		if (size == 0)
+			return false;
+
+	std::vector<uint8_t> staging(layout.totalSize);
+
+	MeshStagingTarget target;
+	target.memory = staging.data();
+	target.size = staging.size();
+	if (!DecodeMeshFile(data, dataSize, layout, target))
+		return false;
+
+	outMesh = ProcessedMesh();
+	outMesh.vertexCount = header.vertexCount;
+	memcpy(outMesh.boundsMin, header.boundsMin, sizeof(outMesh.boundsMin));
+	memcpy(outMesh.boundsMax, header.boundsMax, sizeof(outMesh.boundsMax));
+
+	auto copyStream = [&](MeshFileStreamType type, auto& outArray)
+	{
+		const auto index = (int)type;
+		outArray.resize(layout.sizes[index] / sizeof(outArray[0]));
+		memcpy(outArray.data(), staging.data() + layout.offsets[index], layout.sizes[index]);
+	};
+
+	copyStream(MeshFileStreamType::Positions, outMesh.positions);
+	copyStream(MeshFileStreamType::Normals, outMesh.normals);
+	copyStream(MeshFileStreamType::Tangents, outMesh.tangents);
+	copyStream(MeshFileStreamType::UVs, outMesh.uvs);
+
+	{
+		const auto index = (int)MeshFileStreamType::Indices;
+		const auto* indexData = staging.data() + layout.offsets[index];
+
+		outMesh.indices.resize(header.indexCount);
+		if (layout.sizes[index] == header.indexCount * sizeof(uint16_t))
+		{
+			const auto* indices16 = (const uint16_t*)indexData;
+			for (uint32_t i = 0; i < header.indexCount; ++i)
+				outMesh.indices[i] = indices16[i];
+		}
+		else
+		{
+			memcpy(outMesh.indices.data(), indexData, header.indexCount * sizeof(uint32_t));
+		}
+	}
+
+	return true;
+}
+
+//--
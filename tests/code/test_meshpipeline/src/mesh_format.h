@@ -0,0 +1,96 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include "mesh_pipeline.h"
+
+//--
+
+// Compression applied on top of the meshoptimizer encoded streams
+enum class MeshFileCompression : uint8_t
+{
+	None,
+	LZ4,
+	Zstd,
+};
+
+enum class MeshFileStreamType : uint8_t
+{
+	Positions,
+	Normals,
+	Tangents,
+	UVs,
+	Indices,
+
+	MAX,
+};
+
+static const uint32_t MESH_FILE_MAGIC = 0x4D4F4D42; // 'BMOM'
+static const uint16_t MESH_FILE_VERSION = 1;
+
+static const uint32_t MESH_FILE_MAX_VERTEX_SIZE = 256; // meshoptimizer vertex codec limit
+static const uint64_t MESH_FILE_MAX_STAGING_SIZE = 1ULL << 30; // files asking for more are treated as corrupted
+
+#pragma pack(push, 4)
+struct MeshFileHeader
+{
+	uint32_t magic = MESH_FILE_MAGIC;
+	uint16_t version = MESH_FILE_VERSION;
+	MeshFileCompression compression = MeshFileCompression::None;
+	uint8_t numStreams = 0;
+
+	float boundsMin[3] = { 0,0,0 };
+	float boundsMax[3] = { 0,0,0 };
+
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+};
+
+struct MeshFileStream
+{
+	MeshFileStreamType type = MeshFileStreamType::Positions;
+	uint8_t padding = 0;
+	uint16_t elementSize = 0; // size of single vertex or index in the decoded stream
+	uint32_t elementCount = 0;
+	uint32_t encodedSize = 0; // size of the meshoptimizer encoded data
+	uint32_t storedSize = 0; // size of the data in the file (after compression)
+	uint32_t dataOffset = 0; // from the start of the file
+};
+#pragma pack(pop)
+
+//--
+
+// Where each decoded stream lands in the staging memory
+struct MeshStagingLayout
+{
+	uint32_t offsets[(int)MeshFileStreamType::MAX] = {};
+	uint32_t sizes[(int)MeshFileStreamType::MAX] = {};
+	uint32_t totalSize = 0;
+};
+
+// Memory the mesh is decoded into, usually a mapped GPU upload buffer
+struct MeshStagingTarget
+{
+	uint8_t* memory = nullptr;
+	size_t size = 0;
+};
+
+//--
+
+// Encode processed mesh into the compact file format
+extern bool EncodeMeshFile(const ProcessedMesh& mesh, MeshFileCompression compression, std::vector<uint8_t>& outData);
+
+// Validate file and read the header, also computes the staging memory layout required to decode it
+extern bool ReadMeshFileHeader(const uint8_t* data, size_t dataSize, MeshFileHeader& outHeader, MeshStagingLayout& outLayout);
+
+// Decode all streams directly into the staging memory, the memory must be at least layout.totalSize bytes
+extern bool DecodeMeshFile(const uint8_t* data, size_t dataSize, const MeshStagingLayout& layout, const MeshStagingTarget& target);
+
+// Decode file back into the processed mesh, mostly for testing
+extern bool DecodeMeshFile(const uint8_t* data, size_t dataSize, ProcessedMesh& outMesh);
+
+//--
@@ -0,0 +1,427 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "mesh_format.h"
+#include "test_data.h"
+
+#include <ofbx.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+//--
+
+static ProcessedMesh MakeGridMesh(uint32_t size)
+{
+	SourceMesh source;
+	GenerateWavyGridMesh(size, size, source);
+	ShuffleTriangles(source, size);
+
+	ProcessedMesh ret;
+	PipelineTimings timings;
+	EXPECT_TRUE(ProcessMesh(source, ret, timings));
+	return ret;
+}
+
+// Raw arrays, the baseline we compare the format against
+static void WriteRawMesh(const ProcessedMesh& mesh, std::vector<uint8_t>& outData)
+{
+	outData.clear();
+
+	auto append = [&outData](const void* data, size_t size)
+	{
+		const auto pos = outData.size();
+		outData.resize(pos + size);
+		memcpy(outData.data() + pos, data, size);
+	};
+
+	append(&mesh.vertexCount, sizeof(mesh.vertexCount));
+	append(mesh.positions.data(), mesh.positions.size() * sizeof(mesh.positions[0]));
+	append(mesh.normals.data(), mesh.normals.size() * sizeof(mesh.normals[0]));
+	append(mesh.tangents.data(), mesh.tangents.size() * sizeof(mesh.tangents[0]));
+	append(mesh.uvs.data(), mesh.uvs.size() * sizeof(mesh.uvs[0]));
+	append(mesh.indices.data(), mesh.indices.size() * sizeof(mesh.indices[0]));
+}
+
+static const MeshFileCompression ALL_COMPRESSIONS[] = { MeshFileCompression::None, MeshFileCompression::LZ4, MeshFileCompression::Zstd };
+
+static const char* CompressionName(MeshFileCompression compression)
+{
+	switch (compression)
+	{
+		case MeshFileCompression::None: return "meshopt";
+		case MeshFileCompression::LZ4: return "meshopt+lz4";
+		case MeshFileCompression::Zstd: return "meshopt+zstd";
+	}
+
+	return "unknown";
+}
+
+//--
+
+TEST(MeshFormat, RoundTrip)
+{
+	const auto mesh = MakeGridMesh(64);
+
+	for (const auto compression : ALL_COMPRESSIONS)
+	{
+		std::vector<uint8_t> data;
+		ASSERT_TRUE(EncodeMeshFile(mesh, compression, data)) << CompressionName(compression);
+
+		ProcessedMesh decoded;
+		ASSERT_TRUE(DecodeMeshFile(data.data(), data.size(), decoded)) << CompressionName(compression);
+		EXPECT_TRUE(SameMesh(mesh, decoded)) << CompressionName(compression);
+	}
+}
+
+TEST(MeshFormat, RoundTripLargeIndices)
+{
+	const auto mesh = MakeGridMesh(300); // more than 64k vertices
+	ASSERT_LT(65536, mesh.vertexCount);
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(EncodeMeshFile(mesh, MeshFileCompression::LZ4, data));
+
+	ProcessedMesh decoded;
+	ASSERT_TRUE(DecodeMeshFile(data.data(), data.size(), decoded));
+	EXPECT_TRUE(SameMesh(mesh, decoded));
+}
+
+TEST(MeshFormat, RoundTripFile)
+{
+	const auto mesh = MakeGridMesh(32);
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(EncodeMeshFile(mesh, MeshFileCompression::Zstd, data));
+
+	const auto path = std::filesystem::temp_directory_path() / "bme_mesh_format_test.mesh";
+	{
+		std::ofstream file(path, std::ios::binary);
+		ASSERT_TRUE(file.is_open());
+		file.write((const char*)data.data(), data.size());
+	}
+
+	std::vector<uint8_t> loaded;
+	ASSERT_TRUE(LoadFileToBuffer(path, loaded));
+	std::filesystem::remove(path);
+
+	ProcessedMesh decoded;
+	ASSERT_TRUE(DecodeMeshFile(loaded.data(), loaded.size(), decoded));
+	EXPECT_TRUE(SameMesh(mesh, decoded));
+}
+
+TEST(MeshFormat, DecodeIntoStagingMemory)
+{
+	const auto mesh = MakeGridMesh(64);
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(EncodeMeshFile(mesh, MeshFileCompression::LZ4, data));
+
+	MeshFileHeader header;
+	MeshStagingLayout layout;
+	ASSERT_TRUE(ReadMeshFileHeader(data.data(), data.size(), header, layout));
+	EXPECT_EQ(mesh.vertexCount, header.vertexCount);
+	EXPECT_EQ(mesh.indices.size(), header.indexCount);
+
+	// staging buffer is usually bigger than the mesh and shared with other uploads
+	const auto stagingOffset = 256;
+	std::vector<uint8_t> staging(stagingOffset + layout.totalSize + 256, 0xCD);
+
+	MeshStagingTarget target;
+	target.memory = staging.data() + stagingOffset;
+	target.size = layout.totalSize;
+	ASSERT_TRUE(DecodeMeshFile(data.data(), data.size(), layout, target));
+
+	for (uint32_t i = 0; i < (uint32_t)MeshFileStreamType::MAX; ++i)
+		EXPECT_EQ(0, layout.offsets[i] % 16) << i;
+
+	const auto* positions = target.memory + layout.offsets[(int)MeshFileStreamType::Positions];
+	EXPECT_EQ(0, memcmp(positions, mesh.positions.data(), mesh.positions.size() * sizeof(uint16_t)));
+
+	const auto* indices = (const uint16_t*)(target.memory + layout.offsets[(int)MeshFileStreamType::Indices]);
+	for (uint32_t i = 0; i < mesh.indices.size(); ++i)
+		ASSERT_EQ(mesh.indices[i], indices[i]) << i;
+
+	// nothing written outside of the target
+	for (uint32_t i = 0; i < stagingOffset; ++i)
+		ASSERT_EQ(0xCD, staging[i]);
+	for (uint32_t i = stagingOffset + layout.totalSize; i < staging.size(); ++i)
+		ASSERT_EQ(0xCD, staging[i]);
+}
+
+TEST(MeshFormat, StagingTooSmallRejected)
+{
+	const auto mesh = MakeGridMesh(16);
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(EncodeMeshFile(mesh, MeshFileCompression::None, data));
+
+	MeshFileHeader header;
+	MeshStagingLayout layout;
+	ASSERT_TRUE(ReadMeshFileHeader(data.data(), data.size(), header, layout));
+
+	std::vector<uint8_t> staging(layout.totalSize - 1);
+	MeshStagingTarget target;
+	target.memory = staging.data();
+	target.size = staging.size();
+	EXPECT_FALSE(DecodeMeshFile(data.data(), data.size(), layout, target));
+}
+
+TEST(MeshFormat, CorruptedDataRejected)
+{
+	const auto mesh = MakeGridMesh(16);
+
+	for (const auto compression : ALL_COMPRESSIONS)
+	{
+		std::vector<uint8_t> data;
+		ASSERT_TRUE(EncodeMeshFile(mesh, compression, data));
+
+		ProcessedMesh decoded;
+
+		// bad magic
+		{
+			auto copy = data;
+			copy[0] ^= 0xFF;
+			EXPECT_FALSE(DecodeMeshFile(copy.data(), copy.size(), decoded)) << CompressionName(compression);
+		}
+
+		// truncated
+		{
+			EXPECT_FALSE(DecodeMeshFile(data.data(), sizeof(MeshFileHeader) - 1, decoded)) << CompressionName(compression);
+			EXPECT_FALSE(DecodeMeshFile(data.data(), data.size() - 1, decoded)) << CompressionName(compression);
+		}
+	}
+}
+
+// Encode a mesh and overwrite parts of the header or stream table
+template< typename F >
+static std::vector<uint8_t> MakeCorruptedFile(MeshFileCompression compression, const F& corrupt)
+{
+	std::vector<uint8_t> data;
+	EXPECT_TRUE(EncodeMeshFile(MakeGridMesh(16), compression, data));
+
+	MeshFileHeader header;
+	memcpy(&header, data.data(), sizeof(header));
+
+	std::vector<MeshFileStream> streams(header.numStreams);
+	memcpy(streams.data(), data.data() + sizeof(header), streams.size() * sizeof(MeshFileStream));
+
+	corrupt(header, streams);
+
+	memcpy(data.data(), &header, sizeof(header));
+	memcpy(data.data() + sizeof(header), streams.data(), streams.size() * sizeof(MeshFileStream));
+	return data;
+}
+
+static bool IsIndexStream(const MeshFileStream& stream)
+{
+	return stream.type == MeshFileStreamType::Indices;
+}
+
+static void ExpectRejected(const std::vector<uint8_t>& data, const char* what)
+{
+	MeshFileHeader header;
+	MeshStagingLayout layout;
+	EXPECT_FALSE(ReadMeshFileHeader(data.data(), data.size(), header, layout)) << what;
+
+	ProcessedMesh decoded;
+	EXPECT_FALSE(DecodeMeshFile(data.data(), data.size(), decoded)) << what;
+}
+
+TEST(MeshFormat, CorruptedHeaderRejected)
+{
+	for (const auto compression : ALL_COMPRESSIONS)
+	{
+		// vertex stream sizes wrap around in 32 bits (8 * 2^29 == 2^32)
+		ExpectRejected(MakeCorruptedFile(compression, [](MeshFileHeader& header, std::vector<MeshFileStream>& streams)
+			{
+				header.vertexCount = 1U << 29;
+				for (auto& stream : streams)
+					if (!IsIndexStream(stream))
+						stream.elementCount = header.vertexCount;
+			}), "wrapped vertex size");
+
+		// fits in 64 bits but not in the staging limit
+		ExpectRejected(MakeCorruptedFile(compression, [](MeshFileHeader& header, std::vector<MeshFileStream>& streams)
+			{
+				header.indexCount = 0xFFFFFFFF;
+				for (auto& stream : streams)
+					if (IsIndexStream(stream))
+						stream.elementCount = header.indexCount;
+			}), "huge index count");
+
+		ExpectRejected(MakeCorruptedFile(compression, [](MeshFileHeader& header, std::vector<MeshFileStream>& streams)
+			{
+				header.indexCount -= 1;
+				for (auto& stream : streams)
+					if (IsIndexStream(stream))
+						stream.elementCount = header.indexCount;
+			}), "partial triangle");
+
+		for (const uint16_t elementSize : { 1, 3, 8 })
+		{
+			ExpectRejected(MakeCorruptedFile(compression, [elementSize](MeshFileHeader& header, std::vector<MeshFileStream>& streams)
+				{
+					for (auto& stream : streams)
+						if (IsIndexStream(stream))
+							stream.elementSize = elementSize;
+				}), "index element size");
+		}
+
+		for (const uint16_t elementSize : { 0, 2, 6, 260, 0xFFFC })
+		{
+			ExpectRejected(MakeCorruptedFile(compression, [elementSize](MeshFileHeader& header, std::vector<MeshFileStream>& streams)
+				{
+					streams[0].elementSize = elementSize;
+				}), "vertex element size");
+		}
+
+		// would allocate 4GB for the decompressed data
+		ExpectRejected(MakeCorruptedFile(compression, [](MeshFileHeader& header, std::vector<MeshFileStream>& streams)
+			{
+				streams[0].encodedSize = 0xFFFFFFFF;
+			}), "huge encoded size");
+	}
+}
+
+TEST(MeshFormat, IndicesOutOfRangeRejected)
+{
+	// the last vertex is cut off, the index buffer still references it
+	auto mesh = MakeGridMesh(16);
+	mesh.vertexCount -= 1;
+
+	for (const auto compression : ALL_COMPRESSIONS)
+	{
+		std::vector<uint8_t> data;
+		ASSERT_TRUE(EncodeMeshFile(mesh, compression, data)) << CompressionName(compression);
+
+		// the header itself is consistent
+		MeshFileHeader header;
+		MeshStagingLayout layout;
+		ASSERT_TRUE(ReadMeshFileHeader(data.data(), data.size(), header, layout)) << CompressionName(compression);
+
+		std::vector<uint8_t> staging(layout.totalSize);
+		MeshStagingTarget target;
+		target.memory = staging.data();
+		target.size = staging.size();
+		EXPECT_FALSE(DecodeMeshFile(data.data(), data.size(), layout, target)) << CompressionName(compression);
+
+		ProcessedMesh decoded;
+		EXPECT_FALSE(DecodeMeshFile(data.data(), data.size(), decoded)) << CompressionName(compression);
+	}
+}
+
+TEST(MeshFormat, SmallerThanRawArrays)
+{
+	const auto mesh = MakeGridMesh(128);
+
+	std::vector<uint8_t> raw;
+	WriteRawMesh(mesh, raw);
+
+	for (const auto compression : ALL_COMPRESSIONS)
+	{
+		std::vector<uint8_t> data;
+		ASSERT_TRUE(EncodeMeshFile(mesh, compression, data));
+
+		printf("%s: %u bytes (raw %u bytes, %.1f%%)\n", CompressionName(compression), (uint32_t)data.size(), (uint32_t)raw.size(), 100.0 * data.size() / raw.size());
+		EXPECT_LT(data.size(), raw.size()) << CompressionName(compression);
+	}
+}
+
+//--
+
+template< typename F >
+static double MeasureAverage(uint32_t numIterations, const F& func)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t i = 0; i < numIterations; ++i)
+		func();
+
+	return std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / numIterations;
+}
+
+TEST(MeshFormat, DISABLED_LoadBenchmark)
+{
+	const uint32_t NUM_ITERATIONS = 20;
+
+	const auto mesh = MakeGridMesh(512);
+
+	std::vector<uint8_t> raw;
+	WriteRawMesh(mesh, raw);
+
+	std::vector<uint8_t> staging(raw.size() + 1024);
+
+	const auto rawTime = MeasureAverage(NUM_ITERATIONS, [&]()
+		{
+			memcpy(staging.data(), raw.data(), raw.size());
+		});
+
+	printf("%u vertices, %u triangles\n", mesh.vertexCount, mesh.triangleCount());
+	printf("  %-14s %10u bytes %10.1f us\n", "raw", (uint32_t)raw.size(), rawTime);
+
+	for (const auto compression : ALL_COMPRESSIONS)
+	{
+		std::vector<uint8_t> data;
+		ASSERT_TRUE(EncodeMeshFile(mesh, compression, data));
+
+		MeshFileHeader header;
+		MeshStagingLayout layout;
+		ASSERT_TRUE(ReadMeshFileHeader(data.data(), data.size(), header, layout));
+
+		MeshStagingTarget target;
+		target.memory = staging.data();
+		target.size = staging.size();
+		ASSERT_LE(layout.totalSize, target.size);
+
+		bool valid = true;
+		const auto time = MeasureAverage(NUM_ITERATIONS, [&]()
+			{
+				valid &= DecodeMeshFile(data.data(), data.size(), layout, target);
+			});
+
+		EXPECT_TRUE(valid);
+		printf("  %-14s %10u bytes %10.1f us\n", CompressionName(compression), (uint32_t)data.size(), time);
+	}
+}
+
+TEST(MeshFormat, DISABLED_LoadBenchmarkVsFBX)
+{
+	const uint32_t NUM_ITERATIONS = 100;
+
+	std::vector<uint8_t> fbxData;
+	ASSERT_TRUE(LoadFileToBuffer(MakeTestDataPath("cube.fbx"), fbxData));
+
+	ProcessedMesh mesh;
+	const auto fbxTime = MeasureAverage(NUM_ITERATIONS, [&]()
+		{
+			auto* scene = ofbx::load(fbxData.data(), (int)fbxData.size(), 0);
+			ASSERT_TRUE(scene);
+
+			SourceMesh source;
+			PipelineTimings timings;
+			EXPECT_TRUE(ExtractSourceMesh(scene->getGeometry(0), source));
+			EXPECT_TRUE(ProcessMesh(source, mesh, timings));
+
+			scene->destroy();
+		});
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(EncodeMeshFile(mesh, MeshFileCompression::LZ4, data));
+
+	ProcessedMesh decoded;
+	const auto decodeTime = MeasureAverage(NUM_ITERATIONS, [&]()
+		{
+			EXPECT_TRUE(DecodeMeshFile(data.data(), data.size(), decoded));
+		});
+
+	EXPECT_TRUE(SameMesh(mesh, decoded));
+	printf("cube.fbx: re-import %.1f us (%u bytes), meshopt+lz4 %.1f us (%u bytes)\n", fbxTime, (uint32_t)fbxData.size(), decodeTime, (uint32_t)data.size());
+}
+
+//--
@@ -0,0 +1,119 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "mesh_lod.h"
+
+#include <meshoptimizer/meshoptimizer.h>
+
+#include <algorithm>
+
+//--
+
+bool GenerateLodChain(const ProcessedMesh& mesh, const LodSettings& settings, LodChain& outChain)
+{
+	outChain = LodChain();
+
+	if (mesh.indices.empty() || mesh.vertexCount == 0)
+		return false;
+
+	// simplifier works on full precision positions
+	std::vector<float> positions(mesh.vertexCount * 3);
+	for (uint32_t i = 0; i < mesh.vertexCount; ++i)
+		DequantizePosition(mesh, i, &positions[3 * i]);
+
+	outChain.errorScale = meshopt_simplifyScale(positions.data(), mesh.vertexCount, 3 * sizeof(float));
+
+	const auto numLods = std::min(std::max<uint32_t>(1, settings.numLods), MAX_MESH_LODS);
+
+	std::vector<std::vector<uint32_t>> lodIndices;
+	lodIndices.reserve(numLods);
+	lodIndices.push_back(mesh.indices);
+
+	std::vector<LodLevel> levels;
+	levels.emplace_back();
+
+	std::vector<uint32_t> simplified;
+	for (uint32_t lod = 1; lod < numLods; ++lod)
+	{
+		const auto& source = lodIndices.back();
+		const auto& sourceLevel = levels.back();
+
+		const auto targetIndexCount = ((size_t)(source.size() / 3 * settings.triangleRatio)) * 3;
+		if (targetIndexCount / 3 < settings.minTriangles)
+			break;
+
+		// each LOD is simplified from the previous one so the errors add up
+		const auto errorBudget = settings.maxError[lod] - sourceLevel.error;
+		if (errorBudget <= 0.0f)
+			break;
+
+		LodLevel level;
+
+		simplified.resize(source.size());
+		float resultError = 0.0f;
+		simplified.resize(meshopt_simplify(simplified.data(), source.data(), source.size(), positions.data(), mesh.vertexCount, 3 * sizeof(float), targetIndexCount, errorBudget, 0, &resultError));
+
+		// topology or attribute seams can stop the regular simplifier way before the target
+		if (settings.allowSloppy && simplified.size() > targetIndexCount + targetIndexCount / 2)
+		{
+			std::vector<uint32_t> sloppy(source.size());
+			float sloppyError = 0.0f;
+			sloppy.resize(meshopt_simplifySloppy(sloppy.data(), source.data(), source.size(), positions.data(), mesh.vertexCount, 3 * sizeof(float), targetIndexCount, errorBudget, &sloppyError));
+
+			if (!sloppy.empty() && sloppy.size() < simplified.size() && sloppyError <= errorBudget)
+			{
+				simplified = std::move(sloppy);
+				resultError = sloppyError;
+				level.sloppy = true;
+			}
+		}
+
+		// no point in keeping LODs that are not smaller
+		if (simplified.empty() || simplified.size() >= source.size())
+			break;
+
+		meshopt_optimizeVertexCache(simplified.data(), simplified.data(), simplified.size(), mesh.vertexCount);
+
+		level.error = sourceLevel.error + resultError;
+		levels.push_back(level);
+		lodIndices.push_back(simplified);
+	}
+
+	// pack all LODs into single index buffer
+	size_t totalIndices = 0;
+	for (const auto& indices : lodIndices)
+		totalIndices += indices.size();
+
+	outChain.indices.reserve(totalIndices);
+	for (uint32_t i = 0; i < lodIndices.size(); ++i)
+	{
+		levels[i].firstIndex = (uint32_t)outChain.indices.size();
+		levels[i].indexCount = (uint32_t)lodIndices[i].size();
+		outChain.indices.insert(outChain.indices.end(), lodIndices[i].begin(), lodIndices[i].end());
+	}
+
+	outChain.levels = std::move(levels);
+	return true;
+}
+
+uint32_t GenerateLodChains(const std::vector<ProcessedMesh>& meshes, const LodSettings& settings, std::vector<LodChain>& outChains, JobSystem* jobs)
+{
+	outChains.clear();
+	outChains.resize(meshes.size());
+
+	std::atomic<uint32_t> numFailed = 0;
+
+	ParallelFor((uint32_t)meshes.size(), jobs, [&](uint32_t index)
+		{
+			if (!GenerateLodChain(meshes[index], settings, outChains[index]))
+				numFailed += 1;
+		});
+
+	return numFailed;
+}
+
+//--
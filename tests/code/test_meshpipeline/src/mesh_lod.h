@@ -0,0 +1,50 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include "mesh_pipeline.h"
+
+//--
+
+static const uint32_t MAX_MESH_LODS = 6;
+
+struct LodSettings
+{
+	uint32_t numLods = 5; // including LOD0, at most MAX_MESH_LODS
+	float triangleRatio = 0.5f; // target triangle count of each LOD relative to the previous one
+	float maxError[MAX_MESH_LODS] = { 0.0f, 0.002f, 0.005f, 0.01f, 0.02f, 0.05f }; // error bound of each LOD relative to the mesh extents
+	uint32_t minTriangles = 16; // don't generate LODs smaller than this
+	bool allowSloppy = true; // use meshopt_simplifySloppy when regular simplification can't reach the target
+};
+
+struct LodLevel
+{
+	uint32_t firstIndex = 0; // in the shared index buffer
+	uint32_t indexCount = 0;
+	float error = 0.0f; // accumulated error relative to the mesh extents
+	bool sloppy = false;
+
+	inline uint32_t triangleCount() const { return indexCount / 3; }
+};
+
+// All LODs of a mesh, they share the vertex buffer and live in a single index buffer (LOD0 first)
+struct LodChain
+{
+	std::vector<uint32_t> indices;
+	std::vector<LodLevel> levels;
+	float errorScale = 0.0f; // multiply relative error by this to get the world space error
+};
+
+//--
+
+// Build LOD chain for the processed mesh
+extern bool GenerateLodChain(const ProcessedMesh& mesh, const LodSettings& settings, LodChain& outChain);
+
+// Build LOD chains for many meshes in parallel, returns number of meshes that failed
+extern uint32_t GenerateLodChains(const std::vector<ProcessedMesh>& meshes, const LodSettings& settings, std::vector<LodChain>& outChains, JobSystem* jobs = nullptr);
+
+//--
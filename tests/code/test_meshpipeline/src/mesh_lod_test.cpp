@@ -0,0 +1,271 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "mesh_lod.h"
+#include "test_data.h"
+
+#include <ofbx.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+
+//--
+
+static ProcessedMesh MakeGridMesh(uint32_t size, bool flat = false)
+{
+	SourceMesh source;
+	GenerateWavyGridMesh(size, size, source);
+
+	if (flat)
+	{
+		for (uint32_t i = 0; i < source.cornerCount(); ++i)
+		{
+			source.positions[3 * i + 2] = 0.0f;
+			source.normals[3 * i + 0] = 0.0f;
+			source.normals[3 * i + 1] = 0.0f;
+			source.normals[3 * i + 2] = 1.0f;
+		}
+	}
+
+	ProcessedMesh ret;
+	PipelineTimings timings;
+	EXPECT_TRUE(ProcessMesh(source, ret, timings));
+	return ret;
+}
+
+static void ExpectValidChain(const ProcessedMesh& mesh, const LodSettings& settings, const LodChain& chain)
+{
+	ASSERT_FALSE(chain.levels.empty());
+	ASSERT_LE(chain.levels.size(), settings.numLods);
+
+	// LOD0 is the original mesh
+	EXPECT_EQ(0, chain.levels[0].firstIndex);
+	EXPECT_EQ(mesh.indices.size(), chain.levels[0].indexCount);
+	EXPECT_EQ(0.0f, chain.levels[0].error);
+	EXPECT_TRUE(std::equal(mesh.indices.begin(), mesh.indices.end(), chain.indices.begin()));
+
+	uint32_t expectedFirstIndex = 0;
+	for (uint32_t i = 0; i < chain.levels.size(); ++i)
+	{
+		const auto& level = chain.levels[i];
+
+		// packed one after another
+		EXPECT_EQ(expectedFirstIndex, level.firstIndex) << i;
+		EXPECT_EQ(0, level.indexCount % 3) << i;
+		expectedFirstIndex += level.indexCount;
+
+		// within the error bound
+		EXPECT_LE(level.error, settings.maxError[i] + 1e-6f) << i;
+
+		if (i > 0)
+		{
+			const auto& prev = chain.levels[i - 1];
+			EXPECT_LT(level.triangleCount(), prev.triangleCount()) << i;
+			EXPECT_GE(level.error, prev.error) << i;
+			EXPECT_LE(settings.minTriangles, (uint32_t)(prev.triangleCount() * settings.triangleRatio)) << i;
+		}
+	}
+
+	EXPECT_EQ(expectedFirstIndex, chain.indices.size());
+
+	for (const auto index : chain.indices)
+		ASSERT_LT(index, mesh.vertexCount);
+}
+
+//--
+
+TEST(MeshLod, WavyGridChain)
+{
+	const auto mesh = MakeGridMesh(128);
+
+	LodSettings settings;
+	LodChain chain;
+	ASSERT_TRUE(GenerateLodChain(mesh, settings, chain));
+	ExpectValidChain(mesh, settings, chain);
+
+	EXPECT_LE(4, chain.levels.size());
+
+	for (uint32_t i = 0; i < chain.levels.size(); ++i)
+		printf("LOD%u: %u triangles, error %.5f (%.5f world)%s\n", i, chain.levels[i].triangleCount(), chain.levels[i].error, chain.levels[i].error * chain.errorScale, chain.levels[i].sloppy ? " sloppy" : "");
+}
+
+TEST(MeshLod, TriangleCountTargets)
+{
+	const auto mesh = MakeGridMesh(128, true);
+
+	// flat mesh has no error to stop the simplification, every level should hit the target
+	LodSettings settings;
+	settings.numLods = MAX_MESH_LODS;
+
+	LodChain chain;
+	ASSERT_TRUE(GenerateLodChain(mesh, settings, chain));
+	ExpectValidChain(mesh, settings, chain);
+
+	ASSERT_EQ(MAX_MESH_LODS, chain.levels.size());
+	for (uint32_t i = 1; i < chain.levels.size(); ++i)
+	{
+		const auto target = (uint32_t)(chain.levels[i - 1].triangleCount() * settings.triangleRatio);
+		EXPECT_LE(chain.levels[i].triangleCount(), target) << i;
+		EXPECT_NEAR(0.0f, chain.levels[i].error, 0.0001f) << i;
+	}
+}
+
+TEST(MeshLod, ErrorBoundLimitsReduction)
+{
+	const auto mesh = MakeGridMesh(128);
+
+	// tiny error budget on a curved surface, only vertices in the nearly flat areas can go
+	const float errorBudget = 1e-5f;
+
+	LodSettings settings;
+	settings.allowSloppy = false;
+	for (uint32_t i = 1; i < MAX_MESH_LODS; ++i)
+		settings.maxError[i] = errorBudget;
+
+	LodChain chain;
+	ASSERT_TRUE(GenerateLodChain(mesh, settings, chain));
+	ExpectValidChain(mesh, settings, chain);
+
+	// the simplifier removed something but stopped way before the triangle target
+	ASSERT_LE(2, chain.levels.size());
+	const auto target = (uint32_t)(chain.levels[0].triangleCount() * settings.triangleRatio);
+	EXPECT_GT(chain.levels[1].triangleCount(), target);
+
+	for (uint32_t i = 1; i < chain.levels.size(); ++i)
+	{
+		EXPECT_FALSE(chain.levels[i].sloppy) << i;
+		EXPECT_LE(chain.levels[i].error, errorBudget) << i;
+	}
+}
+
+TEST(MeshLod, ZeroErrorBudgetKeepsOriginal)
+{
+	const auto mesh = MakeGridMesh(128);
+
+	// no error allowed at all, the simplifier is not even called
+	LodSettings settings;
+	for (auto& error : settings.maxError)
+		error = 0.0f;
+
+	LodChain chain;
+	ASSERT_TRUE(GenerateLodChain(mesh, settings, chain));
+	ExpectValidChain(mesh, settings, chain);
+	EXPECT_EQ(1, chain.levels.size());
+}
+
+TEST(MeshLod, TooSmallMeshHasNoLods)
+{
+	const auto mesh = MakeGridMesh(2);
+
+	LodSettings settings;
+	LodChain chain;
+	ASSERT_TRUE(GenerateLodChain(mesh, settings, chain));
+	EXPECT_EQ(1, chain.levels.size());
+	EXPECT_EQ(mesh.indices, chain.indices);
+}
+
+TEST(MeshLod, ParallelMatchesSerial)
+{
+	std::vector<ProcessedMesh> meshes;
+	for (uint32_t i = 0; i < 12; ++i)
+		meshes.push_back(MakeGridMesh(32 + 8 * i, (i & 1) != 0));
+
+	LodSettings settings;
+
+	std::vector<LodChain> serial, parallel;
+	ASSERT_EQ(0, GenerateLodChains(meshes, settings, serial));
+	ASSERT_EQ(0, GenerateLodChains(meshes, settings, parallel, &TestJobSystem()));
+
+	ASSERT_EQ(serial.size(), parallel.size());
+	for (uint32_t i = 0; i < serial.size(); ++i)
+	{
+		EXPECT_EQ(serial[i].indices, parallel[i].indices) << i;
+		ASSERT_EQ(serial[i].levels.size(), parallel[i].levels.size()) << i;
+	}
+}
+
+//--
+
+// Folder with FBX files to run the benchmark on, defaults to the test data folder
+static std::filesystem::path BenchmarkFolder()
+{
+	if (const auto* path = std::getenv("BM_MESH_BENCHMARK_PATH"))
+		return path;
+
+	return TestRootPath();
+}
+
+TEST(MeshLod, DISABLED_ThroughputBenchmark)
+{
+	std::vector<SourceMesh> sourceMeshes;
+
+	PipelineTimings importTimings;
+	uint32_t numFiles = 0;
+	for (const auto& entry : std::filesystem::recursive_directory_iterator(BenchmarkFolder()))
+	{
+		if (!entry.is_regular_file() || entry.path().extension() != ".fbx")
+			continue;
+
+		std::vector<uint8_t> data;
+		if (!LoadFileToBuffer(entry.path(), data))
+			continue;
+
+		auto* scene = ofbx::load(data.data(), (int)data.size(), 0);
+		if (!scene)
+			continue;
+
+		std::vector<SourceMesh> meshes;
+		ExtractSceneMeshes(scene, meshes, importTimings);
+		scene->destroy();
+
+		numFiles += 1;
+		for (auto& mesh : meshes)
+			sourceMeshes.push_back(std::move(mesh));
+	}
+
+	ASSERT_LE(1, numFiles);
+
+	// test data has only tiny meshes, add some of decent size
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		SourceMesh mesh;
+		GenerateWavyGridMesh(64 + 16 * i, 64 + 16 * i, mesh);
+		ShuffleTriangles(mesh, i);
+		sourceMeshes.push_back(std::move(mesh));
+	}
+
+	std::vector<ProcessedMesh> meshes;
+	PipelineTimings timings;
+	ASSERT_EQ(0, ProcessMeshes(sourceMeshes, meshes, timings, &TestJobSystem()));
+
+	uint64_t numTriangles = 0;
+	for (const auto& mesh : meshes)
+		numTriangles += mesh.triangleCount();
+
+	LodSettings settings;
+
+	for (auto* jobs : { (JobSystem*)nullptr, &TestJobSystem() })
+	{
+		std::vector<LodChain> chains;
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		ASSERT_EQ(0, GenerateLodChains(meshes, settings, chains, jobs));
+		const auto time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		uint64_t numLods = 0;
+		for (const auto& chain : chains)
+			numLods += chain.levels.size();
+
+		printf("%u FBX files, %u meshes, %u LODs, %s: %.2f ms, %.1f meshes/s, %.2f Mtris/s\n",
+			numFiles, (uint32_t)meshes.size(), (uint32_t)numLods, jobs ? "parallel" : "serial",
+			time * 1000.0, meshes.size() / time, numTriangles / time / 1000000.0);
+	}
+}
+
+//--
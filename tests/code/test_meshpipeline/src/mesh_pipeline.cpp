@@ -0,0 +1,465 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "mesh_pipeline.h"
+
+#include "../../common/job_system.h"
+
+#include <ofbx.h>
+#include <mikkt/mikktspace.h>
+#include <meshoptimizer/meshoptimizer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+//--
+
+const char* PipelineStageName(PipelineStage stage)
+{
+	switch (stage)
+	{
+		case PipelineStage::Extract: return "Extract";
+		case PipelineStage::Tangents: return "Tangents";
+		case PipelineStage::Weld: return "Weld";
+		case PipelineStage::VertexCache: return "VertexCache";
+		case PipelineStage::Overdraw: return "Overdraw";
+		case PipelineStage::VertexFetch: return "VertexFetch";
+		case PipelineStage::Quantize: return "Quantize";
+		default: break;
+	}
+
+	return "Unknown";
+}
+
+double PipelineTimings::total() const
+{
+	double ret = 0.0;
+	for (const auto time : stages)
+		ret += time;
+	return ret;
+}
+
+void PipelineTimings::accumulate(const PipelineTimings& other)
+{
+	for (int i = 0; i < (int)PipelineStage::MAX; ++i)
+		stages[i] += other.stages[i];
+}
+
+void PipelineTimings::print(const char* title) const
+{
+	printf("%s: %.3f ms total\n", title, total());
+
+	for (int i = 0; i < (int)PipelineStage::MAX; ++i)
+		printf("  %-12s %10.3f ms\n", PipelineStageName((PipelineStage)i), stages[i]);
+}
+
+//--
+
+struct ScopedStageTimer
+{
+	ScopedStageTimer(PipelineTimings& timings, PipelineStage stage)
+		: m_timings(timings)
+		, m_stage(stage)
+		, m_start(std::chrono::high_resolution_clock::now())
+	{}
+
+	~ScopedStageTimer()
+	{
+		m_timings[m_stage] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_start).count();
+	}
+
+private:
+	PipelineTimings& m_timings;
+	PipelineStage m_stage;
+	std::chrono::high_resolution_clock::time_point m_start;
+};
+
+//--
+
+void ParallelFor(uint32_t count, JobSystem* jobs, const std::function<void(uint32_t)>& func)
+{
+	if (!jobs || count <= 1)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+			func(i);
+		return;
+	}
+
+	jobs->parallelFor(count, func);
+}
+
+//--
+
+static void GenerateFlatNormals(SourceMesh& mesh)
+{
+	const auto triangleCount = mesh.triangleCount();
+	mesh.normals.resize(mesh.positions.size());
+
+	for (uint32_t i = 0; i < triangleCount; ++i)
+	{
+		const auto* a = &mesh.positions[9 * i + 0];
+		const auto* b = &mesh.positions[9 * i + 3];
+		const auto* c = &mesh.positions[9 * i + 6];
+
+		const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		const float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+		float n[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+
+		const auto len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len > 0.0f)
+		{
+			n[0] /= len;
+			n[1] /= len;
+			n[2] /= len;
+		}
+
+		for (uint32_t j = 0; j < 3; ++j)
+		{
+			mesh.normals[9 * i + 3 * j + 0] = n[0];
+			mesh.normals[9 * i + 3 * j + 1] = n[1];
+			mesh.normals[9 * i + 3 * j + 2] = n[2];
+		}
+	}
+}
+
+bool ExtractSourceMesh(const ofbx::Geometry* geometry, SourceMesh& outMesh)
+{
+	if (!geometry)
+		return false;
+
+	const auto* vertices = geometry->getVertices();
+	const auto vertexCount = geometry->getVertexCount();
+	const auto* faceIndices = geometry->getFaceIndices();
+	const auto indexCount = geometry->getIndexCount();
+	if (!vertices || !faceIndices || indexCount < 3)
+		return false;
+
+	// NOTE: normals and UVs are splatted by OpenFBX to be per polygon corner, same as the face indices
+	const auto* normals = geometry->getNormals();
+	const auto* uvs = geometry->getUVs(0);
+
+	outMesh = SourceMesh();
+	outMesh.positions.reserve(indexCount * 3);
+	outMesh.normals.reserve(normals ? indexCount * 3 : 0);
+	outMesh.uvs.reserve(indexCount * 2);
+
+	bool valid = true;
+	auto emitCorner = [&](int corner)
+	{
+		auto index = faceIndices[corner];
+		if (index < 0)
+			index = -index - 1; // last index of the polygon is encoded as negative
+
+		if (index >= vertexCount)
+		{
+			valid = false;
+			index = 0;
+		}
+
+		const auto& pos = vertices[index];
+		outMesh.positions.push_back((float)pos.x);
+		outMesh.positions.push_back((float)pos.y);
+		outMesh.positions.push_back((float)pos.z);
+
+		if (normals)
+		{
+			const auto& n = normals[corner];
+			outMesh.normals.push_back((float)n.x);
+			outMesh.normals.push_back((float)n.y);
+			outMesh.normals.push_back((float)n.z);
+		}
+
+		if (uvs)
+		{
+			const auto& uv = uvs[corner];
+			outMesh.uvs.push_back((float)uv.x);
+			outMesh.uvs.push_back((float)uv.y);
+		}
+		else
+		{
+			outMesh.uvs.push_back(0.0f);
+			outMesh.uvs.push_back(0.0f);
+		}
+	};
+
+	// triangulate polygons as fans
+	int polygonStart = 0;
+	for (int i = 0; i < indexCount; ++i)
+	{
+		if (faceIndices[i] < 0)
+		{
+			for (int j = polygonStart + 1; j < i; ++j)
+			{
+				emitCorner(polygonStart);
+				emitCorner(j);
+				emitCorner(j + 1);
+			}
+
+			polygonStart = i + 1;
+		}
+	}
+
+	if (!normals)
+		GenerateFlatNormals(outMesh);
+
+	return valid && !outMesh.positions.empty();
+}
+
+void ExtractSceneMeshes(const ofbx::IScene* scene, std::vector<SourceMesh>& outMeshes, PipelineTimings& outTimings)
+{
+	ScopedStageTimer timer(outTimings, PipelineStage::Extract);
+
+	outMeshes.clear();
+
+	if (scene)
+	{
+		const auto geometryCount = scene->getGeometryCount();
+		outMeshes.reserve(geometryCount);
+
+		for (int i = 0; i < geometryCount; ++i)
+		{
+			SourceMesh mesh;
+			if (ExtractSourceMesh(scene->getGeometry(i), mesh))
+				outMeshes.push_back(std::move(mesh));
+		}
+	}
+}
+
+//--
+
+namespace mikkt
+{
+	static const SourceMesh& Mesh(const SMikkTSpaceContext* context)
+	{
+		return *(const SourceMesh*)context->m_pUserData;
+	}
+
+	static int GetNumFaces(const SMikkTSpaceContext* context)
+	{
+		return (int)Mesh(context).triangleCount();
+	}
+
+	static int GetNumVerticesOfFace(const SMikkTSpaceContext* context, const int face)
+	{
+		return 3;
+	}
+
+	static void GetPosition(const SMikkTSpaceContext* context, float* outPos, const int face, const int vert)
+	{
+		const auto* pos = &Mesh(context).positions[3 * (3 * face + vert)];
+		outPos[0] = pos[0];
+		outPos[1] = pos[1];
+		outPos[2] = pos[2];
+	}
+
+	static void GetNormal(const SMikkTSpaceContext* context, float* outNormal, const int face, const int vert)
+	{
+		const auto* n = &Mesh(context).normals[3 * (3 * face + vert)];
+		outNormal[0] = n[0];
+		outNormal[1] = n[1];
+		outNormal[2] = n[2];
+	}
+
+	static void GetTexCoord(const SMikkTSpaceContext* context, float* outUV, const int face, const int vert)
+	{
+		const auto* uv = &Mesh(context).uvs[2 * (3 * face + vert)];
+		outUV[0] = uv[0];
+		outUV[1] = uv[1];
+	}
+
+	static void SetTSpaceBasic(const SMikkTSpaceContext* context, const float* tangent, const float sign, const int face, const int vert)
+	{
+		auto& mesh = *(SourceMesh*)context->m_pUserData;
+		auto* t = &mesh.tangents[4 * (3 * face + vert)];
+		t[0] = tangent[0];
+		t[1] = tangent[1];
+		t[2] = tangent[2];
+		t[3] = sign;
+	}
+}
+
+bool GenerateTangents(SourceMesh& mesh)
+{
+	if (mesh.normals.size() != mesh.positions.size() || mesh.uvs.size() != (mesh.cornerCount() * 2))
+		return false;
+
+	mesh.tangents.resize(mesh.cornerCount() * 4);
+
+	SMikkTSpaceInterface callbacks;
+	memset(&callbacks, 0, sizeof(callbacks));
+	callbacks.m_getNumFaces = &mikkt::GetNumFaces;
+	callbacks.m_getNumVerticesOfFace = &mikkt::GetNumVerticesOfFace;
+	callbacks.m_getPosition = &mikkt::GetPosition;
+	callbacks.m_getNormal = &mikkt::GetNormal;
+	callbacks.m_getTexCoord = &mikkt::GetTexCoord;
+	callbacks.m_setTSpaceBasic = &mikkt::SetTSpaceBasic;
+
+	SMikkTSpaceContext context;
+	context.m_pInterface = &callbacks;
+	context.m_pUserData = &mesh;
+
+	return genTangSpaceDefault(&context) != 0;
+}
+
+//--
+
+static void QuantizeMesh(const std::vector<PipelineVertex>& vertices, ProcessedMesh& outMesh)
+{
+	for (int j = 0; j < 3; ++j)
+	{
+		outMesh.boundsMin[j] = vertices.empty() ? 0.0f : vertices[0].position[j];
+		outMesh.boundsMax[j] = outMesh.boundsMin[j];
+	}
+
+	for (const auto& v : vertices)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			outMesh.boundsMin[j] = std::min(outMesh.boundsMin[j], v.position[j]);
+			outMesh.boundsMax[j] = std::max(outMesh.boundsMax[j], v.position[j]);
+		}
+	}
+
+	float invExtent[3];
+	for (int j = 0; j < 3; ++j)
+	{
+		const auto extent = outMesh.boundsMax[j] - outMesh.boundsMin[j];
+		invExtent[j] = (extent > 0.0f) ? (1.0f / extent) : 0.0f;
+	}
+
+	const auto count = vertices.size();
+	outMesh.vertexCount = (uint32_t)count;
+	outMesh.positions.resize(count * 4);
+	outMesh.normals.resize(count * 4);
+	outMesh.tangents.resize(count * 4);
+	outMesh.uvs.resize(count * 2);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const auto& v = vertices[i];
+
+		for (int j = 0; j < 3; ++j)
+		{
+			outMesh.positions[4 * i + j] = (uint16_t)meshopt_quantizeUnorm((v.position[j] - outMesh.boundsMin[j]) * invExtent[j], 16);
+			outMesh.normals[4 * i + j] = (int8_t)meshopt_quantizeSnorm(v.normal[j], 8);
+			outMesh.tangents[4 * i + j] = (int8_t)meshopt_quantizeSnorm(v.tangent[j], 8);
+		}
+
+		outMesh.positions[4 * i + 3] = 0;
+		outMesh.normals[4 * i + 3] = 0;
+		outMesh.tangents[4 * i + 3] = (v.tangent[3] < 0.0f) ? -127 : 127;
+
+		outMesh.uvs[2 * i + 0] = meshopt_quantizeHalf(v.uv[0]);
+		outMesh.uvs[2 * i + 1] = meshopt_quantizeHalf(v.uv[1]);
+	}
+}
+
+bool OptimizeMesh(const SourceMesh& mesh, ProcessedMesh& outMesh, PipelineTimings& outTimings)
+{
+	const auto cornerCount = mesh.cornerCount();
+	if (cornerCount == 0 || mesh.tangents.size() != cornerCount * 4)
+		return false;
+
+	std::vector<PipelineVertex> vertices;
+	std::vector<uint32_t> indices;
+
+	{
+		ScopedStageTimer timer(outTimings, PipelineStage::Weld);
+
+		std::vector<PipelineVertex> corners(cornerCount);
+		for (uint32_t i = 0; i < cornerCount; ++i)
+		{
+			auto& v = corners[i];
+			memcpy(v.position, &mesh.positions[3 * i], sizeof(v.position));
+			memcpy(v.normal, &mesh.normals[3 * i], sizeof(v.normal));
+			memcpy(v.uv, &mesh.uvs[2 * i], sizeof(v.uv));
+			memcpy(v.tangent, &mesh.tangents[4 * i], sizeof(v.tangent));
+		}
+
+		std::vector<uint32_t> remap(cornerCount);
+		const auto vertexCount = meshopt_generateVertexRemap(remap.data(), nullptr, cornerCount, corners.data(), cornerCount, sizeof(PipelineVertex));
+
+		vertices.resize(vertexCount);
+		meshopt_remapVertexBuffer(vertices.data(), corners.data(), cornerCount, sizeof(PipelineVertex), remap.data());
+
+		indices.resize(cornerCount);
+		meshopt_remapIndexBuffer(indices.data(), nullptr, cornerCount, remap.data());
+	}
+
+	{
+		ScopedStageTimer timer(outTimings, PipelineStage::VertexCache);
+		meshopt_optimizeVertexCache(indices.data(), indices.data(), indices.size(), vertices.size());
+	}
+
+	{
+		ScopedStageTimer timer(outTimings, PipelineStage::Overdraw);
+		meshopt_optimizeOverdraw(indices.data(), indices.data(), indices.size(), &vertices[0].position[0], vertices.size(), sizeof(PipelineVertex), 1.05f);
+	}
+
+	{
+		ScopedStageTimer timer(outTimings, PipelineStage::VertexFetch);
+
+		std::vector<PipelineVertex> fetchOrdered(vertices.size());
+		const auto usedCount = meshopt_optimizeVertexFetch(fetchOrdered.data(), indices.data(), indices.size(), vertices.data(), vertices.size(), sizeof(PipelineVertex));
+		fetchOrdered.resize(usedCount);
+		vertices = std::move(fetchOrdered);
+	}
+
+	{
+		ScopedStageTimer timer(outTimings, PipelineStage::Quantize);
+		QuantizeMesh(vertices, outMesh);
+		outMesh.indices = std::move(indices);
+	}
+
+	return true;
+}
+
+bool ProcessMesh(SourceMesh& mesh, ProcessedMesh& outMesh, PipelineTimings& outTimings)
+{
+	{
+		ScopedStageTimer timer(outTimings, PipelineStage::Tangents);
+		if (!GenerateTangents(mesh))
+			return false;
+	}
+
+	return OptimizeMesh(mesh, outMesh, outTimings);
+}
+
+uint32_t ProcessMeshes(std::vector<SourceMesh>& meshes, std::vector<ProcessedMesh>& outMeshes, PipelineTimings& outTimings, JobSystem* jobs)
+{
+	outMeshes.clear();
+	outMeshes.resize(meshes.size());
+
+	std::vector<PipelineTimings> meshTimings(meshes.size());
+	std::atomic<uint32_t> numFailed = 0;
+
+	ParallelFor((uint32_t)meshes.size(), jobs, [&](uint32_t index)
+		{
+			if (!ProcessMesh(meshes[index], outMeshes[index], meshTimings[index]))
+				numFailed += 1;
+		});
+
+	for (const auto& timings : meshTimings)
+		outTimings.accumulate(timings);
+
+	return numFailed;
+}
+
+//--
+
+void DequantizePosition(const ProcessedMesh& mesh, uint32_t vertexIndex, float* outPosition)
+{
+	for (int j = 0; j < 3; ++j)
+	{
+		const auto q = mesh.positions[4 * vertexIndex + j] / 65535.0f;
+		outPosition[j] = mesh.boundsMin[j] + q * (mesh.boundsMax[j] - mesh.boundsMin[j]);
+	}
+}
+
+//--
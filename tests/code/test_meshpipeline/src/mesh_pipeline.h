@@ -0,0 +1,125 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace ofbx
+{
+	struct Geometry;
+	struct IScene;
+}
+
+class JobSystem;
+
+//--
+
+// Source mesh as imported, triangle soup with per-corner attributes (3 corners per triangle)
+struct SourceMesh
+{
+	std::vector<float> positions; // xyz per corner
+	std::vector<float> normals; // xyz per corner
+	std::vector<float> uvs; // uv per corner
+	std::vector<float> tangents; // xyzw per corner, w is the bitangent sign, filled by GenerateTangents
+
+	inline uint32_t cornerCount() const { return (uint32_t)(positions.size() / 3); }
+	inline uint32_t triangleCount() const { return cornerCount() / 3; }
+};
+
+// Full precision vertex, used for welding and optimization
+struct PipelineVertex
+{
+	float position[3];
+	float normal[3];
+	float uv[2];
+	float tangent[4];
+};
+
+// Final mesh with quantized vertex streams
+// Positions are UNORM16 relative to bounds, normals and tangents are SNORM8 (tangent w is the sign), UVs are half floats
+struct ProcessedMesh
+{
+	float boundsMin[3] = { 0,0,0 };
+	float boundsMax[3] = { 0,0,0 };
+
+	uint32_t vertexCount = 0;
+	std::vector<uint16_t> positions; // 4 per vertex (xyz + padding)
+	std::vector<int8_t> normals; // 4 per vertex (xyz + padding)
+	std::vector<int8_t> tangents; // 4 per vertex (xyz + sign)
+	std::vector<uint16_t> uvs; // 2 per vertex
+
+	std::vector<uint32_t> indices;
+
+	inline uint32_t triangleCount() const { return (uint32_t)(indices.size() / 3); }
+};
+
+//--
+
+enum class PipelineStage : uint8_t
+{
+	Extract,
+	Tangents,
+	Weld,
+	VertexCache,
+	Overdraw,
+	VertexFetch,
+	Quantize,
+
+	MAX,
+};
+
+extern const char* PipelineStageName(PipelineStage stage);
+
+// Time spent in each stage of the pipeline, in milliseconds
+struct PipelineTimings
+{
+	double stages[(int)PipelineStage::MAX] = {};
+
+	inline double& operator[](PipelineStage stage) { return stages[(int)stage]; }
+	inline double operator[](PipelineStage stage) const { return stages[(int)stage]; }
+
+	double total() const;
+	void accumulate(const PipelineTimings& other);
+	void print(const char* title) const;
+};
+
+//--
+
+// Run function for each index in [0, count) on the job system, serially on the calling thread if there is none
+extern void ParallelFor(uint32_t count, JobSystem* jobs, const std::function<void(uint32_t)>& func);
+
+//--
+
+// Extract triangulated mesh from FBX geometry, missing normals are generated from the faces
+extern bool ExtractSourceMesh(const ofbx::Geometry* geometry, SourceMesh& outMesh);
+
+// Extract all geometries from the scene
+extern void ExtractSceneMeshes(const ofbx::IScene* scene, std::vector<SourceMesh>& outMeshes, PipelineTimings& outTimings);
+
+// Generate per-corner MikkTSpace tangents
+extern bool GenerateTangents(SourceMesh& mesh);
+
+// Weld identical corners, optimize for vertex cache, overdraw and vertex fetch and quantize the result
+// NOTE: mesh must have tangents already
+extern bool OptimizeMesh(const SourceMesh& mesh, ProcessedMesh& outMesh, PipelineTimings& outTimings);
+
+// Run the full pipeline on a single mesh (tangents + optimization)
+extern bool ProcessMesh(SourceMesh& mesh, ProcessedMesh& outMesh, PipelineTimings& outTimings);
+
+// Run the full pipeline on all meshes, each mesh is processed on a separate job
+// Returns number of meshes that failed, outTimings are summed over all meshes
+extern uint32_t ProcessMeshes(std::vector<SourceMesh>& meshes, std::vector<ProcessedMesh>& outMeshes, PipelineTimings& outTimings, JobSystem* jobs = nullptr);
+
+//--
+
+// Dequantize vertex position from the processed mesh
+extern void DequantizePosition(const ProcessedMesh& mesh, uint32_t vertexIndex, float* outPosition);
+
+//--
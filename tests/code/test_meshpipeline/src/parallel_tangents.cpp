@@ -0,0 +1,270 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "parallel_tangents.h"
+
+#include <mikkt/mikktspace.h>
+#include <meshoptimizer/meshoptimizer.h>
+
+#include <algorithm>
+#include <chrono>
+
+//--
+
+namespace
+{
+	// Part of the mesh given to a single genTangSpace call
+	struct TangentChunk
+	{
+		SourceMesh* mesh = nullptr;
+		std::vector<uint32_t> triangles; // global triangle indices, sorted so the relative order is the same as in the full mesh
+		std::vector<uint8_t> owned; // only owned triangles write the results
+	};
+
+	static const TangentChunk& Chunk(const SMikkTSpaceContext* context)
+	{
+		return *(const TangentChunk*)context->m_pUserData;
+	}
+
+	static int GetNumFaces(const SMikkTSpaceContext* context)
+	{
+		return (int)Chunk(context).triangles.size();
+	}
+
+	static int GetNumVerticesOfFace(const SMikkTSpaceContext* context, const int face)
+	{
+		return 3;
+	}
+
+	static void GetPosition(const SMikkTSpaceContext* context, float* outPos, const int face, const int vert)
+	{
+		const auto& chunk = Chunk(context);
+		const auto* pos = &chunk.mesh->positions[3 * (3 * chunk.triangles[face] + vert)];
+		outPos[0] = pos[0];
+		outPos[1] = pos[1];
+		outPos[2] = pos[2];
+	}
+
+	static void GetNormal(const SMikkTSpaceContext* context, float* outNormal, const int face, const int vert)
+	{
+		const auto& chunk = Chunk(context);
+		const auto* n = &chunk.mesh->normals[3 * (3 * chunk.triangles[face] + vert)];
+		outNormal[0] = n[0];
+		outNormal[1] = n[1];
+		outNormal[2] = n[2];
+	}
+
+	static void GetTexCoord(const SMikkTSpaceContext* context, float* outUV, const int face, const int vert)
+	{
+		const auto& chunk = Chunk(context);
+		const auto* uv = &chunk.mesh->uvs[2 * (3 * chunk.triangles[face] + vert)];
+		outUV[0] = uv[0];
+		outUV[1] = uv[1];
+	}
+
+	static void SetTSpaceBasic(const SMikkTSpaceContext* context, const float* tangent, const float sign, const int face, const int vert)
+	{
+		const auto& chunk = Chunk(context);
+		if (!chunk.owned[face])
+			return;
+
+		auto* t = &chunk.mesh->tangents[4 * (3 * chunk.triangles[face] + vert)];
+		t[0] = tangent[0];
+		t[1] = tangent[1];
+		t[2] = tangent[2];
+		t[3] = sign;
+	}
+
+	// Spread lower 10 bits so there are two zero bits between each one
+	static uint32_t SpreadBits(uint32_t x)
+	{
+		x &= 0x3FF;
+		x = (x | (x << 16)) & 0x030000FF;
+		x = (x | (x << 8)) & 0x0300F00F;
+		x = (x | (x << 4)) & 0x030C30C3;
+		x = (x | (x << 2)) & 0x09249249;
+		return x;
+	}
+
+	// Corner data MikkTSpace uses to decide if two corners are the same vertex
+	struct WeldKey
+	{
+		float position[3];
+		float normal[3];
+		float uv[2];
+	};
+
+	// MikkTSpace compares the floats with ==, the remap compares bytes so -0.0 has to become 0.0 first
+	static void CopyWeldValues(float* outValues, const float* values, uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+			outValues[i] = (values[i] == 0.0f) ? 0.0f : values[i];
+	}
+
+} // anonymous
+
+//--
+
+bool GenerateTangentsParallel(SourceMesh& mesh, const ParallelTangentSettings& settings, ParallelTangentStats* outStats)
+{
+	const auto cornerCount = mesh.cornerCount();
+	const auto triangleCount = mesh.triangleCount();
+	if (mesh.normals.size() != mesh.positions.size() || mesh.uvs.size() != (cornerCount * 2))
+		return false;
+
+	mesh.tangents.resize(cornerCount * 4);
+
+	const auto partitionStart = std::chrono::high_resolution_clock::now();
+
+	// weld corners the same way MikkTSpace does internally, corners with identical position, normal and UV are the same vertex
+	std::vector<uint32_t> cornerVertex(cornerCount);
+	uint32_t vertexCount = 0;
+	{
+		std::vector<WeldKey> keys(cornerCount);
+		for (uint32_t i = 0; i < cornerCount; ++i)
+		{
+			CopyWeldValues(keys[i].position, &mesh.positions[3 * i], 3);
+			CopyWeldValues(keys[i].normal, &mesh.normals[3 * i], 3);
+			CopyWeldValues(keys[i].uv, &mesh.uvs[2 * i], 2);
+		}
+
+		vertexCount = (uint32_t)meshopt_generateVertexRemap(cornerVertex.data(), nullptr, cornerCount, keys.data(), cornerCount, sizeof(WeldKey));
+	}
+
+	// vertex -> triangles adjacency
+	std::vector<uint32_t> vertexTriangleOffsets(vertexCount + 1, 0);
+	std::vector<uint32_t> vertexTriangles(cornerCount);
+	{
+		for (uint32_t i = 0; i < cornerCount; ++i)
+			vertexTriangleOffsets[cornerVertex[i] + 1] += 1;
+
+		for (uint32_t i = 0; i < vertexCount; ++i)
+			vertexTriangleOffsets[i + 1] += vertexTriangleOffsets[i];
+
+		std::vector<uint32_t> writePos(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end() - 1);
+		for (uint32_t i = 0; i < cornerCount; ++i)
+			vertexTriangles[writePos[cornerVertex[i]]++] = i / 3;
+	}
+
+	// order triangles along a Morton curve so consecutive ranges are spatially coherent
+	std::vector<uint64_t> sortKeys(triangleCount);
+	{
+		float boundsMin[3], boundsMax[3];
+		for (int j = 0; j < 3; ++j)
+		{
+			boundsMin[j] = triangleCount ? mesh.positions[j] : 0.0f;
+			boundsMax[j] = boundsMin[j];
+		}
+
+		for (uint32_t i = 0; i < cornerCount; ++i)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				boundsMin[j] = std::min(boundsMin[j], mesh.positions[3 * i + j]);
+				boundsMax[j] = std::max(boundsMax[j], mesh.positions[3 * i + j]);
+			}
+		}
+
+		float scale[3];
+		for (int j = 0; j < 3; ++j)
+		{
+			const auto extent = boundsMax[j] - boundsMin[j];
+			scale[j] = (extent > 0.0f) ? (1023.0f / extent) : 0.0f;
+		}
+
+		for (uint32_t i = 0; i < triangleCount; ++i)
+		{
+			const auto* p = &mesh.positions[9 * i];
+
+			uint32_t cell[3];
+			for (int j = 0; j < 3; ++j)
+			{
+				const auto centroid = (p[j] + p[3 + j] + p[6 + j]) / 3.0f;
+				cell[j] = (uint32_t)std::min(1023.0f, std::max(0.0f, (centroid - boundsMin[j]) * scale[j]));
+			}
+
+			const auto morton = SpreadBits(cell[0]) | (SpreadBits(cell[1]) << 1) | (SpreadBits(cell[2]) << 2);
+			sortKeys[i] = ((uint64_t)morton << 32) | i;
+		}
+
+		std::sort(sortKeys.begin(), sortKeys.end());
+	}
+
+	const auto chunkTriangles = std::max<uint32_t>(1, settings.chunkTriangles);
+	const auto numChunks = (triangleCount + chunkTriangles - 1) / chunkTriangles;
+
+	const auto tangentStart = std::chrono::high_resolution_clock::now();
+
+	std::atomic<uint32_t> numFailed = 0;
+	std::atomic<uint64_t> numHaloTriangles = 0;
+
+	ParallelFor(numChunks, settings.jobs, [&](uint32_t chunkIndex)
+		{
+			const auto firstKey = chunkIndex * chunkTriangles;
+			const auto lastKey = std::min(triangleCount, firstKey + chunkTriangles);
+
+			// owned triangles and all triangles that share a vertex with them
+			std::vector<uint32_t> triangles;
+			triangles.reserve((lastKey - firstKey) * 2);
+			for (auto i = firstKey; i < lastKey; ++i)
+			{
+				const auto triangle = (uint32_t)(sortKeys[i] & 0xFFFFFFFF);
+				for (uint32_t j = 0; j < 3; ++j)
+				{
+					const auto vertex = cornerVertex[3 * triangle + j];
+					triangles.insert(triangles.end(), vertexTriangles.begin() + vertexTriangleOffsets[vertex], vertexTriangles.begin() + vertexTriangleOffsets[vertex + 1]);
+				}
+			}
+
+			std::sort(triangles.begin(), triangles.end());
+			triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+
+			TangentChunk chunk;
+			chunk.mesh = &mesh;
+			chunk.owned.resize(triangles.size(), 0);
+
+			for (auto i = firstKey; i < lastKey; ++i)
+			{
+				const auto triangle = (uint32_t)(sortKeys[i] & 0xFFFFFFFF);
+				const auto it = std::lower_bound(triangles.begin(), triangles.end(), triangle);
+				chunk.owned[it - triangles.begin()] = 1;
+			}
+
+			chunk.triangles = std::move(triangles);
+			numHaloTriangles += chunk.triangles.size() - (lastKey - firstKey);
+
+			SMikkTSpaceInterface callbacks;
+			memset(&callbacks, 0, sizeof(callbacks));
+			callbacks.m_getNumFaces = &GetNumFaces;
+			callbacks.m_getNumVerticesOfFace = &GetNumVerticesOfFace;
+			callbacks.m_getPosition = &GetPosition;
+			callbacks.m_getNormal = &GetNormal;
+			callbacks.m_getTexCoord = &GetTexCoord;
+			callbacks.m_setTSpaceBasic = &SetTSpaceBasic;
+
+			SMikkTSpaceContext context;
+			context.m_pInterface = &callbacks;
+			context.m_pUserData = &chunk;
+
+			if (!genTangSpaceDefault(&context))
+				numFailed += 1;
+		});
+
+	const auto end = std::chrono::high_resolution_clock::now();
+
+	if (outStats)
+	{
+		outStats->numChunks = numChunks;
+		outStats->numHaloTriangles = numHaloTriangles;
+		outStats->partitionTime = std::chrono::duration<double, std::milli>(tangentStart - partitionStart).count();
+		outStats->tangentTime = std::chrono::duration<double, std::milli>(end - tangentStart).count();
+	}
+
+	return numFailed == 0;
+}
+
+//--
@@ -0,0 +1,31 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include "mesh_pipeline.h"
+
+//--
+
+struct ParallelTangentSettings
+{
+	JobSystem* jobs = nullptr; // chunks are processed serially if not set
+	uint32_t chunkTriangles = 65536; // number of triangles owned by each chunk
+};
+
+struct ParallelTangentStats
+{
+	uint32_t numChunks = 0;
+	uint64_t numHaloTriangles = 0; // triangles processed by a chunk that does not own them
+	double partitionTime = 0.0; // ms
+	double tangentTime = 0.0; // ms
+};
+
+// Generate per-corner MikkTSpace tangents by splitting the mesh into spatially coherent chunks processed in parallel
+// Each chunk is extended with all triangles that share a welded vertex with it so the seams produce the same result as single pass
+extern bool GenerateTangentsParallel(SourceMesh& mesh, const ParallelTangentSettings& settings = ParallelTangentSettings(), ParallelTangentStats* outStats = nullptr);
+
+//--
@@ -0,0 +1,214 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "parallel_tangents.h"
+#include "test_data.h"
+
+#include "../../common/job_system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+//--
+
+// Split the grid into UV islands, the right half is moved in UV space and the top half is mirrored
+static void AddUVSeams(SourceMesh& mesh)
+{
+	for (uint32_t i = 0; i < mesh.triangleCount(); ++i)
+	{
+		const auto* p = &mesh.positions[9 * i];
+		const auto centerX = (p[0] + p[3] + p[6]) / 3.0f;
+		const auto centerY = (p[1] + p[4] + p[7]) / 3.0f;
+
+		for (uint32_t j = 0; j < 3; ++j)
+		{
+			auto* uv = &mesh.uvs[6 * i + 2 * j];
+
+			if (centerX > 0.5f)
+				uv[0] += 2.0f;
+
+			if (centerY > 0.5f)
+				uv[1] = -uv[1];
+		}
+	}
+}
+
+// Number of corners with tangent that is not bit exact
+static uint32_t CountMismatchedTangents(const SourceMesh& a, const SourceMesh& b)
+{
+	if (a.tangents.size() != b.tangents.size())
+		return ~0U;
+
+	uint32_t numMismatched = 0;
+	for (uint32_t i = 0; i < a.cornerCount(); ++i)
+	{
+		if (0 != memcmp(&a.tangents[4 * i], &b.tangents[4 * i], 4 * sizeof(float)))
+			numMismatched += 1;
+	}
+
+	return numMismatched;
+}
+
+static void ExpectMatchesSinglePass(const SourceMesh& source, uint32_t chunkTriangles)
+{
+	auto single = source;
+	ASSERT_TRUE(GenerateTangents(single));
+
+	auto chunked = source;
+	ParallelTangentSettings settings;
+	settings.chunkTriangles = chunkTriangles;
+	settings.jobs = &TestJobSystem();
+
+	ParallelTangentStats stats;
+	ASSERT_TRUE(GenerateTangentsParallel(chunked, settings, &stats));
+	EXPECT_EQ((source.triangleCount() + chunkTriangles - 1) / chunkTriangles, stats.numChunks);
+
+	EXPECT_EQ(0, CountMismatchedTangents(single, chunked));
+}
+
+//--
+
+TEST(ParallelTangents, MatchesSinglePass)
+{
+	SourceMesh mesh;
+	GenerateWavyGridMesh(200, 200, mesh);
+	ShuffleTriangles(mesh, 7);
+
+	ExpectMatchesSinglePass(mesh, 4096);
+}
+
+TEST(ParallelTangents, MatchesSinglePassWithSeams)
+{
+	SourceMesh mesh;
+	GenerateWavyGridMesh(200, 200, mesh);
+	AddUVSeams(mesh);
+	ShuffleTriangles(mesh, 8);
+
+	ExpectMatchesSinglePass(mesh, 4096);
+}
+
+TEST(ParallelTangents, MatchesSinglePassWithTinyChunks)
+{
+	SourceMesh mesh;
+	GenerateWavyGridMesh(16, 16, mesh);
+	AddUVSeams(mesh);
+
+	ExpectMatchesSinglePass(mesh, 1);
+	ExpectMatchesSinglePass(mesh, 7);
+}
+
+TEST(ParallelTangents, MatchesSinglePassWithSignedZeros)
+{
+	SourceMesh mesh;
+	GenerateWavyGridMesh(32, 32, mesh);
+
+	// flat grid, every other corner stores the zeros as -0.0 so only a float compare sees the same vertex
+	for (uint32_t i = 0; i < mesh.cornerCount(); ++i)
+	{
+		const auto zero = (i & 1) ? -0.0f : 0.0f;
+		mesh.positions[3 * i + 2] = zero;
+		mesh.normals[3 * i + 0] = zero;
+		mesh.normals[3 * i + 1] = zero;
+		mesh.normals[3 * i + 2] = 1.0f;
+
+		if (mesh.uvs[2 * i + 0] == 0.0f)
+			mesh.uvs[2 * i + 0] = zero;
+	}
+
+	ShuffleTriangles(mesh, 10);
+
+	ExpectMatchesSinglePass(mesh, 64);
+}
+
+TEST(ParallelTangents, SingleChunkHasNoHalo)
+{
+	SourceMesh mesh;
+	GenerateWavyGridMesh(32, 32, mesh);
+
+	ParallelTangentSettings settings;
+	settings.chunkTriangles = mesh.triangleCount();
+
+	ParallelTangentStats stats;
+	ASSERT_TRUE(GenerateTangentsParallel(mesh, settings, &stats));
+	EXPECT_EQ(1, stats.numChunks);
+	EXPECT_EQ(0, stats.numHaloTriangles);
+}
+
+TEST(ParallelTangents, Deterministic)
+{
+	SourceMesh source;
+	GenerateWavyGridMesh(256, 128, source);
+	AddUVSeams(source);
+	ShuffleTriangles(source, 9);
+
+	ParallelTangentSettings settings;
+	settings.chunkTriangles = 2048;
+
+	auto reference = source;
+	ASSERT_TRUE(GenerateTangentsParallel(reference, settings));
+
+	JobSystem twoWorkers(2), fourWorkers(4);
+	for (auto* jobs : { &twoWorkers, &fourWorkers, &TestJobSystem(), &TestJobSystem() })
+	{
+		auto mesh = source;
+		settings.jobs = jobs;
+		ASSERT_TRUE(GenerateTangentsParallel(mesh, settings));
+
+		EXPECT_TRUE(0 == memcmp(reference.tangents.data(), mesh.tangents.data(), reference.tangents.size() * sizeof(float))) << jobs->numThreads();
+	}
+}
+
+//--
+
+static void RunScalingBenchmark(uint32_t gridSize)
+{
+	SourceMesh source;
+	GenerateWavyGridMesh(gridSize, gridSize, source);
+	ShuffleTriangles(source, 1);
+
+	double singleTime = 0.0;
+	{
+		auto mesh = source;
+		const auto start = std::chrono::high_resolution_clock::now();
+		ASSERT_TRUE(GenerateTangents(mesh));
+		singleTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	printf("%u triangles, single pass: %.2f ms\n", source.triangleCount(), singleTime);
+
+	const auto maxThreads = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+	for (uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+	{
+		auto mesh = source;
+		JobSystem jobs(numThreads);
+
+		ParallelTangentSettings settings;
+		settings.jobs = &jobs;
+
+		ParallelTangentStats stats;
+		ASSERT_TRUE(GenerateTangentsParallel(mesh, settings, &stats));
+
+		const auto totalTime = stats.partitionTime + stats.tangentTime;
+		printf("  %2u threads: %8.2f ms (partition %.2f ms, tangents %.2f ms), %u chunks, %.1f%% halo, %.2fx\n",
+			numThreads, totalTime, stats.partitionTime, stats.tangentTime, stats.numChunks,
+			100.0 * stats.numHaloTriangles / source.triangleCount(), singleTime / totalTime);
+	}
+}
+
+TEST(ParallelTangents, DISABLED_ScalingBenchmark)
+{
+	RunScalingBenchmark(500); // 500k triangles
+}
+
+TEST(ParallelTangents, DISABLED_ScalingBenchmark5M)
+{
+	RunScalingBenchmark(1582); // 5M triangles
+}
+
+//--
@@ -0,0 +1,295 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "mesh_pipeline.h"
+#include "test_data.h"
+
+#include <ofbx.h>
+#include <meshoptimizer/meshoptimizer.h>
+
+//--
+
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+//--
+
+typedef std::array<uint16_t, 3> QuantizedCorner;
+typedef std::array<QuantizedCorner, 3> QuantizedTriangle;
+
+static QuantizedCorner QuantizeCorner(const ProcessedMesh& mesh, const float* pos)
+{
+	QuantizedCorner ret;
+	for (int j = 0; j < 3; ++j)
+	{
+		const auto extent = mesh.boundsMax[j] - mesh.boundsMin[j];
+		const auto t = (extent > 0.0f) ? ((pos[j] - mesh.boundsMin[j]) / extent) : 0.0f;
+		ret[j] = (uint16_t)meshopt_quantizeUnorm(t, 16);
+	}
+	return ret;
+}
+
+static void CanonizeTriangle(QuantizedTriangle& tri)
+{
+	// rotate the smallest corner to the front, this keeps the winding
+	const auto smallest = std::min_element(tri.begin(), tri.end()) - tri.begin();
+	std::rotate(tri.begin(), tri.begin() + smallest, tri.end());
+}
+
+// Make sure processed mesh has exactly the same triangles as source mesh (up to quantization)
+static void ExpectSameTriangles(const SourceMesh& source, const ProcessedMesh& processed)
+{
+	ASSERT_EQ(source.triangleCount(), processed.triangleCount());
+
+	std::vector<QuantizedTriangle> sourceTriangles(source.triangleCount());
+	for (uint32_t i = 0; i < sourceTriangles.size(); ++i)
+	{
+		for (uint32_t j = 0; j < 3; ++j)
+			sourceTriangles[i][j] = QuantizeCorner(processed, &source.positions[9 * i + 3 * j]);
+		CanonizeTriangle(sourceTriangles[i]);
+	}
+
+	std::vector<QuantizedTriangle> processedTriangles(processed.triangleCount());
+	for (uint32_t i = 0; i < processedTriangles.size(); ++i)
+	{
+		for (uint32_t j = 0; j < 3; ++j)
+		{
+			const auto index = processed.indices[3 * i + j];
+			ASSERT_LT(index, processed.vertexCount);
+
+			const auto* q = &processed.positions[4 * index];
+			processedTriangles[i][j] = { q[0], q[1], q[2] };
+		}
+		CanonizeTriangle(processedTriangles[i]);
+	}
+
+	std::sort(sourceTriangles.begin(), sourceTriangles.end());
+	std::sort(processedTriangles.begin(), processedTriangles.end());
+	EXPECT_TRUE(sourceTriangles == processedTriangles);
+}
+
+//--
+
+TEST(MeshPipeline, ExtractCube)
+{
+	auto scene = LoadScene(MakeTestDataPath("cube.fbx"));
+	ASSERT_TRUE(scene);
+
+	SourceMesh mesh;
+	ASSERT_TRUE(ExtractSourceMesh(scene->scene->getGeometry(0), mesh));
+
+	EXPECT_EQ(12, mesh.triangleCount());
+	EXPECT_EQ(mesh.positions.size(), mesh.normals.size());
+	EXPECT_EQ(mesh.cornerCount() * 2, mesh.uvs.size());
+}
+
+TEST(MeshPipeline, CubeTangentsGenerated)
+{
+	auto scene = LoadScene(MakeTestDataPath("cube.fbx"));
+	ASSERT_TRUE(scene);
+
+	SourceMesh mesh;
+	ASSERT_TRUE(ExtractSourceMesh(scene->scene->getGeometry(0), mesh));
+	ASSERT_TRUE(GenerateTangents(mesh));
+	ASSERT_EQ(mesh.cornerCount() * 4, mesh.tangents.size());
+
+	for (uint32_t i = 0; i < mesh.cornerCount(); ++i)
+	{
+		const auto* t = &mesh.tangents[4 * i];
+		const auto* n = &mesh.normals[3 * i];
+
+		const auto dot = t[0] * n[0] + t[1] * n[1] + t[2] * n[2];
+		EXPECT_NEAR(0.0f, dot, 0.001f) << i;
+
+		const auto len = std::sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+		EXPECT_NEAR(1.0f, len, 0.001f) << i;
+
+		EXPECT_EQ(1.0f, std::abs(t[3])) << i;
+	}
+}
+
+TEST(MeshPipeline, CubeOutputEquivalent)
+{
+	auto scene = LoadScene(MakeTestDataPath("cube.fbx"));
+	ASSERT_TRUE(scene);
+
+	std::vector<SourceMesh> meshes;
+	PipelineTimings timings;
+	ExtractSceneMeshes(scene->scene, meshes, timings);
+	ASSERT_EQ(1, meshes.size());
+
+	std::vector<ProcessedMesh> processed;
+	ASSERT_EQ(0, ProcessMeshes(meshes, processed, timings));
+	ASSERT_EQ(1, processed.size());
+
+	// cube corners are shared between faces only if all attributes are the same
+	EXPECT_LE(8, processed[0].vertexCount);
+	EXPECT_GE(36, processed[0].vertexCount);
+
+	ExpectSameTriangles(meshes[0], processed[0]);
+}
+
+TEST(MeshPipeline, HighPolyOutputEquivalent)
+{
+	SourceMesh mesh;
+	GenerateWavyGridMesh(256, 256, mesh);
+	ShuffleTriangles(mesh, 42);
+
+	ProcessedMesh processed;
+	PipelineTimings timings;
+	ASSERT_TRUE(ProcessMesh(mesh, processed, timings));
+
+	// grid corners are welded back together
+	EXPECT_EQ(257 * 257, processed.vertexCount);
+
+	ExpectSameTriangles(mesh, processed);
+}
+
+TEST(MeshPipeline, DequantizedPositionsMatch)
+{
+	SourceMesh mesh;
+	GenerateWavyGridMesh(64, 64, mesh);
+
+	ProcessedMesh processed;
+	PipelineTimings timings;
+	ASSERT_TRUE(ProcessMesh(mesh, processed, timings));
+
+	std::vector<float> pos(processed.vertexCount * 3);
+	for (uint32_t i = 0; i < processed.vertexCount; ++i)
+		DequantizePosition(processed, i, &pos[3 * i]);
+
+	// every vertex lands on the grid within the quantization error
+	const float maxError = 1.0f / 65535.0f;
+	for (uint32_t i = 0; i < processed.vertexCount; ++i)
+	{
+		const auto* p = &pos[3 * i];
+		EXPECT_NEAR(std::round(p[0] * 64.0f), p[0] * 64.0f, 64.0f * maxError) << i;
+		EXPECT_NEAR(std::round(p[1] * 64.0f), p[1] * 64.0f, 64.0f * maxError) << i;
+	}
+
+	EXPECT_NEAR(0.0f, processed.boundsMin[0], maxError);
+	EXPECT_NEAR(1.0f, processed.boundsMax[0], maxError);
+}
+
+TEST(MeshPipeline, VertexCacheImproved)
+{
+	SourceMesh mesh;
+	GenerateWavyGridMesh(128, 128, mesh);
+	ShuffleTriangles(mesh, 1234);
+
+	// naive indexing, just welded
+	std::vector<uint32_t> naiveIndices(mesh.cornerCount());
+	const auto vertexCount = meshopt_generateVertexRemap(naiveIndices.data(), nullptr, mesh.cornerCount(), mesh.positions.data(), mesh.cornerCount(), 3 * sizeof(float));
+	const auto naiveStats = meshopt_analyzeVertexCache(naiveIndices.data(), naiveIndices.size(), vertexCount, 16, 0, 0);
+
+	ProcessedMesh processed;
+	PipelineTimings timings;
+	ASSERT_TRUE(ProcessMesh(mesh, processed, timings));
+
+	const auto optimizedStats = meshopt_analyzeVertexCache(processed.indices.data(), processed.indices.size(), processed.vertexCount, 16, 0, 0);
+	printf("ACMR: naive %.3f, optimized %.3f\n", naiveStats.acmr, optimizedStats.acmr);
+
+	EXPECT_LT(optimizedStats.acmr, naiveStats.acmr);
+}
+
+TEST(MeshPipeline, ParallelMatchesSerial)
+{
+	std::vector<SourceMesh> meshes(8);
+	for (uint32_t i = 0; i < meshes.size(); ++i)
+	{
+		GenerateWavyGridMesh(16 + 16 * i, 32 + 8 * i, meshes[i]);
+		ShuffleTriangles(meshes[i], i);
+	}
+
+	std::vector<ProcessedMesh> serial, parallel;
+	PipelineTimings serialTimings, parallelTimings;
+	ASSERT_EQ(0, ProcessMeshes(meshes, serial, serialTimings));
+	ASSERT_EQ(0, ProcessMeshes(meshes, parallel, parallelTimings, &TestJobSystem()));
+
+	ASSERT_EQ(serial.size(), parallel.size());
+	for (uint32_t i = 0; i < serial.size(); ++i)
+	{
+		EXPECT_TRUE(SameMesh(serial[i], parallel[i])) << i;
+	}
+}
+
+TEST(MeshPipeline, StagesRunOnEveryMesh)
+{
+	std::vector<SourceMesh> meshes(4);
+	for (uint32_t i = 0; i < meshes.size(); ++i)
+	{
+		GenerateWavyGridMesh(8 + 4 * i, 8, meshes[i]);
+		ShuffleTriangles(meshes[i], i);
+	}
+
+	for (auto* jobs : { (JobSystem*)nullptr, &TestJobSystem() })
+	{
+		PipelineTimings timings;
+		std::vector<ProcessedMesh> processed;
+		ASSERT_EQ(0, ProcessMeshes(meshes, processed, timings, jobs));
+		ASSERT_EQ(meshes.size(), processed.size());
+
+		for (uint32_t i = 0; i < meshes.size(); ++i)
+		{
+			const auto& source = meshes[i];
+			const auto& mesh = processed[i];
+
+			// tangents: generated in place for every corner
+			EXPECT_EQ(source.cornerCount() * 4, source.tangents.size()) << i;
+
+			// weld: grid corners shared again
+			EXPECT_EQ((9 + 4 * i) * 9, mesh.vertexCount) << i;
+
+			// vertex fetch: vertices are numbered in the order of first use
+			uint32_t nextVertex = 0;
+			for (const auto index : mesh.indices)
+			{
+				ASSERT_LE(index, nextVertex) << i;
+				if (index == nextVertex)
+					nextVertex += 1;
+			}
+			EXPECT_EQ(mesh.vertexCount, nextVertex) << i;
+
+			// quantize: all streams have the packed size
+			EXPECT_EQ(mesh.vertexCount * 4, mesh.positions.size()) << i;
+			EXPECT_EQ(mesh.vertexCount * 4, mesh.normals.size()) << i;
+			EXPECT_EQ(mesh.vertexCount * 4, mesh.tangents.size()) << i;
+			EXPECT_EQ(mesh.vertexCount * 2, mesh.uvs.size()) << i;
+
+			ExpectSameTriangles(source, mesh);
+		}
+	}
+}
+
+TEST(MeshPipeline, DISABLED_StageTimingsBenchmark)
+{
+	std::vector<SourceMesh> meshes(32);
+	for (uint32_t i = 0; i < meshes.size(); ++i)
+	{
+		GenerateWavyGridMesh(128, 128, meshes[i]);
+		ShuffleTriangles(meshes[i], i);
+	}
+
+	for (auto* jobs : { (JobSystem*)nullptr, &TestJobSystem() })
+	{
+		PipelineTimings timings;
+		std::vector<ProcessedMesh> processed;
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		ASSERT_EQ(0, ProcessMeshes(meshes, processed, timings, jobs));
+		const auto wallTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		char title[128];
+		sprintf(title, "%u meshes, %s, %.3f ms wall", (uint32_t)meshes.size(), jobs ? "parallel" : "serial", wallTime);
+		timings.print(title);
+	}
+}
+
+//--
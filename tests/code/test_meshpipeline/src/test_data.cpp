@@ -0,0 +1,201 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+#include "test_data.h"
+
+#include "../../common/job_system.h"
+
+#ifdef __APPLE__
+#import <sys/proc_info.h>
+#import <libproc.h>
+#elif defined _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <ofbx.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string.h>
+
+//--
+
+#define TEST_DATA "../../../data/"
+
+static std::filesystem::path GetExecutablePath()
+{
+	char exepath[1024];
+	memset(exepath, 0, sizeof(exepath));
+
+#ifdef _WIN32
+	GetModuleFileNameA(GetModuleHandle(NULL), exepath, sizeof(exepath));
+#elif defined(__APPLE__)
+	proc_pidpath(getpid(), exepath, sizeof(exepath));
+	printf("path: %s\n", exepath);
+#else
+	char arg1[20];
+	sprintf(arg1, "/proc/%d/exe", getpid());
+	if (readlink(arg1, exepath, sizeof(exepath)) < 0)
+		return "";
+#endif
+
+	return std::filesystem::path(exepath);
+}
+
+std::filesystem::path TestRootPath()
+{
+	static auto rootPath = std::filesystem::weakly_canonical(GetExecutablePath().parent_path() / TEST_DATA).make_preferred();
+	return rootPath;
+}
+
+std::filesystem::path MakeTestDataPath(std::string_view name)
+{
+	return (TestRootPath() / name).make_preferred();
+}
+
+bool LoadFileToBuffer(const std::filesystem::path& path, std::vector<uint8_t>& outBuffer)
+{
+	std::ifstream file(path, std::ios::binary);
+	file.unsetf(std::ios::skipws);
+
+	if (!file.is_open())
+	{
+		std::cout << "Unable to open file " << path << "\n";
+		return false;
+	}
+
+	file.seekg(0, std::ios::end);
+	auto fileSize = file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	outBuffer.resize(fileSize);
+	file.read((char*)outBuffer.data(), fileSize);
+
+	return true;
+}
+
+SceneWrapper::SceneWrapper(ofbx::IScene* s)
+	: scene(s)
+{}
+
+SceneWrapper::~SceneWrapper()
+{
+	if (scene)
+	{
+		scene->destroy();
+		scene = nullptr;
+	}
+}
+
+std::shared_ptr<SceneWrapper> LoadScene(const std::filesystem::path& path)
+{
+	std::vector<uint8_t> data;
+	if (!LoadFileToBuffer(path, data))
+		return nullptr;
+
+	auto scene = ofbx::load(data.data(), data.size(), 0);
+	if (!scene)
+		return nullptr;
+
+	return std::make_shared<SceneWrapper>(scene);
+}
+
+//--
+
+void GenerateWavyGridMesh(uint32_t cellsX, uint32_t cellsY, SourceMesh& outMesh)
+{
+	const float frequency = 12.0f;
+	const float amplitude = 0.05f;
+
+	auto emitCorner = [&](uint32_t x, uint32_t y)
+	{
+		const float u = x / (float)cellsX;
+		const float v = y / (float)cellsY;
+
+		const float h = amplitude * std::sin(u * frequency) * std::cos(v * frequency);
+		const float dhdu = amplitude * frequency * std::cos(u * frequency) * std::cos(v * frequency);
+		const float dhdv = -amplitude * frequency * std::sin(u * frequency) * std::sin(v * frequency);
+
+		float n[3] = { -dhdu, -dhdv, 1.0f };
+		const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+		outMesh.positions.push_back(u);
+		outMesh.positions.push_back(v);
+		outMesh.positions.push_back(h);
+		outMesh.normals.push_back(n[0] / len);
+		outMesh.normals.push_back(n[1] / len);
+		outMesh.normals.push_back(n[2] / len);
+		outMesh.uvs.push_back(u);
+		outMesh.uvs.push_back(v);
+	};
+
+	outMesh = SourceMesh();
+	outMesh.positions.reserve(cellsX * cellsY * 18);
+	outMesh.normals.reserve(cellsX * cellsY * 18);
+	outMesh.uvs.reserve(cellsX * cellsY * 12);
+
+	for (uint32_t y = 0; y < cellsY; ++y)
+	{
+		for (uint32_t x = 0; x < cellsX; ++x)
+		{
+			emitCorner(x, y);
+			emitCorner(x + 1, y);
+			emitCorner(x + 1, y + 1);
+
+			emitCorner(x, y);
+			emitCorner(x + 1, y + 1);
+			emitCorner(x, y + 1);
+		}
+	}
+}
+
+void ShuffleTriangles(SourceMesh& mesh, uint32_t seed)
+{
+	std::vector<uint32_t> order(mesh.triangleCount());
+	for (uint32_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+
+	std::mt19937 rng(seed);
+	std::shuffle(order.begin(), order.end(), rng);
+
+	SourceMesh shuffled;
+	for (const auto index : order)
+	{
+		shuffled.positions.insert(shuffled.positions.end(), mesh.positions.begin() + 9 * index, mesh.positions.begin() + 9 * (index + 1));
+		shuffled.normals.insert(shuffled.normals.end(), mesh.normals.begin() + 9 * index, mesh.normals.begin() + 9 * (index + 1));
+		shuffled.uvs.insert(shuffled.uvs.end(), mesh.uvs.begin() + 6 * index, mesh.uvs.begin() + 6 * (index + 1));
+	}
+
+	mesh = std::move(shuffled);
+}
+
+bool SameMesh(const ProcessedMesh& a, const ProcessedMesh& b)
+{
+	return a.vertexCount == b.vertexCount
+		&& 0 == memcmp(a.boundsMin, b.boundsMin, sizeof(a.boundsMin))
+		&& 0 == memcmp(a.boundsMax, b.boundsMax, sizeof(a.boundsMax))
+		&& a.positions == b.positions
+		&& a.normals == b.normals
+		&& a.tangents == b.tangents
+		&& a.uvs == b.uvs
+		&& a.indices == b.indices;
+}
+
+//--
+
+JobSystem& TestJobSystem()
+{
+	static JobSystem jobs;
+	return jobs;
+}
+
+//--
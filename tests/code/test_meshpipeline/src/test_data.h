@@ -0,0 +1,59 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#pragma once
+
+#include "mesh_pipeline.h"
+
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace ofbx { struct IScene; }
+class JobSystem;
+
+//--
+
+// Root of the shared test data directory (tests/data)
+extern std::filesystem::path TestRootPath();
+
+// Path to a file in the shared test data directory
+extern std::filesystem::path MakeTestDataPath(std::string_view name);
+
+// Load whole file into memory
+extern bool LoadFileToBuffer(const std::filesystem::path& path, std::vector<uint8_t>& outBuffer);
+
+//--
+
+struct SceneWrapper
+{
+	ofbx::IScene* scene = nullptr;
+
+	SceneWrapper(ofbx::IScene* s);
+	~SceneWrapper();
+};
+
+// Load FBX scene with default flags, nullptr if the file is missing or broken
+extern std::shared_ptr<SceneWrapper> LoadScene(const std::filesystem::path& path);
+
+//--
+
+// Generate a wavy height field with analytical normals, cellsX * cellsY * 2 triangles
+extern void GenerateWavyGridMesh(uint32_t cellsX, uint32_t cellsY, SourceMesh& outMesh);
+
+// Shuffle triangles of the mesh so it has no locality
+extern void ShuffleTriangles(SourceMesh& mesh, uint32_t seed);
+
+// Bit exact comparison of processed meshes
+extern bool SameMesh(const ProcessedMesh& a, const ProcessedMesh& b);
+
+//--
+
+// Job system shared by all tests, one worker per hardware thread
+extern JobSystem& TestJobSystem();
+
+//--
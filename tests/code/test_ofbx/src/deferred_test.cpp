@@ -0,0 +1,349 @@
+/***
+* Bare Metal Engine
+* Written by Tomasz Jonarski (RexDex)
+* Basic middleware testing project
+***/
+
+#include "build.h"
+
+#include <ofbx.h>
+
+//--
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+//--
+
+extern std::filesystem::path MakeTestDataPath(std::string_view name);
+extern bool LoadFileToBuffer(const std::filesystem::path& path, std::vector<uint8_t>& outBuffer);
+
+//--
+
+// What to parse when the scene is opened
+enum class DeferredSceneFlags : uint8_t
+{
+	HierarchyOnly = 0, // node tree and object headers only
+	Everything = 1, // full scene right away (same as ofbx::load)
+};
+
+// Scene opened in two passes
+// - hierarchy(): node tree and object headers, geometry, blend shapes and animation curves are not converted
+// - content(): the full scene, parsed the first time it's needed
+// OpenFBX can't decode the geometry of a single mesh, so the content pass parses the whole file again
+// The content pass replaces the hierarchy scene: it's destroyed before the file is parsed again and the file buffer is released after,
+// so at no point is more than one scene alive and once the content is loaded only the full scene is kept
+// NOTE: objects from hierarchy() are invalid after content() was called, keep object IDs and use contentMesh() to find the mesh again
+class DeferredScene
+{
+public:
+	static constexpr ofbx::u64 HIERARCHY_FLAGS = (ofbx::u64)ofbx::LoadFlags::IGNORE_GEOMETRY | (ofbx::u64)ofbx::LoadFlags::IGNORE_BLEND_SHAPES | (ofbx::u64)ofbx::LoadFlags::IGNORE_ANIMATIONS;
+
+	DeferredScene(std::vector<uint8_t>&& data, DeferredSceneFlags flags = DeferredSceneFlags::HierarchyOnly)
+		: m_data(std::move(data))
+	{
+		if (flags == DeferredSceneFlags::Everything)
+			content();
+		else
+			hierarchy();
+	}
+
+	~DeferredScene()
+	{
+		releaseHierarchy();
+
+		if (m_content)
+		{
+			m_content->destroy();
+			m_content = nullptr;
+		}
+	}
+
+	DeferredScene(const DeferredScene&) = delete;
+	DeferredScene& operator=(const DeferredScene&) = delete;
+
+	// scene with node tree and object headers, no geometry, cheap to get
+	// NOTE: once the content is loaded (or when opened with DeferredSceneFlags::Everything) the full scene is returned
+	const ofbx::IScene* hierarchy()
+	{
+		if (m_content)
+			return m_content;
+
+		if (!m_hierarchy)
+		{
+			m_hierarchy = ofbx::load(m_data.data(), (int)m_data.size(), HIERARCHY_FLAGS);
+			m_parseCount += 1;
+		}
+
+		return m_hierarchy;
+	}
+
+	// full scene with all geometry arrays decoded, parsed on first access
+	// NOTE: destroys the hierarchy scene, all objects obtained from hierarchy() before are invalid after this call
+	const ofbx::IScene* content()
+	{
+		if (!m_content && !m_data.empty())
+		{
+			releaseHierarchy();
+
+			m_content = ofbx::load(m_data.data(), (int)m_data.size(), 0);
+			m_parseCount += 1;
+
+			// the scene has its own copy, nothing will parse the file again
+			std::vector<uint8_t>().swap(m_data);
+		}
+
+		return m_content;
+	}
+
+	// Mesh of the full scene with the given object ID (ofbx::Object::id of a hierarchy mesh), parses the content if needed
+	const ofbx::Mesh* contentMesh(ofbx::u64 meshId)
+	{
+		const auto* scene = content();
+		if (!scene)
+			return nullptr;
+
+		for (int i = 0; i < scene->getMeshCount(); ++i)
+		{
+			const auto* contentMesh = scene->getMesh(i);
+			if (contentMesh->id == meshId)
+				return contentMesh;
+		}
+
+		return nullptr;
+	}
+
+	inline bool contentLoaded() const { return m_content != nullptr; }
+	inline bool hierarchyLoaded() const { return m_hierarchy != nullptr; }
+	inline bool dataLoaded() const { return !m_data.empty(); }
+	inline uint32_t parseCount() const { return m_parseCount; }
+
+private:
+	std::vector<uint8_t> m_data; // OpenFBX copies what it needs, kept only until the content pass parses it again
+
+	ofbx::IScene* m_hierarchy = nullptr;
+	ofbx::IScene* m_content = nullptr;
+
+	uint32_t m_parseCount = 0;
+
+	void releaseHierarchy()
+	{
+		if (m_hierarchy)
+		{
+			m_hierarchy->destroy();
+			m_hierarchy = nullptr;
+		}
+	}
+};
+
+static std::unique_ptr<DeferredScene> LoadDeferredScene(std::string_view name, DeferredSceneFlags flags = DeferredSceneFlags::HierarchyOnly)
+{
+	const auto path = MakeTestDataPath(name);
+
+	std::vector<uint8_t> data;
+	if (!LoadFileToBuffer(path, data))
+		return nullptr;
+
+	auto scene = std::make_unique<DeferredScene>(std::move(data), flags);
+	if (!scene->hierarchy())
+		return nullptr;
+
+	return scene;
+}
+
+//--
+
+TEST(OpenFBXDeferred, LoadCube)
+{
+	auto scene = LoadDeferredScene("cube.fbx");
+	ASSERT_TRUE(scene);
+
+	EXPECT_EQ(1, scene->parseCount());
+	EXPECT_FALSE(scene->contentLoaded());
+}
+
+TEST(OpenFBXDeferred, HierarchySkipsGeometry)
+{
+	auto scene = LoadDeferredScene("cube.fbx");
+	ASSERT_TRUE(scene);
+
+	const auto* hierarchy = scene->hierarchy();
+	ASSERT_TRUE(hierarchy);
+
+	EXPECT_EQ(0, hierarchy->getGeometryCount());
+	EXPECT_EQ(1, hierarchy->getMeshCount());
+
+	const auto* mesh = hierarchy->getMesh(0);
+	ASSERT_TRUE(mesh);
+	EXPECT_STREQ("Cube", mesh->name);
+	EXPECT_EQ(nullptr, mesh->getGeometry());
+
+	// nothing was parsed on the way
+	EXPECT_EQ(1, scene->parseCount());
+	EXPECT_FALSE(scene->contentLoaded());
+}
+
+TEST(OpenFBXDeferred, HierarchyHasRootElement)
+{
+	auto scene = LoadDeferredScene("cube.fbx");
+	ASSERT_TRUE(scene);
+
+	auto root = scene->hierarchy()->getRoot();
+	ASSERT_TRUE(root);
+	ASSERT_EQ(ofbx::Object::Type::ROOT, root->getType());
+	ASSERT_STREQ("RootNode", root->name);
+
+	EXPECT_FALSE(scene->contentLoaded());
+}
+
+TEST(OpenFBXDeferred, HierarchyHasNoGeometryObjects)
+{
+	auto scene = LoadDeferredScene("cube.fbx");
+	ASSERT_TRUE(scene);
+
+	const auto objectCount = scene->hierarchy()->getAllObjectCount();
+	const auto* objects = scene->hierarchy()->getAllObjects();
+	for (int i = 0; i < objectCount; ++i)
+	{
+		EXPECT_NE(ofbx::Object::Type::GEOMETRY, objects[i]->getType()) << objects[i]->name;
+	}
+
+	EXPECT_FALSE(scene->contentLoaded());
+}
+
+TEST(OpenFBXDeferred, GeometryParsedOnFirstAccess)
+{
+	auto scene = LoadDeferredScene("cube.fbx");
+	ASSERT_TRUE(scene);
+	ASSERT_FALSE(scene->contentLoaded());
+
+	const auto* content = scene->content();
+	ASSERT_TRUE(content);
+	EXPECT_TRUE(scene->contentLoaded());
+	EXPECT_EQ(2, scene->parseCount());
+
+	auto geometry = content->getGeometry(0);
+	ASSERT_TRUE(geometry);
+	EXPECT_STREQ("CubeGeometry", geometry->name);
+	EXPECT_EQ(24, geometry->getIndexCount());
+	EXPECT_EQ(8, geometry->getVertexCount());
+}
+
+TEST(OpenFBXDeferred, ContentReplacesHierarchy)
+{
+	auto scene = LoadDeferredScene("cube.fbx");
+	ASSERT_TRUE(scene);
+	ASSERT_TRUE(scene->hierarchyLoaded());
+	ASSERT_TRUE(scene->dataLoaded());
+
+	ASSERT_TRUE(scene->content());
+
+	// only the full scene is kept, the hierarchy and the file buffer are gone
+	EXPECT_FALSE(scene->hierarchyLoaded());
+	EXPECT_FALSE(scene->dataLoaded());
+	EXPECT_EQ(scene->content(), scene->hierarchy());
+	EXPECT_EQ(1, scene->hierarchy()->getGeometryCount());
+}
+
+TEST(OpenFBXDeferred, ContentMeshMatchesHierarchyMesh)
+{
+	auto scene = LoadDeferredScene("cube.fbx");
+	ASSERT_TRUE(scene);
+
+	const auto* mesh = scene->hierarchy()->getMesh(0);
+	ASSERT_TRUE(mesh);
+
+	// the hierarchy mesh is gone once the content is loaded, only the ID is carried over
+	const auto meshId = mesh->id;
+	const std::string meshName = mesh->name;
+
+	const auto* contentMesh = scene->contentMesh(meshId);
+	ASSERT_TRUE(contentMesh);
+	EXPECT_TRUE(scene->contentLoaded());
+
+	EXPECT_EQ(meshId, contentMesh->id);
+	EXPECT_EQ(meshName, contentMesh->name);
+
+	const auto* geometry = contentMesh->getGeometry();
+	ASSERT_TRUE(geometry);
+	EXPECT_EQ(8, geometry->getVertexCount());
+}
+
+TEST(OpenFBXDeferred, ContentParsedOnlyOnce)
+{
+	auto scene = LoadDeferredScene("cube.fbx");
+	ASSERT_TRUE(scene);
+
+	const auto* first = scene->content();
+	const auto* second = scene->content();
+	EXPECT_EQ(first, second);
+	EXPECT_EQ(2, scene->parseCount());
+}
+
+TEST(OpenFBXDeferred, EverythingFlagParsesUpFront)
+{
+	auto scene = LoadDeferredScene("cube.fbx", DeferredSceneFlags::Everything);
+	ASSERT_TRUE(scene);
+
+	EXPECT_TRUE(scene->contentLoaded());
+	EXPECT_FALSE(scene->hierarchyLoaded());
+	EXPECT_FALSE(scene->dataLoaded());
+	EXPECT_EQ(1, scene->parseCount());
+	EXPECT_EQ(scene->content(), scene->hierarchy());
+	EXPECT_EQ(1, scene->hierarchy()->getGeometryCount());
+}
+
+TEST(OpenFBXDeferred, HierarchyHasFewerObjects)
+{
+	const auto path = MakeTestDataPath("cube.fbx");
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(LoadFileToBuffer(path, data));
+
+	auto* full = ofbx::load(data.data(), (int)data.size(), 0);
+	auto* hierarchy = ofbx::load(data.data(), (int)data.size(), DeferredScene::HIERARCHY_FLAGS);
+	ASSERT_TRUE(full);
+	ASSERT_TRUE(hierarchy);
+
+	EXPECT_EQ(0, hierarchy->getGeometryCount());
+	EXPECT_EQ(full->getMeshCount(), hierarchy->getMeshCount());
+	EXPECT_LT(hierarchy->getAllObjectCount(), full->getAllObjectCount());
+
+	hierarchy->destroy();
+	full->destroy();
+}
+
+TEST(OpenFBXDeferred, DISABLED_LoadTimeBenchmark)
+{
+	const auto path = MakeTestDataPath("cube.fbx");
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(LoadFileToBuffer(path, data));
+
+	const int NUM_ITERATIONS = 200;
+
+	auto measure = [&](ofbx::u64 flags)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		for (int i = 0; i < NUM_ITERATIONS; ++i)
+		{
+			auto* scene = ofbx::load(data.data(), (int)data.size(), flags);
+			EXPECT_TRUE(scene);
+			if (scene)
+				scene->destroy();
+		}
+
+		return std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / NUM_ITERATIONS;
+	};
+
+	const auto fullTime = measure(0);
+	const auto hierarchyTime = measure(DeferredScene::HIERARCHY_FLAGS);
+
+	printf("Full load: %.2f us, hierarchy only: %.2f us (%.2fx)\n", fullTime, hierarchyTime, fullTime / std::max(hierarchyTime, 0.001));
+}
+
+//--
@@ -0,0 +1,475 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "batch_cooker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+using namespace physx;
+
+//--
+
+CookedBlobArena::CookedBlobArena(uint32_t chunkSize)
+	: m_chunkSize(chunkSize)
+{}
+
+void CookedBlobArena::grow(uint32_t size)
+{
+	// big blobs get their own chunk
+	Chunk chunk;
+	chunk.size = std::max(m_chunkSize, size);
+	chunk.data.reset(new uint8_t[chunk.size]);
+	m_reservedBytes += chunk.size;
+	m_chunks.push_back(std::move(chunk));
+}
+
+void CookedBlobArena::begin()
+{
+	m_blobStart = m_chunks.empty() ? 0 : m_chunks.back().used;
+}
+
+uint32_t CookedBlobArena::write(const void* src, uint32_t count)
+{
+	if (m_chunks.empty() || m_chunks.back().size - m_chunks.back().used < count)
+	{
+		// move what we have of the blob so far, the rest of the old chunk is wasted
+		const auto written = m_chunks.empty() ? 0 : m_chunks.back().used - m_blobStart;
+		grow(std::max<uint32_t>(2 * (written + count), m_chunkSize));
+
+		if (written)
+		{
+			auto& oldChunk = m_chunks[m_chunks.size() - 2];
+			memcpy(m_chunks.back().data.get(), oldChunk.data.get() + m_blobStart, written);
+			oldChunk.used = m_blobStart;
+		}
+
+		m_chunks.back().used = written;
+		m_blobStart = 0;
+	}
+
+	auto& chunk = m_chunks.back();
+	memcpy(chunk.data.get() + chunk.used, src, count);
+	chunk.used += count;
+	return count;
+}
+
+CookedBlob CookedBlobArena::end()
+{
+	CookedBlob blob;
+	if (!m_chunks.empty())
+	{
+		const auto& chunk = m_chunks.back();
+		blob.data = chunk.data.get() + m_blobStart;
+		blob.size = chunk.used - m_blobStart;
+		m_blobStart = chunk.used;
+		m_usedBytes += blob.size;
+	}
+
+	return blob;
+}
+
+void CookedBlobArena::abort()
+{
+	if (!m_chunks.empty())
+		m_chunks.back().used = m_blobStart;
+}
+
+CookedBlob CookedBlobArena::store(const void* data, uint32_t size)
+{
+	begin();
+	write(data, size);
+	return end();
+}
+
+void CookedBlobArena::clear()
+{
+	m_chunks.clear();
+	m_blobStart = 0;
+	m_usedBytes = 0;
+	m_reservedBytes = 0;
+}
+
+//--
+
+static const uint64_t HASH_PRIME1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t HASH_PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+
+static inline uint64_t HashMix(uint64_t hash, uint64_t value)
+{
+	hash ^= value * HASH_PRIME1;
+	hash = (hash << 31) | (hash >> 33);
+	return hash * HASH_PRIME2;
+}
+
+// 8 bytes at a time, the shapes are mostly floats so bytewise FNV would be the slowest part of a cache hit
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+	const auto* ptr = (const uint8_t*)data;
+
+	while (size >= 8)
+	{
+		uint64_t value;
+		memcpy(&value, ptr, 8);
+		hash = HashMix(hash, value);
+		ptr += 8;
+		size -= 8;
+	}
+
+	if (size)
+	{
+		uint64_t value = 0;
+		memcpy(&value, ptr, size);
+		hash = HashMix(hash, value ^ ((uint64_t)size << 56));
+	}
+
+	return hash;
+}
+
+static uint64_t HashStrided(uint64_t hash, const void* data, uint32_t count, uint32_t stride, uint32_t elementSize)
+{
+	if (!data || !count)
+		return HashMix(hash, 0);
+
+	hash = HashMix(hash, count);
+
+	if (stride == elementSize)
+		return HashBytes(hash, data, (size_t)count * elementSize);
+
+	const auto* ptr = (const uint8_t*)data;
+	for (uint32_t i = 0; i < count; ++i, ptr += stride)
+		hash = HashBytes(hash, ptr, elementSize);
+
+	return hash;
+}
+
+static uint64_t HashFloat(uint64_t hash, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	return HashMix(hash, bits);
+}
+
+uint64_t BatchCooker::HashParams(const PxCookingParams& params)
+{
+	// version first, new PhysX cooks differently
+	uint64_t hash = HashMix(0, PX_PHYSICS_VERSION);
+
+	hash = HashFloat(hash, params.areaTestEpsilon);
+	hash = HashFloat(hash, params.planeTolerance);
+	hash = HashMix(hash, (uint64_t)params.convexMeshCookingType);
+	hash = HashMix(hash, params.suppressTriangleMeshRemapTable);
+	hash = HashMix(hash, params.buildTriangleAdjacencies);
+	hash = HashMix(hash, params.buildGPUData);
+	hash = HashFloat(hash, params.scale.length);
+	hash = HashFloat(hash, params.scale.speed);
+	hash = HashMix(hash, (uint32_t)params.meshPreprocessParams);
+	hash = HashFloat(hash, params.meshWeldTolerance);
+	hash = HashMix(hash, params.gaussMapLimit);
+
+	const auto midphase = params.midphaseDesc.getType();
+	hash = HashMix(hash, (uint64_t)midphase);
+	if (midphase == PxMeshMidPhase::eBVH33)
+	{
+		hash = HashFloat(hash, params.midphaseDesc.mBVH33Desc.meshSizePerformanceTradeOff);
+		hash = HashMix(hash, (uint64_t)params.midphaseDesc.mBVH33Desc.meshCookingHint);
+	}
+	else if (midphase == PxMeshMidPhase::eBVH34)
+	{
+		hash = HashMix(hash, params.midphaseDesc.mBVH34Desc.numPrimsPerLeaf);
+	}
+
+	return hash;
+}
+
+uint64_t BatchCooker::HashInput(const CookingInput& input, uint64_t seed)
+{
+	auto hash = HashMix(seed, (uint64_t)input.type + 1);
+
+	if (input.type == CookedShapeType::Convex && input.convex)
+	{
+		const auto& desc = *input.convex;
+		hash = HashMix(hash, (uint32_t)desc.flags);
+		hash = HashMix(hash, ((uint64_t)desc.vertexLimit << 16) | desc.quantizedCount);
+		hash = HashStrided(hash, desc.points.data, desc.points.count, desc.points.stride, sizeof(PxVec3));
+
+		// user provided hull
+		hash = HashStrided(hash, desc.polygons.data, desc.polygons.count, desc.polygons.stride, sizeof(PxHullPolygon));
+
+		const auto indexSize = (desc.flags & PxConvexFlag::e16_BIT_INDICES) ? 2 : 4;
+		hash = HashStrided(hash, desc.indices.data, desc.indices.count, desc.indices.stride, indexSize);
+	}
+	else if (input.type == CookedShapeType::TriangleMesh && input.triangleMesh)
+	{
+		const auto& desc = *input.triangleMesh;
+		hash = HashMix(hash, (uint32_t)desc.flags);
+		hash = HashStrided(hash, desc.points.data, desc.points.count, desc.points.stride, sizeof(PxVec3));
+
+		const auto indexSize = (desc.flags & PxMeshFlag::e16_BIT_INDICES) ? 2 : 4;
+		hash = HashStrided(hash, desc.triangles.data, desc.triangles.count, desc.triangles.stride, 3 * indexSize);
+
+		hash = HashStrided(hash, desc.materialIndices.data, desc.materialIndices.data ? desc.triangles.count : 0, desc.materialIndices.stride, sizeof(PxMaterialTableIndex));
+	}
+
+	return hash;
+}
+
+//--
+
+BatchCooker::BatchCooker(PxFoundation& foundation, const PxCookingParams& params, JobSystem& jobs)
+	: m_jobs(jobs)
+	, m_paramsHash(HashParams(params))
+{
+	for (uint32_t i = 0; i < jobs.numThreads(); ++i)
+	{
+		auto context = std::make_unique<WorkerContext>();
+		context->cooking = PxCreateCooking(PX_PHYSICS_VERSION, foundation, params);
+		m_workers.push_back(std::move(context));
+	}
+}
+
+BatchCooker::~BatchCooker()
+{
+	for (auto& context : m_workers)
+		if (context->cooking)
+			context->cooking->release();
+}
+
+bool BatchCooker::valid() const
+{
+	for (const auto& context : m_workers)
+		if (!context->cooking)
+			return false;
+
+	return true;
+}
+
+uint64_t BatchCooker::cacheBytes() const
+{
+	uint64_t size = 0;
+	for (const auto& entry : m_cache)
+		size += entry.second.size;
+	return size;
+}
+
+bool BatchCooker::cookInput(const CookingInput& input, CookedBlob& outBlob)
+{
+	// only called from jobs and jobs only run on the workers, a worker runs one job at a time so its context is free
+	const auto worker = m_jobs.currentWorker();
+	if (worker < 0 || worker >= (int32_t)m_workers.size())
+		return false;
+
+	auto& context = *m_workers[worker];
+	context.arena.begin();
+
+	bool success = false;
+	if (input.type == CookedShapeType::Convex && input.convex)
+	{
+		PxConvexMeshCookingResult::Enum condition = PxConvexMeshCookingResult::eSUCCESS;
+		success = context.cooking->cookConvexMesh(*input.convex, context.arena, &condition) && condition == PxConvexMeshCookingResult::eSUCCESS;
+	}
+	else if (input.type == CookedShapeType::TriangleMesh && input.triangleMesh)
+	{
+		PxTriangleMeshCookingResult::Enum condition = PxTriangleMeshCookingResult::eSUCCESS;
+		success = context.cooking->cookTriangleMesh(*input.triangleMesh, context.arena, &condition) && condition != PxTriangleMeshCookingResult::eFAILURE;
+	}
+
+	if (!success)
+	{
+		context.arena.abort();
+		return false;
+	}
+
+	outBlob = context.arena.end();
+	return true;
+}
+
+void BatchCooker::cook(const std::vector<CookingInput>& inputs, std::vector<CookingResult>& outResults)
+{
+	std::lock_guard<std::mutex> lock(m_cookLock);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	m_stats = BatchCookingStats();
+	m_stats.numInputs = (uint32_t)inputs.size();
+
+	outResults.clear();
+	outResults.resize(inputs.size());
+
+	// hash everything, in groups so the jobs are not too small
+	{
+		const uint32_t groupSize = 64;
+
+		JobCounter counter;
+		for (uint32_t first = 0; first < inputs.size(); first += groupSize)
+		{
+			m_jobs.submit([this, first, groupSize, &inputs, &outResults]()
+				{
+					const auto last = std::min<uint32_t>(first + groupSize, (uint32_t)inputs.size());
+					for (uint32_t i = first; i < last; ++i)
+						outResults[i].hash = HashInput(inputs[i], m_paramsHash);
+				}, &counter);
+		}
+
+		m_jobs.wait(counter);
+	}
+
+	const auto hashed = std::chrono::high_resolution_clock::now();
+	m_stats.hashMs = std::chrono::duration<double, std::milli>(hashed - start).count();
+
+	// take what we can from the cache, the first of the identical inputs is cooked
+	std::vector<uint32_t> toCook;
+	std::vector<std::pair<uint32_t, uint32_t>> duplicates; // input, the input it's identical with
+	{
+		std::unordered_map<uint64_t, uint32_t> scheduled;
+
+		for (uint32_t i = 0; i < inputs.size(); ++i)
+		{
+			auto& result = outResults[i];
+
+			const auto cached = m_cache.find(result.hash);
+			if (cached != m_cache.end())
+			{
+				result.blob = cached->second;
+				result.success = true;
+				result.cached = true;
+				m_stats.numCacheHits += 1;
+				continue;
+			}
+
+			const auto first = scheduled.emplace(result.hash, i);
+			if (!first.second)
+			{
+				duplicates.emplace_back(i, first.first->second);
+				m_stats.numDuplicates += 1;
+				continue;
+			}
+
+			toCook.push_back(i);
+		}
+	}
+
+	// one shape per job, they take anything from microseconds to seconds
+	{
+		JobCounter counter;
+		for (const auto index : toCook)
+		{
+			m_jobs.submit([this, index, &inputs, &outResults]()
+				{
+					auto& result = outResults[index];
+					result.success = cookInput(inputs[index], result.blob);
+				}, &counter);
+		}
+
+		m_jobs.wait(counter);
+	}
+
+	m_stats.cookMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - hashed).count();
+
+	for (const auto index : toCook)
+	{
+		const auto& result = outResults[index];
+		if (result.success)
+		{
+			m_cache[result.hash] = result.blob;
+			m_stats.numCooked += 1;
+			m_stats.numCookedBytes += result.blob.size;
+		}
+		else
+		{
+			m_stats.numFailed += 1;
+		}
+	}
+
+	for (const auto& duplicate : duplicates)
+	{
+		auto& result = outResults[duplicate.first];
+		const auto& source = outResults[duplicate.second];
+		result.blob = source.blob;
+		result.success = source.success;
+		result.cached = true;
+
+		if (!result.success)
+			m_stats.numFailed += 1;
+	}
+
+	m_stats.totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void BatchCooker::clearCache()
+{
+	std::lock_guard<std::mutex> lock(m_cookLock);
+
+	m_cache.clear();
+
+	for (auto& context : m_workers)
+		context->arena.clear();
+
+	m_loadedArena.clear();
+}
+
+//--
+
+static const uint32_t CACHE_FILE_MAGIC = 0x43435850; // 'PXCC'
+static const uint32_t CACHE_FILE_VERSION = 1;
+
+bool BatchCooker::saveCache(const std::filesystem::path& path) const
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	const uint32_t header[3] = { CACHE_FILE_MAGIC, CACHE_FILE_VERSION, (uint32_t)m_cache.size() };
+	file.write((const char*)header, sizeof(header));
+
+	for (const auto& entry : m_cache)
+	{
+		file.write((const char*)&entry.first, sizeof(entry.first));
+		file.write((const char*)&entry.second.size, sizeof(entry.second.size));
+		file.write((const char*)entry.second.data, entry.second.size);
+	}
+
+	return file.good();
+}
+
+bool BatchCooker::loadCache(const std::filesystem::path& path)
+{
+	std::lock_guard<std::mutex> lock(m_cookLock);
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	uint32_t header[3] = {};
+	if (!file.read((char*)header, sizeof(header)) || header[0] != CACHE_FILE_MAGIC || header[1] != CACHE_FILE_VERSION)
+		return false;
+
+	// not the arena of a worker, the caller may not be one
+	auto& arena = m_loadedArena;
+
+	std::vector<uint8_t> data;
+	for (uint32_t i = 0; i < header[2]; ++i)
+	{
+		uint64_t hash = 0;
+		uint32_t size = 0;
+		if (!file.read((char*)&hash, sizeof(hash)) || !file.read((char*)&size, sizeof(size)))
+			return false;
+
+		data.resize(size);
+		if (!file.read((char*)data.data(), size))
+			return false;
+
+		// entries cooked with other params just never match
+		m_cache.emplace(hash, arena.store(data.data(), size));
+	}
+
+	return true;
+}
+
+//--
@@ -0,0 +1,166 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#pragma once
+
+#define PX_PHYSX_STATIC_LIB
+#include <PxPhysicsAPI.h>
+#include <cooking/PxCooking.h>
+
+#include "../../common/job_system.h"
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <filesystem>
+
+//--
+
+enum class CookedShapeType : uint8_t
+{
+	Convex,
+	TriangleMesh,
+};
+
+// Shape to cook, the descriptor (and the data it points to) must stay alive until cook() returns
+struct CookingInput
+{
+	CookedShapeType type = CookedShapeType::Convex;
+	const physx::PxConvexMeshDesc* convex = nullptr;
+	const physx::PxTriangleMeshDesc* triangleMesh = nullptr;
+
+	inline CookingInput() {};
+	inline CookingInput(const physx::PxConvexMeshDesc& desc) : type(CookedShapeType::Convex), convex(&desc) {};
+	inline CookingInput(const physx::PxTriangleMeshDesc& desc) : type(CookedShapeType::TriangleMesh), triangleMesh(&desc) {};
+};
+
+// Cooked data, owned by the cooker
+struct CookedBlob
+{
+	const uint8_t* data = nullptr;
+	uint32_t size = 0;
+};
+
+struct CookingResult
+{
+	CookedBlob blob;
+	uint64_t hash = 0;
+	bool success = false;
+	bool cached = false; // taken from the cache (or from an identical input earlier in the same batch), not cooked
+};
+
+struct BatchCookingStats
+{
+	uint32_t numInputs = 0;
+	uint32_t numCooked = 0;
+	uint32_t numCacheHits = 0;
+	uint32_t numDuplicates = 0; // identical inputs in the batch, cooked once
+	uint32_t numFailed = 0;
+	uint64_t numCookedBytes = 0;
+	double hashMs = 0.0;
+	double cookMs = 0.0;
+	double totalMs = 0.0;
+};
+
+// Append only storage for the cooked blobs, PhysX writes straight into it
+// Blobs never move once finished, a blob that does not fit into the rest of the chunk is moved to a new chunk while it's written
+class CookedBlobArena : public physx::PxOutputStream
+{
+public:
+	CookedBlobArena(uint32_t chunkSize = 1 << 20);
+
+	inline uint64_t usedBytes() const { return m_usedBytes; }
+	inline uint64_t reservedBytes() const { return m_reservedBytes; }
+
+	void begin();
+	CookedBlob end();
+	void abort(); // drop what was written since begin()
+
+	// Copy of existing data
+	CookedBlob store(const void* data, uint32_t size);
+
+	void clear();
+
+	virtual uint32_t write(const void* src, uint32_t count) override;
+
+private:
+	struct Chunk
+	{
+		std::unique_ptr<uint8_t[]> data;
+		uint32_t size = 0;
+		uint32_t used = 0;
+	};
+
+	std::vector<Chunk> m_chunks;
+	uint32_t m_chunkSize = 0;
+	uint32_t m_blobStart = 0; // in the last chunk
+	uint64_t m_usedBytes = 0;
+	uint64_t m_reservedBytes = 0;
+
+	void grow(uint32_t size);
+};
+
+// Cooks batches of convexes and triangle meshes on the job system
+// - one PxCooking and one blob arena per worker of the job system, no locking while cooking
+// - blobs loaded from the cache file live in their own arena, loadCache can be called from any thread
+// - cooked blobs are cached by the hash of the input (and of the cooking params), unchanged shapes are not cooked again
+// - identical shapes within one batch are cooked once
+// The output is exactly what PxCooking::cookConvexMesh/cookTriangleMesh would write
+// NOTE: only one thread can cook at a time, the blobs stay valid until the cache is cleared or the cooker is destroyed
+class BatchCooker
+{
+public:
+	BatchCooker(physx::PxFoundation& foundation, const physx::PxCookingParams& params, JobSystem& jobs);
+	~BatchCooker();
+
+	BatchCooker(const BatchCooker&) = delete;
+	BatchCooker& operator=(const BatchCooker&) = delete;
+
+	bool valid() const;
+
+	inline const BatchCookingStats& stats() const { return m_stats; } // of the last batch
+	inline uint32_t cacheSize() const { return (uint32_t)m_cache.size(); }
+
+	uint64_t cacheBytes() const;
+
+	// Results are in the order of the inputs
+	void cook(const std::vector<CookingInput>& inputs, std::vector<CookingResult>& outResults);
+
+	// Invalidates all blobs returned so far
+	void clearCache();
+
+	// Persistent cache, so the next build skips the shapes that did not change
+	bool saveCache(const std::filesystem::path& path) const;
+	bool loadCache(const std::filesystem::path& path);
+
+	// Content hash of the input, seed is the hash of the cooking params
+	static uint64_t HashInput(const CookingInput& input, uint64_t seed);
+	static uint64_t HashParams(const physx::PxCookingParams& params);
+
+private:
+	struct WorkerContext
+	{
+		physx::PxCooking* cooking = nullptr;
+		CookedBlobArena arena;
+	};
+
+	JobSystem& m_jobs;
+	uint64_t m_paramsHash = 0;
+
+	std::vector<std::unique_ptr<WorkerContext>> m_workers; // indexed by JobSystem::currentWorker()
+	CookedBlobArena m_loadedArena; // blobs from loadCache
+
+	std::unordered_map<uint64_t, CookedBlob> m_cache;
+	std::mutex m_cookLock;
+
+	BatchCookingStats m_stats;
+
+	bool cookInput(const CookingInput& input, CookedBlob& outBlob);
+};
+
+//--
@@ -0,0 +1,522 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "batch_cooker.h"
+#include "physx_benchmark.h"
+
+#include <chrono>
+#include <cstring>
+#include <random>
+
+using namespace physx;
+
+//--
+
+// shape_test.cpp
+extern const char* COMPILED_CONVEX_DATA;
+extern const char* COMPILED_MESH_DATA;
+extern void BytesToHexString(std::stringstream& str, const uint8_t* data, uint32_t length);
+
+static std::string BlobToHex(const CookedBlob& blob)
+{
+	std::stringstream str;
+	BytesToHexString(str, blob.data, blob.size);
+	return str.str();
+}
+
+// Same shapes as Cooking.CompileConvex and Cooking.CompileTriangleMesh
+static const PxVec3 GoldenConvexVerts[] = { PxVec3(0,1,0),PxVec3(1,0,0),PxVec3(-1,0,0),PxVec3(0,0,1),PxVec3(0,0,-1) };
+static const PxVec3 GoldenMeshVertices[] = { PxVec3(0,1,0),PxVec3(1,0,0),PxVec3(-1,0,0) };
+static const uint16_t GoldenMeshIndices[] = { 0, 1, 2 };
+
+static PxConvexMeshDesc GoldenConvexDesc()
+{
+	PxConvexMeshDesc convexDesc;
+	convexDesc.points.count = 5;
+	convexDesc.points.stride = sizeof(PxVec3);
+	convexDesc.points.data = GoldenConvexVerts;
+	convexDesc.flags = PxConvexFlag::eCOMPUTE_CONVEX;
+	return convexDesc;
+}
+
+static PxTriangleMeshDesc GoldenMeshDesc()
+{
+	PxTriangleMeshDesc meshDesc;
+	meshDesc.points.count = 3;
+	meshDesc.points.stride = sizeof(PxVec3);
+	meshDesc.points.data = GoldenMeshVertices;
+	meshDesc.triangles.count = 1;
+	meshDesc.triangles.data = GoldenMeshIndices;
+	meshDesc.triangles.stride = 3 * sizeof(uint16_t);
+	meshDesc.flags = PxMeshFlag::e16_BIT_INDICES;
+	return meshDesc;
+}
+
+// Collision shapes of a level: random convex hulls and height field patches as triangle meshes
+struct CookingTestShapes
+{
+	std::vector<std::vector<PxVec3>> convexPoints;
+	std::vector<PxConvexMeshDesc> convexes;
+
+	std::vector<std::vector<PxVec3>> meshPoints;
+	std::vector<std::vector<uint32_t>> meshIndices;
+	std::vector<PxTriangleMeshDesc> meshes;
+
+	void generate(uint32_t numConvexes, uint32_t numMeshes, uint32_t meshCells, uint32_t seed)
+	{
+		std::mt19937 generator(seed);
+		std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+		convexPoints.resize(numConvexes);
+		convexes.resize(numConvexes);
+		for (uint32_t i = 0; i < numConvexes; ++i)
+		{
+			auto& points = convexPoints[i];
+			const auto numPoints = 8 + (i % 25);
+			for (uint32_t j = 0; j < numPoints; ++j)
+				points.push_back(PxVec3(distribution(generator), distribution(generator), distribution(generator)));
+
+			auto& desc = convexes[i];
+			desc.points.count = numPoints;
+			desc.points.stride = sizeof(PxVec3);
+			desc.points.data = points.data();
+			desc.flags = PxConvexFlag::eCOMPUTE_CONVEX;
+		}
+
+		meshPoints.resize(numMeshes);
+		meshIndices.resize(numMeshes);
+		meshes.resize(numMeshes);
+		for (uint32_t i = 0; i < numMeshes; ++i)
+		{
+			auto& points = meshPoints[i];
+			for (uint32_t y = 0; y <= meshCells; ++y)
+				for (uint32_t x = 0; x <= meshCells; ++x)
+					points.push_back(PxVec3((float)x, distribution(generator), (float)y));
+
+			auto& indices = meshIndices[i];
+			for (uint32_t y = 0; y < meshCells; ++y)
+			{
+				for (uint32_t x = 0; x < meshCells; ++x)
+				{
+					const auto a = y * (meshCells + 1) + x;
+					const auto b = a + 1;
+					const auto c = a + meshCells + 1;
+					const auto d = c + 1;
+					indices.insert(indices.end(), { a, c, b, b, c, d });
+				}
+			}
+
+			auto& desc = meshes[i];
+			desc.points.count = (uint32_t)points.size();
+			desc.points.stride = sizeof(PxVec3);
+			desc.points.data = points.data();
+			desc.triangles.count = (uint32_t)(indices.size() / 3);
+			desc.triangles.stride = 3 * sizeof(uint32_t);
+			desc.triangles.data = indices.data();
+		}
+	}
+
+	void inputs(std::vector<CookingInput>& outInputs) const
+	{
+		outInputs.clear();
+		for (const auto& desc : convexes)
+			outInputs.emplace_back(desc);
+		for (const auto& desc : meshes)
+			outInputs.emplace_back(desc);
+	}
+};
+
+// Same as StdVectorOutputStream in shape_test.cpp, the way we cooked so far
+struct ResizingOutputStream : public PxOutputStream
+{
+	std::vector<uint8_t> data;
+
+	virtual uint32_t write(const void* src, uint32_t count) override
+	{
+		auto pos = data.size();
+		data.resize(pos + count);
+		memcpy(data.data() + pos, src, count);
+		return count;
+	}
+};
+
+static bool CookSerial(PxCooking& cooking, const CookingInput& input, std::vector<uint8_t>& outData)
+{
+	ResizingOutputStream output;
+
+	bool success = false;
+	if (input.type == CookedShapeType::Convex)
+		success = cooking.cookConvexMesh(*input.convex, output);
+	else
+		success = cooking.cookTriangleMesh(*input.triangleMesh, output);
+
+	outData = std::move(output.data);
+	return success;
+}
+
+static bool SameData(const CookedBlob& blob, const std::vector<uint8_t>& data)
+{
+	return blob.size == data.size() && 0 == memcmp(blob.data, data.data(), data.size());
+}
+
+//--
+
+TEST(BatchCooker, BlobArenaKeepsBlobsInPlace)
+{
+	CookedBlobArena arena(64);
+
+	std::vector<CookedBlob> blobs;
+	std::vector<std::vector<uint8_t>> expected;
+
+	// blobs written in pieces, some bigger than a chunk
+	for (uint32_t i = 0; i < 100; ++i)
+	{
+		std::vector<uint8_t> data((i * 7) % 150 + 1);
+		for (size_t j = 0; j < data.size(); ++j)
+			data[j] = (uint8_t)(i + j);
+
+		arena.begin();
+		for (size_t offset = 0; offset < data.size(); offset += 10)
+			arena.write(data.data() + offset, (uint32_t)std::min<size_t>(10, data.size() - offset));
+
+		blobs.push_back(arena.end());
+		expected.push_back(std::move(data));
+	}
+
+	// aborted one does not take space
+	const auto used = arena.usedBytes();
+	arena.begin();
+	arena.write(expected[0].data(), (uint32_t)expected[0].size());
+	arena.abort();
+	EXPECT_EQ(used, arena.usedBytes());
+
+	for (size_t i = 0; i < blobs.size(); ++i)
+		EXPECT_TRUE(SameData(blobs[i], expected[i])) << i;
+}
+
+TEST(BatchCooker, MatchesGoldenData)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	JobSystem jobs(4);
+
+	PxTolerancesScale sc;
+	PxCookingParams params(sc);
+
+	BatchCooker cooker(context.foundation(), params, jobs);
+	ASSERT_TRUE(cooker.valid());
+
+	const auto convexDesc = GoldenConvexDesc();
+	const auto meshDesc = GoldenMeshDesc();
+
+	std::vector<CookingInput> inputs;
+	inputs.emplace_back(convexDesc);
+	inputs.emplace_back(meshDesc);
+
+	std::vector<CookingResult> results;
+	cooker.cook(inputs, results);
+	ASSERT_EQ(2, results.size());
+
+	ASSERT_TRUE(results[0].success);
+	EXPECT_EQ(351, results[0].blob.size);
+	EXPECT_STREQ(COMPILED_CONVEX_DATA, BlobToHex(results[0].blob).c_str());
+
+	ASSERT_TRUE(results[1].success);
+	EXPECT_EQ(313, results[1].blob.size);
+	EXPECT_STREQ(COMPILED_MESH_DATA, BlobToHex(results[1].blob).c_str());
+}
+
+TEST(BatchCooker, MatchesSerialCooking)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	JobSystem jobs(4);
+
+	CookingTestShapes shapes;
+	shapes.generate(500, 20, 16, 1);
+
+	std::vector<CookingInput> inputs;
+	shapes.inputs(inputs);
+
+	PxCookingParams params(context.physics().getTolerancesScale());
+	BatchCooker cooker(context.foundation(), params, jobs);
+
+	std::vector<CookingResult> results;
+	cooker.cook(inputs, results);
+	EXPECT_EQ(inputs.size(), cooker.stats().numCooked);
+	EXPECT_EQ(0, cooker.stats().numFailed);
+
+	std::vector<uint8_t> expected;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		ASSERT_TRUE(CookSerial(context.cooking(), inputs[i], expected));
+		ASSERT_TRUE(results[i].success);
+		EXPECT_TRUE(SameData(results[i].blob, expected)) << "Input " << i;
+	}
+}
+
+TEST(BatchCooker, CacheSkipsUnchangedShapes)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	JobSystem jobs(4);
+
+	CookingTestShapes shapes;
+	shapes.generate(200, 10, 8, 2);
+
+	std::vector<CookingInput> inputs;
+	shapes.inputs(inputs);
+
+	PxCookingParams params(context.physics().getTolerancesScale());
+	BatchCooker cooker(context.foundation(), params, jobs);
+
+	std::vector<CookingResult> first, second;
+	cooker.cook(inputs, first);
+	EXPECT_EQ(inputs.size(), cooker.stats().numCooked);
+	EXPECT_EQ(0, cooker.stats().numCacheHits);
+
+	cooker.cook(inputs, second);
+	EXPECT_EQ(0, cooker.stats().numCooked);
+	EXPECT_EQ(inputs.size(), cooker.stats().numCacheHits);
+
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		EXPECT_TRUE(second[i].cached);
+		EXPECT_EQ(first[i].blob.data, second[i].blob.data);
+		EXPECT_EQ(first[i].hash, second[i].hash);
+	}
+
+	// one convex and one mesh changed
+	shapes.convexPoints[7][0].x += 0.5f;
+	shapes.meshPoints[3][5].y += 0.5f;
+
+	cooker.cook(inputs, second);
+	EXPECT_EQ(2, cooker.stats().numCooked);
+	EXPECT_EQ(inputs.size() - 2, cooker.stats().numCacheHits);
+	EXPECT_FALSE(second[7].cached);
+	EXPECT_NE(first[7].hash, second[7].hash);
+}
+
+TEST(BatchCooker, IdenticalInputsCookedOnce)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	JobSystem jobs(2);
+
+	PxTolerancesScale sc;
+	PxCookingParams params(sc);
+	BatchCooker cooker(context.foundation(), params, jobs);
+
+	// same data through different descriptors
+	const auto convexDesc = GoldenConvexDesc();
+	const auto otherConvexDesc = GoldenConvexDesc();
+
+	std::vector<CookingInput> inputs;
+	for (uint32_t i = 0; i < 50; ++i)
+		inputs.emplace_back((i & 1) ? convexDesc : otherConvexDesc);
+
+	std::vector<CookingResult> results;
+	cooker.cook(inputs, results);
+
+	EXPECT_EQ(1, cooker.stats().numCooked);
+	EXPECT_EQ(49, cooker.stats().numDuplicates);
+	EXPECT_EQ(1, cooker.cacheSize());
+
+	for (const auto& result : results)
+	{
+		ASSERT_TRUE(result.success);
+		EXPECT_EQ(results[0].blob.data, result.blob.data);
+	}
+
+	EXPECT_STREQ(COMPILED_CONVEX_DATA, BlobToHex(results[49].blob).c_str());
+}
+
+TEST(BatchCooker, CookingParamsChangeTheHash)
+{
+	PxTolerancesScale sc;
+	PxCookingParams params(sc);
+
+	auto otherParams = params;
+	otherParams.meshWeldTolerance += 0.01f;
+
+	EXPECT_EQ(BatchCooker::HashParams(params), BatchCooker::HashParams(PxCookingParams(sc)));
+	EXPECT_NE(BatchCooker::HashParams(params), BatchCooker::HashParams(otherParams));
+
+	const auto convexDesc = GoldenConvexDesc();
+	EXPECT_NE(BatchCooker::HashInput(convexDesc, BatchCooker::HashParams(params)), BatchCooker::HashInput(convexDesc, BatchCooker::HashParams(otherParams)));
+}
+
+TEST(BatchCooker, CacheFileRoundTrip)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	JobSystem jobs(2);
+
+	CookingTestShapes shapes;
+	shapes.generate(100, 5, 8, 3);
+
+	std::vector<CookingInput> inputs;
+	shapes.inputs(inputs);
+
+	PxCookingParams params(context.physics().getTolerancesScale());
+	const auto path = std::filesystem::temp_directory_path() / "physx_cooking_cache.bin";
+
+	std::vector<CookingResult> cooked;
+	BatchCooker cooker(context.foundation(), params, jobs);
+	cooker.cook(inputs, cooked);
+	ASSERT_TRUE(cooker.saveCache(path));
+
+	BatchCooker nextBuild(context.foundation(), params, jobs);
+	ASSERT_TRUE(nextBuild.loadCache(path));
+	EXPECT_EQ(cooker.cacheSize(), nextBuild.cacheSize());
+	EXPECT_EQ(cooker.cacheBytes(), nextBuild.cacheBytes());
+
+	std::vector<CookingResult> loaded;
+	nextBuild.cook(inputs, loaded);
+	EXPECT_EQ(0, nextBuild.stats().numCooked);
+
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		ASSERT_EQ(cooked[i].blob.size, loaded[i].blob.size);
+		EXPECT_EQ(0, memcmp(cooked[i].blob.data, loaded[i].blob.data, cooked[i].blob.size));
+	}
+
+	std::filesystem::remove(path);
+}
+
+TEST(BatchCooker, CookFromJob)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	JobSystem jobs(2);
+
+	CookingTestShapes shapes;
+	shapes.generate(50, 5, 8, 7);
+
+	std::vector<CookingInput> inputs;
+	shapes.inputs(inputs);
+
+	PxCookingParams params(context.physics().getTolerancesScale());
+	const auto path = std::filesystem::temp_directory_path() / "physx_cooking_cache_job.bin";
+
+	BatchCooker cooker(context.foundation(), params, jobs);
+
+	std::vector<std::vector<uint8_t>> expected;
+	{
+		std::vector<CookingResult> results;
+		cooker.cook(inputs, results);
+		ASSERT_TRUE(cooker.saveCache(path));
+
+		// blobs are gone once the cache is cleared
+		for (const auto& result : results)
+			expected.emplace_back(result.blob.data, result.blob.data + result.blob.size);
+	}
+
+	// the calling worker runs cooking jobs while it waits, each worker has to use its own context
+	std::vector<CookingResult> results;
+	JobCounter counter;
+	jobs.submit([&]()
+		{
+			cooker.clearCache();
+			cooker.cook(inputs, results);
+		}, &counter);
+	jobs.wait(counter);
+
+	ASSERT_EQ(expected.size(), results.size());
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		ASSERT_TRUE(results[i].success) << i;
+		ASSERT_EQ(expected[i].size(), results[i].blob.size) << i;
+		EXPECT_EQ(0, memcmp(expected[i].data(), results[i].blob.data, expected[i].size())) << i;
+	}
+
+	// loaded blobs don't go to the arena of the worker that loads them
+	BatchCooker nextBuild(context.foundation(), params, jobs);
+
+	bool loaded = false;
+	jobs.submit([&]() { loaded = nextBuild.loadCache(path); }, &counter);
+	jobs.wait(counter);
+
+	EXPECT_TRUE(loaded);
+	EXPECT_EQ(cooker.cacheBytes(), nextBuild.cacheBytes());
+
+	std::vector<CookingResult> fromCache;
+	nextBuild.cook(inputs, fromCache);
+	EXPECT_EQ(0, nextBuild.stats().numCooked);
+
+	std::filesystem::remove(path);
+}
+
+//--
+
+TEST(BatchCooker, DISABLED_CookingBenchmark)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	CookingTestShapes shapes;
+	shapes.generate(10000, 500, 32, 4);
+
+	std::vector<CookingInput> inputs;
+	shapes.inputs(inputs);
+
+	PxCookingParams params(context.physics().getTolerancesScale());
+	printf("Cooking %u convexes and %u triangle meshes (%u triangles each):\n", (uint32_t)shapes.convexes.size(), (uint32_t)shapes.meshes.size(), 32 * 32 * 2);
+
+	// one PxCooking, one growing vector per shape
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		uint64_t totalBytes = 0;
+		std::vector<uint8_t> data;
+		for (const auto& input : inputs)
+		{
+			CookSerial(context.cooking(), input, data);
+			totalBytes += data.size();
+		}
+
+		const auto ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		printf("  serial              : %9.2f ms (%.2f MB)\n", ms, totalBytes / (1024.0 * 1024.0));
+	}
+
+	JobSystem jobs;
+	BatchCooker cooker(context.foundation(), params, jobs);
+
+	std::vector<CookingResult> results;
+
+	const auto print = [&cooker](const char* name)
+	{
+		const auto& stats = cooker.stats();
+		printf("  %-20s: %9.2f ms (hash %6.2f ms, cook %9.2f ms), %u cooked, %u from cache\n",
+			name, stats.totalMs, stats.hashMs, stats.cookMs, stats.numCooked, stats.numCacheHits);
+	};
+
+	cooker.cook(inputs, results);
+	print("batch, cold");
+
+	cooker.cook(inputs, results);
+	print("batch, no changes");
+
+	// 5% of the shapes changed since the last build
+	for (size_t i = 0; i < shapes.convexPoints.size(); i += 20)
+		shapes.convexPoints[i][0].y += 0.1f;
+	for (size_t i = 0; i < shapes.meshPoints.size(); i += 20)
+		shapes.meshPoints[i][0].y += 0.1f;
+
+	cooker.cook(inputs, results);
+	print("batch, 5% changed");
+
+	printf("  %u threads, cache %u blobs, %.2f MB\n", jobs.numThreads() + 1, cooker.cacheSize(), cooker.cacheBytes() / (1024.0 * 1024.0));
+}
+
+//--
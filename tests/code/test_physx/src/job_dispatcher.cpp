@@ -0,0 +1,38 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "job_dispatcher.h"
+
+using namespace physx;
+
+//--
+
+JobSystemCpuDispatcher::JobSystemCpuDispatcher(JobSystem& jobs)
+	: m_jobs(jobs)
+{}
+
+JobSystemCpuDispatcher::~JobSystemCpuDispatcher()
+{}
+
+void JobSystemCpuDispatcher::submitTask(PxBaseTask& task)
+{
+	m_numTasks += 1;
+
+	// same as the PhysX worker threads: run and release, releasing may submit the tasks depending on this one
+	m_jobs.submit([&task]()
+		{
+			task.run();
+			task.release();
+		});
+}
+
+uint32_t JobSystemCpuDispatcher::getWorkerCount() const
+{
+	return m_jobs.numThreads();
+}
+
+//--
@@ -0,0 +1,35 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#pragma once
+
+#define PX_PHYSX_STATIC_LIB
+#include <PxPhysicsAPI.h>
+#include <task/PxCpuDispatcher.h>
+
+#include "../../common/job_system.h"
+
+//--
+
+// PhysX dispatcher that runs the simulation tasks as jobs of our job system instead of on PhysX private threads
+// PhysX determinism does not depend on which thread runs a task or in what order, only on the worker count it's told about
+class JobSystemCpuDispatcher : public physx::PxCpuDispatcher
+{
+public:
+	JobSystemCpuDispatcher(JobSystem& jobs);
+	virtual ~JobSystemCpuDispatcher();
+
+	inline uint64_t numTasks() const { return m_numTasks; }
+
+	virtual void submitTask(physx::PxBaseTask& task) override;
+	virtual uint32_t getWorkerCount() const override;
+
+private:
+	JobSystem& m_jobs;
+	std::atomic<uint64_t> m_numTasks = 0;
+};
+
+//--
@@ -0,0 +1,217 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "job_dispatcher.h"
+#include "physx_benchmark.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+using namespace physx;
+
+//--
+
+// Stand-in for the rest of the frame (animation, culling...), pure ALU work
+static void FrameJob(uint32_t index, std::atomic<uint32_t>& sink)
+{
+	float x = 1.0f + index * 0.001f;
+	for (uint32_t i = 0; i < 20000; ++i)
+		x = x * 0.999f + std::sin(x);
+
+	sink += (uint32_t)x;
+}
+
+static void SubmitFrameJobs(JobSystem& jobs, uint32_t numJobs, JobCounter& counter, std::atomic<uint32_t>& sink)
+{
+	for (uint32_t i = 0; i < numJobs; ++i)
+		jobs.submit([i, &sink]() { FrameJob(i, sink); }, &counter);
+}
+
+struct BodyState
+{
+	PxTransform pose;
+	PxVec3 linearVelocity;
+	PxVec3 angularVelocity;
+};
+
+// Simulate the benchmark scene, frameJobs (if any) run between simulate and fetchResults
+static std::vector<BodyState> SimulateScene(const PhysXContext& context, PxCpuDispatcher& dispatcher, PhysXBenchmarkScene type, uint32_t numSteps,
+	const std::function<void()>& frameJobs = nullptr)
+{
+	std::vector<BodyState> states;
+
+	auto* scene = CreatePhysXScene(context, dispatcher, PhysXBenchmarkSceneBounds(type));
+	if (!scene)
+		return states;
+
+	const auto bodies = PopulatePhysXScene(context, *scene, type);
+
+	for (uint32_t i = 0; i < numSteps; ++i)
+	{
+		scene->simulate(1.0f / 60.0f);
+
+		if (frameJobs)
+			frameJobs();
+
+		scene->fetchResults(true);
+	}
+
+	for (const auto* body : bodies)
+		states.push_back(BodyState{ body->getGlobalPose(), body->getLinearVelocity(), body->getAngularVelocity() });
+
+	scene->release();
+	return states;
+}
+
+static uint32_t CountDifferences(const std::vector<BodyState>& a, const std::vector<BodyState>& b)
+{
+	if (a.size() != b.size())
+		return (uint32_t)std::max(a.size(), b.size());
+
+	// bit exact
+	uint32_t count = 0;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		if (memcmp(&a[i].pose, &b[i].pose, sizeof(PxTransform)) != 0
+			|| memcmp(&a[i].linearVelocity, &b[i].linearVelocity, sizeof(PxVec3)) != 0
+			|| memcmp(&a[i].angularVelocity, &b[i].angularVelocity, sizeof(PxVec3)) != 0)
+			count += 1;
+	}
+
+	return count;
+}
+
+//--
+
+TEST(JobDispatcher, RunsSimulationTasks)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	JobSystem jobs(2);
+	JobSystemCpuDispatcher dispatcher(jobs);
+	EXPECT_EQ(2, dispatcher.getWorkerCount());
+
+	const auto states = SimulateScene(context, dispatcher, PhysXBenchmarkScene::Stacks, 10);
+	EXPECT_FALSE(states.empty());
+	EXPECT_GT(dispatcher.numTasks(), 0);
+	EXPECT_GE(jobs.numExecuted(), dispatcher.numTasks());
+}
+
+TEST(JobDispatcher, MatchesDefaultDispatcher)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	JobSystem jobs(4);
+	JobSystemCpuDispatcher jobDispatcher(jobs);
+
+	auto* defaultDispatcher = PxDefaultCpuDispatcherCreate(jobs.numThreads());
+
+	for (const auto type : { PhysXBenchmarkScene::Stacks, PhysXBenchmarkScene::ConvexPile, PhysXBenchmarkScene::Ragdolls })
+	{
+		const auto expected = SimulateScene(context, *defaultDispatcher, type, 120);
+		ASSERT_FALSE(expected.empty());
+
+		const auto states = SimulateScene(context, jobDispatcher, type, 120);
+		EXPECT_EQ(0, CountDifferences(expected, states)) << PhysXBenchmarkSceneName(type);
+
+		// tasks now interleave with unrelated jobs on the same workers
+		std::atomic<uint32_t> sink = 0;
+		const auto overlappedStates = SimulateScene(context, jobDispatcher, type, 120, [&jobs, &sink]()
+			{
+				JobCounter counter;
+				SubmitFrameJobs(jobs, 64, counter, sink);
+				jobs.wait(counter);
+			});
+
+		EXPECT_EQ(0, CountDifferences(expected, overlappedStates)) << PhysXBenchmarkSceneName(type) << " with frame jobs";
+	}
+
+	defaultDispatcher->release();
+}
+
+//--
+
+TEST(JobDispatcher, DISABLED_OverlapBenchmark)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	JobSystem jobs;
+	JobSystemCpuDispatcher jobDispatcher(jobs);
+	auto* defaultDispatcher = PxDefaultCpuDispatcherCreate(jobs.numThreads());
+
+	const uint32_t numFrameJobs = 256;
+	const uint32_t numWarmupFrames = 30;
+	const uint32_t numFrames = 200;
+
+	for (const auto type : { PhysXBenchmarkScene::Ragdolls, PhysXBenchmarkScene::Bodies10k })
+	{
+		printf("%s, %u workers, %u frame jobs:\n", PhysXBenchmarkSceneName(type), jobs.numThreads(), numFrameJobs);
+
+		struct Mode
+		{
+			const char* name;
+			PxCpuDispatcher* dispatcher;
+			bool frameJobs;
+		};
+
+		const Mode modes[] = {
+			{ "frame jobs only", nullptr, true },
+			{ "physics only, default dispatcher", defaultDispatcher, false },
+			{ "physics only, job dispatcher", &jobDispatcher, false },
+			{ "both, default dispatcher", defaultDispatcher, true },
+			{ "both, job dispatcher", &jobDispatcher, true },
+		};
+
+		for (const auto& mode : modes)
+		{
+			PxScene* scene = nullptr;
+			if (mode.dispatcher)
+			{
+				scene = CreatePhysXScene(context, *mode.dispatcher, PhysXBenchmarkSceneBounds(type));
+				ASSERT_NE(nullptr, scene);
+				PopulatePhysXScene(context, *scene, type);
+			}
+
+			std::atomic<uint32_t> sink = 0;
+			std::vector<double> frameMs;
+
+			for (uint32_t i = 0; i < numWarmupFrames + numFrames; ++i)
+			{
+				const auto start = std::chrono::high_resolution_clock::now();
+
+				if (scene)
+					scene->simulate(1.0f / 60.0f);
+
+				if (mode.frameJobs)
+				{
+					JobCounter counter;
+					SubmitFrameJobs(jobs, numFrameJobs, counter, sink);
+					jobs.wait(counter);
+				}
+
+				if (scene)
+					scene->fetchResults(true);
+
+				if (i >= numWarmupFrames)
+					frameMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+			}
+
+			printf("  %-34s: frame p50 %7.2f ms p99 %7.2f ms\n", mode.name, Percentile(frameMs, 0.5), Percentile(frameMs, 0.99));
+
+			if (scene)
+				scene->release();
+		}
+	}
+
+	defaultDispatcher->release();
+}
+
+//--
@@ -0,0 +1,164 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "../../common/job_system.h"
+
+#include <chrono>
+#include <set>
+
+//--
+
+TEST(JobSystem, RunsAllJobs)
+{
+	JobSystem jobs(4);
+	EXPECT_EQ(4, jobs.numThreads());
+
+	std::atomic<uint32_t> sum = 0;
+
+	JobCounter counter;
+	for (uint32_t i = 1; i <= 10000; ++i)
+		jobs.submit([&sum, i]() { sum += i; }, &counter);
+
+	jobs.wait(counter);
+
+	EXPECT_TRUE(counter.done());
+	EXPECT_EQ(10000u * 10001u / 2u, sum.load());
+	EXPECT_EQ(10000, jobs.numExecuted());
+}
+
+TEST(JobSystem, PendingJobsRunBeforeExit)
+{
+	std::atomic<uint32_t> count = 0;
+
+	{
+		JobSystem jobs(2);
+		for (uint32_t i = 0; i < 1000; ++i)
+			jobs.submit([&count]() { count += 1; });
+	}
+
+	EXPECT_EQ(1000, count.load());
+}
+
+TEST(JobSystem, NestedJobsAreStolen)
+{
+	JobSystem jobs(4);
+
+	std::mutex lock;
+	std::set<int32_t> workers;
+
+	// everything is submitted from one worker into its own queue, the others have to steal
+	JobCounter counter;
+	jobs.submit([&]()
+		{
+			JobCounter children;
+			for (uint32_t i = 0; i < 64; ++i)
+			{
+				jobs.submit([&]()
+					{
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+						std::lock_guard<std::mutex> guard(lock);
+						workers.insert(jobs.currentWorker());
+					}, &children);
+			}
+
+			// waiting worker keeps running its own jobs
+			jobs.wait(children);
+		}, &counter);
+
+	jobs.wait(counter);
+
+	EXPECT_EQ(65, jobs.numExecuted());
+	EXPECT_GT(jobs.numStolen(), 0);
+	EXPECT_GT(workers.size(), 1);
+	EXPECT_EQ(0, workers.count(-1));
+}
+
+TEST(JobSystem, CurrentWorker)
+{
+	JobSystem jobs(2);
+	EXPECT_EQ(-1, jobs.currentWorker());
+
+	std::atomic<int32_t> worker = -1;
+
+	JobCounter counter;
+	jobs.submit([&]() { worker = jobs.currentWorker(); }, &counter);
+	jobs.wait(counter);
+
+	EXPECT_GE(worker.load(), 0);
+	EXPECT_LT(worker.load(), 2);
+
+	// other job system's workers are not ours
+	JobSystem otherJobs(1);
+	JobCounter otherCounter;
+	otherJobs.submit([&]() { worker = jobs.currentWorker(); }, &otherCounter);
+	otherJobs.wait(otherCounter);
+	EXPECT_EQ(-1, worker.load());
+}
+
+TEST(JobSystem, MainThreadNeverRunsJobs)
+{
+	JobSystem jobs(2);
+
+	const auto mainThread = std::this_thread::get_id();
+	std::atomic<uint32_t> numOnMainThread = 0;
+	std::atomic<uint32_t> numOutsideWorkers = 0;
+
+	// waiting sleeps instead of helping, so per worker data can be indexed with currentWorker()
+	JobCounter counter;
+	for (uint32_t i = 0; i < 1000; ++i)
+	{
+		jobs.submit([&]()
+			{
+				numOnMainThread += (std::this_thread::get_id() == mainThread) ? 1 : 0;
+				numOutsideWorkers += (jobs.currentWorker() < 0) ? 1 : 0;
+			}, &counter);
+	}
+
+	jobs.wait(counter);
+
+	EXPECT_EQ(0, numOnMainThread.load());
+	EXPECT_EQ(0, numOutsideWorkers.load());
+	EXPECT_EQ(1000, jobs.numExecuted());
+}
+
+TEST(JobSystem, ParallelForVisitsEveryIndexOnce)
+{
+	JobSystem jobs(4);
+
+	for (const auto batchSize : { 1u, 7u, 1000u })
+	{
+		std::vector<std::atomic<uint32_t>> visits(1000);
+		jobs.parallelFor((uint32_t)visits.size(), [&visits](uint32_t index) { visits[index] += 1; }, batchSize);
+
+		for (uint32_t i = 0; i < visits.size(); ++i)
+			ASSERT_EQ(1, visits[i].load()) << i << ", batch size " << batchSize;
+	}
+}
+
+TEST(JobSystem, RunOnAllWorkersRunsOncePerWorker)
+{
+	JobSystem jobs(4);
+
+	// each worker blocks until all of them started, so none of them can run two of the jobs
+	std::atomic<uint32_t> numStarted = 0;
+	std::vector<std::atomic<int32_t>> workers(4);
+
+	jobs.runOnAllWorkers([&](uint32_t workerIndex)
+		{
+			workers[workerIndex] = jobs.currentWorker();
+
+			numStarted += 1;
+			while (numStarted.load() < 4)
+				std::this_thread::yield();
+		});
+
+	for (uint32_t i = 0; i < 4; ++i)
+		EXPECT_EQ((int32_t)i, workers[i].load());
+}
+
+//--
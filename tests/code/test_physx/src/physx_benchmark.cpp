@@ -0,0 +1,492 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "physx_benchmark.h"
+
+#include <cooking/PxCooking.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+using namespace physx;
+
+//--
+
+PhysXContext::PhysXContext()
+{
+	m_foundation = PxCreateFoundation(PX_PHYSICS_VERSION, GPhysXAllocator, GPhysXErrorCallback);
+	if (!m_foundation)
+		return;
+
+	m_physics = PxCreatePhysics(PX_PHYSICS_VERSION, *m_foundation, PxTolerancesScale(), true, nullptr);
+	if (!m_physics)
+		return;
+
+	// joints
+	m_extensions = PxInitExtensions(*m_physics, nullptr);
+
+	PxCookingParams params(m_physics->getTolerancesScale());
+	m_cooking = PxCreateCooking(PX_PHYSICS_VERSION, *m_foundation, params);
+
+	m_material = m_physics->createMaterial(0.5f, 0.5f, 0.6f);
+}
+
+PhysXContext::~PhysXContext()
+{
+	if (m_material)
+		m_material->release();
+
+	if (m_cooking)
+		m_cooking->release();
+
+	if (m_extensions)
+		PxCloseExtensions();
+
+	if (m_physics)
+		m_physics->release();
+
+	if (m_foundation)
+		m_foundation->release();
+}
+
+//--
+
+const char* PhysXBenchmarkSceneName(PhysXBenchmarkScene type)
+{
+	switch (type)
+	{
+		case PhysXBenchmarkScene::Stacks: return "Stacks";
+		case PhysXBenchmarkScene::ConvexPile: return "ConvexPile";
+		case PhysXBenchmarkScene::Ragdolls: return "Ragdolls";
+		case PhysXBenchmarkScene::Bodies10k: return "Bodies10k";
+		case PhysXBenchmarkScene::Bodies50k: return "Bodies50k";
+		case PhysXBenchmarkScene::Bodies100k: return "Bodies100k";
+		default: break;
+	}
+
+	return "Unknown";
+}
+
+const char* BroadPhaseName(PxBroadPhaseType::Enum type)
+{
+	switch (type)
+	{
+		case PxBroadPhaseType::eSAP: return "SAP";
+		case PxBroadPhaseType::eMBP: return "MBP";
+		case PxBroadPhaseType::eABP: return "ABP";
+		default: break;
+	}
+
+	return "Unknown";
+}
+
+//--
+
+static const uint32_t STACKS_PER_AXIS = 8;
+static const uint32_t STACK_BASE = 12; // boxes in the bottom row of a pyramid
+static const float STACK_SPACING = 16.0f;
+
+static const uint32_t CONVEX_PILE_SIZE = 16; // 16x16x16 convexes
+static const float CONVEX_PILE_SPACING = 1.25f;
+
+static const uint32_t RAGDOLLS_PER_AXIS = 16;
+static const float RAGDOLL_SPACING = 2.0f;
+
+static const uint32_t BODY_LAYERS = 2;
+static const float BODY_SPACING = 1.5f;
+
+static uint32_t NumSceneBodies(PhysXBenchmarkScene type)
+{
+	switch (type)
+	{
+		case PhysXBenchmarkScene::Bodies10k: return 10000;
+		case PhysXBenchmarkScene::Bodies50k: return 50000;
+		case PhysXBenchmarkScene::Bodies100k: return 100000;
+		default: break;
+	}
+
+	return 0;
+}
+
+static uint32_t BodyGridSide(uint32_t numBodies)
+{
+	return (uint32_t)std::ceil(std::sqrt((double)numBodies / BODY_LAYERS));
+}
+
+PxBounds3 PhysXBenchmarkSceneBounds(PhysXBenchmarkScene type)
+{
+	float halfSize = 10.0f;
+	float height = 20.0f;
+
+	switch (type)
+	{
+		case PhysXBenchmarkScene::Stacks:
+			halfSize = STACKS_PER_AXIS * STACK_SPACING * 0.5f + 8.0f;
+			height = STACK_BASE + 8.0f;
+			break;
+
+		case PhysXBenchmarkScene::ConvexPile:
+			halfSize = CONVEX_PILE_SIZE * CONVEX_PILE_SPACING * 0.5f + 4.0f;
+			height = CONVEX_PILE_SIZE * CONVEX_PILE_SPACING + 10.0f;
+			break;
+
+		case PhysXBenchmarkScene::Ragdolls:
+			halfSize = RAGDOLLS_PER_AXIS * RAGDOLL_SPACING * 0.5f + 4.0f;
+			height = 10.0f;
+			break;
+
+		default:
+			halfSize = BodyGridSide(NumSceneBodies(type)) * BODY_SPACING * 0.5f + 4.0f;
+			height = BODY_LAYERS * BODY_SPACING + 10.0f;
+			break;
+	}
+
+	return PxBounds3(PxVec3(-halfSize, -2.0f, -halfSize), PxVec3(halfSize, height, halfSize));
+}
+
+//--
+
+PxScene* CreatePhysXScene(const PhysXContext& context, PxCpuDispatcher& dispatcher, const PxBounds3& bounds, const PhysXSceneSettings& settings)
+{
+	PxSceneDesc sceneDesc(context.physics().getTolerancesScale());
+	sceneDesc.gravity = PxVec3(0.0f, -9.81f, 0.0f);
+	sceneDesc.cpuDispatcher = &dispatcher;
+	sceneDesc.filterShader = PxDefaultSimulationFilterShader;
+	sceneDesc.broadPhaseType = settings.broadPhase;
+
+	if (settings.enhancedDeterminism)
+		sceneDesc.flags |= PxSceneFlag::eENABLE_ENHANCED_DETERMINISM;
+
+	auto* scene = context.physics().createScene(sceneDesc);
+	if (!scene)
+		return nullptr;
+
+	// MBP does not work without regions, objects outside of them are not colliding at all
+	if (settings.broadPhase == PxBroadPhaseType::eMBP)
+	{
+		const auto numRegions = std::max<uint32_t>(1, settings.numRegions);
+
+		std::vector<PxBounds3> regions(numRegions * numRegions);
+		const auto count = PxBroadPhaseExt::createRegionsFromWorldBounds(regions.data(), bounds, numRegions, 1);
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			PxBroadPhaseRegion region;
+			region.bounds = regions[i];
+			region.userData = nullptr;
+			scene->addBroadPhaseRegion(region);
+		}
+	}
+
+	return scene;
+}
+
+//--
+
+static void AddFloor(const PhysXContext& context, PxScene& scene, const PxBounds3& bounds)
+{
+	// box, not a plane - planes have infinite bounds and would end up outside of the MBP regions
+	const auto extents = bounds.getExtents();
+	const auto center = bounds.getCenter();
+
+	auto* floor = PxCreateStatic(context.physics(), PxTransform(PxVec3(center.x, -0.5f, center.z)), PxBoxGeometry(extents.x, 0.5f, extents.z), context.material());
+	scene.addActor(*floor);
+}
+
+static PxRigidDynamic* AddBody(const PhysXContext& context, PxScene& scene, const PxTransform& pose, const PxGeometry& geometry,
+	std::vector<PxRigidDynamic*>& outBodies, const PxTransform& shapeOffset = PxTransform(PxIdentity))
+{
+	auto* body = PxCreateDynamic(context.physics(), pose, geometry, context.material(), 10.0f, shapeOffset);
+	body->setSleepThreshold(0.0f);
+	scene.addActor(*body);
+
+	outBodies.push_back(body);
+	return body;
+}
+
+static void PopulateStacks(const PhysXContext& context, PxScene& scene, std::vector<PxRigidDynamic*>& outBodies)
+{
+	const float halfExtent = 0.5f;
+	const PxBoxGeometry box(halfExtent, halfExtent, halfExtent);
+
+	for (uint32_t sz = 0; sz < STACKS_PER_AXIS; ++sz)
+	{
+		for (uint32_t sx = 0; sx < STACKS_PER_AXIS; ++sx)
+		{
+			const auto baseX = (sx - (STACKS_PER_AXIS - 1) * 0.5f) * STACK_SPACING;
+			const auto baseZ = (sz - (STACKS_PER_AXIS - 1) * 0.5f) * STACK_SPACING;
+
+			for (uint32_t row = 0; row < STACK_BASE; ++row)
+			{
+				const auto count = STACK_BASE - row;
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					const auto x = baseX + (i - (count - 1) * 0.5f) * halfExtent * 2.0f;
+					const auto y = halfExtent + row * halfExtent * 2.0f;
+					AddBody(context, scene, PxTransform(PxVec3(x, y, baseZ)), box, outBodies);
+				}
+			}
+		}
+	}
+}
+
+static PxConvexMesh* CookRandomConvex(const PhysXContext& context, std::mt19937& generator)
+{
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+	// random points between radius 0.3 and 0.5, the hull gets a different number of faces every time
+	std::vector<PxVec3> points;
+	while (points.size() < 24)
+	{
+		const PxVec3 dir(distribution(generator), distribution(generator), distribution(generator));
+		const auto length = dir.magnitude();
+		if (length < 0.1f || length > 1.0f)
+			continue;
+
+		const auto radius = 0.3f + 0.2f * (distribution(generator) * 0.5f + 0.5f);
+		points.push_back(dir * (radius / length));
+	}
+
+	PxConvexMeshDesc desc;
+	desc.points.count = (PxU32)points.size();
+	desc.points.stride = sizeof(PxVec3);
+	desc.points.data = points.data();
+	desc.flags = PxConvexFlag::eCOMPUTE_CONVEX;
+
+	return context.cooking().createConvexMesh(desc, context.physics().getPhysicsInsertionCallback());
+}
+
+static void PopulateConvexPile(const PhysXContext& context, PxScene& scene, uint32_t seed, std::vector<PxRigidDynamic*>& outBodies)
+{
+	// walls around the floor so the convexes stay in a pile
+	{
+		const auto halfSize = CONVEX_PILE_SIZE * CONVEX_PILE_SPACING * 0.5f + 1.0f;
+		const auto wallHeight = 4.0f;
+
+		const PxBoxGeometry wallX(0.5f, wallHeight, halfSize + 1.0f);
+		const PxBoxGeometry wallZ(halfSize + 1.0f, wallHeight, 0.5f);
+
+		scene.addActor(*PxCreateStatic(context.physics(), PxTransform(PxVec3(-halfSize - 0.5f, wallHeight, 0.0f)), wallX, context.material()));
+		scene.addActor(*PxCreateStatic(context.physics(), PxTransform(PxVec3(halfSize + 0.5f, wallHeight, 0.0f)), wallX, context.material()));
+		scene.addActor(*PxCreateStatic(context.physics(), PxTransform(PxVec3(0.0f, wallHeight, -halfSize - 0.5f)), wallZ, context.material()));
+		scene.addActor(*PxCreateStatic(context.physics(), PxTransform(PxVec3(0.0f, wallHeight, halfSize + 0.5f)), wallZ, context.material()));
+	}
+
+	std::mt19937 generator(seed);
+
+	PxConvexMesh* convexes[4] = {};
+	for (auto& convex : convexes)
+		convex = CookRandomConvex(context, generator);
+
+	std::uniform_real_distribution<float> angle(0.0f, PxTwoPi);
+
+	uint32_t index = 0;
+	for (uint32_t y = 0; y < CONVEX_PILE_SIZE; ++y)
+	{
+		for (uint32_t z = 0; z < CONVEX_PILE_SIZE; ++z)
+		{
+			for (uint32_t x = 0; x < CONVEX_PILE_SIZE; ++x, ++index)
+			{
+				auto* convex = convexes[index % 4];
+				if (!convex)
+					continue;
+
+				const PxVec3 pos((x - (CONVEX_PILE_SIZE - 1) * 0.5f) * CONVEX_PILE_SPACING, 1.0f + y * CONVEX_PILE_SPACING, (z - (CONVEX_PILE_SIZE - 1) * 0.5f) * CONVEX_PILE_SPACING);
+				const PxQuat rot(angle(generator), PxVec3(0.0f, 1.0f, 0.0f));
+				AddBody(context, scene, PxTransform(pos, rot), PxConvexMeshGeometry(convex), outBodies);
+			}
+		}
+	}
+
+	// shapes keep their own references
+	for (auto* convex : convexes)
+		if (convex)
+			convex->release();
+}
+
+struct RagdollPart
+{
+	int parent; // -1 for the root
+	float x, y; // center, the ragdoll is standing on Y
+	float halfHeight; // vertical capsule
+	float radius;
+	float jointY; // where it's connected to the parent
+};
+
+static const RagdollPart RAGDOLL_PARTS[] = {
+	{ -1, 0.0f, 1.0f, 0.1f, 0.15f, 0.0f }, // pelvis
+	{ 0, 0.0f, 1.4f, 0.15f, 0.17f, 1.2f }, // torso
+	{ 1, 0.0f, 1.85f, 0.05f, 0.12f, 1.7f }, // head
+	{ 1, -0.3f, 1.35f, 0.12f, 0.05f, 1.55f }, // upper arms
+	{ 1, 0.3f, 1.35f, 0.12f, 0.05f, 1.55f },
+	{ 3, -0.3f, 1.0f, 0.12f, 0.045f, 1.18f }, // lower arms
+	{ 4, 0.3f, 1.0f, 0.12f, 0.045f, 1.18f },
+	{ 0, -0.1f, 0.65f, 0.15f, 0.07f, 0.85f }, // thighs
+	{ 0, 0.1f, 0.65f, 0.15f, 0.07f, 0.85f },
+	{ 7, -0.1f, 0.25f, 0.15f, 0.06f, 0.45f }, // shins
+	{ 8, 0.1f, 0.25f, 0.15f, 0.06f, 0.45f },
+};
+
+static void PopulateRagdolls(const PhysXContext& context, PxScene& scene, uint32_t seed, std::vector<PxRigidDynamic*>& outBodies)
+{
+	const auto numParts = (uint32_t)(sizeof(RAGDOLL_PARTS) / sizeof(RAGDOLL_PARTS[0]));
+
+	// capsules are along X, joints twist around X as well, both are pointed down
+	const PxTransform capsuleOffset(PxQuat(PxHalfPi, PxVec3(0.0f, 0.0f, 1.0f)));
+	const PxQuat jointRotation(-PxHalfPi, PxVec3(0.0f, 0.0f, 1.0f));
+
+	std::mt19937 generator(seed);
+	std::uniform_real_distribution<float> push(-2.0f, 2.0f);
+
+	for (uint32_t rz = 0; rz < RAGDOLLS_PER_AXIS; ++rz)
+	{
+		for (uint32_t rx = 0; rx < RAGDOLLS_PER_AXIS; ++rx)
+		{
+			const PxVec3 base((rx - (RAGDOLLS_PER_AXIS - 1) * 0.5f) * RAGDOLL_SPACING, 0.05f, (rz - (RAGDOLLS_PER_AXIS - 1) * 0.5f) * RAGDOLL_SPACING);
+
+			PxRigidDynamic* parts[sizeof(RAGDOLL_PARTS) / sizeof(RAGDOLL_PARTS[0])] = {};
+			for (uint32_t i = 0; i < numParts; ++i)
+			{
+				const auto& part = RAGDOLL_PARTS[i];
+				const auto center = base + PxVec3(part.x, part.y, 0.0f);
+
+				auto* body = AddBody(context, scene, PxTransform(center), PxCapsuleGeometry(part.radius, part.halfHeight), outBodies, capsuleOffset);
+				body->setSolverIterationCounts(8, 2);
+				parts[i] = body;
+
+				if (part.parent >= 0)
+				{
+					const auto* parent = parts[part.parent];
+					const auto anchor = base + PxVec3(part.x, part.jointY, 0.0f);
+
+					const PxTransform parentFrame(anchor - parent->getGlobalPose().p, jointRotation);
+					const PxTransform childFrame(anchor - center, jointRotation);
+
+					auto* joint = PxSphericalJointCreate(context.physics(), parts[part.parent], parentFrame, body, childFrame);
+					if (joint)
+					{
+						joint->setLimitCone(PxJointLimitCone(PxPi / 4.0f, PxPi / 4.0f));
+						joint->setSphericalJointFlag(PxSphericalJointFlag::eLIMIT_ENABLED, true);
+					}
+				}
+			}
+
+			// so they don't all fall the same way
+			parts[1]->setLinearVelocity(PxVec3(push(generator), 0.0f, push(generator)));
+		}
+	}
+}
+
+static void PopulateBodies(const PhysXContext& context, PxScene& scene, uint32_t numBodies, uint32_t seed, std::vector<PxRigidDynamic*>& outBodies)
+{
+	const auto side = BodyGridSide(numBodies);
+
+	const PxBoxGeometry box(0.4f, 0.4f, 0.4f);
+	const PxSphereGeometry sphere(0.4f);
+
+	std::mt19937 generator(seed);
+	std::uniform_real_distribution<float> velocity(-1.0f, 1.0f);
+
+	// layers dropped on each other with some sideways motion, so there is always something colliding
+	uint32_t index = 0;
+	for (uint32_t layer = 0; layer < BODY_LAYERS && index < numBodies; ++layer)
+	{
+		for (uint32_t z = 0; z < side && index < numBodies; ++z)
+		{
+			for (uint32_t x = 0; x < side && index < numBodies; ++x, ++index)
+			{
+				const PxVec3 pos((x - (side - 1) * 0.5f) * BODY_SPACING, 1.0f + layer * BODY_SPACING, (z - (side - 1) * 0.5f) * BODY_SPACING);
+
+				auto* body = AddBody(context, scene, PxTransform(pos), (index & 1) ? (const PxGeometry&)sphere : (const PxGeometry&)box, outBodies);
+				body->setLinearVelocity(PxVec3(velocity(generator), 0.0f, velocity(generator)));
+			}
+		}
+	}
+}
+
+std::vector<PxRigidDynamic*> PopulatePhysXScene(const PhysXContext& context, PxScene& scene, PhysXBenchmarkScene type, uint32_t seed)
+{
+	std::vector<PxRigidDynamic*> bodies;
+
+	const auto bounds = PhysXBenchmarkSceneBounds(type);
+	AddFloor(context, scene, bounds);
+
+	switch (type)
+	{
+		case PhysXBenchmarkScene::Stacks:
+			PopulateStacks(context, scene, bodies);
+			break;
+
+		case PhysXBenchmarkScene::ConvexPile:
+			PopulateConvexPile(context, scene, seed, bodies);
+			break;
+
+		case PhysXBenchmarkScene::Ragdolls:
+			PopulateRagdolls(context, scene, seed, bodies);
+			break;
+
+		default:
+			PopulateBodies(context, scene, NumSceneBodies(type), seed, bodies);
+			break;
+	}
+
+	return bodies;
+}
+
+//--
+
+void PhysXStepTimings::clear()
+{
+	simulateMs.clear();
+	fetchMs.clear();
+	stepMs.clear();
+}
+
+void PhysXStepTimings::reserve(uint32_t numSteps)
+{
+	simulateMs.reserve(numSteps);
+	fetchMs.reserve(numSteps);
+	stepMs.reserve(numSteps);
+}
+
+double Percentile(std::vector<double> values, double fraction)
+{
+	if (values.empty())
+		return 0.0;
+
+	// nearest rank
+	std::sort(values.begin(), values.end());
+
+	const auto rank = (size_t)std::ceil(fraction * values.size());
+	return values[std::min(values.size(), std::max<size_t>(1, rank)) - 1];
+}
+
+void StepPhysXScene(PxScene& scene, uint32_t numSteps, uint32_t numWarmupSteps, float dt, PhysXStepTimings& outTimings)
+{
+	outTimings.clear();
+	outTimings.reserve(numSteps);
+
+	for (uint32_t i = 0; i < numWarmupSteps + numSteps; ++i)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+		scene.simulate(dt);
+		const auto simulated = std::chrono::high_resolution_clock::now();
+		scene.fetchResults(true);
+		const auto fetched = std::chrono::high_resolution_clock::now();
+
+		if (i >= numWarmupSteps)
+		{
+			outTimings.simulateMs.push_back(std::chrono::duration<double, std::milli>(simulated - start).count());
+			outTimings.fetchMs.push_back(std::chrono::duration<double, std::milli>(fetched - simulated).count());
+			outTimings.stepMs.push_back(std::chrono::duration<double, std::milli>(fetched - start).count());
+		}
+	}
+}
+
+//--
@@ -0,0 +1,101 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#pragma once
+
+#define PX_PHYSX_STATIC_LIB
+#include <PxPhysicsAPI.h>
+#include <extensions/PxDefaultAllocator.h>
+#include <common/PxTolerancesScale.h>
+
+#include <stdint.h>
+#include <vector>
+
+//--
+
+extern physx::PxDefaultAllocator GPhysXAllocator;
+extern physx::PxDefaultErrorCallback GPhysXErrorCallback;
+
+// Foundation, physics (with extensions) and cooking
+// NOTE: PhysX foundation is a singleton, only one context can exist at a time
+class PhysXContext
+{
+public:
+	PhysXContext();
+	~PhysXContext();
+
+	PhysXContext(const PhysXContext&) = delete;
+	PhysXContext& operator=(const PhysXContext&) = delete;
+
+	inline bool valid() const { return m_physics && m_cooking && m_material; }
+
+	inline physx::PxFoundation& foundation() const { return *m_foundation; }
+	inline physx::PxPhysics& physics() const { return *m_physics; }
+	inline physx::PxCooking& cooking() const { return *m_cooking; }
+	inline physx::PxMaterial& material() const { return *m_material; }
+
+private:
+	physx::PxFoundation* m_foundation = nullptr;
+	physx::PxPhysics* m_physics = nullptr;
+	physx::PxCooking* m_cooking = nullptr;
+	physx::PxMaterial* m_material = nullptr;
+	bool m_extensions = false;
+};
+
+//--
+
+enum class PhysXBenchmarkScene : uint8_t
+{
+	Stacks, // pyramids of boxes
+	ConvexPile, // random convexes dropped into a pile
+	Ragdolls, // capsules connected with spherical joints
+	Bodies10k, // boxes and spheres dropped on a large floor
+	Bodies50k,
+	Bodies100k,
+
+	MAX,
+};
+
+extern const char* PhysXBenchmarkSceneName(PhysXBenchmarkScene type);
+extern const char* BroadPhaseName(physx::PxBroadPhaseType::Enum type);
+
+// Area the scene is contained in, the MBP regions are created from it
+extern physx::PxBounds3 PhysXBenchmarkSceneBounds(PhysXBenchmarkScene type);
+
+struct PhysXSceneSettings
+{
+	physx::PxBroadPhaseType::Enum broadPhase = physx::PxBroadPhaseType::eABP;
+	uint32_t numRegions = 4; // MBP only, numRegions x numRegions on XZ
+	bool enhancedDeterminism = false;
+};
+
+// Y up scene with the given dispatcher, for MBP the regions are added right away
+extern physx::PxScene* CreatePhysXScene(const PhysXContext& context, physx::PxCpuDispatcher& dispatcher, const physx::PxBounds3& bounds, const PhysXSceneSettings& settings = PhysXSceneSettings());
+
+// Add the floor and the bodies of the benchmark scene, returns the dynamic bodies in creation order
+// Sleeping is disabled on all bodies so every step measures the whole scene
+extern std::vector<physx::PxRigidDynamic*> PopulatePhysXScene(const PhysXContext& context, physx::PxScene& scene, PhysXBenchmarkScene type, uint32_t seed = 1);
+
+//--
+
+// Time of every measured step, in milliseconds
+struct PhysXStepTimings
+{
+	std::vector<double> simulateMs; // simulate() call, the work is started but not waited for
+	std::vector<double> fetchMs; // fetchResults(true), waiting for the simulation to finish
+	std::vector<double> stepMs; // both
+
+	void clear();
+	void reserve(uint32_t numSteps);
+};
+
+// Value below which the given fraction (0-1) of the samples fall
+extern double Percentile(std::vector<double> values, double fraction);
+
+// Step the scene numWarmupSteps times without measuring and then numSteps times with timing
+extern void StepPhysXScene(physx::PxScene& scene, uint32_t numSteps, uint32_t numWarmupSteps, float dt, PhysXStepTimings& outTimings);
+
+//--
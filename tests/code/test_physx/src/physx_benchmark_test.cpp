@@ -0,0 +1,172 @@
+/***
+* Inferno Engine v4
+* Written by Tomasz Jonarski (RexDex)
+* Source code licensed under LGPL 3.0 license
+***/
+
+#include "build.h"
+#include "physx_benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <tuple>
+
+using namespace physx;
+
+//--
+
+TEST(PhysXBenchmark, PercentileNearestRank)
+{
+	std::vector<double> values;
+	for (uint32_t i = 100; i > 0; --i)
+		values.push_back((double)i);
+
+	EXPECT_EQ(50.0, Percentile(values, 0.5));
+	EXPECT_EQ(99.0, Percentile(values, 0.99));
+	EXPECT_EQ(100.0, Percentile(values, 1.0));
+	EXPECT_EQ(1.0, Percentile(values, 0.0));
+	EXPECT_EQ(0.0, Percentile({}, 0.5));
+}
+
+TEST(PhysXBenchmark, SceneBodyCounts)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	auto* dispatcher = PxDefaultCpuDispatcherCreate(2);
+
+	const std::pair<PhysXBenchmarkScene, uint32_t> expected[] = {
+		{ PhysXBenchmarkScene::Stacks, 8 * 8 * (12 * 13 / 2) },
+		{ PhysXBenchmarkScene::ConvexPile, 16 * 16 * 16 },
+		{ PhysXBenchmarkScene::Ragdolls, 16 * 16 * 11 },
+		{ PhysXBenchmarkScene::Bodies10k, 10000 },
+		{ PhysXBenchmarkScene::Bodies50k, 50000 },
+		{ PhysXBenchmarkScene::Bodies100k, 100000 },
+	};
+
+	for (const auto& entry : expected)
+	{
+		auto* scene = CreatePhysXScene(context, *dispatcher, PhysXBenchmarkSceneBounds(entry.first));
+		ASSERT_NE(nullptr, scene);
+
+		const auto bodies = PopulatePhysXScene(context, *scene, entry.first);
+		EXPECT_EQ(entry.second, bodies.size()) << PhysXBenchmarkSceneName(entry.first);
+		EXPECT_EQ(entry.second, scene->getNbActors(PxActorTypeFlag::eRIGID_DYNAMIC)) << PhysXBenchmarkSceneName(entry.first);
+
+		scene->release();
+	}
+
+	dispatcher->release();
+}
+
+class PhysXSceneTest : public ::testing::TestWithParam<PxBroadPhaseType::Enum>
+{
+};
+
+TEST_P(PhysXSceneTest, BodiesStayOnTheFloor)
+{
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	auto* dispatcher = PxDefaultCpuDispatcherCreate(2);
+
+	PhysXSceneSettings settings;
+	settings.broadPhase = GetParam();
+
+	// with the MBP regions missing or too small things would fall through the floor
+	for (const auto type : { PhysXBenchmarkScene::Stacks, PhysXBenchmarkScene::ConvexPile, PhysXBenchmarkScene::Ragdolls, PhysXBenchmarkScene::Bodies10k })
+	{
+		const auto bounds = PhysXBenchmarkSceneBounds(type);
+
+		auto* scene = CreatePhysXScene(context, *dispatcher, bounds, settings);
+		ASSERT_NE(nullptr, scene);
+
+		const auto bodies = PopulatePhysXScene(context, *scene, type);
+
+		PhysXStepTimings timings;
+		StepPhysXScene(*scene, 60, 0, 1.0f / 60.0f, timings);
+		EXPECT_EQ(60, timings.stepMs.size());
+
+		uint32_t numLost = 0;
+		for (const auto* body : bodies)
+		{
+			const auto pose = body->getGlobalPose();
+			if (!pose.isValid() || pose.p.y < -0.5f || !bounds.contains(pose.p))
+				numLost += 1;
+		}
+
+		EXPECT_EQ(0, numLost) << PhysXBenchmarkSceneName(type) << " " << BroadPhaseName(GetParam());
+
+		scene->release();
+	}
+
+	dispatcher->release();
+}
+
+INSTANTIATE_TEST_SUITE_P(BroadPhases, PhysXSceneTest, ::testing::Values(PxBroadPhaseType::eSAP, PxBroadPhaseType::eMBP, PxBroadPhaseType::eABP));
+
+//--
+
+class PhysXSteppingBenchmark : public ::testing::TestWithParam<std::tuple<PhysXBenchmarkScene, PxBroadPhaseType::Enum>>
+{
+};
+
+TEST_P(PhysXSteppingBenchmark, DISABLED_StepTimes)
+{
+	const auto type = std::get<0>(GetParam());
+	const auto broadPhase = std::get<1>(GetParam());
+
+	PhysXContext context;
+	ASSERT_TRUE(context.valid());
+
+	// 1, 2, 4 ... and all the hardware threads
+	std::vector<uint32_t> threadCounts;
+	const auto hardwareThreads = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+	for (uint32_t count = 1; count < hardwareThreads; count *= 2)
+		threadCounts.push_back(count);
+	threadCounts.push_back(hardwareThreads);
+
+	PhysXSceneSettings settings;
+	settings.broadPhase = broadPhase;
+
+	const uint32_t numWarmupSteps = 30;
+	const uint32_t numSteps = 200;
+
+	double singleThreadMs = 0.0;
+	for (const auto numThreads : threadCounts)
+	{
+		auto* dispatcher = PxDefaultCpuDispatcherCreate(numThreads);
+
+		// fresh scene for every thread count so they all simulate the same thing
+		auto* scene = CreatePhysXScene(context, *dispatcher, PhysXBenchmarkSceneBounds(type), settings);
+		ASSERT_NE(nullptr, scene);
+
+		const auto bodies = PopulatePhysXScene(context, *scene, type);
+		if (numThreads == threadCounts.front())
+			printf("%s (%u bodies), %s, %u steps:\n", PhysXBenchmarkSceneName(type), (uint32_t)bodies.size(), BroadPhaseName(broadPhase), numSteps);
+
+		PhysXStepTimings timings;
+		StepPhysXScene(*scene, numSteps, numWarmupSteps, 1.0f / 60.0f, timings);
+
+		const auto stepP50 = Percentile(timings.stepMs, 0.5);
+		if (numThreads == threadCounts.front())
+			singleThreadMs = stepP50;
+
+		printf("  %2u threads: step p50 %7.2f ms p99 %7.2f ms (simulate p50 %6.2f p99 %6.2f, fetchResults p50 %7.2f p99 %7.2f), %.2fx\n",
+			numThreads, stepP50, Percentile(timings.stepMs, 0.99),
+			Percentile(timings.simulateMs, 0.5), Percentile(timings.simulateMs, 0.99),
+			Percentile(timings.fetchMs, 0.5), Percentile(timings.fetchMs, 0.99),
+			stepP50 > 0.0 ? singleThreadMs / stepP50 : 0.0);
+
+		scene->release();
+		dispatcher->release();
+	}
+}
+
+INSTANTIATE_TEST_SUITE_P(Scenes, PhysXSteppingBenchmark, ::testing::Combine(
+	::testing::Values(PhysXBenchmarkScene::Stacks, PhysXBenchmarkScene::ConvexPile, PhysXBenchmarkScene::Ragdolls,
+		PhysXBenchmarkScene::Bodies10k, PhysXBenchmarkScene::Bodies50k, PhysXBenchmarkScene::Bodies100k),
+	::testing::Values(PxBroadPhaseType::eSAP, PxBroadPhaseType::eMBP, PxBroadPhaseType::eABP)));
+
+//--
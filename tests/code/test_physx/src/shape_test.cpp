@@ -99,7 +99,7 @@ std::string VectorToHex(const std::vector<uint8_t>& data)
 	return str.str();
 }
 
-static const char* COMPILED_CONVEX_DATA = "4e5853014356584d0d0000000000000049434501434c484c090000000500000008000000050000001000000000000000000000000000803f000000000000803f00000000000080bf00000000000000000000803f00000000000000000000000000000000000080bf00000000000080bf0000000000000080000004013acd13bf3acd133f3acd133f3acd13bf040003033acd133f3acd133f3acd133f3acd13bf070003023acd133f3acd133f3acd13bf3acd13bf0a0003003acd13bf3acd133f3acd13bf3acd13bf0d000300040300020001020003010401030402010003000200010004010201040203030400010201020300010400020300030400000000000080bf00000000000080bf0000803f0000803f0000803fabaa2a3f8988083e0000000000000000000000008988083e0000000000000000000000008988083e000000000000803e00000000000080bf0000803ec732ec3e3acd133e3acd133e";
+const char* COMPILED_CONVEX_DATA = "4e5853014356584d0d0000000000000049434501434c484c090000000500000008000000050000001000000000000000000000000000803f000000000000803f00000000000080bf00000000000000000000803f00000000000000000000000000000000000080bf00000000000080bf0000000000000080000004013acd13bf3acd133f3acd133f3acd13bf040003033acd133f3acd133f3acd133f3acd13bf070003023acd133f3acd133f3acd13bf3acd13bf0a0003003acd13bf3acd133f3acd13bf3acd13bf0d000300040300020001020003010401030402010003000200010004010201040203030400010201020300010400020300030400000000000080bf00000000000080bf0000803f0000803f0000803fabaa2a3f8988083e0000000000000000000000008988083e0000000000000000000000008988083e000000000000803e00000000000080bf0000803ec732ec3e3acd133e3acd133e";
 
 TEST(Cooking, CompileConvex)
 {
@@ -136,7 +136,7 @@ TEST(Cooking, CompileConvex)
 
 //--
 
-static const char* COMPILED_MESH_DATA = "4e5853014d4553480f00000000000000060000000300000001000000000000000000803f000000000000803f0000000000000000000080bf000000000000000000010200000000005254524502000000621080bf6f1203ba6f1203ba000000006210803f6210803f6f12033a000000000000803f0000803f0000803f0000803fe210003844218037f212833200000000040000000100000001000000040000000100000000000000621080bfffff7f7fffff7f7fffff7f7f6f1203baffff7f7fffff7f7fffff7f7f6f1203baffff7f7fffff7f7fffff7f7f6210803fffff7fffffff7fffffff7fff6210803fffff7fffffff7fffffff7fff6f12033affff7fffffff7fffffff7fff010000001d0000001d0000001d00000000008034000080bf00000000000000000000803f0000803f000000000100000038";
+const char* COMPILED_MESH_DATA = "4e5853014d4553480f00000000000000060000000300000001000000000000000000803f000000000000803f0000000000000000000080bf000000000000000000010200000000005254524502000000621080bf6f1203ba6f1203ba000000006210803f6210803f6f12033a000000000000803f0000803f0000803f0000803fe210003844218037f212833200000000040000000100000001000000040000000100000000000000621080bfffff7f7fffff7f7fffff7f7f6f1203baffff7f7fffff7f7fffff7f7f6f1203baffff7f7fffff7f7fffff7f7f6210803fffff7fffffff7fffffff7fff6210803fffff7fffffff7fffffff7fff6f12033affff7fffffff7fffffff7fff010000001d0000001d0000001d00000000008034000080bf00000000000000000000803f0000803f000000000100000038";
 
 TEST(Cooking, CompileTriangleMesh)
 {